@@ -0,0 +1,807 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libim/common.h"
+#include "libim/cnd.h"
+#include "libim/cnd_delta.h"
+#include "libim/gob.h"
+#include "libim/io/filestream.h"
+#include "libim/material/atlas.h"
+#include "libim/material/bcn.h"
+#include "libim/material/bmp.h"
+#include "libim/material/compare.h"
+#include "libim/material/mat.h"
+#include "libim/material/quantize.h"
+#include "libim/material/material.h"
+#include "libim/manifest.h"
+#include "libim/memory/arena.h"
+#include "libim/progress.h"
+#include "libim/server/client.h"
+#include "libim/server/server.h"
+#include "libim/utils/thread_pool.h"
+#include "cndext/extract.h"
+#include "gobext/extract.h"
+#include "imgen/generator.h"
+#include "cmdutils/options.h"
+
+#define SETW(n, f)  std::right << std::setfill(f) << std::setw(n)
+
+static constexpr auto OPT_ITERATIONS     ("--iterations");
+static constexpr auto OPT_ITERATIONS_SHORT("-n");
+static constexpr auto OPT_WARMUP         ("--warmup");
+static constexpr auto OPT_FILTER         ("--filter");
+static constexpr auto OPT_GOB_ENTRIES    ("--gob-entries");
+static constexpr auto OPT_GOB_ENTRY_SIZE ("--gob-entry-size");
+static constexpr auto OPT_MATERIALS      ("--materials");
+static constexpr auto OPT_MAT_SIZE       ("--mat-size");
+static constexpr auto OPT_MIPMAPS        ("--mipmaps");
+static constexpr auto OPT_POD_READS      ("--pod-reads");
+static constexpr auto OPT_WORK_DIR       ("--work-dir");
+static constexpr auto OPT_JSON           ("--json");
+static constexpr auto OPT_HELP           ("--help");
+static constexpr auto OPT_HELP_SHORT     ("-h");
+
+struct BenchConfig
+{
+    uint32_t iterations   = 10;
+    uint32_t warmup       = 1;
+    uint32_t gobEntries   = 256;
+    uint32_t gobEntrySize = 64 * 1024;
+    uint32_t materials    = 64;
+    uint32_t matSize      = 128;  // Width and height of the base mipmap level
+    uint32_t mipmaps      = 2;    // Number of mipmaps per material
+    uint32_t pixelLevels  = 4;    // Number of textures (LODs) per mipmap
+    uint32_t podReads     = 100000;
+    std::string filter;
+    std::string workDir   = "libim_bench_data";
+    std::string jsonFile;
+};
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t items = 0;   // Items processed per iteration
+    uint64_t bytes = 0;   // Bytes processed per iteration
+    std::vector<double> samples; // Per-iteration wall time in seconds
+
+    double percentile(double p) const
+    {
+        if(samples.empty()) return 0.0;
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        const double rank = p / 100.0 * (sorted.size() - 1);
+        const std::size_t lo = static_cast<std::size_t>(std::floor(rank));
+        const std::size_t hi = static_cast<std::size_t>(std::ceil(rank));
+        return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+    }
+
+    double mean() const
+    {
+        if(samples.empty()) return 0.0;
+        return std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    }
+
+    double mbPerSec() const
+    {
+        const double t = percentile(50);
+        return t > 0.0 ? (bytes / (1024.0 * 1024.0)) / t : 0.0;
+    }
+
+    double itemsPerSec() const
+    {
+        const double t = percentile(50);
+        return t > 0.0 ? items / t : 0.0;
+    }
+};
+
+/* Redirects std::cout to nowhere for the lifetime of the object.
+   Used to keep the console output of the timed code out of the measurements. */
+class ScopedMuteStdout
+{
+public:
+    ScopedMuteStdout() : m_buf(std::cout.rdbuf(nullptr)) {}
+    ~ScopedMuteStdout()
+    {
+        std::cout.rdbuf(m_buf);
+        std::cout.clear();
+    }
+private:
+    std::streambuf* m_buf;
+};
+
+void print_help();
+bool ParseConfig(const Options& opt, BenchConfig& cfg);
+bool MakeGobFixture(const std::string& path, const BenchConfig& cfg);
+bool MakeCndFixture(const std::string& path, const BenchConfig& cfg);
+void PrintResults(const std::vector<BenchResult>& results);
+void WriteJson(std::ostream& os, const BenchConfig& cfg, const std::vector<BenchResult>& results);
+
+int main(int argc, const char *argv[])
+{
+    Options opt(argc, argv);
+    if(opt.hasOpt(OPT_HELP) || opt.hasOpt(OPT_HELP_SHORT))
+    {
+        print_help();
+        return 1;
+    }
+
+    BenchConfig cfg;
+    if(!ParseConfig(opt, cfg))
+    {
+        print_help();
+        return 1;
+    }
+
+    /* Progress output would skew timings */
+    SetProgressMode(ProgressMode::Off);
+
+    /* Generate input fixtures */
+    if(!DirExists(cfg.workDir) && !MakePath(cfg.workDir))
+    {
+        std::cerr << "Error: could not make work dir: " << cfg.workDir << "!\n";
+        return 1;
+    }
+
+    const std::string gobFile = cfg.workDir + "/bench.gob";
+    const std::string cndFile = cfg.workDir + "/bench.cnd";
+    const std::string outDir  = cfg.workDir + "/out";
+    MakePath(outDir);
+
+    std::cerr << "Generating fixtures in: " << cfg.workDir << std::endl;
+    if(!MakeGobFixture(gobFile, cfg) || !MakeCndFixture(cndFile, cfg)) {
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    auto run = [&](const std::string& name, uint64_t items, uint64_t bytes,
+                   const std::function<void()>& setup, const std::function<void()>& body)
+    {
+        if(!cfg.filter.empty() && name.find(cfg.filter) == std::string::npos) {
+            return;
+        }
+
+        std::cerr << "Running: " << name << std::endl;
+        BenchResult res;
+        res.name  = name;
+        res.items = items;
+        res.bytes = bytes;
+
+        for(uint32_t i = 0; i < cfg.warmup + cfg.iterations; i++)
+        {
+            if(setup) setup();
+
+            ScopedMuteStdout mute;
+            auto start = std::chrono::steady_clock::now();
+            body();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+            if(i >= cfg.warmup) {
+                res.samples.push_back(elapsed.count());
+            }
+        }
+
+        results.emplace_back(std::move(res));
+    };
+
+    /* Reports benchmark which can't run on this system */
+    auto skip = [&](const std::string& name, const std::string& reason)
+    {
+        if(cfg.filter.empty() || name.find(cfg.filter) != std::string::npos) {
+            std::cerr << "Skipping: " << name << " (" << reason << ")" << std::endl;
+        }
+    };
+
+    try
+    {
+        /* Stream::read<T> POD reads */
+        const uint64_t nPods = std::min<uint64_t>(cfg.podReads, (cfg.gobEntries * uint64_t(cfg.gobEntrySize)) / sizeof(uint32_t));
+        run("stream_read_pod_u32", nPods, nPods * sizeof(uint32_t), nullptr, [&]
+        {
+            InputFileStream ifs(gobFile);
+            uint32_t acc = 0;
+            for(uint64_t i = 0; i < nPods; i++) {
+                acc ^= ifs.read<uint32_t>();
+            }
+            volatile uint32_t sink = acc; (void)sink;
+        });
+
+        run("stream_read_pod_gob_entry", cfg.gobEntries, cfg.gobEntries * sizeof(GobFileEntry), nullptr, [&]
+        {
+            InputFileStream ifs(gobFile);
+            auto header = ifs.read<GobFileHeader>();
+            ifs.seek(header.directoryOffset + sizeof(uint32_t));
+            for(uint32_t i = 0; i < cfg.gobEntries; i++) {
+                ifs.read<GobFileEntry>();
+            }
+        });
+
+        /* GOB */
+        run("load_gob_from_file", cfg.gobEntries, cfg.gobEntries * sizeof(GobFileEntry), nullptr, [&]
+        {
+            if(!LoadGobFromFile(gobFile)) {
+                throw std::runtime_error("LoadGobFromFile failed");
+            }
+        });
+
+        auto gobDir = LoadGobFromFile(gobFile);
+        if(!gobDir) {
+            throw std::runtime_error("LoadGobFromFile failed");
+        }
+
+        run("extract_gob", cfg.gobEntries, cfg.gobEntries * uint64_t(cfg.gobEntrySize), nullptr, [&]
+        {
+            if(!ExtractGob(gobDir, outDir + "/gob", false)) {
+                throw std::runtime_error("ExtractGob failed");
+            }
+        });
+
+        run("list_gob_ndjson", cfg.gobEntries, cfg.gobEntries * sizeof(GobFileEntry), nullptr, [&]
+        {
+            std::ofstream ofs(outDir + "/gob_list.ndjson", std::ios::binary);
+            if(!ListGob(*gobDir, ofs, ListFormat::Ndjson)) {
+                throw std::runtime_error("ListGob failed");
+            }
+        });
+
+        run("extract_gob_manifest", cfg.gobEntries, cfg.gobEntries * uint64_t(cfg.gobEntrySize), nullptr, [&]
+        {
+            Manifest manifest;
+            if(!ExtractGob(gobDir, outDir + "/gob", false, &manifest)) {
+                throw std::runtime_error("ExtractGob failed");
+            }
+        });
+
+        for(const auto algorithm : { HashAlgorithm::Crc32c, HashAlgorithm::XXH64 })
+        {
+            run(std::string("verify_gob_") + HashAlgorithmName(algorithm), cfg.gobEntries, cfg.gobEntries * uint64_t(cfg.gobEntrySize), nullptr, [&]
+            {
+                if(HashGobFile(gobFile, algorithm, 0).entries.size() != cfg.gobEntries) {
+                    throw std::runtime_error("HashGobFile failed");
+                }
+            });
+        }
+
+        if(IoUringAvailable())
+        {
+            run("extract_gob_async_uring", cfg.gobEntries, cfg.gobEntries * uint64_t(cfg.gobEntrySize), nullptr, [&]
+            {
+                if(!ExtractGobAsync(gobDir, gobFile, outDir + "/gob", false, 32, AsyncBackend::IoUring)) {
+                    throw std::runtime_error("ExtractGobAsync failed");
+                }
+            });
+        }
+        else {
+            skip("extract_gob_async_uring", "io_uring not available");
+        }
+
+        run("extract_gob_async_threads", cfg.gobEntries, cfg.gobEntries * uint64_t(cfg.gobEntrySize), nullptr, [&]
+        {
+            if(!ExtractGobAsync(gobDir, gobFile, outDir + "/gob", false, 32, AsyncBackend::ThreadPool)) {
+                throw std::runtime_error("ExtractGobAsync failed");
+            }
+        });
+
+        /* CND */
+        const uint64_t nTextures   = uint64_t(cfg.materials) * cfg.mipmaps * cfg.pixelLevels;
+        const uint64_t nPixelBytes = uint64_t(cfg.materials) * cfg.mipmaps * GetMipmapPixelDataSize(cfg.pixelLevels, cfg.matSize, cfg.matSize, RGB_565.bpp);
+
+        run("cnd_load_materials", cfg.materials, nPixelBytes, nullptr, [&]
+        {
+            InputFileStream ifs(cndFile);
+            if(libim::CND::LoadMaterials(ifs).size() != cfg.materials) {
+                throw std::runtime_error("LoadMaterials failed");
+            }
+        });
+
+        run("cnd_load_materials_arena", cfg.materials, nPixelBytes, nullptr, [&]
+        {
+            InputFileStream ifs(cndFile);
+            MaterialArena arena(ifs.size());
+            if(libim::CND::LoadMaterials(ifs, arena.resource()).size() != cfg.materials) {
+                throw std::runtime_error("LoadMaterials failed");
+            }
+        });
+
+        run("cnd_load_materials_arena_thp", cfg.materials, nPixelBytes, nullptr, [&]
+        {
+            InputFileStream ifs(cndFile);
+            MaterialArena arena(ifs.size(), /*hugePages=*/true);
+            if(libim::CND::LoadMaterials(ifs, arena.resource()).size() != cfg.materials) {
+                throw std::runtime_error("LoadMaterials failed");
+            }
+        });
+
+        run("cnd_extract_pipeline_bmp", cfg.materials, nPixelBytes, nullptr, [&]
+        {
+            if(!ExtractMaterials(cndFile, outDir + "/cnd", /*convert=*/true)) {
+                throw std::runtime_error("ExtractMaterials failed");
+            }
+        });
+
+        run("cnd_extract_copy_mat", cfg.materials, nPixelBytes, nullptr, [&]
+        {
+            if(!ExtractMaterials(cndFile, outDir + "/cnd", /*convert=*/false)) {
+                throw std::runtime_error("ExtractMaterials failed");
+            }
+        });
+
+        run("cnd_list_ndjson", cfg.materials, cfg.materials * sizeof(libim::CND::CndMatHeader), nullptr, [&]
+        {
+            std::ofstream ofs(outDir + "/cnd_list.ndjson", std::ios::binary);
+            if(!ListMaterials(cndFile, ofs, ListFormat::Ndjson)) {
+                throw std::runtime_error("ListMaterials failed");
+            }
+        });
+
+        run("cnd_load_index", cfg.materials, cfg.materials * sizeof(libim::CND::CndMatHeader), nullptr, [&]
+        {
+            InputFileStream ifs(cndFile);
+            if(libim::CND::LoadCndIndex(ifs).materials.size() != cfg.materials) {
+                throw std::runtime_error("LoadCndIndex failed");
+            }
+        });
+
+#ifndef OS_WINDOWS
+        {
+            ResourceServer server(outDir + "/bench.sock", { gobFile, cndFile });
+            std::thread serverThread([&]{ server.run(); });
+            ResourceClient client(server.socketPath());
+
+            const auto gobEntries = client.list(GetFileName(gobFile));
+            const auto cndEntries = client.list(GetFileName(cndFile));
+            uint64_t nGobBytes = 0;
+            for(const auto& e : gobEntries) {
+                nGobBytes += e.size;
+            }
+
+            run("server_stat", gobEntries.size(), 0, nullptr, [&]
+            {
+                for(const auto& e : gobEntries)
+                {
+                    if(!client.stat(GetFileName(gobFile), e.name)) {
+                        throw std::runtime_error("ResourceClient::stat failed");
+                    }
+                }
+            });
+
+            run("server_read_gob", gobEntries.size(), nGobBytes, nullptr, [&]
+            {
+                for(const auto& e : gobEntries) {
+                    client.read(GetFileName(gobFile), e.name);
+                }
+            });
+
+            run("server_read_mat", cndEntries.size(), nPixelBytes, nullptr, [&]
+            {
+                for(const auto& e : cndEntries) {
+                    client.read(GetFileName(cndFile), e.name);
+                }
+            });
+
+            server.stop();
+            serverThread.join();
+        }
+#endif
+
+        const Bitmap pixelBuffer(nPixelBytes, 0xAB);
+        run("copy_mipmap_from_buffer", nTextures, nPixelBytes, nullptr, [&]
+        {
+            auto itPixelData = pixelBuffer.cbegin();
+            for(uint64_t i = 0; i < uint64_t(cfg.materials) * cfg.mipmaps; i++)
+            {
+                Mipmap mipmap;
+                itPixelData = CopyMipmapFromBuffer(mipmap, itPixelData, cfg.pixelLevels, cfg.matSize, cfg.matSize, RGB_565);
+            }
+        });
+
+        InputFileStream cndIfs(cndFile);
+        auto materials = libim::CND::LoadMaterials(cndIfs);
+        cndIfs.close();
+        if(materials.empty()) {
+            throw std::runtime_error("LoadMaterials failed");
+        }
+
+        run("save_material_to_file", cfg.materials, nPixelBytes, nullptr, [&]
+        {
+            for(const auto& mat : materials)
+            {
+                if(!SaveMaterialToFile(outDir + "/" + mat.name(), mat)) {
+                    throw std::runtime_error("SaveMaterialToFile failed");
+                }
+            }
+        });
+
+        run("texture_to_bmp", nTextures, nPixelBytes, nullptr, [&]
+        {
+            std::size_t acc = 0;
+            for(const auto& mat : materials)
+            {
+                for(const auto& mipmap : mat.mipmaps())
+                {
+                    for(const auto& tex : mipmap) {
+                        acc += tex.toBmp().info.sizeImage;
+                    }
+                }
+            }
+            volatile std::size_t sink = acc; (void)sink;
+        });
+
+        /* Block compression of all material textures, per kernel and quality */
+        for(auto format : { BCFormat::BC1, BCFormat::BC3 })
+        {
+            for(auto quality : { BCQuality::Fast, BCQuality::High })
+            {
+                for(auto kernel : { BCKernel::Scalar, BCKernel::SSE41, BCKernel::AVX2 })
+                {
+                    if(!IsBCKernelSupported(kernel)) {
+                        continue;
+                    }
+
+                    const std::string name = std::string(format == BCFormat::BC1 ? "bc1" : "bc3") + "_encode_" +
+                        (quality == BCQuality::Fast ? "fast_" : "high_") + BCKernelName(kernel);
+
+                    const BCEncodeOptions opt { format, quality, kernel };
+                    run(name, nTextures, nPixelBytes, nullptr, [&]
+                    {
+                        std::size_t acc = 0;
+                        for(const auto& mat : materials)
+                        {
+                            for(const auto& images : EncodeMaterialBC(mat, opt)) {
+                                acc += images.size();
+                            }
+                        }
+                        volatile std::size_t sink = acc; (void)sink;
+                    });
+                }
+            }
+        }
+
+        ThreadPool bcPool;
+        run("bc3_encode_high_parallel", nTextures, nPixelBytes, nullptr, [&]
+        {
+            for(const auto& mat : materials) {
+                EncodeMaterialBC(mat, BCEncodeOptions{ BCFormat::BC3, BCQuality::High, BCKernel::Auto }, &bcPool);
+            }
+        });
+
+        run("atlas_build", nTextures, nPixelBytes, nullptr, [&]
+        {
+            AtlasOptions opt;
+            opt.includeMipmaps = true;
+            auto atlas = BuildTextureAtlas(materials, opt);
+            volatile std::size_t sink = atlas.pages.size(); (void)sink;
+        });
+
+        run("atlas_build_parallel", nTextures, nPixelBytes, nullptr, [&]
+        {
+            AtlasOptions opt;
+            opt.includeMipmaps = true;
+            auto atlas = BuildTextureAtlas(materials, opt, &bcPool);
+            volatile std::size_t sink = atlas.pages.size(); (void)sink;
+        });
+
+        /* Quantization of all material textures decoded to RGBA8, per dither method and kernel */
+        std::vector<RGBAImage> rgbaImages;
+        for(const auto& mat : materials)
+        {
+            for(const auto& mipmap : mat.mipmaps())
+            {
+                for(const auto& tex : mipmap) {
+                    rgbaImages.push_back({ tex.width(), tex.height(), TextureToRGBA8(tex) });
+                }
+            }
+        }
+
+        auto quantizeAll = [&](const QuantizeOptions& opt, ThreadPool* pool)
+        {
+            std::size_t acc = 0;
+            for(const auto& image : rgbaImages) {
+                acc += QuantizeRGBA8(image.data.data(), image.width, image.height, RGB_565, opt, pool).bitmap()->size();
+            }
+            volatile std::size_t sink = acc; (void)sink;
+        };
+
+        for(auto method : { DitherMethod::None, DitherMethod::Ordered })
+        {
+            for(auto kernel : { DitherKernel::Scalar, DitherKernel::SSE41, DitherKernel::AVX2 })
+            {
+                if(!IsDitherKernelSupported(kernel)) {
+                    continue;
+                }
+
+                const std::string name = std::string("quantize_") + (method == DitherMethod::None ? "none_" : "ordered_") + DitherKernelName(kernel);
+                run(name, nTextures, nPixelBytes, nullptr, [&]{
+                    quantizeAll(QuantizeOptions{ method, kernel }, nullptr);
+                });
+            }
+        }
+
+        run("quantize_diffusion", nTextures, nPixelBytes, nullptr, [&]{
+            quantizeAll(QuantizeOptions{ DitherMethod::Diffusion, DitherKernel::Auto }, nullptr);
+        });
+
+        run("quantize_diffusion_parallel", nTextures, nPixelBytes, nullptr, [&]{
+            quantizeAll(QuantizeOptions{ DitherMethod::Diffusion, DitherKernel::Auto }, &bcPool);
+        });
+
+        /* PSNR and SSIM of all material textures decoded to RGBA8, per kernel */
+        for(auto kernel : { CompareKernel::Scalar, CompareKernel::SSE41, CompareKernel::AVX2 })
+        {
+            if(!IsCompareKernelSupported(kernel)) {
+                continue;
+            }
+
+            run(std::string("compare_rgba8_") + CompareKernelName(kernel), nTextures, nPixelBytes, nullptr, [&]
+            {
+                double acc = 0.0;
+                for(const auto& image : rgbaImages) {
+                    acc += CompareRGBA8(image.data.data(), image.data.data(), image.width, image.height, 0xF, kernel).ssim;
+                }
+                volatile double sink = acc; (void)sink;
+            });
+        }
+
+        /* All materials are identical, so only their hashes are computed */
+        run("compare_materials_identical", nTextures, nPixelBytes, nullptr, [&]
+        {
+            auto diffs = CompareMaterials(materials, materials, CompareKernel::Auto, &bcPool);
+            volatile std::size_t sink = diffs.size(); (void)sink;
+        });
+
+        /* Delta between CND file and its copy with one material's pixels inverted */
+        const std::string deltaNewFile   = cfg.workDir + "/bench_delta_new.cnd";
+        const std::string deltaPatchFile = cfg.workDir + "/bench_delta.cndd";
+        {
+            InputFileStream ifs(cndFile);
+            OutputFileStream ofs(deltaNewFile);
+            ofs.write(ifs);
+        }
+
+        const auto& deltaSrc = materials.at(materials.size() / 3);
+        Material deltaMat(deltaSrc.name());
+        deltaMat.setSize(deltaSrc.width(), deltaSrc.height())
+                .setColorFormat(deltaSrc.colorFormat());
+        for(const auto& mipmap : deltaSrc.mipmaps())
+        {
+            Mipmap inverted;
+            for(auto tex : mipmap)
+            {
+                auto bitmap = MakeBitmapPtr(tex.bitmap()->size());
+                std::transform(tex.bitmap()->begin(), tex.bitmap()->end(), bitmap->begin(), [](byte_t b) { return byte_t(~b); });
+                inverted.push_back(tex.setBitmap(std::move(bitmap)));
+            }
+            deltaMat.addMipmap(std::move(inverted));
+        }
+
+        if(!libim::CND::ReplaceMaterial(deltaMat, deltaNewFile)) {
+            throw std::runtime_error("ReplaceMaterial failed");
+        }
+
+        const uint64_t nCndBytes = InputFileStream(cndFile).size();
+        run("cnd_delta_write", 1, nCndBytes, nullptr, [&]
+        {
+            InputFileStream oldCnd(cndFile);
+            InputFileStream newCnd(deltaNewFile);
+            OutputFileStream patch(deltaPatchFile);
+            libim::CND::WriteCndDelta(oldCnd, newCnd, patch);
+        });
+
+        run("cnd_delta_apply", 1, nCndBytes, nullptr, [&]
+        {
+            InputFileStream oldCnd(cndFile);
+            InputFileStream patch(deltaPatchFile);
+            OutputFileStream newCnd(outDir + "/bench_delta_applied.cnd");
+            libim::CND::ApplyCndDelta(oldCnd, patch, newCnd);
+        });
+
+        const uint64_t nMatBytes = cfg.mipmaps * GetMipmapPixelDataSize(cfg.pixelLevels, cfg.matSize, cfg.matSize, RGB_565.bpp);
+        run("cnd_replace_material", 1, nMatBytes, nullptr, [&]
+        {
+            if(!libim::CND::ReplaceMaterial(materials.at(materials.size() / 2), cndFile)) {
+                throw std::runtime_error("ReplaceMaterial failed");
+            }
+        });
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Benchmark error: " << e.what() << "!\n";
+        return 1;
+    }
+
+    PrintResults(results);
+
+    if(!cfg.jsonFile.empty())
+    {
+        if(cfg.jsonFile == "-") {
+            WriteJson(std::cout, cfg, results);
+        }
+        else
+        {
+            std::ofstream ofs(cfg.jsonFile);
+            if(!ofs)
+            {
+                std::cerr << "Error: could not open JSON output file: " << cfg.jsonFile << "!\n";
+                return 1;
+            }
+            WriteJson(ofs, cfg, results);
+        }
+    }
+
+    return 0;
+}
+
+void print_help()
+{
+    std::cout << "\nlibim benchmark suite\n";
+    std::cout << "Times libim stream, GOB, CND and MAT operations on generated input files.\n";
+    std::cout << "  Usage: libim_bench [options]" << std::endl << std::endl;
+
+    std::cout << "Option                  Meaning\n";
+    std::cout << "-n, --iterations <n>    Number of timed iterations per benchmark (default: 10)\n";
+    std::cout << "    --warmup <n>        Number of untimed warmup iterations (default: 1)\n";
+    std::cout << "    --filter <name>     Run only benchmarks whose name contains <name>\n";
+    std::cout << "    --gob-entries <n>   Number of entries in generated GOB file (default: 256)\n";
+    std::cout << "    --gob-entry-size <bytes>  Size of each GOB entry (default: 65536)\n";
+    std::cout << "    --materials <n>     Number of materials in generated CND file (default: 64)\n";
+    std::cout << "    --mat-size <px>     Width and height of material base texture (default: 128)\n";
+    std::cout << "    --mipmaps <n>       Number of mipmaps per material (default: 2)\n";
+    std::cout << "    --pod-reads <n>     Number of POD reads in stream benchmark (default: 100000)\n";
+    std::cout << "    --work-dir <dir>    Folder for generated input and output files (default: libim_bench_data)\n";
+    std::cout << "    --json <file>       Write machine-readable results to <file> ('-' for stdout)\n";
+    std::cout << "-h, --help              Show this message\n";
+}
+
+bool ParseConfig(const Options& opt, BenchConfig& cfg)
+{
+    auto parseUInt = [&](const char* name, uint32_t& value, bool allowZero = false)
+    {
+        if(!opt.hasOpt(name)) {
+            return true;
+        }
+
+        try
+        {
+            auto v = std::stoul(opt.arg(name));
+            if((v == 0 && !allowZero) || v > UINT32_MAX) {
+                throw std::out_of_range(name);
+            }
+            value = static_cast<uint32_t>(v);
+            return true;
+        }
+        catch(const std::exception&)
+        {
+            std::cerr << "Error: invalid value for option " << name << ": '" << opt.arg(name) << "'\n";
+            return false;
+        }
+    };
+
+    bool ok = parseUInt(OPT_ITERATIONS_SHORT, cfg.iterations) &&
+              parseUInt(OPT_ITERATIONS,       cfg.iterations) &&
+              parseUInt(OPT_GOB_ENTRIES,      cfg.gobEntries) &&
+              parseUInt(OPT_GOB_ENTRY_SIZE,   cfg.gobEntrySize) &&
+              parseUInt(OPT_MATERIALS,        cfg.materials) &&
+              parseUInt(OPT_MAT_SIZE,         cfg.matSize) &&
+              parseUInt(OPT_MIPMAPS,          cfg.mipmaps) &&
+              parseUInt(OPT_POD_READS,        cfg.podReads) &&
+              parseUInt(OPT_WARMUP,           cfg.warmup, /*allowZero=*/true);
+    if(!ok) {
+        return false;
+    }
+
+    if(opt.hasOpt(OPT_FILTER)) {
+        cfg.filter = opt.arg(OPT_FILTER);
+    }
+
+    if(opt.hasOpt(OPT_WORK_DIR)) {
+        cfg.workDir = opt.arg(OPT_WORK_DIR);
+    }
+
+    if(opt.hasOpt(OPT_JSON)) {
+        cfg.jsonFile = opt.arg(OPT_JSON).empty() ? "-" : opt.arg(OPT_JSON);
+    }
+
+    /* Material size must be power of 2 and the smallest LOD texture at least 1x1 */
+    uint32_t matSize = 1;
+    while(matSize <= cfg.matSize / 2) matSize <<= 1;
+    cfg.matSize = matSize;
+
+    uint32_t maxLevels = 1;
+    while((cfg.matSize >> maxLevels) > 0) maxLevels++;
+    cfg.pixelLevels = std::min(cfg.pixelLevels, maxLevels);
+    return true;
+}
+
+bool MakeGobFixture(const std::string& path, const BenchConfig& cfg)
+{
+    GobGenSpec spec;
+    spec.entries = cfg.gobEntries;
+    spec.minSize = cfg.gobEntrySize;
+    spec.maxSize = cfg.gobEntrySize;
+    return GenerateGob(path, spec);
+}
+
+bool MakeCndFixture(const std::string& path, const BenchConfig& cfg)
+{
+    CndGenSpec spec;
+    spec.materials = cfg.materials;
+    spec.minSize   = cfg.matSize;
+    spec.maxSize   = cfg.matSize;
+    spec.minCels   = cfg.mipmaps;
+    spec.maxCels   = cfg.mipmaps;
+    spec.minLevels = cfg.pixelLevels;
+    spec.maxLevels = cfg.pixelLevels;
+    spec.randomColorFormat = false;
+    return GenerateCnd(path, spec);
+}
+
+void PrintResults(const std::vector<BenchResult>& results)
+{
+    auto ms = [](double s) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(3) << s * 1000.0;
+        return ss.str();
+    };
+
+    std::cout << "\n" << std::left << std::setfill(' ') << std::setw(28) << "Benchmark"
+              << SETW(11, ' ') << "p50 ms" << SETW(11, ' ') << "p90 ms" << SETW(11, ' ') << "p99 ms"
+              << SETW(11, ' ') << "mean ms" << SETW(12, ' ') << "MB/s" << SETW(14, ' ') << "items/s" << "\n";
+
+    for(const auto& r : results)
+    {
+        std::cout << std::left << std::setfill(' ') << std::setw(28) << r.name
+                  << SETW(11, ' ') << ms(r.percentile(50)) << SETW(11, ' ') << ms(r.percentile(90))
+                  << SETW(11, ' ') << ms(r.percentile(99)) << SETW(11, ' ') << ms(r.mean())
+                  << SETW(12, ' ') << std::fixed << std::setprecision(1) << r.mbPerSec()
+                  << SETW(14, ' ') << std::fixed << std::setprecision(0) << r.itemsPerSec() << "\n";
+    }
+    std::cout << std::endl;
+}
+
+void WriteJson(std::ostream& os, const BenchConfig& cfg, const std::vector<BenchResult>& results)
+{
+    os << std::setprecision(9);
+    os << "{\n";
+    os << "  \"config\": {"
+       << "\"iterations\": "     << cfg.iterations
+       << ", \"warmup\": "       << cfg.warmup
+       << ", \"gob_entries\": "  << cfg.gobEntries
+       << ", \"gob_entry_size\": " << cfg.gobEntrySize
+       << ", \"materials\": "    << cfg.materials
+       << ", \"mat_size\": "     << cfg.matSize
+       << ", \"mipmaps\": "      << cfg.mipmaps
+       << ", \"pod_reads\": "    << cfg.podReads << "},\n";
+    os << "  \"results\": [\n";
+    for(std::size_t i = 0; i < results.size(); i++)
+    {
+        const auto& r = results.at(i);
+        os << "    {\"name\": \"" << r.name << "\""
+           << ", \"items\": "  << r.items
+           << ", \"bytes\": "  << r.bytes
+           << ", \"min_s\": "  << r.percentile(0)
+           << ", \"p50_s\": "  << r.percentile(50)
+           << ", \"p90_s\": "  << r.percentile(90)
+           << ", \"p99_s\": "  << r.percentile(99)
+           << ", \"max_s\": "  << r.percentile(100)
+           << ", \"mean_s\": " << r.mean()
+           << ", \"mb_per_s\": "    << r.mbPerSec()
+           << ", \"items_per_s\": " << r.itemsPerSec()
+           << ", \"samples_s\": [";
+        for(std::size_t j = 0; j < r.samples.size(); j++) {
+            os << (j ? ", " : "") << r.samples.at(j);
+        }
+        os << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
@@ -0,0 +1,214 @@
+#include "listwriter.h"
+
+#include <charconv>
+#include <stdexcept>
+
+bool ParseListFormat(const std::string& name, ListFormat& format)
+{
+    if(name == "text") {
+        format = ListFormat::Text;
+    }
+    else if(name == "json") {
+        format = ListFormat::Json;
+    }
+    else if(name == "csv") {
+        format = ListFormat::Csv;
+    }
+    else if(name == "ndjson") {
+        format = ListFormat::Ndjson;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+ListWriter::ListWriter(std::ostream& os, ListFormat format, std::vector<std::string> columns, std::size_t bufferSize) :
+    m_os(os),
+    m_format(format),
+    m_columns(std::move(columns)),
+    m_bufferSize(bufferSize)
+{
+    m_buffer.reserve(m_bufferSize + 4096);
+    if(m_format == ListFormat::Text || m_format == ListFormat::Csv)
+    {
+        for(std::size_t i = 0; i < m_columns.size(); i++)
+        {
+            if(i > 0) {
+                m_buffer += m_format == ListFormat::Text ? '\t' : ',';
+            }
+            m_buffer += m_columns[i];
+        }
+        m_buffer += '\n';
+    }
+    else if(m_format == ListFormat::Json) {
+        m_buffer += '[';
+    }
+}
+
+void ListWriter::beginField()
+{
+    if(m_nField >= m_columns.size()) {
+        throw std::logic_error("ListWriter: row has more fields than columns");
+    }
+
+    switch(m_format)
+    {
+        case ListFormat::Text:
+            if(m_nField > 0) m_buffer += '\t';
+            break;
+        case ListFormat::Csv:
+            if(m_nField > 0) m_buffer += ',';
+            break;
+        case ListFormat::Json:
+        case ListFormat::Ndjson:
+            if(m_nField == 0)
+            {
+                if(m_format == ListFormat::Json) {
+                    m_buffer += m_nRows > 0 ? ",\n " : "\n ";
+                }
+                m_buffer += '{';
+            }
+            else {
+                m_buffer += ", ";
+            }
+            string(m_columns[m_nField]);
+            m_buffer += ": ";
+            break;
+    }
+
+    m_nField++;
+}
+
+ListWriter& ListWriter::field(uint64_t value)
+{
+    beginField();
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    m_buffer.append(buf, res.ptr);
+    return *this;
+}
+
+ListWriter& ListWriter::field(int64_t value)
+{
+    beginField();
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    m_buffer.append(buf, res.ptr);
+    return *this;
+}
+
+ListWriter& ListWriter::field(std::string_view value)
+{
+    beginField();
+    string(value);
+    return *this;
+}
+
+/* Appends value quoted and escaped as needed by format */
+void ListWriter::string(std::string_view value)
+{
+    static constexpr char HEX[] = "0123456789abcdef";
+    switch(m_format)
+    {
+        case ListFormat::Text:
+            for(char c : value) {
+                m_buffer += (c == '\t' || c == '\n' || c == '\r') ? ' ' : c;
+            }
+            break;
+
+        case ListFormat::Csv:
+            if(value.find_first_of(",\"\r\n") == std::string_view::npos) {
+                m_buffer.append(value);
+            }
+            else
+            {
+                m_buffer += '"';
+                for(char c : value)
+                {
+                    if(c == '"') {
+                        m_buffer += '"';
+                    }
+                    m_buffer += c;
+                }
+                m_buffer += '"';
+            }
+            break;
+
+        case ListFormat::Json:
+        case ListFormat::Ndjson:
+            m_buffer += '"';
+            for(char c : value)
+            {
+                switch(c)
+                {
+                    case '"':  m_buffer += "\\\""; break;
+                    case '\\': m_buffer += "\\\\"; break;
+                    case '\n': m_buffer += "\\n";  break;
+                    case '\r': m_buffer += "\\r";  break;
+                    case '\t': m_buffer += "\\t";  break;
+                    default:
+                        if(static_cast<unsigned char>(c) < 0x20)
+                        {
+                            m_buffer += "\\u00";
+                            m_buffer += HEX[(c >> 4) & 0xF];
+                            m_buffer += HEX[c & 0xF];
+                        }
+                        else {
+                            m_buffer += c;
+                        }
+                }
+            }
+            m_buffer += '"';
+            break;
+    }
+}
+
+void ListWriter::endRow()
+{
+    if(m_nField != m_columns.size()) {
+        throw std::logic_error("ListWriter: row has fewer fields than columns");
+    }
+
+    switch(m_format)
+    {
+        case ListFormat::Text:
+        case ListFormat::Csv:
+            m_buffer += '\n';
+            break;
+        case ListFormat::Json:
+            m_buffer += '}';
+            break;
+        case ListFormat::Ndjson:
+            m_buffer += "}\n";
+            break;
+    }
+
+    m_nField = 0;
+    m_nRows++;
+    flushIfFull();
+}
+
+void ListWriter::flushIfFull()
+{
+    if(m_buffer.size() >= m_bufferSize) {
+        flush();
+    }
+}
+
+void ListWriter::flush()
+{
+    m_os.write(m_buffer.data(), std::streamsize(m_buffer.size()));
+    m_buffer.clear();
+}
+
+bool ListWriter::finish()
+{
+    if(m_format == ListFormat::Json) {
+        m_buffer += m_nRows > 0 ? "\n]\n" : "]\n";
+    }
+
+    flush();
+    m_os.flush();
+    return bool(m_os);
+}
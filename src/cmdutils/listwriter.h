@@ -0,0 +1,86 @@
+#ifndef CMDUTILS_LISTWRITER_H
+#define CMDUTILS_LISTWRITER_H
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "options.h"
+
+#define OPT_FORMAT "--format"
+
+enum class ListFormat
+{
+    Text,   // Tab separated columns with header line
+    Json,   // Array of objects
+    Csv,    // RFC 4180 with header line
+    Ndjson  // One object per line
+};
+
+/* Parses list format name: text, json, csv or ndjson. Returns false if name is unknown. */
+bool ParseListFormat(const std::string& name, ListFormat& format);
+
+/* Gets list format from --format option, text if not given. Returns false if format is unknown. */
+inline bool GetListFormatOption(const Options& opt, ListFormat& format)
+{
+    format = ListFormat::Text;
+    if(opt.hasOpt(OPT_FORMAT) && !ParseListFormat(opt.arg(OPT_FORMAT), format))
+    {
+        std::cerr << "Error: unknown list format: " << opt.arg(OPT_FORMAT) << "!\n";
+        return false;
+    }
+    return true;
+}
+
+/* Writes rows of named columns in list format.
+   Rows are formatted into a buffer which is written to os in large blocks,
+   so os is not flushed per row. Call finish after the last row. */
+class ListWriter
+{
+public:
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE = 256 * 1024;
+
+    ListWriter(std::ostream& os, ListFormat format, std::vector<std::string> columns,
+               std::size_t bufferSize = DEFAULT_BUFFER_SIZE);
+
+    ListWriter(const ListWriter&) = delete;
+    ListWriter& operator = (const ListWriter&) = delete;
+
+    /* Adds next field of current row, row starts with first field */
+    ListWriter& field(std::string_view value);
+    ListWriter& field(uint64_t value);
+    ListWriter& field(int64_t value);
+
+    ListWriter& field(uint32_t value)
+    {
+        return field(uint64_t(value));
+    }
+
+    ListWriter& field(int32_t value)
+    {
+        return field(int64_t(value));
+    }
+
+    /* Ends current row after all its fields were added */
+    void endRow();
+
+    /* Ends list and writes buffered output to os. Returns false if writing to os failed. */
+    bool finish();
+
+private:
+    void beginField();
+    void string(std::string_view value);
+    void flushIfFull();
+    void flush();
+
+    std::ostream& m_os;
+    ListFormat m_format;
+    std::vector<std::string> m_columns;
+    std::size_t m_bufferSize;
+    std::string m_buffer;
+    std::size_t m_nField = 0;
+    std::size_t m_nRows  = 0;
+};
+
+#endif // CMDUTILS_LISTWRITER_H
@@ -0,0 +1,63 @@
+#ifndef CMDUTILS_MANIFEST_H
+#define CMDUTILS_MANIFEST_H
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "options.h"
+#include "libim/manifest.h"
+
+#define OPT_MANIFEST "--manifest"
+#define OPT_HASH     "--hash"
+
+/* Gets hash algorithm from --hash option, crc32c if not given. Returns false if algorithm is unknown. */
+inline bool GetHashAlgorithmOption(const Options& opt, HashAlgorithm& algorithm)
+{
+    algorithm = HashAlgorithm::Crc32c;
+    if(opt.hasOpt(OPT_HASH) && !ParseHashAlgorithm(opt.arg(OPT_HASH), algorithm))
+    {
+        std::cerr << "Error: unknown hash algorithm: " << opt.arg(OPT_HASH) << "!\n";
+        return false;
+    }
+    return true;
+}
+
+/* Sorts manifest and writes it to file. Returns false on error. */
+inline bool WriteManifestFile(const std::string& file, Manifest& manifest)
+{
+    manifest.sort();
+    std::ofstream ofs(file, std::ios::binary);
+    if(ofs) {
+        WriteManifest(ofs, manifest);
+    }
+
+    if(!ofs.flush())
+    {
+        std::cerr << "Error: could not write manifest file: " << file << "!\n";
+        return false;
+    }
+    return true;
+}
+
+/* Reads manifest from file. Returns false on error. */
+inline bool ReadManifestFile(const std::string& file, Manifest& manifest)
+{
+    std::ifstream ifs(file, std::ios::binary);
+    if(!ifs)
+    {
+        std::cerr << "Error: could not open manifest file: " << file << "!\n";
+        return false;
+    }
+
+    try {
+        manifest = ReadManifest(ifs);
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << " in manifest file: " << file << "!\n";
+        return false;
+    }
+    return true;
+}
+
+#endif // CMDUTILS_MANIFEST_H
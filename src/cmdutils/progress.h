@@ -0,0 +1,32 @@
+#ifndef CMDUTILS_PROGRESS_H
+#define CMDUTILS_PROGRESS_H
+#include <iostream>
+
+#include "options.h"
+#include "libim/progress.h"
+#include "libim/stats.h"
+
+#define OPT_PROGRESS    "--progress"
+#define OPT_NO_PROGRESS "--no-progress"
+
+/* Sets progress mode from --progress and --no-progress options.
+   Progress is reported by default if stderr is terminal. */
+inline void ApplyProgressOptions(const Options& opt)
+{
+    if(opt.hasOpt(OPT_NO_PROGRESS)) {
+        SetProgressMode(ProgressMode::Off);
+    }
+    else if(opt.hasOpt(OPT_PROGRESS)) {
+        SetProgressMode(ProgressMode::On);
+    }
+}
+
+/* Prints per-phase timings to stderr if progress is reported */
+inline void WriteProgressSummary()
+{
+    if(ProgressEnabled()) {
+        PrintPhaseTimes(std::cerr, GetStats());
+    }
+}
+
+#endif // CMDUTILS_PROGRESS_H
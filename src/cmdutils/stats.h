@@ -0,0 +1,47 @@
+#ifndef CMDUTILS_STATS_H
+#define CMDUTILS_STATS_H
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "options.h"
+#include "libim/stats.h"
+
+#define OPT_STATS      "--stats"
+#define OPT_STATS_JSON "--stats-json"
+
+/* Prints collected statistics if requested by --stats (human readable, to stdout)
+   or --stats-json [file] (JSON, to file or stdout). */
+inline bool WriteStatsOutput(const Options& opt)
+{
+    if(!opt.hasOpt(OPT_STATS) && !opt.hasOpt(OPT_STATS_JSON)) {
+        return true;
+    }
+
+    const auto stats = GetStats();
+    if(opt.hasOpt(OPT_STATS)) {
+        PrintStats(std::cout, stats);
+    }
+
+    if(opt.hasOpt(OPT_STATS_JSON))
+    {
+        const auto file = opt.arg(OPT_STATS_JSON);
+        if(file.empty()) {
+            PrintStatsJson(std::cout, stats);
+        }
+        else
+        {
+            std::ofstream ofs(file);
+            if(!ofs)
+            {
+                std::cerr << "Error: could not open stats output file: " << file << "!\n";
+                return false;
+            }
+            PrintStatsJson(ofs, stats);
+        }
+    }
+
+    return true;
+}
+
+#endif // CMDUTILS_STATS_H
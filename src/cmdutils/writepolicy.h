@@ -0,0 +1,43 @@
+#ifndef CMDUTILS_WRITEPOLICY_H
+#define CMDUTILS_WRITEPOLICY_H
+#include <iostream>
+#include <string>
+
+#include "options.h"
+#include "libim/io/writepolicy.h"
+
+#define OPT_DURABILITY  "--durability"
+#define OPT_PREALLOCATE "--preallocate"
+
+/* Sets write policy from --durability <none|per-file|batch> and --preallocate options.
+   Returns false if an option is invalid. */
+inline bool ApplyWritePolicyOptions(const Options& opt)
+{
+    WritePolicy policy;
+    if(opt.hasOpt(OPT_DURABILITY) && !ParseDurability(opt.arg(OPT_DURABILITY), policy.durability))
+    {
+        std::cerr << "Error: unknown durability: " << opt.arg(OPT_DURABILITY) << "!\n";
+        return false;
+    }
+
+    policy.preallocate = opt.hasOpt(OPT_PREALLOCATE);
+    SetWritePolicy(policy);
+    return true;
+}
+
+/* Syncs files written with batch durability. Returns false on error. */
+inline bool FinishDeferredWrites()
+{
+    try
+    {
+        SyncDeferredWrites();
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "!\n";
+        return false;
+    }
+}
+
+#endif // CMDUTILS_WRITEPOLICY_H
@@ -0,0 +1,865 @@
+#include "extract.h"
+#include "libim/cnd.h"
+#include "libim/common.h"
+#include "libim/material/atlas.h"
+#include "libim/material/bmp.h"
+#include "libim/material/compare.h"
+#include "libim/material/mat.h"
+#include "libim/material/texfile.h"
+#include "libim/io/hashingstream.h"
+#include "libim/memory/arena.h"
+#include "libim/progress.h"
+#include "libim/stats.h"
+#include "libim/utils/bounded_queue.h"
+#include "libim/utils/thread_pool.h"
+#include "libim/utils/xxhash.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#define SETW(n, f)  std::right << std::setfill(f) << std::setw(n)
+#define SET_VINFO_LW(n) SETW(32 + n, '.')
+
+namespace {
+    struct FileError
+    {
+        std::string path;
+        std::string error;
+    };
+
+    /* Material passed between pipeline stages */
+    struct MaterialJob
+    {
+        std::unique_ptr<MaterialArena> arena;             // Memory of decoded material, must outlive it
+        std::optional<libim::CND::CndMaterialData> data;  // Raw material read from file
+        std::optional<Material> material;                 // Decoded material
+        std::size_t pixelDataSize = 0;                    // Size of raw pixel data
+    };
+
+    using JobQueue = BoundedQueue<MaterialJob>;
+
+    /* Stops pipeline stage threads when leaving scope, also when an exception is thrown.
+       Queues are closed so blocked stages return, then stages are joined. */
+    class StageJoiner
+    {
+    public:
+        StageJoiner(JobQueue& readQueue, JobQueue& decodeQueue) :
+            m_readQueue(readQueue), m_decodeQueue(decodeQueue)
+        {}
+
+        ~StageJoiner()
+        {
+            m_readQueue.close();
+            m_decodeQueue.close();
+            for(auto& t : threads)
+            {
+                if(t.joinable()) {
+                    t.join();
+                }
+            }
+        }
+
+        StageJoiner(const StageJoiner&) = delete;
+        StageJoiner& operator=(const StageJoiner&) = delete;
+
+        std::vector<std::thread> threads;
+
+    private:
+        JobQueue& m_readQueue;
+        JobQueue& m_decodeQueue;
+    };
+
+    /* Returns true for materials which should be extracted */
+    using MaterialFilter = std::function<bool(const libim::CND::CndMatHeader&)>;
+
+    /* Returns path of bmp file of texture texIdx in mipmap mmIdx of material matName */
+    std::string BmpFilePath(const std::string& bmpDir, const std::string& matName, std::size_t nMipmaps, std::size_t mmIdx,
+                            std::size_t nTextures, std::size_t texIdx)
+    {
+        const std::string sufix = (nMipmaps > 1 ? "_" + std::to_string(mmIdx) : "") + ".bmp";
+        const std::string infix = nTextures > 1 ? "_" + std::to_string(texIdx) : "";
+        return bmpDir + "/" + GetBaseName(matName) + infix + sufix;
+    }
+}
+
+namespace {
+    /* Returns color format name made of channels with bits from most to least significant, e.g. RGB565 */
+    std::string ColorFormatName(const ColorFormat& ci)
+    {
+        struct Channel { char name; int32_t bits; int32_t shl; };
+        std::array<Channel, 4> channels = {{
+            { 'A', ci.alphaBPP, ci.AlphaShl },
+            { 'R', ci.redBPP,   ci.RedShl   },
+            { 'G', ci.greenBPP, ci.GreenShl },
+            { 'B', ci.blueBPP,  ci.BlueShl  }
+        }};
+        std::stable_sort(channels.begin(), channels.end(), [](const Channel& a, const Channel& b) {
+            return a.shl > b.shl;
+        });
+
+        std::string name, bits;
+        for(const auto& c : channels)
+        {
+            if(c.bits > 0)
+            {
+                name += c.name;
+                bits += std::to_string(c.bits);
+            }
+        }
+        return name.empty() ? "unknown" : name + bits;
+    }
+}
+
+void PrintMaterialInfo(const Material& mat)
+{
+    if(mat.mipmaps().empty()) return;
+    std::cout << "    Total mipmaps:" << SET_VINFO_LW(2) << mat.mipmaps().size() << std::endl << std::endl;
+}
+
+void PrintMipmapInfo(const Mipmap& mipmap, uint32_t mmIdx)
+{
+    if(mipmap.empty()) return;
+    const Texture& tex = mipmap.at(0);
+
+    std::string colorMode;
+    switch (tex.colorInfo().colorMode)
+    {
+    case 1:
+        colorMode = "RGB_565";
+        break;
+    case 2:
+        colorMode = "RGB_4444";
+        break;
+    default:
+        colorMode = "Unknown";
+        break;
+    }
+
+    std::cout << "    ------------------ Mipmap Info -----------------\n";
+    std::cout << "    MIP num:" << SET_VINFO_LW(8)  << mmIdx << std::endl;
+    std::cout << "    Width:"   << SET_VINFO_LW(10) << tex.width() << std::endl;
+    std::cout << "    Height:"  << SET_VINFO_LW(9)  << tex.height() << std::endl;
+    std::cout << "    Mipmap textures:" << SET_VINFO_LW(0) << mipmap.size() << std::endl;
+    std::cout << "    Pixel data size:" << SET_VINFO_LW(0) << GetMipmapPixelDataSize(mipmap.size(), tex.width(), tex.height(), tex.colorInfo().bpp) << std::endl;
+    std::cout << "    Color info:\n";
+
+    auto cmLw = colorMode.size() /2;
+    cmLw = (colorMode.size()  % 8 == 0 ? cmLw -1 : cmLw);
+    std::cout << "      Color mode:" << SET_VINFO_LW(cmLw) << colorMode << std::endl;
+    std::cout << "      Bit depth:"  << SET_VINFO_LW(4) << tex.colorInfo().bpp << std::endl;
+    std::cout << "      Bit depth per channel:" << std::endl;
+    std::cout << "        Red:"   << SET_VINFO_LW(8) << tex.colorInfo().redBPP   << std::endl;
+    std::cout << "        Green:" << SET_VINFO_LW(6) << tex.colorInfo().greenBPP << std::endl;
+    std::cout << "        Blue:"  << SET_VINFO_LW(7) << tex.colorInfo().blueBPP  << std::endl;
+    std::cout << "        Alpha:" << SET_VINFO_LW(6) << tex.colorInfo().alphaBPP << std::endl;
+    std::cout << "      Left shift per channel:" << std::endl;
+    std::cout << "        Red:"   << SET_VINFO_LW(8) << tex.colorInfo().RedShl   << std::endl;
+    std::cout << "        Green:" << SET_VINFO_LW(6) << tex.colorInfo().GreenShl << std::endl;
+    std::cout << "        Blue:"  << SET_VINFO_LW(7) << tex.colorInfo().BlueShl  << std::endl;
+    std::cout << "        Alpha:" << SET_VINFO_LW(6) << tex.colorInfo().AlphaShl << std::endl;
+    std::cout << "      Right shift per channel:" << std::endl;
+    std::cout << "        Red:"   << SET_VINFO_LW(8) << tex.colorInfo().RedShr   << std::endl;
+    std::cout << "        Green:" << SET_VINFO_LW(6) << tex.colorInfo().GreenShr << std::endl;
+    std::cout << "        Blue:"  << SET_VINFO_LW(7) << tex.colorInfo().BlueShr  << std::endl;
+    std::cout << "        Alpha:" << SET_VINFO_LW(6) << tex.colorInfo().AlphaShr << std::endl << std::endl;
+}
+
+/* Copies materials' pixel data from CND file to MAT files without decoding textures */
+static bool CopyMaterials(const std::string& cndFile, std::string outDir, const MaterialFilter& filter, Manifest* manifest)
+{
+    try
+    {
+        InputFileStream ifstream(cndFile);
+        const auto materials = libim::CND::LoadMaterialLocations(ifstream);
+        if(materials.empty())
+        {
+            std::cout << "CND Info: No materials found in CND file!\n";
+            return true;
+        }
+
+        std::cout << "Found materials: " << materials.size() << std::endl;
+
+        outDir += (outDir.empty() ? "" : "/" ) + GetBaseName(cndFile);
+        const std::string matDir = outDir + "/" + "mat";
+        MakePath(matDir);
+
+        uint64_t nTotal = 0, totalSize = 0;
+        for(const auto& mat : materials)
+        {
+            if(!filter || filter(mat.header))
+            {
+                nTotal++;
+                totalSize += mat.size;
+            }
+        }
+
+        StatPhaseTimer phase("copy_mat");
+        ProgressReporter progress("Extracting", nTotal, totalSize);
+        const bool printMaterials = !progress.active();
+        std::size_t nExtracted = 0;
+        for(const auto& mat : materials)
+        {
+            const auto& header = mat.header;
+            if(filter && !filter(header)) {
+                continue;
+            }
+
+            if(header.mipmapCount < 1 || header.texturesPerMipmap < 1)
+            {
+                std::cerr << "CND Warning: No pixel data found for material: " << header.name << std::endl;
+                continue;
+            }
+
+            if(printMaterials) {
+                std::cout << "Extracting material: " << header.name << '\n';
+            }
+
+            const std::string matFilePath(matDir + "/" + header.name);
+            try
+            {
+                OutputFileStream ofstream(matFilePath);
+                ofstream.preallocate(libim::CND::GetMatFileSize(header));
+                if(manifest)
+                {
+                    HashingStream hstream(manifest->algorithm, &ofstream);
+                    libim::CND::CopyMaterialToMat(ifstream, mat, hstream);
+                    manifest->add("mat/" + ManifestEntryName(header.name), hstream.size(), hstream.digest());
+                }
+                else {
+                    libim::CND::CopyMaterialToMat(ifstream, mat, ofstream);
+                }
+            }
+            catch(const std::exception& e)
+            {
+                std::cerr << "CND Error: Failed to write material file " << matFilePath << ": " << e.what() << "!\n";
+                return false;
+            }
+
+            nExtracted++;
+            progress.add(1, mat.size);
+        }
+
+        progress.finish();
+        std::cout << "\n-----------------------------------------\nTotal materials extracted: " << nExtracted << std::endl << std::endl;
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "CND Error: An exception was thrown while extracting materials: " << e.what() << "!\n";
+        return false;
+    }
+}
+
+/* Extracts materials of CND file for which filter returns true, or all materials if filter is null */
+static bool ExtractMaterialsIf(const std::string& cndFile, std::string outDir, bool convert, bool verbose, bool hugePages, std::size_t queueSize, std::size_t jobs,
+                               const std::optional<TexFileOptions>& texExport, const MaterialFilter& filter, Manifest* manifest)
+{
+    /* Nothing needs decoded textures, splice raw pixel data straight into MAT files */
+    if(!convert && !texExport && !verbose) {
+        return CopyMaterials(cndFile, std::move(outDir), filter, manifest);
+    }
+
+    try
+    {
+        InputFileStream ifstream(cndFile);
+        libim::CND::MaterialReader reader(ifstream);
+        if(reader.headers().empty())
+        {
+            std::cout << "CND Info: No materials found in CND file!\n";
+            return true;
+        }
+
+        std::cout << "Found materials: " << reader.headers().size() << std::endl;
+
+        outDir += (outDir.empty() ? "" : "/" ) + GetBaseName(cndFile);
+        const std::string matDir = outDir + "/" + "mat";
+        MakePath(matDir);
+
+        std::string bmpDir;
+        if(convert)
+        {
+            bmpDir = outDir + "/" + "bmp";
+            MakePath(bmpDir);
+        }
+
+        std::string texDir;
+        if(texExport)
+        {
+            texDir = outDir + "/" + std::string(TexFileExtension(texExport->format) + 1);
+            MakePath(texDir);
+        }
+
+        uint64_t nTotal = 0, totalSize = 0;
+        for(const auto& header : reader.headers())
+        {
+            if(!filter || filter(header))
+            {
+                nTotal++;
+                totalSize += libim::CND::GetMaterialPixelDataSize(header);
+            }
+        }
+
+        JobQueue readQueue(queueSize);
+        JobQueue decodeQueue(queueSize);
+
+        /* Errors of bmp and texture files which failed to convert */
+        std::mutex fileErrorsMutex;
+        std::vector<FileError> fileErrors;
+
+        /* Pool converting textures to bmp and materials to texture files */
+        std::optional<ThreadPool> pool;
+        if(convert || texExport) {
+            pool.emplace(jobs);
+        }
+
+        /* On error stop all stages */
+        std::atomic<bool> failed(false);
+        auto fail = [&](const std::string& error)
+        {
+            if(!failed.exchange(true) && !error.empty()) {
+                std::cerr << "CND Error: " << error << "!\n";
+            }
+
+            readQueue.close();
+            decodeQueue.close();
+        };
+
+        StageJoiner stages(readQueue, decodeQueue);
+        stages.threads.reserve(2);
+
+        /* Stage 1: read raw material data from file */
+        stages.threads.emplace_back([&]
+        {
+            StatPhaseTimer phase("read_materials");
+            try
+            {
+                while(auto data = reader.next())
+                {
+                    if(filter && !filter(data->header)) {
+                        continue;
+                    }
+
+                    MaterialJob job;
+                    job.data = std::move(data);
+                    if(!readQueue.push(std::move(job))) {
+                        break;
+                    }
+                }
+            }
+            catch(const std::exception& e) {
+                fail(std::string("An exception was thrown while reading materials: ") + e.what());
+            }
+
+            readQueue.close();
+        });
+
+        /* Stage 2: decode material's textures */
+        stages.threads.emplace_back([&]
+        {
+            StatPhaseTimer phase("decode_materials");
+            try
+            {
+                while(auto job = readQueue.pop())
+                {
+                    const auto& header = job->data->header;
+                    if(header.mipmapCount < 1 || header.texturesPerMipmap < 1)
+                    {
+                        std::cerr << "CND Warning: No pixel data found for material: " << header.name << std::endl;
+                        continue;
+                    }
+
+                    /* Each material gets its own arena which is freed when material is written */
+                    job->arena = std::make_unique<MaterialArena>(job->data->pixelData.size() + 4096, hugePages);
+                    job->material.emplace(libim::CND::DecodeMaterial(*job->data, job->arena->resource()));
+                    job->pixelDataSize = job->data->pixelData.size();
+                    job->data.reset();
+
+                    if(!decodeQueue.push(std::move(*job))) {
+                        break;
+                    }
+                }
+            }
+            catch(const std::exception& e) {
+                fail(e.what());
+            }
+
+            decodeQueue.close();
+        });
+
+        /* Stage 3: save extracted materials to files and queue textures for bmp conversion.
+           Every texture is converted and written to bmp file by its own pool task,
+           every exported material by one task. */
+        ProgressReporter progress("Extracting", nTotal, totalSize);
+        const bool printMaterials = verbose || !progress.active();
+        std::size_t nExtracted = 0;
+        try
+        {
+            while(auto decoded = decodeQueue.pop())
+            {
+                /* Shared by pool tasks, material's arena is freed after the last texture is written */
+                auto job = std::make_shared<const MaterialJob>(std::move(*decoded));
+                const auto& mat = *job->material;
+                if(printMaterials) {
+                    std::cout << "Extracting material: " << mat.name() << '\n';
+                }
+
+                std::string matFilePath(matDir + "/" + mat.name());
+                {
+                    StatPhaseTimer phase("write_mat");
+                    std::optional<Hasher> hasher;
+                    if(manifest) {
+                        hasher.emplace(manifest->algorithm);
+                    }
+
+                    if(!SaveMaterialToFile(std::move(matFilePath), mat, hasher ? &*hasher : nullptr))
+                    {
+                        fail("");
+                        break;
+                    }
+
+                    if(manifest) {
+                        manifest->add("mat/" + ManifestEntryName(mat.name()), hasher->size(), hasher->digest());
+                    }
+                }
+
+                if(verbose)
+                {
+                    std::cout << "  ================== Material Info ===================\n";
+                    PrintMaterialInfo(mat);
+
+                    uint32_t mmIdx = 0;
+                    for(const auto& mipmap : mat.mipmaps()) {
+                        PrintMipmapInfo(mipmap, mmIdx++);
+                    }
+                }
+
+                /* Convert to bmp */
+                for(std::size_t mmIdx = 0; convert && mmIdx < mat.mipmaps().size(); mmIdx++)
+                {
+                    const auto& mipmap = mat.mipmaps().at(mmIdx);
+                    for(std::size_t texIdx = 0; texIdx < mipmap.size(); texIdx++)
+                    {
+                        std::string fileName = BmpFilePath(bmpDir, mat.name(), mat.mipmaps().size(), mmIdx, mipmap.size(), texIdx);
+
+                        pool->submit([&, job, mmIdx, texIdx, fileName = std::move(fileName)]
+                        {
+                            StatPhaseTimer phase("write_bmp");
+                            try {
+                                WriteBmpToFile(fileName, job->material->mipmaps().at(mmIdx).at(texIdx).toBmp());
+                            }
+                            catch(const std::exception& e)
+                            {
+                                std::lock_guard<std::mutex> lock(fileErrorsMutex);
+                                fileErrors.push_back({ fileName, e.what() });
+                            }
+                        });
+                    }
+                }
+
+                /* Export to texture file */
+                if(texExport)
+                {
+                    std::string fileName = texDir + "/" + GetBaseName(mat.name()) + TexFileExtension(texExport->format);
+                    pool->submit([&, job, fileName = std::move(fileName)]
+                    {
+                        StatPhaseTimer phase("write_texfile");
+                        try {
+                            WriteMaterialToTexFile(fileName, *job->material, *texExport);
+                        }
+                        catch(const std::exception& e)
+                        {
+                            std::lock_guard<std::mutex> lock(fileErrorsMutex);
+                            fileErrors.push_back({ fileName, e.what() });
+                        }
+                    });
+                }
+
+                if(verbose) {
+                    std::cout << "  =============== Material Info End =================\n\n\n";
+                }
+
+                nExtracted++;
+                progress.add(1, job->pixelDataSize);
+            }
+        }
+        catch(const std::exception& e) {
+            fail(std::string("An exception was thrown while writing materials: ") + e.what());
+        }
+
+        for(auto& t : stages.threads) {
+            t.join();
+        }
+
+        if(pool) {
+            pool->wait();
+        }
+        progress.finish();
+
+        /* Report failed files in deterministic order */
+        std::sort(fileErrors.begin(), fileErrors.end(), [](const auto& a, const auto& b){ return a.path < b.path; });
+        for(const auto& e : fileErrors) {
+            std::cerr << "CND Error: Failed to write file " << e.path << ": " << e.error << "!\n";
+        }
+
+        if(failed || !fileErrors.empty()) {
+            return false;
+        }
+
+        std::cout << (!verbose ? "\n" : "") << "-----------------------------------------\nTotal materials extracted: " << nExtracted << std::endl << std::endl;
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "CND Error: An exception was thrown while extracting materials: " << e.what() << "!\n";
+        return false;
+    }
+}
+
+bool ExtractMaterials(const std::string& cndFile, std::string outDir, bool convert, bool verbose, bool hugePages, std::size_t queueSize, std::size_t jobs,
+                      const std::optional<TexFileOptions>& texExport, Manifest* manifest)
+{
+    return ExtractMaterialsIf(cndFile, std::move(outDir), convert, verbose, hugePages, queueSize, jobs, texExport, nullptr, manifest);
+}
+
+MaterialExtractState HashMaterials(const std::string& cndFile)
+{
+    InputFileStream ifstream(cndFile);
+    const auto materials = libim::CND::LoadMaterialLocations(ifstream);
+
+    MaterialExtractState state;
+    state.reserve(materials.size());
+
+    ByteArray buffer(64 * 1024);
+    for(const auto& mat : materials)
+    {
+        XXHash64 hash;
+        hash.update(reinterpret_cast<const byte_t*>(&mat.header), sizeof(mat.header));
+
+        ifstream.seek(mat.offset);
+        for(std::size_t nLeft = mat.size; nLeft > 0;)
+        {
+            const std::size_t nChunk = std::min(nLeft, buffer.size());
+            if(ifstream.read(buffer.data(), nChunk) != nChunk) {
+                throw StreamError(std::string("Could not read pixel data of material ") + mat.header.name);
+            }
+
+            hash.update(buffer.data(), nChunk);
+            nLeft -= nChunk;
+        }
+
+        state[mat.header.name] = { mat.header, hash.digest() };
+    }
+
+    return state;
+}
+
+/* Returns paths of all files extracted from material */
+static std::vector<std::string> MaterialOutputFiles(const std::string& outDir, const libim::CND::CndMatHeader& header, bool convert,
+                                                    const std::optional<TexFileOptions>& texExport)
+{
+    std::vector<std::string> files = { outDir + "/mat/" + header.name };
+    for(int mmIdx = 0; convert && mmIdx < header.mipmapCount; mmIdx++)
+    {
+        for(int texIdx = 0; texIdx < header.texturesPerMipmap; texIdx++) {
+            files.push_back(BmpFilePath(outDir + "/bmp", header.name, header.mipmapCount, mmIdx, header.texturesPerMipmap, texIdx));
+        }
+    }
+
+    if(texExport) {
+        files.push_back(outDir + "/" + std::string(TexFileExtension(texExport->format) + 1) + "/" + GetBaseName(header.name) + TexFileExtension(texExport->format));
+    }
+
+    return files;
+}
+
+bool ExtractMaterialChanges(const std::string& cndFile, const std::string& outDir, bool convert, bool verbose, bool hugePages, std::size_t queueSize,
+                            std::size_t jobs, const std::optional<TexFileOptions>& texExport, MaterialExtractState& state,
+                            Manifest* manifest)
+{
+    try
+    {
+        MaterialExtractState newState;
+        {
+            StatPhaseTimer phase("hash_materials");
+            newState = HashMaterials(cndFile);
+        }
+
+        /* Files of changed materials are removed too, changed material can have fewer mipmaps or textures */
+        const std::string cndOutDir = outDir + (outDir.empty() ? "" : "/") + GetBaseName(cndFile);
+        std::size_t nChanged = 0;
+        std::size_t nRemoved = 0;
+        std::vector<std::string> removed;
+        for(const auto& [name, matState] : state)
+        {
+            const auto it = newState.find(name);
+            if(it != newState.end() && it->second.hash == matState.hash) {
+                continue;
+            }
+
+            if(it == newState.end())
+            {
+                std::cout << "Removing material: " << name << std::endl;
+                nRemoved++;
+            }
+
+            for(const auto& file : MaterialOutputFiles(cndOutDir, matState.header, convert, texExport)) {
+                RemoveFile(file);
+            }
+            removed.push_back("mat/" + ManifestEntryName(name));
+        }
+
+        const auto changed = [&](const libim::CND::CndMatHeader& header)
+        {
+            const auto it = state.find(header.name);
+            return it == state.end() || it->second.hash != newState.at(header.name).hash;
+        };
+
+        for(const auto& [name, matState] : newState) {
+            nChanged += changed(matState.header);
+        }
+
+        std::cout << "Changed materials: " << nChanged << ", removed materials: " << nRemoved << std::endl;
+        Manifest changes;
+        changes.algorithm = manifest ? manifest->algorithm : changes.algorithm;
+        if(nChanged > 0 && !ExtractMaterialsIf(cndFile, outDir, convert, verbose, hugePages, queueSize, jobs, texExport, changed,
+                                               manifest ? &changes : nullptr)) {
+            return false;
+        }
+
+        if(manifest) {
+            manifest->update(changes, removed);
+        }
+        state = std::move(newState);
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "CND Error: An exception was thrown while extracting changed materials: " << e.what() << "!\n";
+        return false;
+    }
+}
+
+bool BuildAtlas(const std::string& cndFile, std::string outDir, const AtlasOptions& opt, std::size_t jobs, const std::optional<TexFileOptions>& texExport)
+{
+    try
+    {
+        std::vector<Material> materials;
+        {
+            StatPhaseTimer phase("load_materials");
+            InputFileStream ifstream(cndFile);
+            materials = libim::CND::LoadMaterials(ifstream);
+        }
+
+        if(materials.empty())
+        {
+            std::cout << "CND Info: No materials found in CND file!\n";
+            return true;
+        }
+
+        std::cout << "Found materials: " << materials.size() << std::endl;
+
+        TextureAtlas atlas;
+        {
+            StatPhaseTimer phase("build_atlas");
+            ThreadPool pool(jobs);
+            atlas = BuildTextureAtlas(materials, opt, &pool);
+        }
+
+        outDir += (outDir.empty() ? "" : "/" ) + GetBaseName(cndFile);
+        const std::string atlasDir = outDir + "/" + "atlas";
+        MakePath(atlasDir);
+
+        StatPhaseTimer phase("write_atlas");
+        for(std::size_t pageIdx = 0; pageIdx < atlas.pages.size(); pageIdx++)
+        {
+            const auto& page = atlas.pages[pageIdx];
+            const std::string name = "page_" + std::to_string(pageIdx);
+            std::cout << "Writing atlas page: " << name << " " << page.width() << "x" << page.height() << std::endl;
+
+            if(texExport)
+            {
+                Material mat(name);
+                mat.setSize(page.width(), page.height())
+                   .setColorFormat(page.colorInfo())
+                   .addMipmap(Mipmap{ page });
+                WriteMaterialToTexFile(atlasDir + "/" + name + TexFileExtension(texExport->format), mat, *texExport);
+            }
+            else {
+                WriteBmpToFile(atlasDir + "/" + name + ".bmp", page.toBmp());
+            }
+        }
+
+        const std::string uvFile = atlasDir + "/" + "uv.csv";
+        std::ofstream ofs(uvFile);
+        WriteAtlasUVTable(ofs, atlas, materials);
+        if(!ofs.flush())
+        {
+            std::cerr << "CND Error: Failed to write UV table " << uvFile << "!\n";
+            return false;
+        }
+
+        std::cout << "\n-----------------------------------------\nTotal textures packed: " << atlas.entries.size()
+                  << " into " << atlas.pages.size() << " atlas pages" << std::endl << std::endl;
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "CND Error: An exception was thrown while building atlas: " << e.what() << "!\n";
+        return false;
+    }
+}
+
+/* Loads materials of CND file or MAT files */
+static std::vector<Material> LoadMaterialSource(const std::vector<std::string>& files)
+{
+    std::vector<Material> materials;
+    for(const auto& file : files)
+    {
+        std::string ext = GetFileExtension(file);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if(ext == "cnd")
+        {
+            InputFileStream ifstream(file);
+            auto cndMaterials = libim::CND::LoadMaterials(ifstream);
+            std::move(cndMaterials.begin(), cndMaterials.end(), std::back_inserter(materials));
+        }
+        else
+        {
+            auto mat = LoadMaterialFromFile(file);
+            if(!mat) {
+                throw std::runtime_error("Failed to load material file " + file);
+            }
+            materials.push_back(std::move(*mat));
+        }
+    }
+    return materials;
+}
+
+int CompareCndMaterials(const std::string& cndFile, const std::vector<std::string>& newFiles, const std::string& reportFile, std::size_t jobs)
+{
+    try
+    {
+        std::vector<Material> oldMaterials;
+        std::vector<Material> newMaterials;
+        {
+            StatPhaseTimer phase("load_materials");
+            oldMaterials = LoadMaterialSource({ cndFile });
+            newMaterials = LoadMaterialSource(newFiles);
+        }
+
+        std::vector<MaterialDiff> diffs;
+        {
+            StatPhaseTimer phase("compare_materials");
+            ThreadPool pool(jobs);
+            diffs = CompareMaterials(oldMaterials, newMaterials, CompareKernel::Auto, &pool);
+        }
+
+        std::size_t count[5] = {};
+        for(const auto& d : diffs)
+        {
+            count[std::size_t(d.status)]++;
+            if(d.status == MaterialDiffStatus::Identical) {
+                continue;
+            }
+
+            std::cout << std::left << std::setfill(' ') << std::setw(14) << MaterialDiffStatusName(d.status) << std::setw(40) << d.name;
+            if(d.status == MaterialDiffStatus::Changed)
+            {
+                std::cout << "PSNR: " << std::fixed << std::setprecision(2) << d.metrics.psnr << " dB  SSIM: "
+                          << std::setprecision(5) << d.metrics.ssim << "  Changed textures: " << d.nChangedTextures;
+                std::cout.unsetf(std::ios_base::floatfield);
+            }
+            else if(d.status == MaterialDiffStatus::Incompatible) {
+                std::cout << d.reason;
+            }
+            std::cout << '\n';
+        }
+
+        if(!reportFile.empty())
+        {
+            std::ofstream ofs(reportFile);
+            ofs << "material,status,psnr,ssim,changed_textures,reason\n";
+            for(const auto& d : diffs)
+            {
+                ofs << d.name << ',' << MaterialDiffStatusName(d.status) << ',';
+                if(d.status == MaterialDiffStatus::Identical || d.status == MaterialDiffStatus::Changed) {
+                    ofs << d.metrics.psnr << ',' << d.metrics.ssim;
+                }
+                else {
+                    ofs << ',';
+                }
+                ofs << ',' << d.nChangedTextures << ',' << d.reason << '\n';
+            }
+
+            if(!ofs.flush())
+            {
+                std::cerr << "CND Error: Failed to write compare report " << reportFile << "!\n";
+                return COMPARE_ERROR;
+            }
+        }
+
+        std::cout << "\n-----------------------------------------\nCompared materials: " << diffs.size()
+                  << "\nIdentical: "    << count[std::size_t(MaterialDiffStatus::Identical)]
+                  << "\nChanged: "      << count[std::size_t(MaterialDiffStatus::Changed)]
+                  << "\nAdded: "        << count[std::size_t(MaterialDiffStatus::Added)]
+                  << "\nRemoved: "      << count[std::size_t(MaterialDiffStatus::Removed)]
+                  << "\nIncompatible: " << count[std::size_t(MaterialDiffStatus::Incompatible)] << std::endl << std::endl;
+        return count[std::size_t(MaterialDiffStatus::Identical)] == diffs.size() ? COMPARE_IDENTICAL : COMPARE_DIFFERENT;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "CND Error: An exception was thrown while comparing materials: " << e.what() << "!\n";
+        return COMPARE_ERROR;
+    }
+}
+
+bool ListMaterials(const std::string& cndFile, std::ostream& os, ListFormat format)
+{
+    try
+    {
+        InputFileStream ifstream(cndFile);
+        const auto index = libim::CND::LoadCndIndex(ifstream);
+
+        ListWriter writer(os, format, { "name", "width", "height", "mipmaps", "textures", "format", "bpp", "pixel_offset", "pixel_size" });
+        for(const auto& mat : index.materials)
+        {
+            const auto& header = mat.header;
+            writer.field(std::string_view(header.name, strnlen(header.name, sizeof(header.name))))
+                  .field(header.width)
+                  .field(header.height)
+                  .field(header.mipmapCount)
+                  .field(header.texturesPerMipmap)
+                  .field(ColorFormatName(header.colorInfo))
+                  .field(header.colorInfo.bpp)
+                  .field(mat.offset)
+                  .field(mat.size)
+                  .endRow();
+        }
+
+        if(!writer.finish())
+        {
+            std::cerr << "CND Error: Failed to write material list!\n";
+            return false;
+        }
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "CND Error: An exception was thrown while listing materials: " << e.what() << "!\n";
+        return false;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef CNDEXT_EXTRACT_H
+#define CNDEXT_EXTRACT_H
+#include <cstddef>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libim/cnd.h"
+#include "libim/manifest.h"
+#include "libim/material/atlas.h"
+#include "libim/material/texfile.h"
+#include "cmdutils/listwriter.h"
+
+/* Default number of materials buffered between two extraction stages */
+static constexpr std::size_t DEFAULT_STAGE_QUEUE_SIZE = 8;
+
+/* Extracts materials from CND file to outDir/<cnd name>/mat and converts them to bmp
+   files in outDir/<cnd name>/bmp if convert is set.
+   Extraction runs as a pipeline of stages, each on its own thread: reading the next
+   material, decoding it and writing the previous one overlap.
+   At most queueSize materials wait between two stages, which caps memory use.
+   Textures are converted to bmp in parallel on a pool of jobs threads (0 = one per core).
+   If texExport is set, every material with all its mipmaps is also written to one texture
+   file in outDir/<cnd name>/<dds|ktx2>, on the same pool.
+   Failing bmp and texture files are reported individually and don't stop the extraction.
+   When neither convert, texExport nor verbose is set, textures are not decoded and materials'
+   pixel data is copied from CND file to MAT files as is.
+   If manifest is given, MAT files are hashed while they're written and added to it as mat/<name>. */
+bool ExtractMaterials(const std::string& cndFile, std::string outDir, bool convert, bool verbose = false,
+                      bool hugePages = false, std::size_t queueSize = DEFAULT_STAGE_QUEUE_SIZE, std::size_t jobs = 0,
+                      const std::optional<TexFileOptions>& texExport = std::nullopt, Manifest* manifest = nullptr);
+
+/* Header and content hash of extracted materials by material name */
+struct MaterialState
+{
+    libim::CND::CndMatHeader header;
+    uint64_t hash = 0; // XXH64 of header and pixel data
+};
+
+using MaterialExtractState = std::unordered_map<std::string, MaterialState>;
+
+/* Reads and hashes every material of CND file. Throws StreamError on error. */
+MaterialExtractState HashMaterials(const std::string& cndFile);
+
+/* Same as ExtractMaterials but extracts only materials which were added or changed since state,
+   and deletes extracted files of materials which are no longer in CND file.
+   On success state is set to CND file's state. If manifest is given, extracted MAT files are hashed
+   while they're written and merged into it, and entries of deleted files are dropped from it. */
+bool ExtractMaterialChanges(const std::string& cndFile, const std::string& outDir, bool convert, bool verbose, bool hugePages, std::size_t queueSize,
+                            std::size_t jobs, const std::optional<TexFileOptions>& texExport, MaterialExtractState& state,
+                            Manifest* manifest = nullptr);
+
+/* Packs textures of all materials in CND file into atlas pages written to outDir/<cnd name>/atlas
+   as bmp files, or as texture files if texExport is set, and writes UV remap table atlas/uv.csv.
+   Textures are copied to pages on a pool of jobs threads (0 = one per core). */
+bool BuildAtlas(const std::string& cndFile, std::string outDir, const AtlasOptions& opt, std::size_t jobs = 0,
+                const std::optional<TexFileOptions>& texExport = std::nullopt);
+
+/* Compares materials of CND or MAT file cndFile to materials of CND or MAT files newFiles by name,
+   prints changed, added, removed and incompatible materials and writes CSV report of all
+   materials to reportFile if not empty. Materials are compared on a pool of jobs threads (0 = one per core).
+   Returns COMPARE_IDENTICAL if all materials are identical, COMPARE_DIFFERENT if any material
+   is not identical and COMPARE_ERROR on error. */
+constexpr int COMPARE_IDENTICAL = 0;
+constexpr int COMPARE_ERROR     = 1;
+constexpr int COMPARE_DIFFERENT = 2;
+int CompareCndMaterials(const std::string& cndFile, const std::vector<std::string>& newFiles, const std::string& reportFile = "",
+                         std::size_t jobs = 0);
+
+/* Writes name, size, mipmap count, textures per mipmap, color format, and offset and size
+   of pixel data of each material in CND file to os in format. Returns false on error. */
+bool ListMaterials(const std::string& cndFile, std::ostream& os, ListFormat format);
+
+#endif // CNDEXT_EXTRACT_H
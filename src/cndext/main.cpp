@@ -1,32 +1,65 @@
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <optional>
 
+#include "extract.h"
 #include "libim/common.h"
 #include "libim/material/bmp.h"
 #include "libim/material/mat.h"
+#include "libim/material/quantize.h"
+#include "libim/material/texfile.h"
 #include "libim/cnd.h"
+#include "libim/cnd_delta.h"
+#include "libim/io/filewatcher.h"
+#include "libim/utils/thread_pool.h"
 #include "cmdutils/options.h"
+#include "cmdutils/stats.h"
+#include "cmdutils/manifest.h"
+#include "cmdutils/progress.h"
+#include "cmdutils/listwriter.h"
+#include "cmdutils/writepolicy.h"
 
 #define SETW(n, f)  std::right << std::setfill(f) << std::setw(n)
-#define SET_VINFO_LW(n) SETW(32 + n, '.')
 
 #define OPT_OTPUT_DIR         "--output-dir"
 #define OPT_OTPUT_DIR_SHORT   "-o"
 #define OPT_MAT_PATCH         "--mat-patch"
 #define OPT_MAT_PATCH_SHORT   "-mp"
+#define OPT_BMP_PATCH         "--bmp-patch"
+#define OPT_DITHER            "--dither"
+#define OPT_DELTA             "--delta"
+#define OPT_APPLY_DELTA       "--apply-delta"
+#define OPT_ATLAS             "--atlas"
+#define OPT_ATLAS_PADDING     "--atlas-padding"
+#define OPT_ATLAS_MIPMAPS     "--atlas-mipmaps"
+#define OPT_COMPARE           "--compare"
+#define OPT_COMPARE_REPORT    "--compare-report"
 #define OPT_CONVERT_MAT       "--bmp"
 #define OPT_CONVERT_MAT_SHORT "-b"
+#define OPT_EXPORT            "--export"
+#define OPT_EXPORT_ENCODING   "--export-encoding"
+#define OPT_HUGE_PAGES        "--huge-pages"
+#define OPT_QUEUE_SIZE        "--queue-size"
+#define OPT_JOBS              "--jobs"
+#define OPT_JOBS_SHORT        "-j"
+#define OPT_WATCH             "--watch"
+#define OPT_LIST              "--list"
 #define OPT_VERBOSE           "--verbose"
 #define OPT_VERBOSE_SHORT     "-v"
 #define OPT_HELP              "--help"
 #define OPT_HELP_SHORT        "-h"
 
 void print_help();
-void PrintMaterialInfo(const Material& mat);
-void PrintMipmapInfo(const Mipmap& mipmap, uint32_t mmIdx);
-
 bool ReplaceMaterial(const std::string& cndFile, std::vector<std::string> matFiles);
-bool ExtractMaterials(const std::string& cndFile, std::string outDir, bool convert, bool verbose = false);
+bool MakeDelta(const std::string& oldCndFile, const std::string& newCndFile, const std::string& patchFile);
+bool ApplyDelta(const std::string& cndFile, const std::string& patchFile, const std::string& outFile);
+bool ReplaceMaterialFromBmp(const std::string& cndFile, const std::vector<std::string>& bmpFiles, const QuantizeOptions& opt, std::size_t jobs);
+bool WatchCndFile(const std::string& cndFile, const std::string& outDir, bool convert, bool verbose, bool hugePages, std::size_t queueSize,
+                  std::size_t jobs, const std::optional<TexFileOptions>& texExport, std::optional<Manifest>& manifest,
+                  const std::string& manifestFile);
 
 int main(int argc, const char *argv[])
 {
@@ -64,16 +97,53 @@ int main(int argc, const char *argv[])
         bVerboseOutput = true;
     }
 
+    std::size_t jobs = 0;
+    if(opt.hasOpt(OPT_JOBS_SHORT)) {
+        jobs = std::strtoul(opt.arg(OPT_JOBS_SHORT).c_str(), nullptr, 10);
+    }
+    else if(opt.hasOpt(OPT_JOBS)) {
+        jobs = std::strtoul(opt.arg(OPT_JOBS).c_str(), nullptr, 10);
+    }
+
     bool bConvertMatToBmp = false;
     if(opt.hasOpt(OPT_CONVERT_MAT) || opt.hasOpt(OPT_CONVERT_MAT_SHORT)){
         bConvertMatToBmp = true;
     }
 
+    ListFormat listFormat;
+    if(!GetListFormatOption(opt, listFormat)) {
+        return 1;
+    }
+
+    /* Manifest of extracted MAT files, hashed while they're written */
+    std::optional<Manifest> manifest;
+    if(opt.hasOpt(OPT_MANIFEST))
+    {
+        manifest.emplace();
+        if(!GetHashAlgorithmOption(opt, manifest->algorithm)) {
+            return 1;
+        }
+    }
+
+    if(!ApplyWritePolicyOptions(opt)) {
+        return 1;
+    }
+
+    ApplyProgressOptions(opt);
 
     int result = 0;
+    std::function<bool()> watch; // Runs after extraction with --watch
 
+    /* List */
+    if(opt.hasOpt(OPT_LIST))
+    {
+        StatPhaseTimer phase("list");
+        if(!ListMaterials(inputFile, std::cout, listFormat)) {
+            result = 1;
+        }
+    }
     /* Patch */
-    if(opt.hasOpt(OPT_MAT_PATCH) || opt.hasOpt(OPT_MAT_PATCH_SHORT))
+    else if(opt.hasOpt(OPT_MAT_PATCH) || opt.hasOpt(OPT_MAT_PATCH_SHORT))
     {
         auto matFiles  = opt.args(OPT_MAT_PATCH);
         auto matFiles2 = opt.args(OPT_MAT_PATCH_SHORT);
@@ -85,14 +155,184 @@ int main(int argc, const char *argv[])
             result = 1;
         }
     }
-    /* Extract materials */
-    else if(!ExtractMaterials(inputFile, std::move(outDir), bConvertMatToBmp, bVerboseOutput)) {
+    else if(opt.hasOpt(OPT_BMP_PATCH))
+    {
+        QuantizeOptions quantizeOpt;
+        if(opt.hasOpt(OPT_DITHER) && !ParseDitherMethod(opt.arg(OPT_DITHER), quantizeOpt.method))
+        {
+            std::cerr << "Error: unknown dither method: " << opt.arg(OPT_DITHER) << "!\n";
+            return 1;
+        }
+
+        if(!ReplaceMaterialFromBmp(inputFile, opt.args(OPT_BMP_PATCH), quantizeOpt, jobs)) {
+            result = 1;
+        }
+    }
+    /* Delta patch */
+    else if(opt.hasOpt(OPT_DELTA))
+    {
+        const auto args = opt.args(OPT_DELTA);
+        if(args.size() != 2)
+        {
+            print_help();
+            return 1;
+        }
+
+        if(!MakeDelta(inputFile, args.at(0), args.at(1))) {
+            result = 1;
+        }
+    }
+    else if(opt.hasOpt(OPT_APPLY_DELTA))
+    {
+        const auto args = opt.args(OPT_APPLY_DELTA);
+        if(args.empty() || args.size() > 2)
+        {
+            print_help();
+            return 1;
+        }
+
+        if(!ApplyDelta(inputFile, args.at(0), args.size() > 1 ? args.at(1) : inputFile)) {
+            result = 1;
+        }
+    }
+    /* Compare */
+    else if(opt.hasOpt(OPT_COMPARE))
+    {
+        const auto newFiles = opt.args(OPT_COMPARE);
+        if(newFiles.empty())
+        {
+            print_help();
+            return 1;
+        }
+
+        result = CompareCndMaterials(inputFile, newFiles, opt.arg(OPT_COMPARE_REPORT), jobs);
+    }
+    /* Extract materials or build atlas */
+    else
+    {
+        std::size_t queueSize = DEFAULT_STAGE_QUEUE_SIZE;
+        if(opt.hasOpt(OPT_QUEUE_SIZE)) {
+            queueSize = std::strtoul(opt.arg(OPT_QUEUE_SIZE).c_str(), nullptr, 10);
+        }
+
+        if(queueSize == 0)
+        {
+            std::cerr << "Error: invalid queue size: " << opt.arg(OPT_QUEUE_SIZE) << "!\n";
+            return 1;
+        }
+
+        std::optional<TexFileOptions> texExport;
+        if(opt.hasOpt(OPT_EXPORT))
+        {
+            texExport.emplace();
+            if(!ParseTexFileFormat(opt.arg(OPT_EXPORT), texExport->format))
+            {
+                std::cerr << "Error: unknown export format: " << opt.arg(OPT_EXPORT) << "!\n";
+                return 1;
+            }
+
+            if(opt.hasOpt(OPT_EXPORT_ENCODING) && !ParseTexFileEncoding(opt.arg(OPT_EXPORT_ENCODING), texExport->encoding))
+            {
+                std::cerr << "Error: unknown export encoding: " << opt.arg(OPT_EXPORT_ENCODING) << "!\n";
+                return 1;
+            }
+        }
+
+        if(opt.hasOpt(OPT_ATLAS))
+        {
+            AtlasOptions atlasOpt;
+            atlasOpt.includeMipmaps = opt.hasOpt(OPT_ATLAS_MIPMAPS);
+            if(!opt.arg(OPT_ATLAS).empty()) {
+                atlasOpt.maxSize = std::strtoul(opt.arg(OPT_ATLAS).c_str(), nullptr, 10);
+            }
+
+            if(atlasOpt.maxSize == 0 || (atlasOpt.maxSize & (atlasOpt.maxSize - 1)) != 0)
+            {
+                std::cerr << "Error: atlas size must be a power of two: " << opt.arg(OPT_ATLAS) << "!\n";
+                return 1;
+            }
+
+            if(opt.hasOpt(OPT_ATLAS_PADDING)) {
+                atlasOpt.padding = std::strtoul(opt.arg(OPT_ATLAS_PADDING).c_str(), nullptr, 10);
+            }
+
+            if(!BuildAtlas(inputFile, std::move(outDir), atlasOpt, jobs, texExport)) {
+                result = 1;
+            }
+        }
+        else if(!ExtractMaterials(inputFile, outDir, bConvertMatToBmp, bVerboseOutput, opt.hasOpt(OPT_HUGE_PAGES), queueSize, jobs, texExport,
+                                  manifest ? &*manifest : nullptr) ||
+                (manifest && !WriteManifestFile(opt.arg(OPT_MANIFEST), *manifest))) {
+            result = 1;
+        }
+        else if(opt.hasOpt(OPT_WATCH))
+        {
+            watch = [=, hugePages = opt.hasOpt(OPT_HUGE_PAGES), manifestFile = opt.arg(OPT_MANIFEST)]() mutable {
+                return WatchCndFile(inputFile, outDir, bConvertMatToBmp, bVerboseOutput, hugePages, queueSize, jobs, texExport,
+                                    manifest, manifestFile);
+            };
+        }
+    }
+
+    if(!FinishDeferredWrites()) {
+        result = 1;
+    }
+
+    if(!WriteStatsOutput(opt)) {
+        result = 1;
+    }
+
+    if(!opt.hasOpt(OPT_LIST)) {
+        WriteProgressSummary();
+    }
+
+    if(result == 0 && watch && !watch()) {
         result = 1;
     }
 
     return result;
 }
 
+/* Re-extracts changed materials every time CND file changes.
+   If manifest is given, changed materials are merged into it and it's rewritten to manifestFile
+   after every extraction. Returns only on error. */
+bool WatchCndFile(const std::string& cndFile, const std::string& outDir, bool convert, bool verbose, bool hugePages, std::size_t queueSize,
+                  std::size_t jobs, const std::optional<TexFileOptions>& texExport, std::optional<Manifest>& manifest,
+                  const std::string& manifestFile)
+{
+    try
+    {
+        /* Watch is set before hashing, so changes made meanwhile aren't missed */
+        FileWatcher watcher({ cndFile });
+        MaterialExtractState state = HashMaterials(cndFile);
+
+        for(;;)
+        {
+            std::cout << "Watching " << cndFile << " for changes...\n";
+            watcher.wait();
+            if(!FileExists(cndFile)) {
+                continue;
+            }
+
+            std::cout << "\nCND file changed, extracting changes\n";
+            Manifest* pManifest = manifest ? &*manifest : nullptr;
+            if(!ExtractMaterialChanges(cndFile, outDir, convert, verbose, hugePages, queueSize, jobs, texExport, state, pManifest)) {
+                std::cerr << "CND Error: Failed to extract changes, waiting for next change!\n";
+            }
+            else if(manifest && !WriteManifestFile(manifestFile, *manifest)) {
+                std::cerr << "CND Error: Failed to update manifest, waiting for next change!\n";
+            }
+
+            FinishDeferredWrites();
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "CND Error: " << e.what() << "!\n";
+        return false;
+    }
+}
+
 void print_help()
 {
     std::cout << "\nIndiana Jones and The Infernal Machine CND file extractor\n";
@@ -100,65 +340,36 @@ void print_help()
     std::cout << "  Usage: cndext <cnd file> [options] ..." << std::endl << std::endl;
 
     std::cout << "Option        Long option        Meaning\n";
+    std::cout << SETW(27, ' ')         << OPT_APPLY_DELTA                  << SETW(71, ' ') << "Apply <patch file> to cnd file and write it to [output cnd file]\n";
+    std::cout << SETW(21, ' ')         << OPT_ATLAS                        << SETW(89, ' ') << "Pack textures into atlas pages of max size [default 2048] and write UV table\n";
+    std::cout << SETW(29, ' ')         << OPT_ATLAS_MIPMAPS                << SETW(36, ' ') << "Also pack mip levels into atlas\n";
+    std::cout << SETW(29, ' ')         << OPT_ATLAS_PADDING                << SETW(52, ' ') << "Pad atlas textures with edge pixels [default 2]\n";
     std::cout << OPT_CONVERT_MAT_SHORT << SETW(17, ' ') << OPT_CONVERT_MAT << SETW(49, ' ') << "Convert extracted materials to bmp\n";
+    std::cout << SETW(25, ' ')         << OPT_BMP_PATCH                    << SETW(85, ' ') << "Replace materials in cnd file with <bmp files>, quantized to material format\n";
+    std::cout << SETW(23, ' ')         << OPT_COMPARE                      << SETW(95, ' ') << "Compare materials to <cnd file> or <mat files> by name, exit status 2 if any differs\n";
+    std::cout << SETW(30, ' ')         << OPT_COMPARE_REPORT               << SETW(52, ' ') << "Write CSV report of compared materials to <file>\n";
+    std::cout << SETW(22, ' ')         << OPT_DITHER                       << SETW(83, ' ') << "Dithering of --bmp-patch: none, ordered or diffusion [default: ordered]\n";
+    std::cout << SETW(21, ' ')         << OPT_DELTA                        << SETW(78, ' ') << "Write delta patch from cnd file to <new cnd file> to <patch file>\n";
+    std::cout << SETW(26, ' ')         << OPT_DURABILITY                   << SETW(59, ' ') << "When to sync written files: none, per-file or batch\n";
+    std::cout << SETW(22, ' ')         << OPT_EXPORT                       << SETW(82, ' ') << "Export each material with all mipmaps to one texture file: dds or ktx2\n";
+    std::cout << SETW(31, ' ')         << OPT_EXPORT_ENCODING              << SETW(80, ' ') << "Pixel encoding of exported files: native, rgba8, bc1 or bc3 [default: native]\n";
+    std::cout << SETW(22, ' ')         << OPT_FORMAT                       << SETW(55, ' ') << "Format of --list: text, json, csv or ndjson\n";
     std::cout << OPT_HELP_SHORT        << SETW(18, ' ') << OPT_HELP        << SETW(31, ' ') << "Show this message\n";
+    std::cout << SETW(26, ' ')         << OPT_HUGE_PAGES                   << SETW(65, ' ') << "Use transparent huge pages for loaded material pixel data\n";
+    std::cout << SETW(20, ' ')         << OPT_HASH                         << SETW(77, ' ') << "Hash algorithm of --manifest: crc32c or xxh64 [default: crc32c]\n";
+    std::cout << SETW(20, ' ')         << OPT_LIST                         << SETW(77, ' ') << "List materials with size, mipmaps, format and pixel data offset\n";
+    std::cout << SETW(24, ' ')         << OPT_MANIFEST                     << SETW(75, ' ') << "Write manifest of extracted MAT files' sizes and hashes to <file>\n";
+    std::cout << OPT_JOBS_SHORT        << SETW(18, ' ') << OPT_JOBS        << SETW(66, ' ') << "Number of conversion threads [default: one per core]\n";
     std::cout << OPT_MAT_PATCH_SHORT   << SETW(22, ' ') << OPT_MAT_PATCH   << SETW(95, ' ') << "Replace materials in cnd file <material files>. No material is extracted from CND file\n";
+    std::cout << SETW(27, ' ')         << OPT_NO_PROGRESS                  << SETW(28, ' ') << "Don't report progress\n";
+    std::cout << SETW(27, ' ')         << OPT_PREALLOCATE                  << SETW(48, ' ') << "Preallocate disk space of extracted files\n";
+    std::cout << SETW(24, ' ')         << OPT_PROGRESS                     << SETW(89, ' ') << "Report progress to stderr even if it isn't terminal [default: only to terminal]\n";
+    std::cout << SETW(26, ' ')         << OPT_QUEUE_SIZE                   << SETW(68, ' ') << "Max materials buffered between extraction stages [default 8]\n";
     std::cout << OPT_OTPUT_DIR_SHORT   << SETW(24, ' ') << OPT_OTPUT_DIR   << SETW(34, ' ') << "Output folder <output dir>\n";
+    std::cout << SETW(21, ' ')         << OPT_STATS                        << SETW(43, ' ') << "Print I/O and parse statistics\n";
+    std::cout << SETW(26, ' ')         << OPT_STATS_JSON                   << SETW(44, ' ') << "Write statistics as JSON [to <file>]\n";
     std::cout << OPT_VERBOSE_SHORT     << SETW(21, ' ') << OPT_VERBOSE     << SETW(25, ' ') << "Verbose output\n";
-}
-
-void PrintMaterialInfo(const Material& mat)
-{
-    if(mat.mipmaps().empty()) return;
-    std::cout << "    Total mipmaps:" << SET_VINFO_LW(2) << mat.mipmaps().size() << std::endl << std::endl;
-}
-
-void PrintMipmapInfo(const Mipmap& mipmap, uint32_t mmIdx)
-{
-    if(mipmap.empty()) return;
-    const Texture& tex = mipmap.at(0);
-
-    std::string colorMode;
-    switch (tex.colorInfo().colorMode)
-    {
-    case 1:
-        colorMode = "RGB_565";
-        break;
-    case 2:
-        colorMode = "RGB_4444";
-        break;
-    default:
-        colorMode = "Unknown";
-        break;
-    }
-
-    std::cout << "    ------------------ Mipmap Info -----------------\n";
-    std::cout << "    MIP num:" << SET_VINFO_LW(8)  << mmIdx << std::endl;
-    std::cout << "    Width:"   << SET_VINFO_LW(10) << tex.width() << std::endl;
-    std::cout << "    Height:"  << SET_VINFO_LW(9)  << tex.height() << std::endl;
-    std::cout << "    Mipmap textures:" << SET_VINFO_LW(0) << mipmap.size() << std::endl;
-    std::cout << "    Pixel data size:" << SET_VINFO_LW(0) << GetMipmapPixelDataSize(mipmap.size(), tex.width(), tex.height(), tex.colorInfo().bpp) << std::endl;
-    std::cout << "    Color info:\n";
-
-    auto cmLw = colorMode.size() /2;
-    cmLw = (colorMode.size()  % 8 == 0 ? cmLw -1 : cmLw);
-    std::cout << "      Color mode:" << SET_VINFO_LW(cmLw) << colorMode << std::endl;
-    std::cout << "      Bit depth:"  << SET_VINFO_LW(4) << tex.colorInfo().bpp << std::endl;
-    std::cout << "      Bit depth per channel:" << std::endl;
-    std::cout << "        Red:"   << SET_VINFO_LW(8) << tex.colorInfo().redBPP   << std::endl;
-    std::cout << "        Green:" << SET_VINFO_LW(6) << tex.colorInfo().greenBPP << std::endl;
-    std::cout << "        Blue:"  << SET_VINFO_LW(7) << tex.colorInfo().blueBPP  << std::endl;
-    std::cout << "        Alpha:" << SET_VINFO_LW(6) << tex.colorInfo().alphaBPP << std::endl;
-    std::cout << "      Left shift per channel:" << std::endl;
-    std::cout << "        Red:"   << SET_VINFO_LW(8) << tex.colorInfo().RedShl   << std::endl;
-    std::cout << "        Green:" << SET_VINFO_LW(6) << tex.colorInfo().GreenShl << std::endl;
-    std::cout << "        Blue:"  << SET_VINFO_LW(7) << tex.colorInfo().BlueShl  << std::endl;
-    std::cout << "        Alpha:" << SET_VINFO_LW(6) << tex.colorInfo().AlphaShl << std::endl;
-    std::cout << "      Right shift per channel:" << std::endl;
-    std::cout << "        Red:"   << SET_VINFO_LW(8) << tex.colorInfo().RedShr   << std::endl;
-    std::cout << "        Green:" << SET_VINFO_LW(6) << tex.colorInfo().GreenShr << std::endl;
-    std::cout << "        Blue:"  << SET_VINFO_LW(7) << tex.colorInfo().BlueShr  << std::endl;
-    std::cout << "        Alpha:" << SET_VINFO_LW(6) << tex.colorInfo().AlphaShr << std::endl << std::endl;
+    std::cout << SETW(21, ' ')         << OPT_WATCH                        << SETW(67, ' ') << "Re-extract changed materials whenever cnd file changes\n";
 }
 
 bool ReplaceMaterial(const std::string& cndFile, std::vector<std::string> matFiles)
@@ -166,14 +377,25 @@ bool ReplaceMaterial(const std::string& cndFile, std::vector<std::string> matFil
     bool bSuccess = false;
     if(!matFiles.empty())
     {
+         ProgressReporter progress("Patching", matFiles.size(), 0);
          for(const auto& matFile : matFiles)
          {
-            auto mat = LoadMaterialFromFile(matFile);
+            std::shared_ptr<Material> mat;
+            {
+                StatPhaseTimer phase("load_mat");
+                mat = LoadMaterialFromFile(matFile);
+            }
+
+            StatPhaseTimer phase("replace_material");
             if(!mat || !libim::CND::ReplaceMaterial(*mat, cndFile)) {
                 return false;
             }
+
+            progress.add(1, 0);
          }
 
+         progress.finish();
+
          std::cout << "CND file has been successfully patched!\n";
          bSuccess = true;
     }
@@ -184,78 +406,146 @@ bool ReplaceMaterial(const std::string& cndFile, std::vector<std::string> matFil
     return bSuccess;
 }
 
-bool ExtractMaterials(const std::string& cndFile, std::string outDir, bool convert, bool verbose)
+bool ReplaceMaterialFromBmp(const std::string& cndFile, const std::vector<std::string>& bmpFiles, const QuantizeOptions& opt, std::size_t jobs)
 {
-    InputFileStream ifstream(cndFile);
-    auto materials = libim::CND::LoadMaterials(ifstream);
-
-    std::string matDir;
-    std::string bmpDir;
-    if(!materials.empty())
+    if(bmpFiles.empty())
     {
-        std::cout << "Found materials: " << materials.size()<< std::endl;
+        print_help();
+        return false;
+    }
 
-        outDir += (outDir.empty() ? "" : "/" ) + GetBaseName(cndFile);
-        matDir = outDir + "/" + "mat";
-        MakePath(matDir);
+    try
+    {
+        std::vector<libim::CND::CndMaterialLocation> locations;
+        {
+            InputFileStream ifstream(cndFile);
+            locations = libim::CND::LoadMaterialLocations(ifstream);
+        }
 
-        if(convert)
+        ThreadPool pool(jobs);
+        ProgressReporter progress("Patching", bmpFiles.size(), 0);
+        for(const auto& bmpFile : bmpFiles)
         {
-            bmpDir = outDir + "/" + "bmp";
-            MakePath(bmpDir);
+            /* Patched material keeps color format and mipmap count of material it replaces */
+            const std::string matName = GetBaseName(bmpFile) + ".mat";
+            auto it = std::find_if(locations.begin(), locations.end(), [&](const auto& l) {
+                return matName == l.header.name;
+            });
+
+            if(it == locations.end())
+            {
+                std::cerr << "CND Error: Material " << matName << " not found in CND file!\n";
+                return false;
+            }
+
+            /* Image replaces one mipmap, other mipmaps (animation cels) would be lost */
+            if(it->header.mipmapCount > 1)
+            {
+                std::cerr << "CND Error: Material " << matName << " has " << it->header.mipmapCount
+                          << " mipmaps, only materials with one mipmap can be replaced with bmp file!\n";
+                return false;
+            }
+
+            RGBAImage image;
+            {
+                StatPhaseTimer phase("load_bmp");
+                const auto bmp = LoadBmpFromFile(bmpFile);
+                image.width  = uint32_t(bmp.info.width);
+                image.height = uint32_t(-bmp.info.height);
+                image.data   = BmpToRGBA8(bmp);
+            }
+
+            Material mat;
+            {
+                StatPhaseTimer phase("quantize");
+                mat = QuantizeMaterial(matName, { image }, it->header.colorInfo, uint32_t(it->header.texturesPerMipmap), opt, &pool);
+            }
+
+            StatPhaseTimer phase("replace_material");
+            if(!libim::CND::ReplaceMaterial(mat, cndFile)) {
+                return false;
+            }
+
+            progress.add(1, 0);
         }
     }
-
-    /* Save extracted materials to files */
-    for(const auto& mat : materials)
+    catch(const std::exception& e)
     {
-        std::cout << "Extracting material: " << mat.name() << std::endl;
+        std::cerr << "CND Error: " << e.what() << std::endl;
+        return false;
+    }
 
-        std::string matFilePath(matDir + "/" + mat.name());
-        if(!SaveMaterialToFile(std::move(matFilePath), mat)) {
-            return false;
-        }
+    std::cout << "CND file has been successfully patched!\n";
+    return true;
+}
 
-        if(verbose)
+bool MakeDelta(const std::string& oldCndFile, const std::string& newCndFile, const std::string& patchFile)
+{
+    try
+    {
+        InputFileStream oldCnd(oldCndFile);
+        InputFileStream newCnd(newCndFile);
+
+        /* Output file stream doesn't truncate existing file */
+        RemoveFile(patchFile);
+        OutputFileStream patch(patchFile);
+
+        StatPhaseTimer phase("write_delta");
+        const auto stats = libim::CND::WriteCndDelta(oldCnd, newCnd, patch);
+        const auto patchSize = patch.size();
+        patch.close();
+
+        std::cout << "Delta patch has been written: " << patchFile << "\n"
+                  << "Copied bytes: "   << stats.copiedBytes   << " in " << stats.nCopyOps   << " ops\n"
+                  << "Inserted bytes: " << stats.insertedBytes << " in " << stats.nInsertOps << " ops\n"
+                  << "Patch size: "     << patchSize << std::endl;
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        RemoveFile(patchFile);
+        std::cerr << "CND Error: An exception was thrown while writing delta patch: " << e.what() << "!\n";
+        return false;
+    }
+}
+
+bool ApplyDelta(const std::string& cndFile, const std::string& patchFile, const std::string& outFile)
+{
+    /* Patched file is written next to output file and renamed after it's verified,
+       so cnd file can be patched in place */
+    const std::string tmpFile = outFile + ".patched";
+    try
+    {
+        libim::CND::CndDeltaHeader header;
         {
-            std::cout << "  ================== Material Info ===================\n";
-            PrintMaterialInfo(mat);
+            StatPhaseTimer phase("apply_delta");
+            InputFileStream oldCnd(cndFile);
+            InputFileStream patch(patchFile);
+            RemoveFile(tmpFile);
+            OutputFileStream newCnd(tmpFile);
+            header = libim::CND::ApplyCndDelta(oldCnd, patch, newCnd);
+            newCnd.close();
         }
 
-        /* Print material mipmaps info and convert to bmp */
-        if(convert || verbose)
         {
-            uint32_t mmIdx = 0;
-            for(const auto& mipmap : mat.mipmaps())
-            {
-                if(verbose) {
-                    PrintMipmapInfo(mipmap, mmIdx);
-                }
-
-                /* Save as bmp */
-                if(convert)
-                {
-                    for(std::size_t texIdx = 0; texIdx < mipmap.size(); texIdx++)
-                    {
-                        const std::string sufix = (mat.mipmaps().size() > 1 ? "_" + std::to_string(mmIdx) : "") + ".bmp";
-                        const std::string infix = mipmap.size() > 1 ? "_" + std::to_string(texIdx) : "";
-                        const std::string fileName = bmpDir + "/" + GetBaseName(mat.name()) + infix + sufix;
-
-                        if(!SaveBmpToFile(fileName, mipmap.at(texIdx).toBmp())) {
-                            return false;
-                        }
-                    }
-                }
-
-                mmIdx++;
+            StatPhaseTimer phase("verify_delta");
+            InputFileStream newCnd(tmpFile);
+            if(newCnd.size() != header.newSize || libim::CND::HashStream(newCnd) != header.newHash) {
+                throw StreamError("Patched file doesn't match delta patch");
             }
         }
 
-        if(verbose) {
-            std::cout << "  =============== Material Info End =================\n\n\n";
+        if(!RenameFile(tmpFile, outFile)) {
+            throw StreamError("Failed to rename " + tmpFile + " to " + outFile);
         }
-    }
 
-    std::cout << (!verbose ? "\n" : "") << "-----------------------------------------\nTotal materials extracted: " << materials.size() << std::endl << std::endl;
-    return true;
+        std::cout << "CND file has been successfully patched!\n";
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        RemoveFile(tmpFile);
+        std::cerr << "CND Error: An exception was thrown while applying delta patch: " << e.what() << "!\n";
+        return false;
+    }
 }
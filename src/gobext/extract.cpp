@@ -0,0 +1,510 @@
+#include "extract.h"
+#include "libim/common.h"
+#include "libim/io/filestream.h"
+#include "libim/io/outputtree.h"
+#include "libim/progress.h"
+#include "libim/stats.h"
+#include "libim/utils/xxhash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#ifndef OS_WINDOWS
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#define SETW(n, f)  std::right << std::setfill(f) << std::setw(n)
+#define SET_FINFO_LW(n) SETW(10 + n, '.')
+
+namespace {
+    uint64_t TotalEntrySize(const GobFileDirectory& gobDir)
+    {
+        uint64_t size = 0;
+        for(const auto& entry : gobDir.entries) {
+            size += entry.size;
+        }
+        return size;
+    }
+}
+
+bool ExtractGob(std::shared_ptr<const GobFileDirectory> gobDir, std::string outDir, const bool verbose, Manifest* manifest)
+{
+    try
+    {
+        OutputTree outTree(std::move(outDir));
+        ProgressReporter progress("Extracting", gobDir->entries.size(), TotalEntrySize(*gobDir));
+        const bool printEntries = verbose || !progress.active();
+
+        /* Save entries to files */
+        for(const auto& entry : gobDir->entries)
+        {
+            if(printEntries) {
+                std::cout << "Extracting file: " << entry.name << '\n';
+            }
+
+            if(verbose)
+            {
+                std::string strSize = std::to_string(entry.size);
+                std::cout << "  offset in gob:"  << SET_FINFO_LW((14 - (strSize.size() + 6)) + 11) << std::hex << std::showbase << entry.offset << std::endl;
+                std::cout << "  file size:"      << SET_FINFO_LW(14) << std::dec << strSize<< " bytes\n";
+            }
+
+            /* Seek to entry offset */
+            gobDir->stream->seek(entry.offset);
+
+            /* Make entry file and its directory */
+            OutputFileStream ofs = outTree.createFile(entry.name);
+            ofs.preallocate(entry.size);
+
+            /* Write entry to file */
+            ByteArray buffer(4096);
+            std::size_t offEntryEnd = entry.offset + entry.size;
+            std::size_t nWritten = 0;
+            std::optional<Hasher> hasher;
+            if(manifest) {
+                hasher.emplace(manifest->algorithm);
+            }
+
+            while(gobDir->stream->tell() < offEntryEnd && !gobDir->stream->eos())
+            {
+                if(gobDir->stream->tell() + buffer.size() >= offEntryEnd) {
+                    buffer.resize(offEntryEnd - gobDir->stream->tell());
+                }
+
+                if(gobDir->stream->read(reinterpret_cast<byte_t*>(buffer.data()), buffer.size()) != buffer.size())
+                {
+                    std::cerr << "Error reading GOB entry into buffer!\n";
+                    return false;
+                }
+
+                ofs.write(buffer);
+                nWritten += buffer.size();
+                if(hasher) {
+                    hasher->update(buffer.data(), buffer.size());
+                }
+            }
+
+            if(verbose) {
+                std::cout << "  bytes written to disk:" << SET_FINFO_LW(2) << std::dec << nWritten << " bytes\n\n";
+            }
+
+            if(nWritten < entry.size) {
+                std::cerr << "  Warning: not all bytes were written to disk!\n\n";
+            } else if(nWritten > entry.size) {
+                std::cerr << "  Warning: too many bytes were written to disk!\n\n";
+            }
+
+            if(manifest) {
+                manifest->add(ManifestEntryName(entry.name), nWritten, hasher->digest());
+            }
+
+            progress.add(1, nWritten);
+        }
+
+        progress.finish();
+        std::cout << (!verbose ? "\n" : "") << "--------------------------\nTotal files extracted: " << gobDir->entries.size() << std::endl << std::endl;
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "An exception was thrown while extracting GOB dir: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+GobExtractState HashGobEntries(const GobFileDirectory& gobDir)
+{
+    GobExtractState state;
+    state.reserve(gobDir.entries.size());
+
+    ByteArray buffer(64 * 1024);
+    for(const auto& entry : gobDir.entries)
+    {
+        gobDir.stream->seek(entry.offset);
+
+        XXHash64 hash;
+        for(std::size_t nLeft = entry.size; nLeft > 0;)
+        {
+            const std::size_t nChunk = std::min(nLeft, buffer.size());
+            if(gobDir.stream->read(buffer.data(), nChunk) != nChunk) {
+                throw StreamError(std::string("Could not read GOB entry ") + entry.name);
+            }
+
+            hash.update(buffer.data(), nChunk);
+            nLeft -= nChunk;
+        }
+
+        state[entry.name] = { entry.size, hash.digest() };
+    }
+
+    return state;
+}
+
+bool ExtractGobChanges(std::shared_ptr<const GobFileDirectory> gobDir, const std::string& gobFile, const std::string& outDir,
+                       const bool verbose, std::size_t queueDepth, AsyncBackend backend, GobExtractState& state,
+                       Manifest* manifest)
+{
+    try
+    {
+        GobExtractState newState;
+        {
+            StatPhaseTimer phase("hash_gob");
+            newState = HashGobEntries(*gobDir);
+        }
+
+        /* Entry offset alone doesn't change extracted file, so it's not compared */
+        auto changedDir = std::make_shared<GobFileDirectory>();
+        changedDir->stream = gobDir->stream;
+        for(const auto& entry : gobDir->entries)
+        {
+            const auto it = state.find(entry.name);
+            const auto& entryState = newState.at(entry.name);
+            if(it == state.end() || it->second.size != entryState.size || it->second.hash != entryState.hash) {
+                changedDir->entries.push_back(entry);
+            }
+        }
+
+        std::vector<std::string> removed;
+        OutputTree outTree(outDir);
+        for(const auto& [name, entryState] : state)
+        {
+            if(!newState.count(name))
+            {
+                std::cout << "Removing file: " << name << std::endl;
+                RemoveFile(outTree.path(name));
+                removed.push_back(ManifestEntryName(name));
+            }
+        }
+
+        std::cout << "Changed files: " << changedDir->entries.size() << ", removed files: " << removed.size() << std::endl;
+        Manifest changes;
+        changes.algorithm = manifest ? manifest->algorithm : changes.algorithm;
+        if(!changedDir->entries.empty())
+        {
+            Manifest* pChanges = manifest ? &changes : nullptr;
+            const bool extracted = queueDepth > 0 ?
+                ExtractGobAsync(changedDir, gobFile, outDir, verbose, queueDepth, backend, pChanges) :
+                ExtractGob(changedDir, outDir, verbose, pChanges);
+
+            if(!extracted) {
+                return false;
+            }
+        }
+
+        if(manifest) {
+            manifest->update(changes, removed);
+        }
+        state = std::move(newState);
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "An exception was thrown while extracting GOB changes: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+#ifndef OS_WINDOWS
+namespace {
+    constexpr std::size_t AsyncChunkSize = 256 * 1024;
+
+    /* Extraction state of one GOB entry. Each slot owns one registered buffer
+       and has at most one request in flight. */
+    struct ExtractSlot
+    {
+        enum State { Idle, Reading, Writing, Syncing };
+
+        State state = Idle;
+        const GobFileEntry* entry = nullptr;
+        int fd = -1;
+        byte_t* buffer = nullptr;
+        std::size_t nCopied   = 0; // Bytes of entry written to file
+        std::size_t chunkSize = 0; // Bytes in buffer
+        std::size_t nFlushed  = 0; // Bytes of buffer written to file
+        std::optional<Hasher> hasher; // Hash of written bytes if manifest is made
+    };
+
+    class FileDescriptor
+    {
+    public:
+        explicit FileDescriptor(int fd) : m_fd(fd) {}
+        ~FileDescriptor()
+        {
+            if(m_fd >= 0) {
+                ::close(m_fd);
+            }
+        }
+
+        operator int() const
+        {
+            return m_fd;
+        }
+
+    private:
+        int m_fd;
+    };
+}
+
+bool ExtractGobAsync(std::shared_ptr<const GobFileDirectory> gobDir, const std::string& gobFile, std::string outDir,
+                     const bool verbose, std::size_t queueDepth, AsyncBackend backend, Manifest* manifest)
+{
+    std::vector<ExtractSlot> slots;
+    auto closeSlots = [&]{
+        for(auto& s : slots)
+        {
+            if(s.fd >= 0) {
+                ::close(s.fd);
+            }
+            s.fd = -1;
+        }
+    };
+
+    try
+    {
+        OutputTree outTree(std::move(outDir));
+
+        FileDescriptor gobFd(open(GetNativePath(gobFile).c_str(), O_RDONLY));
+        if(gobFd < 0)
+        {
+            std::cerr << "Error: could not open GOB file: " << gobFile << ": " << strerror(errno) << "!\n";
+            return false;
+        }
+
+        StatAdd(Stat::Syscalls);
+        StatAdd(Stat::FileOpens);
+
+        /* Allocate per slot buffers. Buffers must outlive aio. */
+        queueDepth = std::max<std::size_t>(1, std::min(queueDepth, gobDir->entries.size()));
+        std::vector<byte_t> buffers(queueDepth * AsyncChunkSize);
+
+        auto aio = MakeAsyncIO(queueDepth, backend);
+        if(verbose) {
+            std::cout << "Using " << aio->name() << " async I/O with queue depth " << queueDepth << "\n\n";
+        }
+
+        /* Register buffers */
+        std::vector<std::pair<byte_t*, std::size_t>> regBuffers;
+        slots.resize(queueDepth);
+        for(std::size_t i = 0; i < queueDepth; i++)
+        {
+            slots[i].buffer = buffers.data() + i * AsyncChunkSize;
+            regBuffers.emplace_back(slots[i].buffer, AsyncChunkSize);
+        }
+
+        const bool fixedBuffers = aio->registerBuffers(regBuffers);
+        ProgressReporter progress("Extracting", gobDir->entries.size(), TotalEntrySize(*gobDir));
+        const bool printEntries = verbose || !progress.active();
+
+        auto submit = [&](std::size_t slotIdx, AsyncRequest::Op op, byte_t* data, std::size_t len, uint64_t offset)
+        {
+            auto& slot = slots[slotIdx];
+            AsyncRequest req;
+            req.op          = op;
+            req.fd          = (op == AsyncRequest::Read ? int(gobFd) : slot.fd);
+            req.data        = data;
+            req.length      = len;
+            req.offset      = offset;
+            req.bufferIndex = fixedBuffers && op != AsyncRequest::Fsync ? int(slotIdx) : -1;
+            req.userData    = slotIdx;
+            aio->submit(req);
+        };
+
+        auto readNextChunk = [&](std::size_t slotIdx)
+        {
+            auto& slot = slots[slotIdx];
+            slot.state     = ExtractSlot::Reading;
+            slot.chunkSize = std::min(AsyncChunkSize, slot.entry->size - slot.nCopied);
+            slot.nFlushed  = 0;
+            submit(slotIdx, AsyncRequest::Read, slot.buffer, slot.chunkSize, uint64_t(slot.entry->offset) + slot.nCopied);
+        };
+
+        auto finishEntry = [&](ExtractSlot& slot)
+        {
+            ::close(slot.fd);
+            StatAdd(Stat::Syscalls);
+            slot.fd    = -1;
+            slot.state = ExtractSlot::Idle;
+            progress.add(1, slot.nCopied);
+            if(manifest) {
+                manifest->add(ManifestEntryName(slot.entry->name), slot.nCopied, slot.hasher->digest());
+            }
+
+            if(verbose) {
+                std::cout << "  " << slot.entry->name << ": bytes written to disk:" << SET_FINFO_LW(2) << std::dec << slot.nCopied << " bytes\n";
+            }
+        };
+
+        /* Syncs written entry file according to durability policy.
+           Returns true if sync was submitted, otherwise entry is finished. */
+        const auto durability = GetWritePolicy().durability;
+        auto syncEntry = [&](std::size_t slotIdx)
+        {
+            auto& slot = slots[slotIdx];
+            if(durability == Durability::PerFile)
+            {
+                slot.state = ExtractSlot::Syncing;
+                submit(slotIdx, AsyncRequest::Fsync, nullptr, 0, 0);
+                return true;
+            }
+
+            SyncOnClose(slot.fd, durability);
+            finishEntry(slot);
+            return false;
+        };
+
+        /* Starts extracting next entry in slot. Returns false if there are no more entries. */
+        std::size_t nextEntry = 0;
+        auto startEntry = [&](std::size_t slotIdx)
+        {
+            auto& slot = slots[slotIdx];
+            while(nextEntry < gobDir->entries.size())
+            {
+                const auto& entry = gobDir->entries[nextEntry++];
+                if(printEntries) {
+                    std::cout << "Extracting file: " << entry.name << '\n';
+                }
+
+                /* Make entry file and its directory */
+                slot.fd = outTree.openFile(entry.name);
+                PreallocateFile(slot.fd, entry.size);
+
+                slot.entry   = &entry;
+                slot.nCopied = 0;
+                if(manifest) {
+                    slot.hasher.emplace(manifest->algorithm);
+                }
+                if(entry.size > 0)
+                {
+                    readNextChunk(slotIdx);
+                    return true;
+                }
+
+                if(syncEntry(slotIdx)) {
+                    return true;
+                }
+            }
+
+            return false;
+        };
+
+        for(std::size_t i = 0; i < slots.size() && startEntry(i); i++) {}
+
+        /* Drive requests until all entries are extracted */
+        std::vector<AsyncCompletion> completions;
+        while(aio->inFlight() > 0)
+        {
+            completions.clear();
+            aio->wait(completions, 1);
+
+            for(const auto& c : completions)
+            {
+                const std::size_t slotIdx = c.userData;
+                auto& slot = slots[slotIdx];
+                if(c.result < 0) {
+                    throw AsyncIOError(std::string("I/O error while extracting ") + slot.entry->name + ": " + strerror(int(-c.result)));
+                }
+
+                switch (slot.state)
+                {
+                case ExtractSlot::Reading:
+                    if(c.result == 0) {
+                        throw AsyncIOError(std::string("unexpected end of GOB file while reading ") + slot.entry->name);
+                    }
+
+                    slot.chunkSize = std::size_t(c.result);
+                    slot.state = ExtractSlot::Writing;
+                    submit(slotIdx, AsyncRequest::Write, slot.buffer, slot.chunkSize, slot.nCopied);
+                    break;
+
+                case ExtractSlot::Writing:
+                    if(c.result == 0) {
+                        throw AsyncIOError(std::string("no bytes written while extracting ") + slot.entry->name);
+                    }
+
+                    slot.nFlushed += std::size_t(c.result);
+                    if(slot.nFlushed < slot.chunkSize)
+                    {
+                        /* Short write, write the rest of the chunk */
+                        submit(slotIdx, AsyncRequest::Write, slot.buffer + slot.nFlushed,
+                               slot.chunkSize - slot.nFlushed, slot.nCopied + slot.nFlushed);
+                        break;
+                    }
+
+                    /* Chunks are written in order, so entry is hashed before buffer is reused */
+                    if(slot.hasher) {
+                        slot.hasher->update(slot.buffer, slot.chunkSize);
+                    }
+
+                    slot.nCopied += slot.chunkSize;
+                    if(slot.nCopied < slot.entry->size) {
+                        readNextChunk(slotIdx);
+                    }
+                    else if(!syncEntry(slotIdx)) {
+                        startEntry(slotIdx);
+                    }
+                    break;
+
+                case ExtractSlot::Syncing:
+                    finishEntry(slot);
+                    startEntry(slotIdx);
+                    break;
+
+                case ExtractSlot::Idle:
+                    break;
+                }
+            }
+        }
+
+        progress.finish();
+        std::cout << (!verbose ? "\n" : "") << "--------------------------\nTotal files extracted: " << gobDir->entries.size() << std::endl << std::endl;
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        closeSlots();
+        std::cerr << "An exception was thrown while extracting GOB dir: " << e.what() << std::endl;
+        return false;
+    }
+}
+#else
+bool ExtractGobAsync(std::shared_ptr<const GobFileDirectory> gobDir, const std::string&, std::string outDir,
+                     const bool verbose, std::size_t, AsyncBackend, Manifest* manifest)
+{
+    return ExtractGob(std::move(gobDir), std::move(outDir), verbose, manifest);
+}
+#endif
+
+bool ListGob(const GobFileDirectory& gobDir, std::ostream& os, ListFormat format)
+{
+    try
+    {
+        ListWriter writer(os, format, { "name", "offset", "size" });
+        for(const auto& entry : gobDir.entries)
+        {
+            writer.field(std::string_view(entry.name, strnlen(entry.name, GOB_ENTRY_NAME_MAX_SIZE)))
+                  .field(entry.offset)
+                  .field(entry.size)
+                  .endRow();
+        }
+
+        if(!writer.finish())
+        {
+            std::cerr << "Error: failed to write GOB entry list!\n";
+            return false;
+        }
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "!\n";
+        return false;
+    }
+}
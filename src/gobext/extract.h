@@ -0,0 +1,47 @@
+#ifndef GOBEXT_EXTRACT_H
+#define GOBEXT_EXTRACT_H
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "libim/gob.h"
+#include "libim/io/asyncio.h"
+#include "libim/manifest.h"
+#include "cmdutils/listwriter.h"
+
+/* Extracts GOB entries to outDir. If manifest is given, extracted entries are hashed
+   while they're written and added to it with manifest's algorithm. */
+bool ExtractGob(std::shared_ptr<const GobFileDirectory> gobDir, std::string outDir, const bool verbose, Manifest* manifest = nullptr);
+
+/* Extracts GOB entries keeping up to queueDepth entry reads, file writes and syncs in flight.
+   gobFile is path to GOB file gobDir was loaded from. */
+bool ExtractGobAsync(std::shared_ptr<const GobFileDirectory> gobDir, const std::string& gobFile, std::string outDir,
+                     const bool verbose, std::size_t queueDepth, AsyncBackend backend = AsyncBackend::Auto, Manifest* manifest = nullptr);
+
+/* Size and content hash of extracted GOB entries by entry name */
+struct GobEntryState
+{
+    uint32_t size = 0;
+    uint64_t hash = 0; // XXH64 of entry data
+};
+
+using GobExtractState = std::unordered_map<std::string, GobEntryState>;
+
+/* Reads and hashes every entry of gobDir. Throws StreamError on error. */
+GobExtractState HashGobEntries(const GobFileDirectory& gobDir);
+
+/* Extracts only entries of gobDir which were added or whose size or content changed since state,
+   and deletes extracted files of entries which are no longer in gobDir.
+   Entries are extracted asynchronously if queueDepth > 0. On success state is set to gobDir's state.
+   If manifest is given, extracted entries are hashed while they're written and merged into it,
+   and entries of deleted files are dropped from it. */
+bool ExtractGobChanges(std::shared_ptr<const GobFileDirectory> gobDir, const std::string& gobFile, const std::string& outDir,
+                       const bool verbose, std::size_t queueDepth, AsyncBackend backend, GobExtractState& state,
+                       Manifest* manifest = nullptr);
+
+/* Writes name, offset and size of each entry of gobDir to os in format. Returns false on error. */
+bool ListGob(const GobFileDirectory& gobDir, std::ostream& os, ListFormat format);
+
+#endif // GOBEXT_EXTRACT_H
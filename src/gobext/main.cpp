@@ -1,11 +1,20 @@
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <optional>
 
+#include "extract.h"
 #include "libim/gob.h"
 #include "libim/common.h"
 #include "libim/io/filestream.h"
+#include "libim/io/filewatcher.h"
 #include "cmdutils/options.h"
+#include "cmdutils/stats.h"
+#include "cmdutils/listwriter.h"
+#include "cmdutils/manifest.h"
+#include "cmdutils/progress.h"
+#include "cmdutils/writepolicy.h"
 
 #define SETW(n, f)  std::right << std::setfill(f) << std::setw(n)
 #define SET_FINFO_LW(n) SETW(10 + n, '.')
@@ -16,9 +25,17 @@ static constexpr auto OPT_VERBOSE         ("--verbose");
 static constexpr auto OPT_VERBOSE_SHORT   ("-v");
 static constexpr auto OPT_HELP            ("--help");
 static constexpr auto OPT_HELP_SHORT      ("-h");
+static constexpr auto OPT_ASYNC           ("--async");
+static constexpr auto OPT_IO_BACKEND      ("--io-backend");
+static constexpr auto OPT_WATCH           ("--watch");
+static constexpr auto OPT_LIST            ("--list");
+
+static constexpr std::size_t DEFAULT_QUEUE_DEPTH = 32;
 
 void print_help();
-bool ExtractGob(std::shared_ptr<const GobFileDirectory> gobDir, std::string outDir, const bool verbose);
+bool WatchGobFile(std::shared_ptr<const GobFileDirectory> gobDir, const std::string& gobFile, const std::string& outDir,
+                  bool verbose, std::size_t queueDepth, AsyncBackend backend, std::optional<Manifest>& manifest,
+                  const std::string& manifestFile);
 
 int main(int argc, const char *argv[])
 {
@@ -55,15 +72,86 @@ int main(int argc, const char *argv[])
         bVerboseOutput = true;
     }
 
+    std::size_t queueDepth = 0;
+    if(opt.hasOpt(OPT_ASYNC))
+    {
+        queueDepth = DEFAULT_QUEUE_DEPTH;
+        if(!opt.arg(OPT_ASYNC).empty()) {
+            queueDepth = std::strtoul(opt.arg(OPT_ASYNC).c_str(), nullptr, 10);
+        }
+
+        if(queueDepth == 0 || queueDepth > 4096)
+        {
+            std::cerr << "Error: invalid async queue depth: " << opt.arg(OPT_ASYNC) << "!\n";
+            return 1;
+        }
+    }
+
+    AsyncBackend ioBackend = AsyncBackend::Auto;
+    if(opt.hasOpt(OPT_IO_BACKEND))
+    {
+        const auto backend = opt.arg(OPT_IO_BACKEND);
+        if(backend == "uring") {
+            ioBackend = AsyncBackend::IoUring;
+        }
+        else if(backend == "threads") {
+            ioBackend = AsyncBackend::ThreadPool;
+        }
+        else if(backend != "auto")
+        {
+            std::cerr << "Error: unknown I/O backend: " << backend << "!\n";
+            return 1;
+        }
+    }
+
+    ListFormat listFormat;
+    if(!GetListFormatOption(opt, listFormat)) {
+        return 1;
+    }
+
+    /* Manifest of extracted entries, hashed while they're written */
+    std::optional<Manifest> manifest;
+    if(opt.hasOpt(OPT_MANIFEST))
+    {
+        manifest.emplace();
+        if(!GetHashAlgorithmOption(opt, manifest->algorithm)) {
+            return 1;
+        }
+    }
+
+    if(!ApplyWritePolicyOptions(opt)) {
+        return 1;
+    }
+
+    ApplyProgressOptions(opt);
+
     /* Extract files from gob file */
     int result = 0;
-    auto gobDir = LoadGobFromFile(inputFile);
-    if(gobDir)
+    std::shared_ptr<GobFileDirectory> gobDir;
+    {
+        StatPhaseTimer phase("load_gob");
+        gobDir = LoadGobFromFile(inputFile);
+    }
+
+    if(gobDir && opt.hasOpt(OPT_LIST))
+    {
+        StatPhaseTimer phase("list");
+        if(!ListGob(*gobDir, std::cout, listFormat)) {
+            result = 1;
+        }
+    }
+    else if(gobDir)
     {
         outdir += (outdir.empty() ? "" : "/") + GetBaseName(inputFile) + "_GOB";
         MakePath(outdir);
 
-        if(!ExtractGob(gobDir, outdir, bVerboseOutput)) {
+        StatPhaseTimer phase("extract");
+        Manifest* pManifest = manifest ? &*manifest : nullptr;
+        const bool extracted = queueDepth > 0 ?
+            ExtractGobAsync(gobDir, inputFile, outdir, bVerboseOutput, queueDepth, ioBackend, pManifest) :
+            ExtractGob(gobDir, outdir, bVerboseOutput, pManifest);
+
+        if(!extracted || (manifest && !WriteManifestFile(opt.arg(OPT_MANIFEST), *manifest))) {
             result = 1;
         }
     }
@@ -73,88 +161,95 @@ int main(int argc, const char *argv[])
         result =  1;
     }
 
-    return result;
-}
+    if(!FinishDeferredWrites()) {
+        result = 1;
+    }
 
-void print_help()
-{
-    std::cout << "\nIndiana Jones and The Infernal Machine GOB file extractor\n";
-    std::cout << "Extracts resources from CND file!\n";
-    std::cout << "  Usage: gobext <gob file> [options]" << std::endl << std::endl;
+    if(!WriteStatsOutput(opt)) {
+        result = 1;
+    }
 
-    std::cout << "Option        Long option        Meaning\n";
-    std::cout << OPT_HELP_SHORT        << SETW(18, ' ') << OPT_HELP        << SETW(31, ' ') << "Show this message\n";
-    std::cout << OPT_OTPUT_DIR_SHORT   << SETW(24, ' ') << OPT_OTPUT_DIR   << SETW(34, ' ') << "Output folder <output dir>\n";
-    std::cout << OPT_VERBOSE_SHORT     << SETW(21, ' ') << OPT_VERBOSE     << SETW(25, ' ') << "Verbose output\n";
+    if(!opt.hasOpt(OPT_LIST)) {
+        WriteProgressSummary();
+    }
+
+    if(result == 0 && opt.hasOpt(OPT_WATCH) && !opt.hasOpt(OPT_LIST) &&
+       !WatchGobFile(std::move(gobDir), inputFile, outdir, bVerboseOutput, queueDepth, ioBackend, manifest, opt.arg(OPT_MANIFEST))) {
+        result = 1;
+    }
+
+    return result;
 }
 
-bool ExtractGob(std::shared_ptr<const GobFileDirectory> gobDir, std::string outDir, const bool verbose)
+/* Re-extracts changed entries every time GOB file changes.
+   If manifest is given, changed entries are merged into it and it's rewritten to manifestFile
+   after every extraction. Returns only on error. */
+bool WatchGobFile(std::shared_ptr<const GobFileDirectory> gobDir, const std::string& gobFile, const std::string& outDir,
+                  bool verbose, std::size_t queueDepth, AsyncBackend backend, std::optional<Manifest>& manifest,
+                  const std::string& manifestFile)
 {
     try
     {
-        /* Save entries to files */
-        for(const auto& entry : gobDir->entries)
+        /* Watch is set before hashing, so changes made meanwhile aren't missed */
+        FileWatcher watcher({ gobFile });
+        GobExtractState state = HashGobEntries(*gobDir);
+        gobDir.reset();
+
+        for(;;)
         {
-            std::cout << "Extracting file: " << entry.name << std::endl;
-            if(verbose)
-            {
-                std::string strSize = std::to_string(entry.size);
-                std::cout << "  offset in gob:"  << SET_FINFO_LW((14 - (strSize.size() + 6)) + 11) << std::hex << std::showbase << entry.offset << std::endl;
-                std::cout << "  file size:"      << SET_FINFO_LW(14) << std::dec << strSize<< " bytes\n";
+            std::cout << "Watching " << gobFile << " for changes...\n";
+            watcher.wait();
+            if(!FileExists(gobFile)) {
+                continue;
             }
 
-            /* Seek to entry offset */
-            gobDir->stream->seek(entry.offset);
-
-            /* Set entry file path */
-            auto outPath = outDir + '/' + entry.name;
-            if(!MakePath(outPath))
+            std::cout << "\nGOB file changed, extracting changes\n";
+            auto newDir = LoadGobFromFile(gobFile);
+            if(!newDir)
             {
-                std::cerr << "Error: could not make file path: " << outPath << "!\n";
-                return 1;
+                std::cerr << "Error reading GOB file, waiting for next change!\n";
+                continue;
             }
 
-            /* Open output file stream */
-            OutputFileStream ofs(outPath);
-
-            /* Write entry to file */
-            ByteArray buffer(4096);
-            std::size_t offEntryEnd = entry.offset + entry.size;
-            std::size_t nWritten = 0;
-
-            while(gobDir->stream->tell() < offEntryEnd && !gobDir->stream->eos())
-            {
-                if(gobDir->stream->tell() + buffer.size() >= offEntryEnd) {
-                    buffer.resize(offEntryEnd - gobDir->stream->tell());
-                }
-
-                if(gobDir->stream->read(reinterpret_cast<byte_t*>(buffer.data()), buffer.size()) != buffer.size())
-                {
-                    std::cerr << "Error reading GOB entry into buffer!\n";
-                    return false;
-                }
-
-                ofs.write(buffer);
-                nWritten += buffer.size();
+            Manifest* pManifest = manifest ? &*manifest : nullptr;
+            if(!ExtractGobChanges(std::move(newDir), gobFile, outDir, verbose, queueDepth, backend, state, pManifest)) {
+                std::cerr << "Error extracting changes, waiting for next change!\n";
             }
-
-            if(verbose) {
-                std::cout << "  bytes written to disk:" << SET_FINFO_LW(2) << std::dec << nWritten << " bytes\n\n";
+            else if(manifest && !WriteManifestFile(manifestFile, *manifest)) {
+                std::cerr << "Error updating manifest, waiting for next change!\n";
             }
 
-            if(nWritten < entry.size) {
-                std::cerr << "  Warning: not all bytes were written to disk!\n\n";
-            } else if(nWritten > entry.size) {
-                std::cerr << "  Warning: too many bytes were written to disk!\n\n";
-            }
+            FinishDeferredWrites();
         }
-
-        std::cout << (!verbose ? "\n" : "") << "--------------------------\nTotal files extracted: " << gobDir->entries.size() << std::endl << std::endl;
-        return true;
     }
-    catch (const std::exception& e)
+    catch(const std::exception& e)
     {
-        std::cerr << "An exception was thrown while extracting GOB dir: " << e.what() << std::endl;
+        std::cerr << "Error: " << e.what() << "!\n";
         return false;
     }
 }
+
+void print_help()
+{
+    std::cout << "\nIndiana Jones and The Infernal Machine GOB file extractor\n";
+    std::cout << "Extracts resources from CND file!\n";
+    std::cout << "  Usage: gobext <gob file> [options]" << std::endl << std::endl;
+
+    std::cout << "Option        Long option        Meaning\n";
+    std::cout << OPT_HELP_SHORT        << SETW(18, ' ') << OPT_HELP        << SETW(31, ' ') << "Show this message\n";
+    std::cout << SETW(26, ' ')         << OPT_DURABILITY                   << SETW(59, ' ') << "When to sync written files: none, per-file or batch\n";
+    std::cout << SETW(22, ' ')         << OPT_FORMAT                       << SETW(55, ' ') << "Format of --list: text, json, csv or ndjson\n";
+    std::cout << SETW(20, ' ')         << OPT_HASH                         << SETW(77, ' ') << "Hash algorithm of --manifest: crc32c or xxh64 [default: crc32c]\n";
+    std::cout << SETW(20, ' ')         << OPT_LIST                         << SETW(69, ' ') << "List entries with offset and size instead of extracting\n";
+    std::cout << SETW(24, ' ')         << OPT_MANIFEST                     << SETW(71, ' ') << "Write manifest of extracted files' sizes and hashes to <file>\n";
+    std::cout << SETW(27, ' ')         << OPT_NO_PROGRESS                  << SETW(28, ' ') << "Don't report progress\n";
+    std::cout << SETW(27, ' ')         << OPT_PREALLOCATE                  << SETW(48, ' ') << "Preallocate disk space of extracted files\n";
+    std::cout << SETW(24, ' ')         << OPT_PROGRESS                     << SETW(89, ' ') << "Report progress to stderr even if it isn't terminal [default: only to terminal]\n";
+    std::cout << OPT_OTPUT_DIR_SHORT   << SETW(24, ' ') << OPT_OTPUT_DIR   << SETW(34, ' ') << "Output folder <output dir>\n";
+    std::cout << SETW(21, ' ')         << OPT_ASYNC                        << SETW(61, ' ') << "Extract with async I/O [queue depth, default 32]\n";
+    std::cout << SETW(26, ' ')         << OPT_IO_BACKEND                   << SETW(49, ' ') << "Async I/O backend: auto, uring or threads\n";
+    std::cout << SETW(21, ' ')         << OPT_STATS                        << SETW(43, ' ') << "Print I/O and parse statistics\n";
+    std::cout << SETW(26, ' ')         << OPT_STATS_JSON                   << SETW(44, ' ') << "Write statistics as JSON [to <file>]\n";
+    std::cout << OPT_VERBOSE_SHORT     << SETW(21, ' ') << OPT_VERBOSE     << SETW(25, ' ') << "Verbose output\n";
+    std::cout << SETW(21, ' ')         << OPT_WATCH                        << SETW(65, ' ') << "Re-extract changed entries whenever gob file changes\n";
+}
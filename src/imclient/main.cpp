@@ -0,0 +1,120 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libim/common.h"
+#include "libim/io/filestream.h"
+#include "libim/server/client.h"
+#include "cmdutils/options.h"
+
+static constexpr auto CMD_ARCHIVES        ("archives");
+static constexpr auto CMD_LIST            ("list");
+static constexpr auto CMD_STAT            ("stat");
+static constexpr auto CMD_READ            ("read");
+static constexpr auto OPT_OTPUT_FILE      ("--output");
+static constexpr auto OPT_OTPUT_FILE_SHORT("-o");
+static constexpr auto OPT_HELP            ("--help");
+static constexpr auto OPT_HELP_SHORT      ("-h");
+
+void print_help();
+
+static void PrintEntries(const std::vector<ResourceEntry>& entries)
+{
+    for(const auto& e : entries) {
+        std::cout << e.size << '\t' << e.name << '\n';
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    Options opt(argc, argv);
+    const auto args = opt.unspecified();
+    if(opt.hasOpt(OPT_HELP) ||
+       opt.hasOpt(OPT_HELP_SHORT) ||
+       args.size() < 2)
+    {
+        print_help();
+        return 1;
+    }
+
+    const std::string& socketPath = args.at(0);
+    const std::string& cmd        = args.at(1);
+    const std::size_t nCmdArgs = cmd == CMD_ARCHIVES ? 0 : cmd == CMD_LIST ? 1 : 2;
+    if(args.size() != 2 + nCmdArgs)
+    {
+        print_help();
+        return 1;
+    }
+
+    try
+    {
+        ResourceClient client(socketPath);
+        if(cmd == CMD_ARCHIVES) {
+            PrintEntries(client.archives());
+        }
+        else if(cmd == CMD_LIST) {
+            PrintEntries(client.list(args.at(2)));
+        }
+        else if(cmd == CMD_STAT)
+        {
+            const auto entry = client.stat(args.at(2), args.at(3));
+            if(!entry)
+            {
+                std::cerr << "Error: entry " << args.at(3) << " not found in " << args.at(2) << "!\n";
+                return 1;
+            }
+            PrintEntries({ *entry });
+        }
+        else if(cmd == CMD_READ)
+        {
+            std::string outFile = opt.arg(OPT_OTPUT_FILE_SHORT);
+            if(outFile.empty()) {
+                outFile = opt.arg(OPT_OTPUT_FILE);
+            }
+
+            if(outFile.empty())
+            {
+                const auto data = client.read(args.at(2), args.at(3));
+                std::cout.write(reinterpret_cast<const char*>(data.data()), data.size());
+            }
+            else
+            {
+                RemoveFile(outFile);
+                OutputFileStream ofs(outFile);
+                client.read(args.at(2), args.at(3), ofs);
+            }
+        }
+        else
+        {
+            std::cerr << "Error: unknown command: '" << cmd << "'\n";
+            print_help();
+            return 1;
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "!\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+void print_help()
+{
+    std::cout << "\nIndiana Jones and The Infernal Machine resource server client\n";
+    std::cout << "Queries archives served by imserver.\n";
+    std::cout << "  Usage: imclient <socket path> archives\n";
+    std::cout << "         imclient <socket path> list <archive>\n";
+    std::cout << "         imclient <socket path> stat <archive> <entry>\n";
+    std::cout << "         imclient <socket path> read <archive> <entry> [-o <file>]" << std::endl << std::endl;
+
+    std::cout << "Commands:\n";
+    std::cout << "  archives              List served archives and their sizes\n";
+    std::cout << "  list                  List entries of archive and their sizes\n";
+    std::cout << "  stat                  Print size of archive entry\n";
+    std::cout << "  read                  Write archive entry to stdout or <file>\n";
+    std::cout << "Options:\n";
+    std::cout << "  -o, --output <file>   Output file of read\n";
+    std::cout << "  -h, --help            Show this message\n";
+}
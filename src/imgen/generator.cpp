@@ -0,0 +1,252 @@
+#include "generator.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "libim/common.h"
+#include "libim/cnd.h"
+#include "libim/gob.h"
+#include "libim/io/filestream.h"
+#include "libim/material/colorformat.h"
+#include "libim/material/mat.h"
+#include "libim/material/material.h"
+
+using namespace libim::CND;
+
+static constexpr std::size_t CND_SOUND_HEADER_SIZE = 48;
+static constexpr std::array<const char*, 8> GOB_ENTRY_EXT = {{
+    "3do", "mat", "key", "cog", "wav", "pup", "snd", "ai"
+}};
+static constexpr std::array<ColorFormat, 4> GEN_COLOR_FORMATS = {{
+    RGB_565, RGBA_4444, ARGB_4444, ARGB_5551
+}};
+
+
+static void FillRandom(GenRandom& rng, byte_t* data, std::size_t size)
+{
+    std::size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        const uint64_t r = rng.next();
+        std::memcpy(data + i, &r, sizeof(r));
+    }
+
+    if(i < size)
+    {
+        const uint64_t r = rng.next();
+        std::memcpy(data + i, &r, size - i);
+    }
+}
+
+static uint32_t FloorPow2(uint32_t v)
+{
+    uint32_t p = 1;
+    while(p <= v / 2) p <<= 1;
+    return v == 0 ? 1 : p;
+}
+
+/* Per-material random stream. Material layout and pixel data of material at index
+   are derived from the same stream so headers and pixel data can be generated in
+   separate passes without holding all materials in memory. */
+static GenRandom MaterialRandom(const CndGenSpec& spec, uint32_t index)
+{
+    return GenRandom(spec.seed * 0x100000001B3ULL + index + 1);
+}
+
+static CndMatHeader GenMaterialLayout(GenRandom& rng, const CndGenSpec& spec, uint32_t index)
+{
+    const uint32_t minSize = FloorPow2(std::max<uint32_t>(spec.minSize, 1));
+    const uint32_t maxSize = FloorPow2(std::max(spec.maxSize, minSize));
+
+    uint32_t minExp = 0, maxExp = 0;
+    while((1u << minExp) < minSize) minExp++;
+    while((1u << maxExp) < maxSize) maxExp++;
+
+    CndMatHeader mh{};
+    std::snprintf(mh.name, sizeof(mh.name), "gen_mat%05u.mat", index);
+    mh.width  = 1 << rng.uniform(minExp, maxExp);
+    mh.height = 1 << rng.uniform(minExp, maxExp);
+    mh.mipmapCount = rng.uniform(std::max<uint32_t>(spec.minCels, 1), std::max(spec.maxCels, spec.minCels));
+
+    /* Smallest LOD texture must be at least 1x1 */
+    uint32_t maxLevels = 1;
+    while((std::min(mh.width, mh.height) >> maxLevels) > 0) maxLevels++;
+    const uint32_t minLevels = std::min(std::max<uint32_t>(spec.minLevels, 1), maxLevels);
+    mh.texturesPerMipmap = rng.uniform(minLevels, std::min(std::max(spec.maxLevels, minLevels), maxLevels));
+
+    const uint32_t fmtIdx = rng.uniform(0, GEN_COLOR_FORMATS.size() - 1);
+    mh.colorInfo = spec.randomColorFormat ? GEN_COLOR_FORMATS.at(fmtIdx) : RGB_565;
+    return mh;
+}
+
+static uint32_t MaterialPixelDataSize(const CndMatHeader& mh)
+{
+    return mh.mipmapCount * GetMipmapPixelDataSize(mh.texturesPerMipmap, mh.width, mh.height, mh.colorInfo.bpp);
+}
+
+bool GenerateGob(const std::string& file, const GobGenSpec& spec)
+{
+    try
+    {
+        GenRandom rng(spec.seed);
+        const uint32_t minSize = std::min(spec.minSize, spec.maxSize);
+
+        /* Generate directory */
+        std::vector<GobFileEntry> entries(spec.entries);
+        uint64_t offset = sizeof(GobFileHeader);
+        for(uint32_t i = 0; i < spec.entries; i++)
+        {
+            auto& entry = entries.at(i);
+            if(spec.distribution == GobGenSpec::Exponential)
+            {
+                const double size = -std::log(1.0 - rng.real()) * spec.meanSize;
+                entry.size = static_cast<uint32_t>(std::min<double>(std::max<double>(size, minSize), spec.maxSize));
+            }
+            else {
+                entry.size = rng.uniform(minSize, spec.maxSize);
+            }
+
+            /* Entry offsets and directory offset are 32 bit */
+            entry.offset = static_cast<uint32_t>(offset);
+            offset += entry.size;
+            if(offset > UINT32_MAX) {
+                throw StreamError("GOB entry data too big");
+            }
+
+            const uint32_t dir = rng.uniform(0, std::max<uint32_t>(spec.dirs, 1) - 1);
+            const char* ext = GOB_ENTRY_EXT.at(rng.uniform(0, GOB_ENTRY_EXT.size() - 1));
+            std::memset(entry.name, 0, sizeof(entry.name));
+            std::snprintf(entry.name, sizeof(entry.name), "dir%03u\\entry%06u.%s", dir, i, ext);
+        }
+
+        /* Write header, entry data and directory */
+        OutputFileStream ofs(file);
+
+        GobFileHeader header;
+        header.signature = GOB_FILE_SIGNATURE;
+        header.version   = GOB_FILE_VERSION;
+        header.directoryOffset = static_cast<uint32_t>(offset);
+        ofs.write(header);
+
+        ByteArray buffer(64 * 1024);
+        for(const auto& entry : entries)
+        {
+            std::size_t nLeft = entry.size;
+            while(nLeft > 0)
+            {
+                const std::size_t nChunk = std::min(nLeft, buffer.size());
+                FillRandom(rng, buffer.data(), nChunk);
+                ofs.write(buffer.data(), nChunk);
+                nLeft -= nChunk;
+            }
+        }
+
+        ofs.write(spec.entries);
+        ofs.write(entries);
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error generating GOB file: " << e.what() << "!\n";
+        return false;
+    }
+}
+
+bool GenerateCnd(const std::string& file, const CndGenSpec& spec, const std::string& matDir)
+{
+    try
+    {
+        /* Generate material header list */
+        std::vector<CndMatHeader> matHeaders;
+        matHeaders.reserve(spec.materials);
+
+        uint64_t nPixelDataSize = 0;
+        for(uint32_t i = 0; i < spec.materials; i++)
+        {
+            auto rng = MaterialRandom(spec, i);
+            matHeaders.push_back(GenMaterialLayout(rng, spec, i));
+            nPixelDataSize += MaterialPixelDataSize(matHeaders.back());
+        }
+
+        if(nPixelDataSize > UINT32_MAX) {
+            throw StreamError("Material pixel data too big");
+        }
+
+        OutputFileStream ofs(file);
+
+        /* Write header */
+        CndHeader header{};
+        header.copyright    = CopyrightNotice;
+        header.version      = FileVersion;
+        header.type         = 0xC;
+        header.numMaterials = spec.materials;
+        header.worldSounds  = spec.sounds;
+        header.worldSoundUnknown = spec.sounds * spec.soundSize;
+        ofs.write(header);
+
+        /* Write sound stubs: silent sound data followed by zeroed sound headers */
+        const ByteArray zeros(std::max<std::size_t>(spec.soundSize, CND_SOUND_HEADER_SIZE), 0);
+        for(uint32_t i = 0; i < spec.sounds; i++) {
+            ofs.write(zeros.data(), spec.soundSize);
+        }
+
+        for(uint32_t i = 0; i < spec.sounds; i++) {
+            ofs.write(zeros.data(), CND_SOUND_HEADER_SIZE);
+        }
+
+        ofs.write(uint32_t(0)); // unknown 4 bytes
+
+        /* Write material section */
+        ofs.write(static_cast<uint32_t>(nPixelDataSize));
+        ofs.write(matHeaders);
+
+        if(!matDir.empty()) {
+            MakePath(matDir);
+        }
+
+        Bitmap pixelData;
+        for(uint32_t i = 0; i < spec.materials; i++)
+        {
+            auto rng = MaterialRandom(spec, i);
+            const auto mh = GenMaterialLayout(rng, spec, i);
+
+            pixelData.resize(MaterialPixelDataSize(mh));
+            FillRandom(rng, pixelData.data(), pixelData.size());
+            ofs.write(pixelData);
+
+            /* Write matching MAT file */
+            if(!matDir.empty())
+            {
+                std::pmr::vector<Mipmap> mipmaps(mh.mipmapCount);
+                auto itPixelData = pixelData.cbegin();
+                for(auto& mipmap : mipmaps) {
+                    itPixelData = CopyMipmapFromBuffer(mipmap, itPixelData, mh.texturesPerMipmap, mh.width, mh.height, mh.colorInfo);
+                }
+
+                Material mat(mh.name);
+                mat.setSize(mh.width, mh.height);
+                mat.setColorFormat(mh.colorInfo);
+                mat.setMipmaps(std::move(mipmaps));
+
+                if(!SaveMaterialToFile(matDir + "/" + mat.name(), mat)) {
+                    return false;
+                }
+            }
+        }
+
+        /* Write final file size */
+        ofs.seekBegin();
+        ofs.write(static_cast<uint32_t>(ofs.size()));
+        return true;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error generating CND file: " << e.what() << "!\n";
+        return false;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef IMGEN_GENERATOR_H
+#define IMGEN_GENERATOR_H
+#include <cstdint>
+#include <string>
+
+/* Deterministic pseudo random number generator (splitmix64).
+   Unlike std::mt19937 combined with std::*_distribution, the produced
+   sequence is the same on every platform and standard library. */
+class GenRandom
+{
+public:
+    explicit GenRandom(uint64_t seed) : m_state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (m_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /* Returns random number in range [min, max] */
+    uint32_t uniform(uint32_t min, uint32_t max)
+    {
+        if(max <= min) return min;
+        return min + static_cast<uint32_t>(next() % (uint64_t(max - min) + 1));
+    }
+
+    /* Returns random number in range [0, 1) */
+    double real()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    uint64_t m_state;
+};
+
+struct GobGenSpec
+{
+    enum SizeDistribution
+    {
+        Uniform,     // Entry sizes uniformly distributed in [minSize, maxSize]
+        Exponential  // Entry sizes exponentially distributed with mean meanSize, clamped to [minSize, maxSize]
+    };
+
+    uint32_t entries  = 1000;
+    uint32_t minSize  = 64;
+    uint32_t maxSize  = 64 * 1024;
+    uint32_t meanSize = 16 * 1024;
+    SizeDistribution distribution = Uniform;
+    uint32_t dirs     = 16;  // Number of distinct directories entries are spread over
+    uint64_t seed     = 1;
+};
+
+struct CndGenSpec
+{
+    uint32_t materials = 100;
+    uint32_t minSize   = 8;   // Min width/height of material's base texture, rounded to power of 2
+    uint32_t maxSize   = 256; // Max width/height of material's base texture, rounded to power of 2
+    uint32_t minCels   = 1;   // Min number of mipmaps (cels) per material
+    uint32_t maxCels   = 2;   // Max number of mipmaps (cels) per material
+    uint32_t minLevels = 1;   // Min number of textures (LODs) per mipmap
+    uint32_t maxLevels = 4;   // Max number of textures (LODs) per mipmap
+    bool randomColorFormat = true; // If false all materials use RGB_565
+    uint32_t sounds    = 0;   // Number of sound stubs in sound section
+    uint32_t soundSize = 1024;// Size of each sound stub's data
+    uint64_t seed      = 1;
+};
+
+/* Generates a valid GOB archive with entries of random content.
+   The output depends only on spec. */
+bool GenerateGob(const std::string& file, const GobGenSpec& spec);
+
+/* Generates a valid CND file with sound stubs and materials.
+   If matDir is not empty, a MAT file matching each generated material is written to it.
+   The output depends only on spec. */
+bool GenerateCnd(const std::string& file, const CndGenSpec& spec, const std::string& matDir = "");
+
+#endif // IMGEN_GENERATOR_H
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <string>
+
+#include "generator.h"
+#include "libim/common.h"
+#include "cmdutils/options.h"
+
+static constexpr auto CMD_GOB             ("gob");
+static constexpr auto CMD_CND             ("cnd");
+static constexpr auto OPT_SEED            ("--seed");
+static constexpr auto OPT_ENTRIES         ("--entries");
+static constexpr auto OPT_MIN_SIZE        ("--min-size");
+static constexpr auto OPT_MAX_SIZE        ("--max-size");
+static constexpr auto OPT_MEAN_SIZE       ("--mean-size");
+static constexpr auto OPT_DIST            ("--dist");
+static constexpr auto OPT_DIRS            ("--dirs");
+static constexpr auto OPT_MATERIALS       ("--materials");
+static constexpr auto OPT_MAX_CELS        ("--max-cels");
+static constexpr auto OPT_MAX_LEVELS      ("--max-levels");
+static constexpr auto OPT_SOUNDS          ("--sounds");
+static constexpr auto OPT_SOUND_SIZE      ("--sound-size");
+static constexpr auto OPT_MAT_DIR         ("--mat-dir");
+static constexpr auto OPT_RGB565          ("--rgb565");
+static constexpr auto OPT_HELP            ("--help");
+static constexpr auto OPT_HELP_SHORT      ("-h");
+
+void print_help();
+
+template<typename T>
+static bool GetOptValue(const Options& opt, const char* name, T& value)
+{
+    if(!opt.hasOpt(name)) {
+        return true;
+    }
+
+    try
+    {
+        value = static_cast<T>(std::stoull(opt.arg(name)));
+        return true;
+    }
+    catch(const std::exception&)
+    {
+        std::cerr << "Error: invalid value for option " << name << ": '" << opt.arg(name) << "'\n";
+        return false;
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    Options opt(argc, argv);
+    if(opt.hasOpt(OPT_HELP) ||
+       opt.hasOpt(OPT_HELP_SHORT) ||
+       opt.unspecified().size() < 2)
+    {
+        print_help();
+        return 1;
+    }
+
+    const std::string cmd     = opt.unspecified().at(0);
+    const std::string outFile = opt.unspecified().at(1);
+
+    if(cmd == CMD_GOB)
+    {
+        GobGenSpec spec;
+        if(!GetOptValue(opt, OPT_SEED, spec.seed)         ||
+           !GetOptValue(opt, OPT_ENTRIES, spec.entries)   ||
+           !GetOptValue(opt, OPT_MIN_SIZE, spec.minSize)  ||
+           !GetOptValue(opt, OPT_MAX_SIZE, spec.maxSize)  ||
+           !GetOptValue(opt, OPT_MEAN_SIZE, spec.meanSize)||
+           !GetOptValue(opt, OPT_DIRS, spec.dirs)) {
+            return 1;
+        }
+
+        if(opt.hasOpt(OPT_DIST))
+        {
+            const auto dist = opt.arg(OPT_DIST);
+            if(dist == "uniform") {
+                spec.distribution = GobGenSpec::Uniform;
+            }
+            else if(dist == "exp") {
+                spec.distribution = GobGenSpec::Exponential;
+            }
+            else
+            {
+                std::cerr << "Error: unknown size distribution: '" << dist << "'\n";
+                return 1;
+            }
+        }
+
+        std::cout << "Generating GOB file: " << outFile << " (" << spec.entries << " entries)" << std::endl;
+        return GenerateGob(outFile, spec) ? 0 : 1;
+    }
+    else if(cmd == CMD_CND)
+    {
+        CndGenSpec spec;
+        if(!GetOptValue(opt, OPT_SEED, spec.seed)             ||
+           !GetOptValue(opt, OPT_MATERIALS, spec.materials)   ||
+           !GetOptValue(opt, OPT_MIN_SIZE, spec.minSize)      ||
+           !GetOptValue(opt, OPT_MAX_SIZE, spec.maxSize)      ||
+           !GetOptValue(opt, OPT_MAX_CELS, spec.maxCels)      ||
+           !GetOptValue(opt, OPT_MAX_LEVELS, spec.maxLevels)  ||
+           !GetOptValue(opt, OPT_SOUNDS, spec.sounds)         ||
+           !GetOptValue(opt, OPT_SOUND_SIZE, spec.soundSize)) {
+            return 1;
+        }
+
+        spec.randomColorFormat = !opt.hasOpt(OPT_RGB565);
+
+        std::cout << "Generating CND file: " << outFile << " (" << spec.materials << " materials)" << std::endl;
+        return GenerateCnd(outFile, spec, opt.arg(OPT_MAT_DIR)) ? 0 : 1;
+    }
+
+    std::cerr << "Error: unknown command: '" << cmd << "'\n";
+    print_help();
+    return 1;
+}
+
+void print_help()
+{
+    std::cout << "\nIndiana Jones and The Infernal Machine synthetic resource generator\n";
+    std::cout << "Generates GOB and CND files with random content for load testing.\n";
+    std::cout << "Output depends only on the given options and seed.\n";
+    std::cout << "  Usage: imgen gob <output gob file> [options]\n";
+    std::cout << "         imgen cnd <output cnd file> [options]" << std::endl << std::endl;
+
+    std::cout << "Common options:\n";
+    std::cout << "  --seed <n>            Random seed (default: 1)\n";
+    std::cout << "  --min-size <n>        Min GOB entry size in bytes or min material width/height\n";
+    std::cout << "  --max-size <n>        Max GOB entry size in bytes or max material width/height\n";
+    std::cout << "GOB options:\n";
+    std::cout << "  --entries <n>         Number of entries (default: 1000)\n";
+    std::cout << "  --dist <uniform|exp>  Entry size distribution (default: uniform)\n";
+    std::cout << "  --mean-size <n>       Mean entry size for exp distribution (default: 16384)\n";
+    std::cout << "  --dirs <n>            Number of directories (default: 16)\n";
+    std::cout << "CND options:\n";
+    std::cout << "  --materials <n>       Number of materials (default: 100)\n";
+    std::cout << "  --max-cels <n>        Max mipmaps per material (default: 2)\n";
+    std::cout << "  --max-levels <n>      Max textures per mipmap (default: 4)\n";
+    std::cout << "  --rgb565              Use RGB_565 for all materials instead of random color formats\n";
+    std::cout << "  --sounds <n>          Number of sound stubs (default: 0)\n";
+    std::cout << "  --sound-size <n>      Size of sound stub data (default: 1024)\n";
+    std::cout << "  --mat-dir <dir>       Also write matching MAT files to <dir>\n";
+}
@@ -0,0 +1,86 @@
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libim/common.h"
+#include "libim/server/server.h"
+#include "cmdutils/options.h"
+#include "cmdutils/stats.h"
+
+static constexpr auto OPT_HELP       ("--help");
+static constexpr auto OPT_HELP_SHORT ("-h");
+
+static ResourceServer* runningServer = nullptr;
+
+void print_help();
+
+static void StopServer(int)
+{
+    if(runningServer) {
+        runningServer->stop();
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    Options opt(argc, argv);
+    if(opt.hasOpt(OPT_HELP) ||
+       opt.hasOpt(OPT_HELP_SHORT) ||
+       opt.unspecified().size() < 2)
+    {
+        print_help();
+        return 1;
+    }
+
+    auto args = opt.unspecified();
+    const std::string socketPath = args.at(0);
+    const std::vector<std::string> archives(args.begin() + 1, args.end());
+
+#ifndef OS_WINDOWS
+    /* Client disconnecting mid reply is reported by send error */
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    int result = 0;
+    try
+    {
+        ResourceServer server(socketPath, archives);
+        runningServer = &server;
+        std::signal(SIGINT, StopServer);
+        std::signal(SIGTERM, StopServer);
+
+        std::cout << "Serving " << archives.size() << " archives on " << socketPath << std::endl;
+        server.run();
+
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        runningServer = nullptr;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "!\n";
+        result = 1;
+    }
+
+    if(!WriteStatsOutput(opt)) {
+        result = 1;
+    }
+
+    return result;
+}
+
+void print_help()
+{
+    std::cout << "\nIndiana Jones and The Infernal Machine resource server\n";
+    std::cout << "Keeps GOB and CND archives open and indexed and serves their entries\n";
+    std::cout << "to local clients (imclient) over Unix domain socket.\n";
+    std::cout << "Archives are named by their file name, CND materials are served as MAT files.\n";
+    std::cout << "  Usage: imserver <socket path> <archive files> [options]" << std::endl << std::endl;
+
+    std::cout << "Options:\n";
+    std::cout << "  -h, --help            Show this message\n";
+    std::cout << "  --stats               Print I/O and parse statistics on exit\n";
+    std::cout << "  --stats-json [file]   Write statistics as JSON on exit [to <file>]\n";
+}
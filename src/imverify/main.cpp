@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "libim/common.h"
+#include "libim/manifest.h"
+#include "libim/io/stream.h"
+#include "libim/utils/crc32c.h"
+#include "cmdutils/options.h"
+#include "cmdutils/manifest.h"
+#include "cmdutils/progress.h"
+#include "cmdutils/stats.h"
+
+static constexpr auto CMD_CREATE     ("create");
+static constexpr auto CMD_CHECK      ("check");
+static constexpr auto OPT_JOBS       ("--jobs");
+static constexpr auto OPT_JOBS_SHORT ("-j");
+static constexpr auto OPT_HELP       ("--help");
+static constexpr auto OPT_HELP_SHORT ("-h");
+
+void print_help();
+
+/* Hashes GOB or CND file by extension, or files in directory.
+   If names is not null only files at names are hashed in directory. */
+static Manifest HashInput(const std::string& input, HashAlgorithm algorithm, std::size_t jobs, const std::vector<std::string>* names)
+{
+    if(DirExists(input)) {
+        return HashFiles(input, names ? *names : ListDirFiles(input), algorithm, jobs);
+    }
+
+    std::string ext = GetFileExtension(input);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return char(std::tolower(c)); });
+    if(ext == "gob" || ext == "goo") {
+        return HashGobFile(input, algorithm, jobs);
+    }
+    else if(ext == "cnd") {
+        return HashCndFile(input, algorithm, jobs);
+    }
+
+    throw StreamError("Unknown input, expected GOB or CND file or directory: " + input);
+}
+
+static void PrintNames(const char* kind, const std::vector<std::string>& names)
+{
+    for(const auto& name : names) {
+        std::cout << kind << ": " << name << '\n';
+    }
+}
+
+int main(int argc, const char *argv[])
+{
+    Options opt(argc, argv);
+    const auto args = opt.unspecified();
+    if(opt.hasOpt(OPT_HELP) ||
+       opt.hasOpt(OPT_HELP_SHORT) ||
+       args.size() != 3)
+    {
+        print_help();
+        return 1;
+    }
+
+    const std::string& cmd          = args.at(0);
+    const std::string& input        = args.at(1);
+    const std::string& manifestFile = args.at(2);
+
+    std::size_t jobs = 0;
+    if(opt.hasOpt(OPT_JOBS_SHORT)) {
+        jobs = std::strtoul(opt.arg(OPT_JOBS_SHORT).c_str(), nullptr, 10);
+    }
+    else if(opt.hasOpt(OPT_JOBS)) {
+        jobs = std::strtoul(opt.arg(OPT_JOBS).c_str(), nullptr, 10);
+    }
+
+    ApplyProgressOptions(opt);
+
+    int result = 0;
+    try
+    {
+        if(cmd == CMD_CREATE)
+        {
+            HashAlgorithm algorithm;
+            if(!GetHashAlgorithmOption(opt, algorithm)) {
+                return 1;
+            }
+
+            Manifest manifest;
+            {
+                StatPhaseTimer phase("hash");
+                manifest = HashInput(input, algorithm, jobs, nullptr);
+            }
+
+            if(!WriteManifestFile(manifestFile, manifest)) {
+                return 1;
+            }
+
+            std::cout << "Hashed entries: " << manifest.entries.size() << '\n';
+        }
+        else if(cmd == CMD_CHECK)
+        {
+            Manifest expected;
+            if(!ReadManifestFile(manifestFile, expected)) {
+                return 1;
+            }
+
+            /* Directory is checked only for files in manifest */
+            std::vector<std::string> names;
+            for(const auto& e : expected.entries) {
+                names.push_back(e.name);
+            }
+
+            Manifest actual;
+            {
+                StatPhaseTimer phase("hash");
+                actual = HashInput(input, expected.algorithm, jobs, &names);
+            }
+
+            const auto diff = CompareManifests(expected, actual);
+            PrintNames("Changed", diff.changed);
+            PrintNames("Missing", diff.missing);
+            PrintNames("Added",   diff.added);
+
+            std::cout << "Verified entries: " << expected.entries.size() << ", changed: " << diff.changed.size()
+                      << ", missing: " << diff.missing.size() << ", added: " << diff.added.size() << '\n';
+            if(!diff.empty()) {
+                result = 1;
+            }
+        }
+        else
+        {
+            std::cerr << "Error: unknown command: '" << cmd << "'\n";
+            print_help();
+            return 1;
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << "!\n";
+        return 1;
+    }
+
+    if(!WriteStatsOutput(opt)) {
+        result = 1;
+    }
+
+    WriteProgressSummary();
+    return result;
+}
+
+void print_help()
+{
+    std::cout << "\nIndiana Jones and The Infernal Machine integrity verifier\n";
+    std::cout << "Hashes entries of GOB and CND files or files of extracted directory and writes or checks their manifest.\n";
+    std::cout << "  Usage: imverify create <gob file|cnd file|dir> <manifest file> [options]\n";
+    std::cout << "         imverify check <gob file|cnd file|dir> <manifest file> [options]" << std::endl << std::endl;
+
+    std::cout << "CND materials are hashed as MAT files extracted by cndext, GOB entries as files extracted by gobext,\n";
+    std::cout << "so manifest of archive can be checked against directory it was extracted to and vice versa.\n";
+    std::cout << "CRC-32C " << (IsCrc32cAccelerated() ? "is" : "isn't") << " computed with SSE4.2 on this CPU.\n\n";
+
+    std::cout << "Commands:\n";
+    std::cout << "  create                    Hash entries and write their manifest to <manifest file>\n";
+    std::cout << "  check                     Hash entries and print entries which differ from <manifest file>\n";
+    std::cout << "Options:\n";
+    std::cout << "  --hash <algorithm>        Hash algorithm of create: crc32c or xxh64 [default: crc32c]\n";
+    std::cout << "  -j, --jobs <n>            Number of hashing threads [default: one per core]\n";
+    std::cout << "  --progress                Report progress to stderr even if it isn't terminal\n";
+    std::cout << "  --no-progress             Don't report progress\n";
+    std::cout << "  --stats                   Print I/O and parse statistics\n";
+    std::cout << "  --stats-json [file]       Write statistics as JSON [to <file>]\n";
+    std::cout << "  -h, --help                Show this message\n";
+}
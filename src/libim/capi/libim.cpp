@@ -0,0 +1,526 @@
+#include "libim.h"
+#include "../cnd.h"
+#include "../gob.h"
+#include "../io/filestream.h"
+#include "../material/bcn.h"
+#include "../material/mat.h"
+#include "../material/quantize.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+static_assert(sizeof(im_color_format) == sizeof(ColorFormat), "im_color_format must match ColorFormat");
+static_assert(std::is_standard_layout_v<ColorFormat>, "ColorFormat must be standard layout");
+
+struct im_archive
+{
+    struct Entry
+    {
+        std::string name;
+        uint64_t offset = 0; // Offset of entry data in archive
+        uint64_t size   = 0; // Size of entry file
+        std::optional<libim::CND::CndMatHeader> material; // Set if entry is CND material, read as MAT file
+    };
+
+    im_archive_type type = IM_ARCHIVE_GOB;
+    InputFileStream istream;
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, std::size_t> index;
+
+    explicit im_archive(const std::string& path) : istream(path) {}
+};
+
+struct im_material
+{
+    Material mat;
+};
+
+namespace {
+    thread_local std::string lastError;
+
+    /* Argument or lookup error, reported with status instead of IM_ERROR */
+    struct ApiError : std::runtime_error
+    {
+        ApiError(im_status status, const std::string& message) :
+            std::runtime_error(message),
+            status(status)
+        {}
+
+        im_status status;
+    };
+
+    /* Calls f and converts thrown exception to status and last error message */
+    template<typename F>
+    im_status Call(F&& f) noexcept
+    {
+        try
+        {
+            lastError.clear();
+            f();
+            return IM_OK;
+        }
+        catch(const ApiError& e)
+        {
+            lastError = e.what();
+            return e.status;
+        }
+        catch(const std::invalid_argument& e)
+        {
+            lastError = e.what();
+            return IM_ERROR_INVALID_ARGUMENT;
+        }
+        catch(const std::bad_alloc&)
+        {
+            lastError = "Out of memory";
+            return IM_ERROR;
+        }
+        catch(const std::exception& e)
+        {
+            lastError = e.what();
+            return IM_ERROR;
+        }
+        catch(...)
+        {
+            lastError = "Unknown error";
+            return IM_ERROR;
+        }
+    }
+
+    void CheckArg(bool valid, const char* message)
+    {
+        if(!valid) {
+            throw ApiError(IM_ERROR_INVALID_ARGUMENT, message);
+        }
+    }
+
+    void CheckBufferSize(std::size_t size, uint64_t required)
+    {
+        if(size < required) {
+            throw ApiError(IM_ERROR_BUFFER_TOO_SMALL, "Buffer is too small, " + std::to_string(required) + " bytes required");
+        }
+    }
+
+    const im_archive::Entry& GetEntry(const im_archive* archive, std::size_t index)
+    {
+        CheckArg(archive != nullptr, "archive is null");
+        if(index >= archive->entries.size()) {
+            throw ApiError(IM_ERROR_NOT_FOUND, "Entry index out of range: " + std::to_string(index));
+        }
+        return archive->entries[index];
+    }
+
+    const Texture& GetTexture(const im_material* material, uint32_t mipmap, uint32_t texture)
+    {
+        CheckArg(material != nullptr, "material is null");
+        const auto& mipmaps = material->mat.mipmaps();
+        if(mipmap >= mipmaps.size() || texture >= mipmaps[mipmap].size()) {
+            throw ApiError(IM_ERROR_NOT_FOUND, "Texture " + std::to_string(mipmap) + ":" + std::to_string(texture) + " not found in material");
+        }
+        return mipmaps[mipmap][texture];
+    }
+
+    uint64_t GetTextureSize(const Texture& tex)
+    {
+        return uint64_t(tex.width()) * tex.height() * BBS(tex.colorInfo().bpp);
+    }
+
+    ColorFormat ToColorFormat(const im_color_format* format)
+    {
+        CheckArg(format != nullptr, "format is null");
+        ColorFormat ci;
+        std::memcpy(&ci, format, sizeof(ci));
+        return ci;
+    }
+
+    void LoadGobEntries(im_archive& archive)
+    {
+        std::vector<GobFileEntry> gobEntries;
+        if(!LoadGobDirectory(archive.istream, gobEntries)) {
+            throw StreamError("Failed to load GOB file " + archive.istream.name());
+        }
+
+        archive.entries.reserve(gobEntries.size());
+        for(const auto& e : gobEntries)
+        {
+            im_archive::Entry entry;
+            entry.name   = e.name;
+            entry.offset = e.offset;
+            entry.size   = e.size;
+            archive.entries.push_back(std::move(entry));
+        }
+    }
+
+    void LoadCndEntries(im_archive& archive)
+    {
+        const auto index = libim::CND::LoadCndIndex(archive.istream);
+
+        /* Materials which can't be read as MAT files are left out */
+        archive.entries.reserve(index.materials.size());
+        for(const auto& mat : index.materials)
+        {
+            const auto& header = mat.header;
+            if(!libim::CND::IsMatCopyable(header)) {
+                continue;
+            }
+
+            im_archive::Entry entry;
+            entry.name     = header.name;
+            entry.offset   = mat.offset;
+            entry.size     = libim::CND::GetMatFileSize(header);
+            entry.material = header;
+            archive.entries.push_back(std::move(entry));
+        }
+    }
+
+    /* Reads [offset, offset + size) of entry stored in archive at entry.offset */
+    std::size_t ReadStored(const im_archive& archive, const im_archive::Entry& entry, uint64_t offset, byte_t* buffer, std::size_t size)
+    {
+        archive.istream.seek(entry.offset + offset);
+        if(archive.istream.read(buffer, size) != size) {
+            throw StreamError("Failed to read entry " + entry.name + ": archive file truncated");
+        }
+        return size;
+    }
+
+    /* Reads [offset, offset + size) of MAT file assembled from material's headers and pixel data in archive */
+    std::size_t ReadMat(const im_archive& archive, const im_archive::Entry& entry, uint64_t offset, byte_t* buffer, std::size_t size)
+    {
+        const auto& matHeader = *entry.material;
+
+        WriteBatch batch;
+        WriteMatFileHeader(batch, matHeader.colorInfo, matHeader.mipmapCount);
+        ByteArray head;
+        head.reserve(batch.size());
+        for(const auto& buf : batch.buffers()) {
+            head.insert(head.end(), buf.data, buf.data + buf.size);
+        }
+
+        MatMipmapHeader mmHeader {};
+        mmHeader.width        = matHeader.width;
+        mmHeader.height       = matHeader.height;
+        mmHeader.textureCount = matHeader.texturesPerMipmap;
+        RecordsToDisk(&mmHeader, 1);
+
+        /* File is head followed by each mipmap's header and pixel data */
+        const uint64_t nMipmapSize = GetMipmapPixelDataSize(matHeader.texturesPerMipmap, matHeader.width, matHeader.height, matHeader.colorInfo.bpp);
+        const uint64_t nChunkSize  = sizeof(mmHeader) + nMipmapSize;
+
+        std::size_t nRead = 0;
+        auto copy = [&](const byte_t* data, uint64_t dataSize)
+        {
+            const std::size_t n = std::size_t(std::min<uint64_t>(dataSize - offset, size - nRead));
+            std::memcpy(buffer + nRead, data + offset, n);
+            nRead += n;
+            offset = 0;
+        };
+
+        if(offset < head.size()) {
+            copy(head.data(), head.size());
+        }
+        else {
+            offset -= head.size();
+        }
+
+        for(uint64_t i = offset / nChunkSize, offMipmap = offset % nChunkSize; nRead < size && i < uint64_t(matHeader.mipmapCount); i++, offMipmap = 0)
+        {
+            offset = offMipmap;
+            if(offset < sizeof(mmHeader)) {
+                copy(reinterpret_cast<const byte_t*>(&mmHeader), sizeof(mmHeader));
+            }
+            else {
+                offset -= sizeof(mmHeader);
+            }
+
+            if(nRead < size)
+            {
+                const std::size_t n = std::size_t(std::min<uint64_t>(nMipmapSize - offset, size - nRead));
+                nRead += ReadStored(archive, entry, i * nMipmapSize + offset, buffer + nRead, n);
+                offset = 0;
+            }
+        }
+
+        return nRead;
+    }
+}
+
+uint32_t im_api_version(void)
+{
+    return IM_API_VERSION;
+}
+
+const char* im_last_error(void)
+{
+    return lastError.c_str();
+}
+
+im_status im_archive_open(const char* path, im_archive** archive)
+{
+    return Call([&]
+    {
+        CheckArg(path != nullptr && archive != nullptr, "path or archive is null");
+        *archive = nullptr;
+
+        auto a = std::make_unique<im_archive>(path);
+
+        std::array<char, 4> signature {};
+        if(a->istream.size() >= signature.size()) {
+            a->istream.read(reinterpret_cast<byte_t*>(signature.data()), signature.size());
+        }
+        a->istream.seek(0);
+
+        std::string ext = GetFileExtension(path);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if(signature == GOB_FILE_SIGNATURE)
+        {
+            a->type = IM_ARCHIVE_GOB;
+            LoadGobEntries(*a);
+        }
+        else if(ext == "cnd")
+        {
+            a->type = IM_ARCHIVE_CND;
+            LoadCndEntries(*a);
+        }
+        else {
+            throw ApiError(IM_ERROR_UNSUPPORTED, std::string("Unknown archive type: ") + path);
+        }
+
+        a->index.reserve(a->entries.size());
+        for(std::size_t i = 0; i < a->entries.size(); i++) {
+            a->index.emplace(a->entries[i].name, i);
+        }
+
+        *archive = a.release();
+    });
+}
+
+void im_archive_close(im_archive* archive)
+{
+    delete archive;
+}
+
+im_archive_type im_archive_get_type(const im_archive* archive)
+{
+    return archive ? archive->type : IM_ARCHIVE_GOB;
+}
+
+size_t im_archive_entry_count(const im_archive* archive)
+{
+    return archive ? archive->entries.size() : 0;
+}
+
+im_status im_archive_get_entry(const im_archive* archive, size_t index, im_entry* entry)
+{
+    return Call([&]
+    {
+        CheckArg(entry != nullptr, "entry is null");
+        const auto& e = GetEntry(archive, index);
+        entry->name = e.name.c_str();
+        entry->size = e.size;
+    });
+}
+
+im_status im_archive_find(const im_archive* archive, const char* name, size_t* index)
+{
+    return Call([&]
+    {
+        CheckArg(archive != nullptr && name != nullptr && index != nullptr, "archive, name or index is null");
+        const auto it = archive->index.find(name);
+        if(it == archive->index.end()) {
+            throw ApiError(IM_ERROR_NOT_FOUND, std::string("Entry ") + name + " not found");
+        }
+        *index = it->second;
+    });
+}
+
+im_status im_archive_read(im_archive* archive, size_t index, uint64_t offset, void* buffer, size_t size, size_t* nread)
+{
+    return Call([&]
+    {
+        CheckArg(nread != nullptr && (buffer != nullptr || size == 0), "buffer or nread is null");
+        *nread = 0;
+
+        const auto& entry = GetEntry(archive, index);
+        if(offset >= entry.size) {
+            return;
+        }
+
+        size = std::size_t(std::min<uint64_t>(size, entry.size - offset));
+        auto* out = static_cast<byte_t*>(buffer);
+        *nread = entry.material ? ReadMat(*archive, entry, offset, out, size)
+                                : ReadStored(*archive, entry, offset, out, size);
+    });
+}
+
+im_status im_material_open_file(const char* path, im_material** material)
+{
+    return Call([&]
+    {
+        CheckArg(path != nullptr && material != nullptr, "path or material is null");
+        *material = nullptr;
+
+        InputFileStream ifstream(path);
+        *material = new im_material{ ReadMaterial(ifstream, GetFileName(path)) };
+    });
+}
+
+im_status im_material_open_entry(im_archive* archive, size_t index, im_material** material)
+{
+    return Call([&]
+    {
+        CheckArg(material != nullptr, "material is null");
+        *material = nullptr;
+
+        const auto& entry = GetEntry(archive, index);
+        if(!entry.material)
+        {
+            archive->istream.seek(entry.offset);
+            *material = new im_material{ ReadMaterial(archive->istream, GetFileName(entry.name)) };
+            return;
+        }
+
+        libim::CND::CndMaterialData data;
+        data.header = *entry.material;
+        data.pixelData.resize(libim::CND::GetMaterialPixelDataSize(data.header));
+        ReadStored(*archive, entry, 0, data.pixelData.data(), data.pixelData.size());
+        *material = new im_material{ libim::CND::DecodeMaterial(data) };
+    });
+}
+
+void im_material_close(im_material* material)
+{
+    delete material;
+}
+
+im_status im_material_get_info(const im_material* material, im_material_info* info)
+{
+    return Call([&]
+    {
+        CheckArg(material != nullptr && info != nullptr, "material or info is null");
+        const auto& mat = material->mat;
+        info->width  = mat.width();
+        info->height = mat.height();
+        info->mipmap_count        = uint32_t(mat.mipmaps().size());
+        info->textures_per_mipmap = mat.mipmaps().empty() ? 0 : uint32_t(mat.mipmaps().front().size());
+        std::memcpy(&info->format, &mat.colorFormat(), sizeof(info->format));
+    });
+}
+
+im_status im_material_get_texture_info(const im_material* material, uint32_t mipmap, uint32_t texture, im_texture_info* info)
+{
+    return Call([&]
+    {
+        CheckArg(info != nullptr, "info is null");
+        const auto& tex = GetTexture(material, mipmap, texture);
+        info->width      = tex.width();
+        info->height     = tex.height();
+        info->size       = GetTextureSize(tex);
+        info->rgba8_size = uint64_t(tex.width()) * tex.height() * 4;
+    });
+}
+
+im_status im_material_read_texture(const im_material* material, uint32_t mipmap, uint32_t texture, void* buffer, size_t size)
+{
+    return Call([&]
+    {
+        const auto& tex = GetTexture(material, mipmap, texture);
+        const uint64_t nSize = GetTextureSize(tex);
+        CheckArg(buffer != nullptr, "buffer is null");
+        CheckBufferSize(size, nSize);
+        if(!tex.bitmap() || tex.bitmap()->size() < nSize) {
+            throw StreamError("Texture bitmap is smaller than texture size");
+        }
+        std::memcpy(buffer, tex.bitmap()->data(), std::size_t(nSize));
+    });
+}
+
+im_status im_material_read_texture_rgba8(const im_material* material, uint32_t mipmap, uint32_t texture, void* buffer, size_t size)
+{
+    return Call([&]
+    {
+        const auto& tex = GetTexture(material, mipmap, texture);
+        CheckArg(buffer != nullptr, "buffer is null");
+        CheckBufferSize(size, uint64_t(tex.width()) * tex.height() * 4);
+
+        const auto rgba = TextureToRGBA8(tex);
+        std::memcpy(buffer, rgba.data(), rgba.size());
+    });
+}
+
+im_status im_get_color_format(im_pixel_format pixelFormat, im_color_format* format)
+{
+    return Call([&]
+    {
+        CheckArg(format != nullptr, "format is null");
+        const ColorFormat* ci = nullptr;
+        switch(pixelFormat)
+        {
+            case IM_PIXEL_RGB565:   ci = &RGB_565;   break;
+            case IM_PIXEL_RGBA4444: ci = &RGBA_4444; break;
+            case IM_PIXEL_ARGB4444: ci = &ARGB_4444; break;
+            case IM_PIXEL_ARGB1555: ci = &ARGB_5551; break;
+            case IM_PIXEL_RGBA8888: ci = &RGBA_8888; break;
+        }
+
+        CheckArg(ci != nullptr, "Unknown pixel format");
+        std::memcpy(format, ci, sizeof(*format));
+    });
+}
+
+im_status im_convert_to_rgba8(const void* src, size_t srcSize, uint32_t width, uint32_t height,
+                              const im_color_format* format, void* dst, size_t dstSize)
+{
+    return Call([&]
+    {
+        const ColorFormat ci = ToColorFormat(format);
+        CheckArg(src != nullptr && dst != nullptr, "src or dst is null");
+        CheckArg(ci.bpp > 0 && ci.bpp % 8 == 0 && ci.bpp <= 32, "Unsupported bit depth");
+        CheckArg(srcSize >= uint64_t(width) * height * BBS(ci.bpp), "src is smaller than width * height pixels");
+        CheckBufferSize(dstSize, uint64_t(width) * height * 4);
+
+        auto bitmap = MakeBitmapPtr(srcSize);
+        std::memcpy(bitmap->data(), src, srcSize);
+
+        Texture tex;
+        tex.setWidth(width)
+           .setHeight(height)
+           .setRowSize(GetRowSize(width, ci.bpp))
+           .setColorInfo(ci)
+           .setBitmap(std::move(bitmap));
+
+        const auto rgba = TextureToRGBA8(tex);
+        std::memcpy(dst, rgba.data(), rgba.size());
+    });
+}
+
+im_status im_convert_from_rgba8(const void* src, size_t srcSize, uint32_t width, uint32_t height,
+                                const im_color_format* format, im_dither dither, void* dst, size_t dstSize)
+{
+    return Call([&]
+    {
+        const ColorFormat ci = ToColorFormat(format);
+        CheckArg(src != nullptr && dst != nullptr, "src or dst is null");
+        CheckArg(srcSize >= uint64_t(width) * height * 4, "src is smaller than width * height pixels");
+        CheckBufferSize(dstSize, uint64_t(width) * height * BBS(ci.bpp));
+
+        QuantizeOptions opt;
+        switch(dither)
+        {
+            case IM_DITHER_NONE:      opt.method = DitherMethod::None;      break;
+            case IM_DITHER_ORDERED:   opt.method = DitherMethod::Ordered;   break;
+            case IM_DITHER_DIFFUSION: opt.method = DitherMethod::Diffusion; break;
+            default: throw ApiError(IM_ERROR_INVALID_ARGUMENT, "Unknown dither method");
+        }
+
+        const auto tex = QuantizeRGBA8(static_cast<const byte_t*>(src), width, height, ci, opt);
+        std::memcpy(dst, tex.bitmap()->data(), tex.bitmap()->size());
+    });
+}
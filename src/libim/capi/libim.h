@@ -0,0 +1,168 @@
+#ifndef LIBIM_CAPI_LIBIM_H
+#define LIBIM_CAPI_LIBIM_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* Stable C interface of libim for in-process use from other languages.
+   All functions return IM_OK on success or error status, and the message of the last
+   error on the calling thread is returned by im_last_error.
+   Handles are not synchronized, a handle may be used by one thread at a time.
+   Structs are passed by pointer and their layout is frozen for LIBIM_1, new fields
+   are added only in new structs with new functions. */
+
+#if defined(_WIN32)
+# if defined(LIBIM_CAPI_EXPORTS)
+#  define IM_API __declspec(dllexport)
+# elif defined(LIBIM_CAPI_SHARED)
+#  define IM_API __declspec(dllimport)
+# else
+#  define IM_API
+# endif
+#elif defined(__GNUC__)
+# define IM_API __attribute__((visibility("default")))
+#else
+# define IM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IM_API_VERSION 1
+
+typedef enum im_status
+{
+    IM_OK                      = 0,
+    IM_ERROR                   = 1, /* I/O or file format error */
+    IM_ERROR_INVALID_ARGUMENT  = 2,
+    IM_ERROR_NOT_FOUND         = 3,
+    IM_ERROR_BUFFER_TOO_SMALL  = 4,
+    IM_ERROR_UNSUPPORTED       = 5
+} im_status;
+
+typedef enum im_archive_type
+{
+    IM_ARCHIVE_GOB = 1,
+    IM_ARCHIVE_CND = 2  /* Entries are materials, read as MAT files */
+} im_archive_type;
+
+typedef enum im_pixel_format
+{
+    IM_PIXEL_RGB565   = 1,
+    IM_PIXEL_RGBA4444 = 2,
+    IM_PIXEL_ARGB4444 = 3,
+    IM_PIXEL_ARGB1555 = 4,
+    IM_PIXEL_RGBA8888 = 5  /* Byte order R, G, B, A */
+} im_pixel_format;
+
+typedef enum im_dither
+{
+    IM_DITHER_NONE      = 0, /* Round to nearest */
+    IM_DITHER_ORDERED   = 1, /* 8x8 Bayer matrix */
+    IM_DITHER_DIFFUSION = 2  /* Floyd-Steinberg error diffusion */
+} im_dither;
+
+/* Pixel layout of texture, same as color info of MAT and CND files */
+typedef struct im_color_format
+{
+    int32_t color_mode;
+    int32_t bpp;
+    int32_t red_bits;
+    int32_t green_bits;
+    int32_t blue_bits;
+    int32_t red_shl;
+    int32_t green_shl;
+    int32_t blue_shl;
+    int32_t red_shr;
+    int32_t green_shr;
+    int32_t blue_shr;
+    int32_t alpha_bits;
+    int32_t alpha_shl;
+    int32_t alpha_shr;
+} im_color_format;
+
+typedef struct im_entry
+{
+    const char* name; /* Valid until archive is closed */
+    uint64_t size;    /* Size of entry file */
+} im_entry;
+
+typedef struct im_material_info
+{
+    uint32_t width;  /* Size of the base texture */
+    uint32_t height;
+    uint32_t mipmap_count;
+    uint32_t textures_per_mipmap;
+    im_color_format format;
+} im_material_info;
+
+typedef struct im_texture_info
+{
+    uint32_t width;
+    uint32_t height;
+    uint64_t size;       /* Size of pixel data in material's color format */
+    uint64_t rgba8_size; /* Size of pixel data converted to 8 bit RGBA */
+} im_texture_info;
+
+typedef struct im_archive im_archive;
+typedef struct im_material im_material;
+
+/* Returns IM_API_VERSION the library was built with */
+IM_API uint32_t im_api_version(void);
+
+/* Returns message of the last error on calling thread, empty if none.
+   Valid until the next call on the same thread. */
+IM_API const char* im_last_error(void);
+
+/* Opens GOB or CND archive and indexes its entries */
+IM_API im_status im_archive_open(const char* path, im_archive** archive);
+IM_API void im_archive_close(im_archive* archive);
+
+IM_API im_archive_type im_archive_get_type(const im_archive* archive);
+IM_API size_t im_archive_entry_count(const im_archive* archive);
+IM_API im_status im_archive_get_entry(const im_archive* archive, size_t index, im_entry* entry);
+
+/* Finds entry by name. Returns IM_ERROR_NOT_FOUND if archive has no such entry. */
+IM_API im_status im_archive_find(const im_archive* archive, const char* name, size_t* index);
+
+/* Reads up to size bytes of entry file starting at offset into buffer.
+   Number of bytes read is stored to nread, which is less than size only at the end of entry. */
+IM_API im_status im_archive_read(im_archive* archive, size_t index, uint64_t offset,
+                                 void* buffer, size_t size, size_t* nread);
+
+/* Decodes material from MAT file */
+IM_API im_status im_material_open_file(const char* path, im_material** material);
+
+/* Decodes material from CND archive material or GOB archive MAT file entry */
+IM_API im_status im_material_open_entry(im_archive* archive, size_t index, im_material** material);
+IM_API void im_material_close(im_material* material);
+
+IM_API im_status im_material_get_info(const im_material* material, im_material_info* info);
+IM_API im_status im_material_get_texture_info(const im_material* material, uint32_t mipmap, uint32_t texture,
+                                              im_texture_info* info);
+
+/* Copies texture pixel data in material's color format to buffer of at least im_texture_info.size bytes */
+IM_API im_status im_material_read_texture(const im_material* material, uint32_t mipmap, uint32_t texture,
+                                          void* buffer, size_t size);
+
+/* Converts texture to 8 bit RGBA into buffer of at least im_texture_info.rgba8_size bytes */
+IM_API im_status im_material_read_texture_rgba8(const im_material* material, uint32_t mipmap, uint32_t texture,
+                                                void* buffer, size_t size);
+
+/* Returns color format of pixel format */
+IM_API im_status im_get_color_format(im_pixel_format pixel_format, im_color_format* format);
+
+/* Converts width x height pixels in format to 8 bit RGBA. dst_size must be at least width * height * 4. */
+IM_API im_status im_convert_to_rgba8(const void* src, size_t src_size, uint32_t width, uint32_t height,
+                                     const im_color_format* format, void* dst, size_t dst_size);
+
+/* Quantizes width x height 8 bit RGBA pixels to 16 bit format.
+   dst_size must be at least width * height * 2. */
+IM_API im_status im_convert_from_rgba8(const void* src, size_t src_size, uint32_t width, uint32_t height,
+                                       const im_color_format* format, im_dither dither, void* dst, size_t dst_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBIM_CAPI_LIBIM_H
@@ -1,11 +1,11 @@
 #include "cnd.h"
+#include "material/mat.h"
 #include <array>
 #include<cstdint>
 
 using namespace libim::CND;
 
-static constexpr uint32_t FileVersion = 3;
-static constexpr std::array<char, 1216> CopyrightNotice = {
+const std::array<char, 1216> libim::CND::CopyrightNotice = {
 //    "................................" \
 //    "................@...@...@...@..." \
 //    ".............@...@..@..@...@...." \
@@ -121,42 +121,41 @@ uint32_t libim::CND::GetMatSectionOffset(const CndHeader& header)
             4;                         // 4 = unknown 4 bytes
 }
 
-std::vector<Material> libim::CND::LoadMaterials(const InputStream& istream)
+std::vector<Material> libim::CND::LoadMaterials(const InputStream& istream, std::pmr::memory_resource* mr)
 {
     try
     {
         std::vector<Material> materials;
 
-        /* Read cnd file header */
-        auto cndHeader = LoadHeader(istream);
+        /* Read cnd file header and material header list */
+        const auto index = LoadCndIndex(istream);
+        materials.reserve(index.materials.size());
 
         /* Return if no materials are present in file*/
-        if(cndHeader.numMaterials < 1)
+        if(index.header.numMaterials < 1)
         {
             std::cout << "CND Info: No materials found in CND file!\n";
             return materials;
         }
 
-        /* Seek to materials position */
-        istream.seek(GetMatSectionOffset(cndHeader));
-
-        /* Read materials pixel data size */
-        uint32_t nBitmapBuffSize = istream.read<uint32_t>();
-        if(nBitmapBuffSize == 0)
+        if(index.pixelDataSize == 0)
         {
             std::cerr << "CND Warning: Read materials bitmap data size == 0!\n";
             return materials;
         }
 
-        /* Read material header list from file stream */
-        auto matHeaders = istream.read<std::vector<CndMatHeader>>(cndHeader.numMaterials);
-
         /* Read materials pixel data from file stream */
-        Bitmap vecBitmapBuff = istream.read<Bitmap>(nBitmapBuffSize);
+        Bitmap vecBitmapBuff(index.pixelDataSize, mr);
+        if(istream.read(vecBitmapBuff.data(), vecBitmapBuff.size()) != vecBitmapBuff.size()) {
+            throw StreamError("Could not read materials pixel data");
+        }
+
+        auto itPixelData = vecBitmapBuff.cbegin();
 
         /* Extract materials from pixel data buffer */
-        for(auto&& matHeader : matHeaders)
+        for(const auto& loc : index.materials)
         {
+            const auto& matHeader = loc.header;
             if(matHeader.mipmapCount < 1 || matHeader.texturesPerMipmap < 1)
             {
                 std::cerr << "CND Warning: No pixel data found for material: " << matHeader.name << std::endl;
@@ -171,22 +170,31 @@ std::vector<Material> libim::CND::LoadMaterials(const InputStream& istream)
                 return materials;
             }
 
+            if(loc.size > uint64_t(std::distance(itPixelData, vecBitmapBuff.cend()))) {
+                throw StreamError(std::string("Pixel data of material ") + matHeader.name + " exceeds materials bitmap data size");
+            }
+
             /* Read mipmaps from buffer */
-            std::vector<Mipmap> mipmaps(matHeader.mipmapCount);
-            for(auto&& mipmap : mipmaps) {
-                mipmap = MoveMipmapFromBuffer(vecBitmapBuff, matHeader.texturesPerMipmap, matHeader.width, matHeader.height, matHeader.colorInfo);
+            std::pmr::vector<Mipmap> mipmaps(mr);
+            mipmaps.reserve(matHeader.mipmapCount);
+            for(int32_t i = 0; i < matHeader.mipmapCount; i++)
+            {
+                Mipmap mipmap(mr);
+                itPixelData = CopyMipmapFromBuffer(mipmap, itPixelData, matHeader.texturesPerMipmap, matHeader.width, matHeader.height, matHeader.colorInfo, mr);
+                mipmaps.push_back(std::move(mipmap));
             }
 
             /* Init new material */
-            Material mat(matHeader.name);
+            Material mat(matHeader.name, mr);
             mat.setSize(matHeader.width, matHeader.height);
             mat.setColorFormat(matHeader.colorInfo);
             mat.setMipmaps(std::move(mipmaps));
 
             materials.emplace_back(std::move(mat));
+            StatAdd(Stat::Materials);
         }
 
-        if(!vecBitmapBuff.empty()) {
+        if(itPixelData != vecBitmapBuff.cend()) {
             std::cerr << "CND Warning: Not all bitmap data was copied from buffer!\n";
         }
 
@@ -308,11 +316,13 @@ bool libim::CND::ReplaceMaterial(const Material& mat, const std::string& cndFile
         ofstream.write(ifstream, 0, matListOffset);
         //ifstream.seek(matListOffset); // Move istream cur forward
 
-        /* Write new pixel data size */
-        ofstream.write(nBitmapBufSize);
+        /* Write new pixel data size and material list headers */
+        WriteBatch batch;
+        batch.add(nBitmapBufSize)
+             .add(matHeaders);
 
-        /* Write material list headers */
-        ofstream.write(matHeaders);
+        ofstream.write(batch);
+        batch.clear();
 
         /* Seek to begining of material list raw data */
         ifstream.seek(ifstream.tell() + sizeof(nBitmapBufSize) + cndHeader.numMaterials * sizeof(CndMatHeader));
@@ -325,10 +335,12 @@ bool libim::CND::ReplaceMaterial(const Material& mat, const std::string& cndFile
         for(const auto& mipmap : mat.mipmaps())
         {
             for(const auto& tex : mipmap) {
-                ofstream.write(tex.bitmap());
+                batch.add(*tex.bitmap());
             }
         }
 
+        ofstream.write(batch);
+
         /* Write the rest of input cnd file to output cnd file */
         ofstream.write(ifstream, ifstream.tell() + replMatSize);
 
@@ -350,3 +362,170 @@ bool libim::CND::ReplaceMaterial(const Material& mat, const std::string& cndFile
         return false;
     }
 }
+
+
+uint32_t libim::CND::GetMaterialPixelDataSize(const CndMatHeader& header)
+{
+    if(header.mipmapCount < 1 || header.texturesPerMipmap < 1) {
+        return 0;
+    }
+
+    return header.mipmapCount * GetMipmapPixelDataSize(header.texturesPerMipmap, header.width, header.height, header.colorInfo.bpp);
+}
+
+bool libim::CND::IsMatCopyable(const CndMatHeader& header)
+{
+    return header.mipmapCount > 0 && header.texturesPerMipmap > 0 && header.colorInfo.bpp % 8 == 0;
+}
+
+uint64_t libim::CND::GetMatFileSize(const CndMatHeader& header)
+{
+    return sizeof(MatHeader) + uint64_t(header.mipmapCount) * (sizeof(MatRecordHeader) + sizeof(MatMipmapHeader)) +
+        GetMaterialPixelDataSize(header);
+}
+
+MaterialReader::MaterialReader(const InputStream& istream) :
+    m_istream(istream)
+{
+    auto index = LoadCndIndex(istream);
+    m_pixelDataLeft = index.pixelDataSize;
+    m_headers.reserve(index.materials.size());
+    for(const auto& loc : index.materials) {
+        m_headers.push_back(loc.header);
+    }
+}
+
+std::optional<CndMaterialData> MaterialReader::next(std::pmr::memory_resource* mr)
+{
+    if(m_next >= m_headers.size()) {
+        return std::nullopt;
+    }
+
+    const auto& header = m_headers[m_next++];
+    const uint32_t nPixelDataSize = GetMaterialPixelDataSize(header);
+    if(nPixelDataSize > m_pixelDataLeft) {
+        throw StreamError(std::string("Pixel data of material ") + header.name + " exceeds materials bitmap data size");
+    }
+
+    /* Materials' pixel data is stored in the same order as headers */
+    std::optional<CndMaterialData> data(CndMaterialData{ header, Bitmap(nPixelDataSize, mr) });
+    if(m_istream.read(data->pixelData.data(), nPixelDataSize) != nPixelDataSize) {
+        throw StreamError(std::string("Could not read pixel data of material ") + header.name);
+    }
+
+    m_pixelDataLeft -= nPixelDataSize;
+    return data;
+}
+
+Material libim::CND::DecodeMaterial(const CndMaterialData& data, std::pmr::memory_resource* mr)
+{
+    const auto& matHeader = data.header;
+
+    /* Verify material bitdepth */
+    if(matHeader.colorInfo.bpp % 8 != 0) {
+        throw StreamError(std::string("Cannot extract material ") + matHeader.name + " from buffer. Wrong bitdepth size: " + std::to_string(matHeader.colorInfo.bpp));
+    }
+
+    if(data.pixelData.size() != GetMaterialPixelDataSize(matHeader)) {
+        throw StreamError(std::string("Wrong pixel data size of material ") + matHeader.name);
+    }
+
+    /* Read mipmaps from buffer */
+    std::pmr::vector<Mipmap> mipmaps(mr);
+    mipmaps.reserve(matHeader.mipmapCount);
+
+    auto itPixelData = data.pixelData.cbegin();
+    for(int32_t i = 0; i < matHeader.mipmapCount; i++)
+    {
+        Mipmap mipmap(mr);
+        itPixelData = CopyMipmapFromBuffer(mipmap, itPixelData, matHeader.texturesPerMipmap, matHeader.width, matHeader.height, matHeader.colorInfo, mr);
+        mipmaps.push_back(std::move(mipmap));
+    }
+
+    /* Init new material */
+    Material mat(matHeader.name, mr);
+    mat.setSize(matHeader.width, matHeader.height);
+    mat.setColorFormat(matHeader.colorInfo);
+    mat.setMipmaps(std::move(mipmaps));
+
+    StatAdd(Stat::Materials);
+    return mat;
+}
+
+CndIndex libim::CND::LoadCndIndex(const InputStream& istream)
+{
+    CndIndex index;
+
+    /* Read cnd file header */
+    index.header = LoadHeader(istream);
+    index.pixelDataOffset = istream.tell();
+    if(index.header.numMaterials > 0)
+    {
+        /* Seek to materials position */
+        istream.seek(GetMatSectionOffset(index.header));
+
+        /* Read materials pixel data size and material header list.
+           Pixel data of materials follows material header list in the same order. */
+        index.pixelDataSize = istream.read<uint32_t>();
+        const auto headers  = istream.read<std::vector<CndMatHeader>>(index.header.numMaterials);
+        index.pixelDataOffset = istream.tell();
+
+        index.materials.reserve(headers.size());
+        uint64_t offset = index.pixelDataOffset;
+        for(const auto& header : headers)
+        {
+            CndMaterialLocation loc;
+            loc.header = header;
+            loc.offset = offset;
+            loc.size   = GetMaterialPixelDataSize(header);
+            offset += loc.size;
+
+            if(offset > istream.size()) {
+                throw StreamError(std::string("Pixel data of material ") + header.name + " exceeds CND file size");
+            }
+
+            index.materials.push_back(loc);
+        }
+    }
+
+    return index;
+}
+
+std::vector<CndMaterialLocation> libim::CND::LoadMaterialLocations(const InputStream& istream)
+{
+    return LoadCndIndex(istream).materials;
+}
+
+void libim::CND::CopyMaterialToMat(const InputStream& istream, const CndMaterialLocation& mat, Stream& ostream)
+{
+    const auto& matHeader = mat.header;
+    if(matHeader.mipmapCount < 1 || matHeader.texturesPerMipmap < 1) {
+        throw StreamError(std::string("No pixel data found for material ") + matHeader.name);
+    }
+
+    /* Verify material bitdepth */
+    if(matHeader.colorInfo.bpp % 8 != 0) {
+        throw StreamError(std::string("Cannot extract material ") + matHeader.name + ". Wrong bitdepth size: " + std::to_string(matHeader.colorInfo.bpp));
+    }
+
+    /* Each mipmap header is followed by its textures' pixel data, same as in CND file */
+    MatMipmapHeader mmHeader {};
+    mmHeader.width        = matHeader.width;
+    mmHeader.height       = matHeader.height;
+    mmHeader.textureCount = matHeader.texturesPerMipmap;
+
+    WriteBatch batch;
+    WriteMatFileHeader(batch, matHeader.colorInfo, matHeader.mipmapCount);
+
+    const uint32_t nMipmapSize = GetMipmapPixelDataSize(matHeader.texturesPerMipmap, matHeader.width, matHeader.height, matHeader.colorInfo.bpp);
+    for(int32_t i = 0; i < matHeader.mipmapCount; i++)
+    {
+        batch.add(mmHeader);
+        ostream.write(batch);
+        batch.clear();
+
+        ostream.write(istream, mat.offset + i * nMipmapSize, nMipmapSize);
+    }
+
+    StatAdd(Stat::Materials);
+}
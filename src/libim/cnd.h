@@ -7,6 +7,8 @@
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
@@ -17,11 +19,15 @@
 #include "material/texture.h"
 #include "common.h"
 #include "io/filestream.h"
+#include "io/record.h"
 #include "io/stream.h"
 
 namespace libim {
 namespace CND {
 
+static constexpr uint32_t FileVersion = 3;
+extern const std::array<char, 1216> CopyrightNotice;
+
 //PACKED(
 struct CndHeader
 {
@@ -36,7 +42,7 @@ struct CndHeader
     float    horizonSkyOffset[2]; // x,y
     float    ceilingSkyOffset[2]; // x,y
     float    LOD_Distances[4];
-    struct {
+    struct Fog {
         int32_t enabled;
         float color[4]; //rgba
         float startDepth;
@@ -79,8 +85,138 @@ struct CndMatHeader
 CndHeader LoadHeader(const InputStream& istream);
 
 uint32_t GetMatSectionOffset(const CndHeader& header);
-std::vector<Material> LoadMaterials(const InputStream& istream);
+/* Loads all materials from CND file stream.
+   Materials' mipmaps and bitmaps are allocated from mr, e.g. MaterialArena::resource(). */
+std::vector<Material> LoadMaterials(const InputStream& istream, std::pmr::memory_resource* mr = std::pmr::get_default_resource());
 bool ReplaceMaterial(const Material& mat, const std::string& filename);
 
+/* Material header and raw pixel data as stored in CND file */
+struct CndMaterialData
+{
+    CndMatHeader header;
+    Bitmap pixelData;
+};
+
+/* Returns size of material's pixel data in CND file */
+uint32_t GetMaterialPixelDataSize(const CndMatHeader& header);
+
+/* Returns true if material can be written as MAT file by CopyMaterialToMat */
+bool IsMatCopyable(const CndMatHeader& header);
+
+/* Returns size of MAT file written by CopyMaterialToMat */
+uint64_t GetMatFileSize(const CndMatHeader& header);
+
+/* Reads materials from CND file stream one at a time, so the memory needed
+   doesn't grow with the number of materials in file.
+   Material headers are read on construction. Throws StreamError on error. */
+class MaterialReader
+{
+public:
+    explicit MaterialReader(const InputStream& istream);
+
+    const std::vector<CndMatHeader>& headers() const
+    {
+        return m_headers;
+    }
+
+    /* Reads next material's pixel data allocated from mr. Returns nothing when all materials were read. */
+    std::optional<CndMaterialData> next(std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+private:
+    const InputStream& m_istream;
+    std::vector<CndMatHeader> m_headers;
+    std::size_t m_next = 0;
+    uint32_t m_pixelDataLeft = 0;
+};
+
+/* Location of material's pixel data in CND file */
+struct CndMaterialLocation
+{
+    CndMatHeader header;
+    uint64_t offset = 0;  // Offset of pixel data from the beginning of file
+    uint32_t size   = 0;  // Size of pixel data
+};
+
+/* Parsed CND file header and material header list */
+struct CndIndex
+{
+    CndHeader header;
+    uint32_t pixelDataSize   = 0; // Size of all materials' pixel data
+    uint64_t pixelDataOffset = 0; // Offset of first material's pixel data
+    std::vector<CndMaterialLocation> materials;
+};
+
+/* Reads CND file header and material header list from the beginning of istream and computes
+   where each material's pixel data is stored. Stream is left at the first material's pixel data.
+   Throws StreamError on error. */
+CndIndex LoadCndIndex(const InputStream& istream);
+
+/* Reads material headers from CND file stream and computes where each material's pixel data is stored.
+   Throws StreamError on error. */
+std::vector<CndMaterialLocation> LoadMaterialLocations(const InputStream& istream);
+
+/* Writes material stored in CND file to ostream in MAT format without decoding its textures.
+   MAT headers are made from material's CND header and pixel data is copied as is from istream,
+   file to file by kernel if both streams are files. Throws StreamError on error. */
+void CopyMaterialToMat(const InputStream& istream, const CndMaterialLocation& mat, Stream& ostream);
+
+/* Makes material from its header and pixel data. Mipmaps and bitmaps are allocated from mr.
+   Throws StreamError if material's bit depth or pixel data size is invalid. */
+Material DecodeMaterial(const CndMaterialData& data, std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
 }}
+
+/* On-disk record layouts */
+LIBIM_RECORD_LAYOUT(libim::CND::CndHeader::Fog, 28,
+    LIBIM_FIELD(libim::CND::CndHeader::Fog, enabled),
+    LIBIM_FIELD(libim::CND::CndHeader::Fog, color),
+    LIBIM_FIELD(libim::CND::CndHeader::Fog, startDepth),
+    LIBIM_FIELD(libim::CND::CndHeader::Fog, endDepth)
+);
+
+LIBIM_RECORD_LAYOUT(libim::CND::CndHeader, 1576,
+    LIBIM_FIELD(libim::CND::CndHeader, fileSize),
+    LIBIM_FIELD(libim::CND::CndHeader, copyright),
+    LIBIM_FIELD(libim::CND::CndHeader, filePath),
+    LIBIM_FIELD(libim::CND::CndHeader, type),
+    LIBIM_FIELD(libim::CND::CndHeader, version),
+    LIBIM_FIELD(libim::CND::CndHeader, worldGravity),
+    LIBIM_FIELD(libim::CND::CndHeader, ceilingSky_Z),
+    LIBIM_FIELD(libim::CND::CndHeader, horizonDistance),
+    LIBIM_FIELD(libim::CND::CndHeader, horizonSkyOffset),
+    LIBIM_FIELD(libim::CND::CndHeader, ceilingSkyOffset),
+    LIBIM_FIELD(libim::CND::CndHeader, LOD_Distances),
+    LIBIM_FIELD(libim::CND::CndHeader, fog),
+    LIBIM_FIELD(libim::CND::CndHeader, unknown2),
+    LIBIM_FIELD(libim::CND::CndHeader, numMaterials),
+    LIBIM_FIELD(libim::CND::CndHeader, sizeMaterials),
+    LIBIM_FIELD(libim::CND::CndHeader, aMaterials),
+    LIBIM_FIELD(libim::CND::CndHeader, unknown4),
+    LIBIM_FIELD(libim::CND::CndHeader, aSelectors),
+    LIBIM_FIELD(libim::CND::CndHeader, unknown5),
+    LIBIM_FIELD(libim::CND::CndHeader, worldAIClasses),
+    LIBIM_FIELD(libim::CND::CndHeader, unknown6),
+    LIBIM_FIELD(libim::CND::CndHeader, numModels),
+    LIBIM_FIELD(libim::CND::CndHeader, sizeModels),
+    LIBIM_FIELD(libim::CND::CndHeader, aModels),
+    LIBIM_FIELD(libim::CND::CndHeader, numSprites),
+    LIBIM_FIELD(libim::CND::CndHeader, sizeSprites),
+    LIBIM_FIELD(libim::CND::CndHeader, aSprites),
+    LIBIM_FIELD(libim::CND::CndHeader, numKeyframes),
+    LIBIM_FIELD(libim::CND::CndHeader, sizeKeyframes),
+    LIBIM_FIELD(libim::CND::CndHeader, aKeyframes),
+    LIBIM_FIELD(libim::CND::CndHeader, unknown9),
+    LIBIM_FIELD(libim::CND::CndHeader, worldSounds),
+    LIBIM_FIELD(libim::CND::CndHeader, worldSoundUnknown)
+);
+
+LIBIM_RECORD_LAYOUT(libim::CND::CndMatHeader, 136,
+    LIBIM_FIELD(libim::CND::CndMatHeader, name),
+    LIBIM_FIELD(libim::CND::CndMatHeader, width),
+    LIBIM_FIELD(libim::CND::CndMatHeader, height),
+    LIBIM_FIELD(libim::CND::CndMatHeader, mipmapCount),
+    LIBIM_FIELD(libim::CND::CndMatHeader, texturesPerMipmap),
+    LIBIM_FIELD(libim::CND::CndMatHeader, colorInfo)
+);
+
 #endif // LIBIM_CND_H
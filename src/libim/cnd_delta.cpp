@@ -0,0 +1,401 @@
+#include "cnd_delta.h"
+#include "cnd.h"
+#include "utils/xxhash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace libim::CND;
+
+namespace {
+    /* Size of buffers files are read into */
+    constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+    /* Size of blocks aligned parts of files are compared in */
+    constexpr std::size_t BLOCK_SIZE = 4 * 1024;
+
+    /* Max size of pending insert data */
+    constexpr std::size_t MAX_INSERT_SIZE = 1024 * 1024;
+
+    /* Max size of one stream to stream copy, bounds buffer of streams which are not files */
+    constexpr uint64_t MAX_COPY_SIZE = 1024 * 1024;
+
+    struct Range
+    {
+        uint64_t offset = 0;
+        uint64_t size   = 0;
+    };
+
+    struct MaterialSections
+    {
+        std::string name;
+        Range header; // Material's record in material header list
+        Range pixels; // Material's pixel data
+    };
+
+    /* Sections of CND file which are aligned to sections of the other file */
+    struct CndLayout
+    {
+        Range header;       // CND file header
+        Range sounds;       // Sound data and sound headers
+        Range matListSize;  // Size of materials' pixel data preceding material header list
+        std::vector<MaterialSections> materials;
+        Range tail;         // Everything after material pixel data
+    };
+
+    CndLayout GetLayout(const InputStream& istream)
+    {
+        CndLayout layout;
+        const uint64_t size = istream.size();
+
+        istream.seek(0);
+        const auto index = LoadCndIndex(istream);
+        layout.header = { 0, sizeof(CndHeader) };
+        if(index.materials.empty())
+        {
+            layout.tail = { layout.header.size, size - layout.header.size };
+            return layout;
+        }
+
+        const uint64_t matSectionOffset = GetMatSectionOffset(index.header);
+        layout.sounds      = { layout.header.size, matSectionOffset - layout.header.size };
+        layout.matListSize = { matSectionOffset, sizeof(uint32_t) };
+
+        uint64_t headerOffset = matSectionOffset + sizeof(uint32_t);
+        for(const auto& loc : index.materials)
+        {
+            MaterialSections m;
+            m.name   = std::string(loc.header.name, strnlen(loc.header.name, sizeof(loc.header.name)));
+            m.header = { headerOffset, sizeof(CndMatHeader) };
+            m.pixels = { loc.offset, loc.size };
+            layout.materials.push_back(std::move(m));
+            headerOffset += sizeof(CndMatHeader);
+        }
+
+        const uint64_t pixelEnd = index.materials.back().offset + index.materials.back().size;
+        layout.tail = { pixelEnd, size - pixelEnd };
+        return layout;
+    }
+
+    /* Writes ops to patch stream, merging adjacent copies and buffering inserts */
+    class DeltaWriter
+    {
+    public:
+        explicit DeltaWriter(Stream& patch) : m_patch(patch)
+        {}
+
+        void copy(uint64_t offset, uint64_t size)
+        {
+            if(size == 0) {
+                return;
+            }
+
+            flushInsert();
+            if(m_copy.size > 0 && m_copy.offset + m_copy.size == offset)
+            {
+                m_copy.size += size;
+                return;
+            }
+
+            flushCopy();
+            m_copy = { offset, size };
+        }
+
+        void insert(const byte_t* data, std::size_t size)
+        {
+            flushCopy();
+            m_insert.insert(m_insert.end(), data, data + size);
+            if(m_insert.size() >= MAX_INSERT_SIZE) {
+                flushInsert();
+            }
+        }
+
+        /* Inserts range of istream */
+        void insert(const InputStream& istream, Range range)
+        {
+            ByteArray buffer(std::min<uint64_t>(range.size, CHUNK_SIZE));
+            istream.seek(range.offset);
+            for(uint64_t left = range.size; left > 0;)
+            {
+                const std::size_t n = std::min<uint64_t>(left, CHUNK_SIZE);
+                istream.read(buffer.data(), n);
+                insert(buffer.data(), n);
+                left -= n;
+            }
+        }
+
+        void finish()
+        {
+            flushCopy();
+            flushInsert();
+            writeOp(DeltaOp::End, 0, 0);
+        }
+
+        const CndDeltaStats& stats() const
+        {
+            return m_stats;
+        }
+
+    private:
+        void writeOp(DeltaOp op, uint64_t offset, uint64_t size, const byte_t* data = nullptr)
+        {
+            WriteBatch batch;
+            batch.add(CndDeltaOp{ op, 0, offset, size })
+                 .add(data, data ? size : 0);
+            m_patch.write(batch);
+        }
+
+        void flushCopy()
+        {
+            if(m_copy.size == 0) {
+                return;
+            }
+
+            writeOp(DeltaOp::Copy, m_copy.offset, m_copy.size);
+            m_stats.copiedBytes += m_copy.size;
+            m_stats.nCopyOps++;
+            m_copy = {};
+        }
+
+        void flushInsert()
+        {
+            if(m_insert.empty()) {
+                return;
+            }
+
+            writeOp(DeltaOp::Insert, 0, m_insert.size(), m_insert.data());
+            m_stats.insertedBytes += m_insert.size();
+            m_stats.nInsertOps++;
+            m_insert.clear();
+        }
+
+        Stream& m_patch;
+        Range m_copy;
+        ByteArray m_insert;
+        CndDeltaStats m_stats;
+    };
+
+    /* Returns size of equal data at the beginning of ranges, or at the end if backward,
+       compared in blocks up to maxSize bytes */
+    uint64_t MatchBlocks(const InputStream& oldCnd, Range oldRange, const InputStream& newCnd, Range newRange, uint64_t maxSize, bool backward)
+    {
+        ByteArray oldBuf(std::min<uint64_t>(maxSize, CHUNK_SIZE));
+        ByteArray newBuf(oldBuf.size());
+        uint64_t matched = 0;
+        while(matched < maxSize)
+        {
+            const std::size_t n = std::min<uint64_t>(maxSize - matched, CHUNK_SIZE);
+            oldCnd.seek(backward ? oldRange.offset + oldRange.size - matched - n : oldRange.offset + matched);
+            oldCnd.read(oldBuf.data(), n);
+            newCnd.seek(backward ? newRange.offset + newRange.size - matched - n : newRange.offset + matched);
+            newCnd.read(newBuf.data(), n);
+
+            for(std::size_t done = 0; done < n;)
+            {
+                const std::size_t bn = std::min(BLOCK_SIZE, n - done);
+                const std::size_t b  = backward ? n - done - bn : done;
+                if(std::memcmp(oldBuf.data() + b, newBuf.data() + b, bn) != 0) {
+                    return matched + done;
+                }
+                done += bn;
+            }
+
+            matched += n;
+        }
+        return matched;
+    }
+
+    /* Writes ops which turn oldRange of oldCnd into newRange of newCnd */
+    void DiffRange(const InputStream& oldCnd, Range oldRange, const InputStream& newCnd, Range newRange, DeltaWriter& writer)
+    {
+        if(oldRange.size != newRange.size)
+        {
+            /* Data was inserted or removed somewhere in range, equal blocks before and after it are copied */
+            const uint64_t common = std::min(oldRange.size, newRange.size);
+            const uint64_t prefix = MatchBlocks(oldCnd, oldRange, newCnd, newRange, common, /*backward=*/false);
+            const uint64_t suffix = MatchBlocks(oldCnd, oldRange, newCnd, newRange, common - prefix, /*backward=*/true);
+
+            writer.copy(oldRange.offset, prefix);
+            writer.insert(newCnd, Range{ newRange.offset + prefix, newRange.size - prefix - suffix });
+            writer.copy(oldRange.offset + oldRange.size - suffix, suffix);
+            return;
+        }
+
+        ByteArray oldBuf(std::min<uint64_t>(oldRange.size, CHUNK_SIZE));
+        ByteArray newBuf(oldBuf.size());
+        for(uint64_t pos = 0; pos < newRange.size;)
+        {
+            const std::size_t n = std::min<uint64_t>(newRange.size - pos, CHUNK_SIZE);
+            oldCnd.seek(oldRange.offset + pos);
+            oldCnd.read(oldBuf.data(), n);
+            newCnd.seek(newRange.offset + pos);
+            newCnd.read(newBuf.data(), n);
+
+            for(std::size_t b = 0; b < n; b += BLOCK_SIZE)
+            {
+                const std::size_t bn = std::min(BLOCK_SIZE, n - b);
+                if(std::memcmp(oldBuf.data() + b, newBuf.data() + b, bn) == 0) {
+                    writer.copy(oldRange.offset + pos + b, bn);
+                }
+                else {
+                    writer.insert(newBuf.data() + b, bn);
+                }
+            }
+
+            pos += n;
+        }
+    }
+
+    /* Copies size bytes at offset of istream to ostream */
+    void CopyRange(const InputStream& istream, uint64_t offset, uint64_t size, Stream& ostream)
+    {
+        while(size > 0)
+        {
+            const uint64_t n = std::min(size, MAX_COPY_SIZE);
+            ostream.write(istream, offset, n);
+            offset += n;
+            size   -= n;
+        }
+    }
+}
+
+uint64_t libim::CND::HashStream(const InputStream& istream)
+{
+    XXHash64 hash;
+    ByteArray buffer(CHUNK_SIZE);
+
+    istream.seek(0);
+    for(uint64_t left = istream.size(); left > 0;)
+    {
+        const std::size_t n = std::min<uint64_t>(left, CHUNK_SIZE);
+        istream.read(buffer.data(), n);
+        hash.update(buffer.data(), n);
+        left -= n;
+    }
+
+    return hash.digest();
+}
+
+CndDeltaStats libim::CND::WriteCndDelta(const InputStream& oldCnd, const InputStream& newCnd, Stream& patch)
+{
+    const auto oldLayout = GetLayout(oldCnd);
+    const auto newLayout = GetLayout(newCnd);
+
+    CndDeltaHeader header;
+    std::memcpy(header.magic, DeltaMagic, sizeof(header.magic));
+    header.version = DeltaVersion;
+    header.oldSize = oldCnd.size();
+    header.oldHash = HashStream(oldCnd);
+    header.newSize = newCnd.size();
+    header.newHash = HashStream(newCnd);
+
+    WriteBatch batch;
+    batch.add(header);
+    patch.write(batch);
+
+    DeltaWriter writer(patch);
+    DiffRange(oldCnd, oldLayout.header, newCnd, newLayout.header, writer);
+    DiffRange(oldCnd, oldLayout.sounds, newCnd, newLayout.sounds, writer);
+    DiffRange(oldCnd, oldLayout.matListSize, newCnd, newLayout.matListSize, writer);
+
+    /* Material headers and pixel data of new file are aligned with old material of the same name */
+    std::unordered_map<std::string, const MaterialSections*> oldMaterials;
+    for(const auto& m : oldLayout.materials) {
+        oldMaterials.emplace(m.name, &m);
+    }
+
+    for(const auto& m : newLayout.materials)
+    {
+        auto it = oldMaterials.find(m.name);
+        if(it != oldMaterials.end()) {
+            DiffRange(oldCnd, it->second->header, newCnd, m.header, writer);
+        }
+        else {
+            writer.insert(newCnd, m.header);
+        }
+    }
+
+    for(const auto& m : newLayout.materials)
+    {
+        auto it = oldMaterials.find(m.name);
+        if(it != oldMaterials.end()) {
+            DiffRange(oldCnd, it->second->pixels, newCnd, m.pixels, writer);
+        }
+        else {
+            writer.insert(newCnd, m.pixels);
+        }
+    }
+
+    DiffRange(oldCnd, oldLayout.tail, newCnd, newLayout.tail, writer);
+    writer.finish();
+    return writer.stats();
+}
+
+CndDeltaHeader libim::CND::ReadCndDeltaHeader(const InputStream& patch, const InputStream& oldCnd)
+{
+    patch.seek(0);
+    const auto header = patch.read<CndDeltaHeader>();
+    if(std::memcmp(header.magic, DeltaMagic, sizeof(header.magic)) != 0) {
+        throw StreamError("Not a CND delta patch");
+    }
+
+    if(header.version != DeltaVersion) {
+        throw StreamError("Unsupported CND delta patch version: " + std::to_string(header.version));
+    }
+
+    if(header.oldSize != oldCnd.size() || header.oldHash != HashStream(oldCnd)) {
+        throw StreamError("CND delta patch was made for a different CND file");
+    }
+
+    patch.seek(sizeof(CndDeltaHeader));
+    return header;
+}
+
+CndDeltaHeader libim::CND::ApplyCndDelta(const InputStream& oldCnd, const InputStream& patch, Stream& newCnd)
+{
+    const auto header = ReadCndDeltaHeader(patch, oldCnd);
+
+    uint64_t nWritten = 0;
+    for(;;)
+    {
+        const auto op = patch.read<CndDeltaOp>();
+        if(op.op == DeltaOp::End) {
+            break;
+        }
+
+        if(op.size > header.newSize - nWritten) {
+            throw StreamError("CND delta patch writes past the end of new file");
+        }
+
+        if(op.op == DeltaOp::Copy)
+        {
+            if(op.offset > oldCnd.size() || op.size > oldCnd.size() - op.offset) {
+                throw StreamError("CND delta patch copies past the end of old file");
+            }
+            CopyRange(oldCnd, op.offset, op.size, newCnd);
+        }
+        else if(op.op == DeltaOp::Insert)
+        {
+            const uint64_t offset = patch.tell();
+            if(offset > patch.size() || op.size > patch.size() - offset) {
+                throw StreamError("CND delta patch is truncated");
+            }
+            CopyRange(patch, offset, op.size, newCnd);
+            patch.seek(offset + op.size);
+        }
+        else {
+            throw StreamError("Invalid CND delta patch op: " + std::to_string(uint32_t(op.op)));
+        }
+
+        nWritten += op.size;
+    }
+
+    if(nWritten != header.newSize) {
+        throw StreamError("CND delta patch is truncated");
+    }
+
+    return header;
+}
@@ -0,0 +1,88 @@
+#ifndef LIBIM_CND_DELTA_H
+#define LIBIM_CND_DELTA_H
+#include <cstdint>
+
+#include "io/record.h"
+#include "io/stream.h"
+
+namespace libim {
+namespace CND {
+
+static constexpr char     DeltaMagic[4] = { 'C', 'N', 'D', 'D' };
+static constexpr uint32_t DeltaVersion  = 1;
+
+/* Header of delta patch file. It's followed by a list of ops ending with DeltaOp::End. */
+struct CndDeltaHeader
+{
+    char     magic[4];
+    uint32_t version;
+    uint64_t oldSize;
+    uint64_t oldHash; // XXH64 of old file
+    uint64_t newSize;
+    uint64_t newHash; // XXH64 of new file
+};
+
+enum class DeltaOp : uint32_t
+{
+    End    = 0,
+    Copy   = 1, // Copy size bytes at offset of old file
+    Insert = 2  // Write size bytes following the op
+};
+
+struct CndDeltaOp
+{
+    DeltaOp  op;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct CndDeltaStats
+{
+    uint64_t copiedBytes   = 0;
+    uint64_t insertedBytes = 0;
+    uint32_t nCopyOps      = 0;
+    uint32_t nInsertOps    = 0;
+};
+
+/* Returns XXH64 hash of the whole stream */
+uint64_t HashStream(const InputStream& istream);
+
+/* Writes delta patch which turns oldCnd into newCnd to patch stream.
+   Files are aligned by section: file header, sounds, header and pixel data of each material
+   matched by name and the part after material pixel data. Aligned parts of equal size are
+   compared in blocks, equal blocks are copied from old file and the rest is inserted.
+   Of parts whose size changed, equal blocks at their beginning and end are copied and the
+   data between them is inserted. Memory use doesn't depend on file size. Throws StreamError if a file is not a valid CND file. */
+CndDeltaStats WriteCndDelta(const InputStream& oldCnd, const InputStream& newCnd, Stream& patch);
+
+/* Reads delta patch header and verifies it was made for oldCnd.
+   Throws StreamError if patch is not a delta patch or oldCnd doesn't match. */
+CndDeltaHeader ReadCndDeltaHeader(const InputStream& patch, const InputStream& oldCnd);
+
+/* Applies delta patch to oldCnd and writes the result to newCnd.
+   Copies are done file to file by kernel if both streams are files, so memory use doesn't
+   depend on file size. The result should be verified against returned header's newSize and
+   newHash. Throws StreamError if patch is invalid or doesn't match oldCnd. */
+CndDeltaHeader ApplyCndDelta(const InputStream& oldCnd, const InputStream& patch, Stream& newCnd);
+
+}}
+
+/* On-disk record layouts */
+LIBIM_RECORD_LAYOUT(libim::CND::CndDeltaHeader, 40,
+    LIBIM_FIELD(libim::CND::CndDeltaHeader, magic),
+    LIBIM_FIELD(libim::CND::CndDeltaHeader, version),
+    LIBIM_FIELD(libim::CND::CndDeltaHeader, oldSize),
+    LIBIM_FIELD(libim::CND::CndDeltaHeader, oldHash),
+    LIBIM_FIELD(libim::CND::CndDeltaHeader, newSize),
+    LIBIM_FIELD(libim::CND::CndDeltaHeader, newHash)
+);
+
+LIBIM_RECORD_LAYOUT(libim::CND::CndDeltaOp, 24,
+    LIBIM_FIELD(libim::CND::CndDeltaOp, op),
+    LIBIM_FIELD(libim::CND::CndDeltaOp, reserved),
+    LIBIM_FIELD(libim::CND::CndDeltaOp, offset),
+    LIBIM_FIELD(libim::CND::CndDeltaOp, size)
+);
+
+#endif // LIBIM_CND_DELTA_H
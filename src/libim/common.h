@@ -7,6 +7,7 @@
 #include <climits>
 #include <ios>
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <vector>
 #include <type_traits>
@@ -45,11 +46,12 @@ static constexpr std::size_t BYTE_BIT = CHAR_BIT;
 using byte_t = uint8_t;
 using ByteArray = std::vector<byte_t>;
 
-using Bitmap = ByteArray;
+using Bitmap = std::pmr::vector<byte_t>;
 using BitmapPtr = std::shared_ptr<Bitmap>;
 
-inline BitmapPtr MakeBitmapPtr(std::size_t size) {
-    return std::make_shared<Bitmap>(size);
+/* Allocates bitmap and its shared_ptr control block in one allocation from mr */
+inline BitmapPtr MakeBitmapPtr(std::size_t size, std::pmr::memory_resource* mr = std::pmr::get_default_resource()) {
+    return std::allocate_shared<Bitmap>(std::pmr::polymorphic_allocator<Bitmap>(mr), size);
 }
 
 
@@ -240,7 +242,7 @@ inline bool MakeDir(const std::string& dirName)
 #endif
 }
 
-static  bool MakePath(const std::string& path, bool createFile = false)
+inline bool MakePath(const std::string& path, bool createFile = false)
 {
     if(path.empty()) {
         return false;
@@ -9,6 +9,8 @@
 #include <vector>
 
 #include "common.h"
+#include "stats.h"
+#include "io/record.h"
 #include "io/stream.h"
 #include "io/filestream.h"
 
@@ -29,69 +31,68 @@ struct GobFileEntry {
     char name[GOB_ENTRY_NAME_MAX_SIZE];
 };
 
+LIBIM_RECORD_LAYOUT(GobFileHeader, 12,
+    LIBIM_FIELD(GobFileHeader, signature),
+    LIBIM_FIELD(GobFileHeader, version),
+    LIBIM_FIELD(GobFileHeader, directoryOffset)
+);
+
+LIBIM_RECORD_LAYOUT(GobFileEntry, 136,
+    LIBIM_FIELD(GobFileEntry, offset),
+    LIBIM_FIELD(GobFileEntry, size),
+    LIBIM_FIELD(GobFileEntry, name)
+);
+
 struct GobFileDirectory
 {
     StreamPtr<Stream> stream;
     std::vector<GobFileEntry> entries;
 };
 
-template<>
-GobFileHeader Stream::read() const
+/* Reads header and directory entries of GOB file from istream.
+   Prints error and returns false if istream is not a GOB file, throws on stream error. */
+inline bool LoadGobDirectory(const InputStream& istream, std::vector<GobFileEntry>& entries)
 {
-    GobFileHeader header;
-    const auto nRead = read(reinterpret_cast<byte_t*>(&header), sizeof(header));
-    if(nRead != sizeof(header)) {
-        throw StreamError("Faild to read 'GobFileHeader'");
-    }
+    /* Read Header */
+    auto header = istream.read<GobFileHeader>();
 
-    return header;
-}
+    /* Verify file signature */
+    if(header.signature != GOB_FILE_SIGNATURE)
+    {
+        std::cerr << "Error unknown GOB file!\n";
+        return false;
+    }
 
-template<>
-GobFileEntry Stream::read() const
-{
-    GobFileEntry entry;
-    const auto nRead = read(reinterpret_cast<byte_t*>(&entry), sizeof(entry));
-    if(nRead != sizeof(entry)) {
-        throw StreamError("Faild to read 'GobFileEntry'");
+    /* Verify file version */
+    if(header.version != GOB_FILE_VERSION)
+    {
+        std::cerr << "Error wrong GOB file version: " << header.version << std::endl;
+        return false;
     }
 
-    return entry;
+    /* Seek to directory */
+    istream.seek(header.directoryOffset);
+
+    /* Read Directory size */
+    const auto nDirSize = istream.read<uint32_t>();
+
+    /* Read Directory */
+    entries = istream.read<std::vector<GobFileEntry>>(nDirSize);
+    StatAdd(Stat::GobEntries, entries.size());
+    return true;
 }
 
-std::shared_ptr<GobFileDirectory> LoadGobFromFile(const std::string& filepath)
+/* Opens GOB file and loads its directory */
+inline std::shared_ptr<GobFileDirectory> LoadGobFromFile(const std::string& filepath)
 {
     try
     {
         auto ifs = MakeStreamPtr<InputFileStream>(filepath);
-
-        /* Read Header */
-        auto header = ifs->read<GobFileHeader>();
-
-        /* Verify file signature */
-        if(header.signature != GOB_FILE_SIGNATURE)
-        {
-            std::cerr << "Error unknown GOB file!\n";
-            return nullptr;
-        }
-
-        /* Verify file version */
-        if(header.version != GOB_FILE_VERSION)
-        {
-            std::cerr << "Error wrong GOB file version: " << header.version << std::endl;
+        auto directory = std::make_shared<GobFileDirectory>();
+        if(!LoadGobDirectory(*ifs, directory->entries)) {
             return nullptr;
         }
 
-        /* Seek to directory */
-        ifs->seek(header.directoryOffset);
-
-        /* Read Directory size */
-        const auto nDirSize = ifs->read<uint32_t>();
-
-        /* Read Directory */
-        auto directory = std::make_shared<GobFileDirectory>();
-        directory->entries = ifs->read<std::vector<GobFileEntry>>(nDirSize);
-
         // TODO: measure if below method is faster
 //       // directory->entries.resize(nDirSize);
 //        const auto nToRead = nDirSize * sizeof(GobFileEntry);
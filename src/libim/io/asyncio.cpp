@@ -0,0 +1,498 @@
+#include "asyncio.h"
+#include "../stats.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifndef OS_WINDOWS
+# include <errno.h>
+# include <sys/uio.h>
+# include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# define LIBIM_HAS_IO_URING 1
+#endif
+
+
+void AsyncIO::submit(const AsyncRequest& req)
+{
+    if(m_inFlight >= m_depth) {
+        throw AsyncIOError("Async I/O queue is full");
+    }
+
+    queue(req);
+    m_inFlight++;
+
+    switch (req.op)
+    {
+    case AsyncRequest::Read:
+        StatAdd(Stat::ReadCalls);
+        break;
+    case AsyncRequest::Write:
+        StatAdd(Stat::WriteCalls);
+        break;
+    case AsyncRequest::Fsync:
+        StatAdd(Stat::Syncs);
+        break;
+    }
+}
+
+std::size_t AsyncIO::wait(std::vector<AsyncCompletion>& completions, std::size_t minComplete)
+{
+    minComplete = std::min(minComplete, m_inFlight);
+    const std::size_t first = completions.size();
+    const auto nReaped = reap(completions, minComplete);
+    m_inFlight -= nReaped;
+
+    for(std::size_t i = first; i < completions.size(); i++)
+    {
+        const auto& c = completions[i];
+        if(c.result > 0 && c.op == AsyncRequest::Read) {
+            StatAdd(Stat::BytesRead, c.result);
+        }
+        else if(c.result > 0 && c.op == AsyncRequest::Write) {
+            StatAdd(Stat::BytesWritten, c.result);
+        }
+    }
+
+    return nReaped;
+}
+
+
+#ifdef LIBIM_HAS_IO_URING
+namespace {
+    int IoUringSetup(unsigned entries, io_uring_params* p)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    int IoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+    }
+
+    int IoUringRegister(int fd, unsigned opcode, const void* arg, unsigned nrArgs)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+    }
+
+    template<typename T>
+    T LoadAcquire(const T* p)
+    {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    template<typename T>
+    void StoreRelease(T* p, T v)
+    {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+
+    /* io_uring backend. Uses the raw kernel interface so no liburing is needed. */
+    class IoUring final : public AsyncIO
+    {
+    public:
+        explicit IoUring(std::size_t depth) : AsyncIO(depth)
+        {
+            /* user_data of submitted entries is index into m_slots */
+            m_slots.resize(depth);
+            for(std::size_t i = depth; i > 0; i--) {
+                m_freeSlots.push_back(i - 1);
+            }
+
+            io_uring_params params {};
+            m_fd = IoUringSetup(static_cast<unsigned>(depth), &params);
+            if(m_fd < 0) {
+                throw AsyncIOError(std::string("io_uring_setup failed: ") + strerror(errno));
+            }
+
+            StatAdd(Stat::Syscalls);
+
+            /* Map submission and completion rings */
+            m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if(singleMmap) {
+                m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+            }
+
+            m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+            if(m_sqRing == MAP_FAILED)
+            {
+                m_sqRing = nullptr;
+                cleanup();
+                throw AsyncIOError(std::string("Failed to map io_uring submission ring: ") + strerror(errno));
+            }
+
+            if(singleMmap) {
+                m_cqRing = m_sqRing;
+            }
+            else
+            {
+                m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+                if(m_cqRing == MAP_FAILED)
+                {
+                    m_cqRing = nullptr;
+                    cleanup();
+                    throw AsyncIOError(std::string("Failed to map io_uring completion ring: ") + strerror(errno));
+                }
+            }
+
+            m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            auto sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+            if(sqes == MAP_FAILED)
+            {
+                cleanup();
+                throw AsyncIOError(std::string("Failed to map io_uring submission entries: ") + strerror(errno));
+            }
+
+            m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+            auto sq = static_cast<byte_t*>(m_sqRing);
+            m_sqHead  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            m_sqTail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            m_sqMask  = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+            auto cq = static_cast<byte_t*>(m_cqRing);
+            m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            m_cqes   = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        ~IoUring() override
+        {
+            /* Wait for in-flight requests so the kernel doesn't access freed buffers */
+            try
+            {
+                std::vector<AsyncCompletion> completions;
+                while(inFlight() > 0) {
+                    wait(completions, inFlight());
+                }
+            }
+            catch(const AsyncIOError&) {}
+
+            cleanup();
+        }
+
+        const char* name() const override
+        {
+            return "io_uring";
+        }
+
+        bool registerBuffers(const std::vector<std::pair<byte_t*, std::size_t>>& buffers) override
+        {
+            std::vector<iovec> iovs;
+            iovs.reserve(buffers.size());
+            for(const auto& b : buffers) {
+                iovs.push_back({ b.first, b.second });
+            }
+
+            if(m_buffersRegistered)
+            {
+                IoUringRegister(m_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+                StatAdd(Stat::Syscalls);
+            }
+
+            m_buffersRegistered = IoUringRegister(m_fd, IORING_REGISTER_BUFFERS, iovs.data(), static_cast<unsigned>(iovs.size())) == 0;
+            StatAdd(Stat::Syscalls);
+            return m_buffersRegistered;
+        }
+
+    protected:
+        void queue(const AsyncRequest& req) override
+        {
+            const unsigned tail = *m_sqTail;
+            const unsigned idx  = tail & m_sqMask;
+
+            io_uring_sqe& sqe = m_sqes[idx];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.fd        = req.fd;
+            sqe.addr      = reinterpret_cast<uint64_t>(req.data);
+            sqe.len       = static_cast<uint32_t>(req.length);
+            sqe.off       = req.offset;
+
+            const auto slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+            m_slots[slot] = { req.userData, req.op };
+            sqe.user_data = slot;
+
+            const bool fixed = m_buffersRegistered && req.bufferIndex >= 0;
+            switch (req.op)
+            {
+            case AsyncRequest::Read:
+                sqe.opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                break;
+            case AsyncRequest::Write:
+                sqe.opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                break;
+            case AsyncRequest::Fsync:
+                sqe.opcode = IORING_OP_FSYNC;
+                sqe.addr = 0;
+                sqe.len  = 0;
+                break;
+            }
+
+            if(fixed) {
+                sqe.buf_index = static_cast<uint16_t>(req.bufferIndex);
+            }
+
+            m_sqArray[idx] = idx;
+            StoreRelease(m_sqTail, tail + 1);
+            m_toSubmit++;
+        }
+
+        std::size_t reap(std::vector<AsyncCompletion>& completions, std::size_t minComplete) override
+        {
+            std::size_t nReaped = popCompletions(completions);
+            if(m_toSubmit == 0 && nReaped >= minComplete) {
+                return nReaped;
+            }
+
+            while(m_toSubmit > 0 || nReaped < minComplete)
+            {
+                const unsigned wantComplete = static_cast<unsigned>(minComplete > nReaped ? minComplete - nReaped : 0);
+                const int ret = IoUringEnter(m_fd, m_toSubmit, wantComplete, wantComplete ? IORING_ENTER_GETEVENTS : 0);
+                StatAdd(Stat::Syscalls);
+                if(ret < 0)
+                {
+                    if(errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                        continue;
+                    }
+                    throw AsyncIOError(std::string("io_uring_enter failed: ") + strerror(errno));
+                }
+
+                m_toSubmit -= std::min<unsigned>(m_toSubmit, static_cast<unsigned>(ret));
+                nReaped += popCompletions(completions);
+            }
+
+            return nReaped;
+        }
+
+    private:
+        std::size_t popCompletions(std::vector<AsyncCompletion>& completions)
+        {
+            unsigned head = *m_cqHead;
+            const unsigned tail = LoadAcquire(m_cqTail);
+
+            std::size_t n = 0;
+            for(; head != tail; head++, n++)
+            {
+                const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+                const auto& slot = m_slots[cqe.user_data];
+                completions.push_back({ slot.first, slot.second, cqe.res });
+                m_freeSlots.push_back(cqe.user_data);
+            }
+
+            StoreRelease(m_cqHead, head);
+            return n;
+        }
+
+        void cleanup()
+        {
+            if(m_sqes) {
+                munmap(m_sqes, m_sqesSize);
+            }
+            if(m_cqRing && m_cqRing != m_sqRing) {
+                munmap(m_cqRing, m_cqRingSize);
+            }
+            if(m_sqRing) {
+                munmap(m_sqRing, m_sqRingSize);
+            }
+            if(m_fd >= 0) {
+                ::close(m_fd);
+            }
+
+            m_sqes   = nullptr;
+            m_cqRing = nullptr;
+            m_sqRing = nullptr;
+            m_fd     = -1;
+        }
+
+    private:
+        int m_fd = -1;
+        bool m_buffersRegistered = false;
+        unsigned m_toSubmit = 0;
+        std::vector<std::pair<uint64_t, AsyncRequest::Op>> m_slots;
+        std::vector<std::size_t> m_freeSlots;
+
+        void* m_sqRing = nullptr;
+        void* m_cqRing = nullptr;
+        std::size_t m_sqRingSize = 0;
+        std::size_t m_cqRingSize = 0;
+        std::size_t m_sqesSize   = 0;
+
+        unsigned* m_sqHead  = nullptr;
+        unsigned* m_sqTail  = nullptr;
+        unsigned* m_sqArray = nullptr;
+        unsigned  m_sqMask  = 0;
+        io_uring_sqe* m_sqes = nullptr;
+
+        unsigned* m_cqHead = nullptr;
+        unsigned* m_cqTail = nullptr;
+        unsigned  m_cqMask = 0;
+        io_uring_cqe* m_cqes = nullptr;
+    };
+}
+#endif // LIBIM_HAS_IO_URING
+
+
+#ifndef OS_WINDOWS
+namespace {
+    /* Portable backend. Requests are executed by worker threads with pread/pwrite/fsync. */
+    class ThreadPoolIO final : public AsyncIO
+    {
+    public:
+        explicit ThreadPoolIO(std::size_t depth) : AsyncIO(depth)
+        {
+            const std::size_t nThreads = std::max<std::size_t>(1, std::min<std::size_t>(depth, 16));
+            for(std::size_t i = 0; i < nThreads; i++) {
+                m_workers.emplace_back([this]{ run(); });
+            }
+        }
+
+        ~ThreadPoolIO() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+
+            m_requestCv.notify_all();
+            for(auto& t : m_workers) {
+                t.join();
+            }
+        }
+
+        const char* name() const override
+        {
+            return "threads";
+        }
+
+    protected:
+        void queue(const AsyncRequest& req) override
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_requests.push_back(req);
+            }
+            m_requestCv.notify_one();
+        }
+
+        std::size_t reap(std::vector<AsyncCompletion>& completions, std::size_t minComplete) override
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_completionCv.wait(lock, [&]{ return m_completions.size() >= minComplete; });
+
+            const std::size_t n = m_completions.size();
+            completions.insert(completions.end(), m_completions.begin(), m_completions.end());
+            m_completions.clear();
+            return n;
+        }
+
+    private:
+        static int64_t execute(const AsyncRequest& req)
+        {
+            ssize_t res = 0;
+            switch (req.op)
+            {
+            case AsyncRequest::Read:
+                res = pread(req.fd, req.data, req.length, static_cast<off_t>(req.offset));
+                break;
+            case AsyncRequest::Write:
+                res = pwrite(req.fd, req.data, req.length, static_cast<off_t>(req.offset));
+                break;
+            case AsyncRequest::Fsync:
+                res = fsync(req.fd);
+                break;
+            }
+
+            StatAdd(Stat::Syscalls);
+            return res < 0 ? -static_cast<int64_t>(errno) : static_cast<int64_t>(res);
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(true)
+            {
+                m_requestCv.wait(lock, [&]{ return m_stop || !m_requests.empty(); });
+                if(m_requests.empty()) {
+                    return;
+                }
+
+                auto req = m_requests.front();
+                m_requests.pop_front();
+
+                lock.unlock();
+                const auto res = execute(req);
+                lock.lock();
+
+                m_completions.push_back({ req.userData, req.op, res });
+                m_completionCv.notify_one();
+            }
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_requestCv;
+        std::condition_variable m_completionCv;
+        std::deque<AsyncRequest> m_requests;
+        std::vector<AsyncCompletion> m_completions;
+        std::vector<std::thread> m_workers;
+        bool m_stop = false;
+    };
+}
+#endif // !OS_WINDOWS
+
+
+bool IoUringAvailable()
+{
+#ifdef LIBIM_HAS_IO_URING
+    static const bool available = []{
+        try
+        {
+            IoUring ring(1);
+            return true;
+        }
+        catch(const AsyncIOError&) {
+            return false;
+        }
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+std::unique_ptr<AsyncIO> MakeAsyncIO(std::size_t depth, AsyncBackend backend)
+{
+    if(depth == 0) {
+        throw AsyncIOError("Async I/O queue depth must be greater than 0");
+    }
+
+#ifdef LIBIM_HAS_IO_URING
+    if(backend == AsyncBackend::IoUring || (backend == AsyncBackend::Auto && IoUringAvailable())) {
+        return std::make_unique<IoUring>(depth);
+    }
+#else
+    if(backend == AsyncBackend::IoUring) {
+        throw AsyncIOError("io_uring is not supported on this platform");
+    }
+#endif
+
+#ifndef OS_WINDOWS
+    return std::make_unique<ThreadPoolIO>(depth);
+#else
+    throw AsyncIOError("Async I/O is not supported on this platform");
+#endif
+}
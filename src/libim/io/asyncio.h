@@ -0,0 +1,103 @@
+#ifndef LIBIM_ASYNCIO_H
+#define LIBIM_ASYNCIO_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "stream.h"
+#include "../common.h"
+
+struct AsyncIOError : public StreamError {
+    using StreamError::StreamError;
+};
+
+enum class AsyncBackend
+{
+    Auto,       // io_uring if available, thread pool otherwise
+    IoUring,    // Linux io_uring
+    ThreadPool  // Portable fallback, worker threads issuing pread/pwrite
+};
+
+struct AsyncRequest
+{
+    enum Op
+    {
+        Read,
+        Write,
+        Fsync
+    };
+
+    Op op = Read;
+    int fd = -1;
+    byte_t* data = nullptr;
+    std::size_t length = 0;
+    uint64_t offset = 0;
+    int bufferIndex = -1;  // Index of registered buffer containing data or -1
+    uint64_t userData = 0; // Returned unchanged in AsyncCompletion
+};
+
+struct AsyncCompletion
+{
+    uint64_t userData = 0;
+    AsyncRequest::Op op = AsyncRequest::Read;
+    int64_t result = 0;    // Number of bytes transferred, or -errno on failure
+};
+
+/* Asynchronous file I/O queue.
+   Requests are queued with submit() and issued to the backend on the next call
+   to wait(), which returns completions in no particular order.
+   At most depth() requests may be in flight at once. */
+class AsyncIO
+{
+public:
+    virtual ~AsyncIO() = default;
+
+    virtual const char* name() const = 0;
+
+    std::size_t depth() const
+    {
+        return m_depth;
+    }
+
+    std::size_t inFlight() const
+    {
+        return m_inFlight;
+    }
+
+    /* Registers buffers with the backend so requests reading into or writing from
+       them (AsyncRequest::bufferIndex) don't have to map user memory each time.
+       Returns false if registration is not supported; requests still work. */
+    virtual bool registerBuffers(const std::vector<std::pair<byte_t*, std::size_t>>& buffers)
+    {
+        (void)buffers;
+        return false;
+    }
+
+    /* Queues request. Throws AsyncIOError if depth() requests are already in flight. */
+    void submit(const AsyncRequest& req);
+
+    /* Issues queued requests and waits until at least minComplete requests have completed.
+       Completions are appended to completions, the number of appended completions is returned. */
+    std::size_t wait(std::vector<AsyncCompletion>& completions, std::size_t minComplete = 1);
+
+protected:
+    explicit AsyncIO(std::size_t depth) : m_depth(depth) {}
+
+    virtual void queue(const AsyncRequest& req) = 0;
+    virtual std::size_t reap(std::vector<AsyncCompletion>& completions, std::size_t minComplete) = 0;
+
+private:
+    std::size_t m_depth;
+    std::size_t m_inFlight = 0;
+};
+
+/* Returns true if io_uring can be used on this system */
+bool IoUringAvailable();
+
+/* Makes async I/O queue of given depth. Throws AsyncIOError if backend can't be created. */
+std::unique_ptr<AsyncIO> MakeAsyncIO(std::size_t depth, AsyncBackend backend = AsyncBackend::Auto);
+
+#endif // LIBIM_ASYNCIO_H
@@ -0,0 +1,58 @@
+#include "filekey.h"
+#include "../common.h"
+
+#include <sys/stat.h>
+
+namespace {
+#ifdef OS_WINDOWS
+    using FileStat = struct _stat64;
+#else
+    using FileStat = struct stat;
+#endif
+
+    FileKey MakeFileKey(const FileStat& st)
+    {
+        FileKey key;
+        key.size   = uint64_t(st.st_size);
+#if defined(OS_WINDOWS)
+        key.mtime  = int64_t(st.st_mtime) * 1000000000;
+#elif defined(__APPLE__)
+        key.mtime  = int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        key.mtime  = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        key.inode  = uint64_t(st.st_ino);
+        key.device = uint64_t(st.st_dev);
+        return key;
+    }
+}
+
+std::optional<FileKey> GetFileKey(const std::string& path)
+{
+    FileStat st;
+#ifdef OS_WINDOWS
+    if(_stat64(path.c_str(), &st) != 0) {
+        return std::nullopt;
+    }
+#else
+    if(stat(path.c_str(), &st) != 0) {
+        return std::nullopt;
+    }
+#endif
+    return MakeFileKey(st);
+}
+
+std::optional<FileKey> GetFileKey(int fd)
+{
+    FileStat st;
+#ifdef OS_WINDOWS
+    if(_fstat64(fd, &st) != 0) {
+        return std::nullopt;
+    }
+#else
+    if(fstat(fd, &st) != 0) {
+        return std::nullopt;
+    }
+#endif
+    return MakeFileKey(st);
+}
@@ -0,0 +1,22 @@
+#ifndef LIBIM_FILEKEY_H
+#define LIBIM_FILEKEY_H
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/* Identity of file's current content as seen by the file system */
+struct FileKey
+{
+    uint64_t size   = 0;
+    int64_t  mtime  = 0; // Nanoseconds since epoch
+    uint64_t inode  = 0;
+    uint64_t device = 0;
+};
+
+/* Returns key of file or nothing if file can't be stat'ed */
+std::optional<FileKey> GetFileKey(const std::string& path);
+
+/* Returns key of open file fd or nothing if it can't be stat'ed */
+std::optional<FileKey> GetFileKey(int fd);
+
+#endif // LIBIM_FILEKEY_H
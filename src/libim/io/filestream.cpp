@@ -1,6 +1,9 @@
 #include "filestream.h"
 #include "../common.h"
+#include "../stats.h"
 #include <algorithm>
+#include <climits>
+#include <cstring>
 
 #ifdef OS_WINDOWS
 #include <windows.h>
@@ -19,6 +22,7 @@
 # include <sys/mman.h>
 # include <sys/stat.h>
 # include <sys/types.h>
+# include <sys/uio.h>
 # include <unistd.h>
 #endif
 
@@ -76,6 +80,9 @@ struct FileStream::FileStreamImpl
             throw FileStreamError("Unknown file open mode!");
         }
 
+        StatAdd(Stat::FileOpens);
+        StatAdd(Stat::Syscalls, 2); // open + get file size
+
     #ifdef OS_WINDOWS
         
         /* Open file */
@@ -121,15 +128,35 @@ struct FileStream::FileStreamImpl
             throw FileStreamError(strerror(errno));
         }
 
-        /* Get file size */
+        readFileSize();
+    #endif
+    }
+
+#ifndef OS_WINDOWS
+    FileStreamImpl(int fd, std::string fp, Mode mode) : mode(mode), filePath(std::move(fp)), fd(fd)
+    {
+        if(fd < 0) {
+            throw FileStreamError("Invalid file descriptor: " + filePath);
+        }
+
+        StatAdd(Stat::Syscalls); // get file size
+        readFileSize();
+    }
+
+    void readFileSize()
+    {
         struct stat fileInfo {};
-        if (fstat(fd, &fileInfo) == -1) {
-            throw FileStreamError(std::string("Error getting the file size: ") + strerror(errno));
+        if (fstat(fd, &fileInfo) == -1)
+        {
+            const std::string error = strerror(errno);
+            ::close(fd);
+            fd = -1;
+            throw FileStreamError("Error getting the file size: " + error);
         }
 
         fileSize = fileInfo.st_size;
-    #endif
     }
+#endif
 
     std::size_t read(byte_t* data, std::size_t length)
     {
@@ -143,6 +170,10 @@ struct FileStream::FileStreamImpl
             throw FileStreamError("Failed to read from file: " + GetLastErrorAsString());
         }
 
+        StatAdd(Stat::Syscalls);
+        StatAdd(Stat::ReadCalls);
+        StatAdd(Stat::BytesRead, nRead);
+
         currentOffset += nRead;
         return static_cast<std::size_t>(nRead);
     }
@@ -159,6 +190,10 @@ struct FileStream::FileStreamImpl
             throw FileStreamError("Failed to write data to file: " + GetLastErrorAsString());
         }
 
+        StatAdd(Stat::Syscalls);
+        StatAdd(Stat::WriteCalls);
+        StatAdd(Stat::BytesWritten, nWritten);
+
         currentOffset += nWritten;
         if(currentOffset > fileSize) {
             fileSize = currentOffset;
@@ -167,6 +202,76 @@ struct FileStream::FileStreamImpl
         return static_cast<std::size_t>(nWritten);
     }
 
+    /* Writes buffers in order. On POSIX systems buffers are gathered by writev,
+       at most IOV_MAX per call, otherwise each buffer is written separately. */
+    std::size_t write(const std::vector<WriteBatch::Buffer>& buffers)
+    {
+    #ifdef OS_WINDOWS
+        std::size_t nWritten = 0;
+        for(const auto& buf : buffers)
+        {
+            const auto n = write(buf.data, buf.size);
+            nWritten += n;
+            if(n != buf.size) {
+                break;
+            }
+        }
+
+        return nWritten;
+    #else
+    # ifdef IOV_MAX
+        constexpr std::size_t maxIov = IOV_MAX;
+    # else
+        constexpr std::size_t maxIov = 1024;
+    # endif
+
+        std::vector<iovec> iov;
+        iov.reserve(buffers.size());
+        for(const auto& buf : buffers) {
+            iov.push_back({ const_cast<byte_t*>(buf.data), buf.size });
+        }
+
+        std::size_t nWritten = 0;
+        std::size_t idx = 0;
+        while(idx < iov.size())
+        {
+            const int nIov = static_cast<int>(std::min(iov.size() - idx, maxIov));
+            const ssize_t n = ::writev(fd, &iov[idx], nIov);
+            if(n == -1) {
+                throw FileStreamError("Failed to write data to file: " + GetLastErrorAsString());
+            }
+
+            StatAdd(Stat::Syscalls);
+            StatAdd(Stat::WriteCalls);
+            StatAdd(Stat::BytesWritten, n);
+
+            nWritten += n;
+            currentOffset += n;
+
+            /* Skip written buffers and continue partially written one */
+            std::size_t nLeft = static_cast<std::size_t>(n);
+            while(idx < iov.size() && nLeft >= iov[idx].iov_len) {
+                nLeft -= iov[idx++].iov_len;
+            }
+
+            if(nLeft > 0)
+            {
+                iov[idx].iov_base = static_cast<byte_t*>(iov[idx].iov_base) + nLeft;
+                iov[idx].iov_len -= nLeft;
+            }
+            else if(n == 0) {
+                break;
+            }
+        }
+
+        if(currentOffset > fileSize) {
+            fileSize = currentOffset;
+        }
+
+        return nWritten;
+    #endif
+    }
+
     void seek(std::size_t position) const
     {
     #ifdef OS_WINDOWS
@@ -181,32 +286,101 @@ struct FileStream::FileStreamImpl
             throw FileStreamError(std::string("Failed to seek to position: ") + GetLastErrorAsString());
         }
 
+        StatAdd(Stat::Syscalls);
+        StatAdd(Stat::Seeks);
+
         currentOffset = position;
         if(currentOffset > fileSize) {
             fileSize = currentOffset;
         }
     }
 
+    /* Copies length bytes at offset of src file to the current position of this file.
+       On Linux data is copied by kernel with copy_file_range and never enters user space. */
+    std::size_t copyFrom(FileStreamImpl& src, std::size_t offset, std::size_t length)
+    {
+        std::size_t nCopied = 0;
+    #if defined(__linux__)
+        loff_t offIn = static_cast<loff_t>(offset);
+        while(nCopied < length)
+        {
+            const ssize_t n = copy_file_range(src.fd, &offIn, fd, nullptr, length - nCopied, 0);
+            StatAdd(Stat::Syscalls);
+            if(n == -1)
+            {
+                /* Not supported for these files, copy through buffer */
+                if(nCopied == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                    break;
+                }
+
+                throw FileStreamError("Failed to copy data to file: " + GetLastErrorAsString());
+            }
+
+            if(n == 0) { // End of src file
+                break;
+            }
+
+            StatAdd(Stat::WriteCalls);
+            StatAdd(Stat::BytesWritten, n);
+            nCopied += n;
+            currentOffset += n;
+        }
+
+        if(currentOffset > fileSize) {
+            fileSize = currentOffset;
+        }
+
+        if(nCopied > 0 || length == 0) {
+            return nCopied;
+        }
+    #endif
+
+        /* Copy through buffer */
+        src.seek(offset);
+        ByteArray buffer(std::min<std::size_t>(length, 64 * 1024));
+        while(nCopied < length)
+        {
+            const auto nRead = src.read(buffer.data(), std::min(buffer.size(), length - nCopied));
+            if(nRead == 0) {
+                break;
+            }
+
+            if(write(buffer.data(), nRead) != nRead) {
+                throw FileStreamError("Failed to copy data to file: " + filePath);
+            }
+
+            nCopied += nRead;
+        }
+
+        return nCopied;
+    }
+
     void close()
     {
 #ifdef OS_WINDOWS
         if(fileHandle != INVALID_HANDLE_VALUE)
         {
-            if(mode == Write || mode == ReadWrite){
+            /* Batch durability can't be deferred, sync now */
+            if((mode == Write || mode == ReadWrite) && durability != Durability::None)
+            {
                 FlushFileBuffers(fileHandle);
+                StatAdd(Stat::Syscalls);
+                StatAdd(Stat::Syncs);
             }
 
             CloseHandle(fileHandle);
+            StatAdd(Stat::Syscalls);
             fileHandle = INVALID_HANDLE_VALUE;
         }
 #else
         if(fd > 0)
         {
-            if(mode == Write || mode == ReadWrite){
-                fsync(fd);
+            if(mode == Write || mode == ReadWrite) {
+                SyncOnClose(fd, durability);
             }
 
             ::close(fd);
+            StatAdd(Stat::Syscalls);
             fd = -1;
         }
 #endif
@@ -218,6 +392,7 @@ struct FileStream::FileStreamImpl
     }
 
     Mode mode;
+    Durability durability = GetWritePolicy().durability;
     std::string filePath;
     mutable std::size_t fileSize = 0;
     mutable std::size_t currentOffset = 0;
@@ -237,14 +412,72 @@ FileStream::FileStream(std::string filePath, Mode mode) :
     this->setName(GetFileName(m_fs->filePath));
 }
 
+#ifndef OS_WINDOWS
+FileStream::FileStream(int fd, std::string filePath, Mode mode) :
+    m_fs(std::make_shared<FileStreamImpl>(fd, std::move(filePath), mode))
+{
+    this->setName(GetFileName(m_fs->filePath));
+}
+#endif
+
 FileStream::~FileStream()
 {}
 
+Stream& FileStream::write(const Stream& istream, std::size_t offsetBegin, std::size_t offsetEnd)
+{
+    auto ifstream = dynamic_cast<const FileStream*>(&istream);
+    if(!ifstream || !ifstream->canRead() || offsetBegin >= istream.size()) {
+        return Stream::write(istream, offsetBegin, offsetEnd);
+    }
+
+    if((offsetBegin + offsetEnd) > istream.size()) {
+        offsetEnd = istream.size() - offsetBegin; // write to the end of istream
+    }
+
+    /* Copy file to file directly */
+    const auto nCopied = m_fs->copyFrom(*ifstream->m_fs, offsetBegin, offsetEnd);
+    if(nCopied != offsetEnd) {
+        throw FileStreamError("Failed to copy data from file: " + ifstream->name());
+    }
+
+    istream.seek(offsetBegin + offsetEnd);
+    return *this;
+}
+
+Stream& FileStream::write(const WriteBatch& batch)
+{
+    if(batch.empty()) {
+        return *this;
+    }
+
+    if(m_fs->write(batch.buffers()) != batch.size()) {
+        throw FileStreamError("Failed to write data to file: " + name());
+    }
+
+    return *this;
+}
+
 std::size_t FileStream::writesome(const byte_t* data, std::size_t length)
 {
     return m_fs->write(data, length);
 }
 
+void FileStream::setDurability(Durability durability)
+{
+    m_fs->durability = durability;
+}
+
+void FileStream::preallocate(std::size_t size)
+{
+#ifndef OS_WINDOWS
+    if(canWrite()) {
+        PreallocateFile(m_fs->fd, size);
+    }
+#else
+    (void)size;
+#endif
+}
+
 void FileStream::seek(std::size_t position) const
 {
     m_fs->seek(position);
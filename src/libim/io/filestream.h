@@ -1,6 +1,7 @@
 #ifndef FILESTREAM_H
 #define FILESTREAM_H
 #include "stream.h"
+#include "writepolicy.h"
 #include "common.h"
 
 #include <memory>
@@ -22,8 +23,28 @@ public:
     };
 
     explicit FileStream(std::string filePath, Mode mode = ReadWrite);
+
+#ifndef OS_WINDOWS
+    /* Takes ownership of open file descriptor fd. filePath is used for naming the stream. */
+    FileStream(int fd, std::string filePath, Mode mode);
+#endif
     virtual ~FileStream();
 
+    using Stream::write;
+
+    /* Writes offsetEnd bytes of istream starting at offsetBegin.
+       If istream is a file the data is copied file to file, by kernel where supported. */
+    virtual Stream& write(const Stream& istream, std::size_t offsetBegin, std::size_t offsetEnd) override;
+
+    /* Writes all buffers of batch with as few system calls as possible (writev) */
+    virtual Stream& write(const WriteBatch& batch) override;
+
+    /* Sets how file is flushed to disk when closed. Default is durability of write policy. */
+    void setDurability(Durability durability);
+
+    /* Reserves disk space for file of final size if enabled by write policy */
+    void preallocate(std::size_t size);
+
     virtual void seek(std::size_t position) const override;
     virtual std::size_t size() const override;
     virtual std::size_t tell() const override;
@@ -44,6 +65,9 @@ class InputFileStream final : public InputStream, public FileStream
 {
 public:
     InputFileStream(std::string filePath) : FileStream(std::move(filePath), Read) {}
+#ifndef OS_WINDOWS
+    InputFileStream(int fd, std::string filePath) : FileStream(fd, std::move(filePath), Read) {}
+#endif
 private:
     using FileStream::write;
 };
@@ -52,6 +76,9 @@ class OutputFileStream final : public FileStream
 {
 public:
     OutputFileStream(std::string filePath) : FileStream(std::move(filePath), Write) {}
+#ifndef OS_WINDOWS
+    OutputFileStream(int fd, std::string filePath) : FileStream(fd, std::move(filePath), Write) {}
+#endif
 private:
     using FileStream::read;
 };
@@ -0,0 +1,218 @@
+#include "filewatcher.h"
+#include "stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifdef __linux__
+# include <errno.h>
+# include <poll.h>
+# include <sys/inotify.h>
+# include <unistd.h>
+#endif
+
+namespace {
+#ifdef __linux__
+    /* Events of file being rewritten in place or replaced */
+    constexpr uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE;
+
+    std::string ParentDir(const std::string& file)
+    {
+        const std::string path = GetNativePath(file);
+        const std::size_t sep = path.find_last_of(PathSeparator());
+        if(sep == std::string::npos) {
+            return ".";
+        }
+        else if(sep == 0) {
+            return "/";
+        }
+        return path.substr(0, sep);
+    }
+#else
+    constexpr std::chrono::milliseconds POLL_INTERVAL{ 500 };
+
+    std::vector<std::optional<FileKey>> GetFileKeys(const std::vector<std::string>& files)
+    {
+        std::vector<std::optional<FileKey>> keys;
+        keys.reserve(files.size());
+        for(const auto& file : files) {
+            keys.push_back(GetFileKey(file));
+        }
+        return keys;
+    }
+
+    bool SameKey(const std::optional<FileKey>& a, const std::optional<FileKey>& b)
+    {
+        if(!a || !b) {
+            return !a && !b;
+        }
+        return a->size == b->size && a->mtime == b->mtime && a->inode == b->inode && a->device == b->device;
+    }
+
+    bool SameKeys(const std::vector<std::optional<FileKey>>& a, const std::vector<std::optional<FileKey>>& b)
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), SameKey);
+    }
+#endif
+}
+
+FileWatcher::FileWatcher(std::vector<std::string> files) :
+    m_files(std::move(files))
+{
+#ifdef __linux__
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_fd == -1) {
+        throw StreamError(std::string("Failed to init inotify: ") + strerror(errno));
+    }
+
+    for(const auto& file : m_files)
+    {
+        const std::string dir = ParentDir(file);
+        const int wd = inotify_add_watch(m_fd, dir.c_str(), WATCH_EVENTS);
+        if(wd == -1)
+        {
+            const std::string error = strerror(errno);
+            close(m_fd);
+            throw StreamError("Failed to watch directory " + dir + ": " + error);
+        }
+
+        m_watches.push_back({ wd, GetFileName(file) });
+    }
+#else
+    m_keys = GetFileKeys(m_files);
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+    close(m_fd);
+#endif
+}
+
+#ifdef __linux__
+bool FileWatcher::readEvents(std::vector<bool>& changed)
+{
+    alignas(inotify_event) char buffer[16 * 1024];
+    bool fileChanged = false;
+    for(;;)
+    {
+        const ssize_t n = ::read(m_fd, buffer, sizeof(buffer));
+        if(n == -1)
+        {
+            if(errno == EINTR) {
+                continue;
+            }
+            else if(errno == EAGAIN) {
+                return fileChanged;
+            }
+            throw StreamError(std::string("Failed to read inotify events: ") + strerror(errno));
+        }
+
+        for(ssize_t off = 0; off < n;)
+        {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + off);
+            off += sizeof(inotify_event) + event->len;
+
+            /* Events were dropped, any file could have changed */
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                std::fill(changed.begin(), changed.end(), true);
+                fileChanged = true;
+                continue;
+            }
+
+            if(event->len == 0) {
+                continue;
+            }
+
+            for(std::size_t i = 0; i < m_watches.size(); i++)
+            {
+                if(m_watches[i].wd == event->wd && m_watches[i].name == event->name)
+                {
+                    changed[i] = true;
+                    fileChanged = true;
+                }
+            }
+        }
+    }
+}
+
+std::vector<std::string> FileWatcher::wait(std::chrono::milliseconds quietPeriod)
+{
+    using Clock = std::chrono::steady_clock;
+
+    /* Events of other files in watched directories don't extend quiet period */
+    std::vector<bool> changed(m_files.size(), false);
+    std::optional<Clock::time_point> quietUntil;
+    for(;;)
+    {
+        int timeout = -1;
+        if(quietUntil)
+        {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(*quietUntil - Clock::now());
+            if(left.count() <= 0) {
+                break;
+            }
+            timeout = int(left.count()) + 1;
+        }
+
+        pollfd pfd { m_fd, POLLIN, 0 };
+        const int res = poll(&pfd, 1, timeout);
+        if(res == -1)
+        {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw StreamError(std::string("Failed to wait for inotify events: ") + strerror(errno));
+        }
+
+        if(res > 0 && readEvents(changed)) {
+            quietUntil = Clock::now() + quietPeriod;
+        }
+    }
+
+    std::vector<std::string> files;
+    for(std::size_t i = 0; i < m_files.size(); i++)
+    {
+        if(changed[i]) {
+            files.push_back(m_files[i]);
+        }
+    }
+    return files;
+}
+#else
+std::vector<std::string> FileWatcher::wait(std::chrono::milliseconds quietPeriod)
+{
+    /* Wait for first change */
+    auto keys = GetFileKeys(m_files);
+    while(SameKeys(keys, m_keys))
+    {
+        std::this_thread::sleep_for(POLL_INTERVAL);
+        keys = GetFileKeys(m_files);
+    }
+
+    /* Wait until files stop changing */
+    for(;;)
+    {
+        std::this_thread::sleep_for(quietPeriod);
+        auto next = GetFileKeys(m_files);
+        if(SameKeys(next, keys)) {
+            break;
+        }
+        keys = std::move(next);
+    }
+
+    std::vector<std::string> files;
+    for(std::size_t i = 0; i < m_files.size(); i++)
+    {
+        if(!SameKey(keys[i], m_keys[i])) {
+            files.push_back(m_files[i]);
+        }
+    }
+
+    m_keys = std::move(keys);
+    return files;
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef LIBIM_FILEWATCHER_H
+#define LIBIM_FILEWATCHER_H
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "filekey.h"
+#include "../common.h"
+
+/* Watches files for changes.
+   On Linux changes are reported by inotify on files' parent directories, so a file which
+   is replaced by rename, as archive builders often do, stays watched. Elsewhere files'
+   size, mtime and inode are polled. */
+class FileWatcher
+{
+public:
+    static constexpr std::chrono::milliseconds DEFAULT_QUIET_PERIOD{ 250 };
+
+    /* Throws StreamError if files can't be watched */
+    explicit FileWatcher(std::vector<std::string> files);
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator = (const FileWatcher&) = delete;
+
+    const std::vector<std::string>& files() const
+    {
+        return m_files;
+    }
+
+    /* Blocks until watched files change and then stay unchanged for quietPeriod,
+       so a file still being written is reported once, after it's complete.
+       Returns changed files in the order they were given. Throws StreamError on error. */
+    std::vector<std::string> wait(std::chrono::milliseconds quietPeriod = DEFAULT_QUIET_PERIOD);
+
+private:
+    std::vector<std::string> m_files;
+#ifdef __linux__
+    struct Watch
+    {
+        int wd;
+        std::string name; // File name in watched directory
+    };
+
+    /* Reads pending events, marks changed files. Returns false if there are none. */
+    bool readEvents(std::vector<bool>& changed);
+
+    int m_fd = -1;
+    std::vector<Watch> m_watches; // One per file
+#else
+    std::vector<std::optional<FileKey>> m_keys;
+#endif
+};
+
+#endif // LIBIM_FILEWATCHER_H
@@ -0,0 +1,88 @@
+#ifndef LIBIM_HASHINGSTREAM_H
+#define LIBIM_HASHINGSTREAM_H
+#include "stream.h"
+#include "../utils/hasher.h"
+
+/* Write-only stream which hashes data written to it and passes it on to ostream, if given.
+   Data written from another stream is read into memory and hashed, so it's read only once
+   but not copied file to file by kernel. */
+class HashingStream final : public OutputStream
+{
+public:
+    explicit HashingStream(HashAlgorithm algorithm, Stream* ostream = nullptr) :
+        m_hasher(algorithm),
+        m_ostream(ostream)
+    {}
+
+    using Stream::write;
+
+    /* Hashes all buffers of batch and writes batch to ostream at once */
+    virtual Stream& write(const WriteBatch& batch) override
+    {
+        for(const auto& buf : batch.buffers()) {
+            m_hasher.update(buf.data, buf.size);
+        }
+
+        if(m_ostream) {
+            m_ostream->write(batch);
+        }
+
+        m_size += batch.size();
+        return *this;
+    }
+
+    /* Returns hash of all data written so far */
+    uint64_t digest() const
+    {
+        return m_hasher.digest();
+    }
+
+    virtual void seek(std::size_t) const override
+    {
+        throw StreamError("HashingStream: seek not supported");
+    }
+
+    virtual std::size_t size() const override
+    {
+        return m_size;
+    }
+
+    virtual std::size_t tell() const override
+    {
+        return m_size;
+    }
+
+    virtual bool canRead() const override
+    {
+        return false;
+    }
+
+    virtual bool canWrite() const override
+    {
+        return true;
+    }
+
+protected:
+    virtual std::size_t readsome(byte_t*, std::size_t) const override
+    {
+        throw StreamError("HashingStream: read not supported");
+    }
+
+    virtual std::size_t writesome(const byte_t* data, std::size_t length) override
+    {
+        if(m_ostream && m_ostream->write(data, length) != length) {
+            throw StreamError("Failed to write data to stream!");
+        }
+
+        m_hasher.update(data, length);
+        m_size += length;
+        return length;
+    }
+
+private:
+    Hasher m_hasher;
+    Stream* m_ostream;
+    std::size_t m_size = 0;
+};
+
+#endif // LIBIM_HASHINGSTREAM_H
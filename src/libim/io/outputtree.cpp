@@ -0,0 +1,178 @@
+#include "outputtree.h"
+#include "../stats.h"
+
+#include <cstring>
+#include <utility>
+
+#ifndef OS_WINDOWS
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+/* Max number of cached directory handles. When exceeded the cache is emptied. */
+static constexpr std::size_t MAX_DIR_HANDLES = 256;
+
+/* Returns native relPath without empty and "." components */
+static std::string NormalizeRelPath(const std::string& relPath)
+{
+    std::string path;
+    for(auto& part : SplitString(GetNativePath(relPath), PathSeparator()))
+    {
+        if(part.empty() || part == ".") {
+            continue;
+        }
+
+        path += (path.empty() ? "" : std::string(1, PathSeparator())) + part;
+    }
+
+    return path;
+}
+
+OutputTree::OutputTree(std::string rootDir) :
+    m_root(GetNativePath(std::move(rootDir)))
+{
+    if(m_root.empty()) {
+        m_root = ".";
+    }
+
+    if(!DirExists(m_root) && !MakePath(m_root)) {
+        throw FileStreamError("Could not make directory: " + m_root);
+    }
+
+#ifndef OS_WINDOWS
+    m_rootFd = open(m_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    StatAdd(Stat::Syscalls);
+    if(m_rootFd == -1) {
+        throw FileStreamError("Could not open directory: " + m_root + ": " + strerror(errno));
+    }
+#endif
+}
+
+OutputTree::~OutputTree()
+{
+#ifndef OS_WINDOWS
+    closeDirHandles();
+    ::close(m_rootFd);
+    StatAdd(Stat::Syscalls);
+#endif
+}
+
+std::string OutputTree::path(const std::string& relPath) const
+{
+    const auto rel = NormalizeRelPath(relPath);
+    return rel.empty() ? m_root : m_root + PathSeparator() + rel;
+}
+
+std::pair<std::string, std::string> OutputTree::splitPath(const std::string& relPath)
+{
+    const auto sep = relPath.find_last_of(PathSeparator());
+    if(sep == std::string::npos) {
+        return { std::string(), relPath };
+    }
+
+    return { relPath.substr(0, sep), relPath.substr(sep + 1) };
+}
+
+#ifndef OS_WINDOWS
+void OutputTree::makeDir(const std::string& relDir)
+{
+    dirHandle(NormalizeRelPath(relDir));
+}
+
+OutputFileStream OutputTree::createFile(const std::string& relPath)
+{
+    const int fd = openFile(relPath);
+    return OutputFileStream(fd, path(relPath));
+}
+
+int OutputTree::openFile(const std::string& relPath, int flags)
+{
+    const auto rel = NormalizeRelPath(relPath);
+    if(rel.empty()) {
+        throw FileStreamError("Invalid file path: " + relPath);
+    }
+
+    const auto [dir, fileName] = splitPath(rel);
+    const int fd = openat(dirHandle(dir), fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | flags, (mode_t)0600);
+    StatAdd(Stat::Syscalls);
+    if(fd == -1) {
+        throw FileStreamError("Could not open file: " + path(rel) + ": " + strerror(errno));
+    }
+
+    StatAdd(Stat::FileOpens);
+    return fd;
+}
+
+int OutputTree::dirHandle(const std::string& relDir)
+{
+    if(relDir.empty()) {
+        return m_rootFd;
+    }
+
+    auto it = m_dirs.find(relDir);
+    if(it != m_dirs.end()) {
+        return it->second;
+    }
+
+    /* Make dir in parent dir and open it */
+    const auto [parentDir, dirName] = splitPath(relDir);
+    const int parentFd = dirHandle(parentDir);
+
+    StatAdd(Stat::Syscalls, 2);
+    if(mkdirat(parentFd, dirName.c_str(), 0775) == -1 && errno != EEXIST) {
+        throw FileStreamError("Could not make directory: " + path(relDir) + ": " + strerror(errno));
+    }
+
+    const int fd = openat(parentFd, dirName.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd == -1) {
+        throw FileStreamError("Could not open directory: " + path(relDir) + ": " + strerror(errno));
+    }
+
+    /* Parent handle is not needed anymore, it's safe to drop it here */
+    if(m_dirs.size() >= MAX_DIR_HANDLES) {
+        closeDirHandles();
+    }
+
+    m_dirs.emplace(relDir, fd);
+    return fd;
+}
+
+void OutputTree::closeDirHandles()
+{
+    for(const auto& [dir, fd] : m_dirs)
+    {
+        ::close(fd);
+        StatAdd(Stat::Syscalls);
+    }
+
+    m_dirs.clear();
+}
+
+#else // OS_WINDOWS
+void OutputTree::makeDir(const std::string& relDir)
+{
+    const auto rel = NormalizeRelPath(relDir);
+    if(rel.empty() || m_dirs.count(rel)) {
+        return;
+    }
+
+    const auto parentDir = splitPath(rel).first;
+    makeDir(parentDir);
+
+    const auto dirPath = path(rel);
+    if(!MakeDir(dirPath) && !DirExists(dirPath)) {
+        throw FileStreamError("Could not make directory: " + dirPath);
+    }
+
+    m_dirs.insert(rel);
+}
+
+OutputFileStream OutputTree::createFile(const std::string& relPath)
+{
+    const auto rel = NormalizeRelPath(relPath);
+    makeDir(splitPath(rel).first);
+    return OutputFileStream(path(rel));
+}
+#endif
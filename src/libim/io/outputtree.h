@@ -0,0 +1,63 @@
+#ifndef LIBIM_OUTPUTTREE_H
+#define LIBIM_OUTPUTTREE_H
+#include "filestream.h"
+#include "../common.h"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/* Creates files in directory tree under root directory.
+   Directories are created once and open directory handles are cached, so files are
+   created relative to their parent (openat) without resolving the whole path and
+   stat-ing every path component again for each file.
+   Paths passed to OutputTree are relative to root and may use either path separator. */
+class OutputTree
+{
+public:
+    /* Creates root directory if it doesn't exist. Throws FileStreamError on error. */
+    explicit OutputTree(std::string rootDir);
+    ~OutputTree();
+
+    OutputTree(const OutputTree&) = delete;
+    OutputTree& operator = (const OutputTree&) = delete;
+
+    const std::string& root() const
+    {
+        return m_root;
+    }
+
+    /* Returns full path of file at relPath */
+    std::string path(const std::string& relPath) const;
+
+    /* Creates all missing directories of dir relDir. Throws FileStreamError on error. */
+    void makeDir(const std::string& relDir);
+
+    /* Creates or truncates file at relPath and its missing parent directories.
+       Throws FileStreamError on error. */
+    OutputFileStream createFile(const std::string& relPath);
+
+#ifndef OS_WINDOWS
+    /* Same as createFile but returns open file descriptor owned by the caller */
+    int openFile(const std::string& relPath, int flags = 0);
+#endif
+
+private:
+    /* Splits native relPath into parent dir and file name */
+    static std::pair<std::string, std::string> splitPath(const std::string& relPath);
+
+#ifndef OS_WINDOWS
+    /* Returns open handle of dir relDir, creating it if needed */
+    int dirHandle(const std::string& relDir);
+    void closeDirHandles();
+
+    std::unordered_map<std::string, int> m_dirs;
+    int m_rootFd = -1;
+#else
+    std::unordered_set<std::string> m_dirs; // Directories which are known to exist
+#endif
+
+    std::string m_root;
+};
+
+#endif // LIBIM_OUTPUTTREE_H
@@ -0,0 +1,176 @@
+#ifndef LIBIM_RECORD_H
+#define LIBIM_RECORD_H
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+/* Compile-time description of binary file records.
+
+   Each on-disk record struct is described by listing its fields in order:
+
+       LIBIM_RECORD_LAYOUT(GobFileHeader, 12,
+           LIBIM_FIELD(GobFileHeader, signature),
+           LIBIM_FIELD(GobFileHeader, version),
+           LIBIM_FIELD(GobFileHeader, directoryOffset)
+       );
+
+   The layout is checked at compile time: the struct must be trivially copyable,
+   have the given on-disk size, and the fields must be contiguous and cover the
+   whole struct. Described records are read and written by Stream as raw bytes,
+   arrays of records in one batch. On big-endian hosts every field is
+   byte-swapped from/to little-endian after reading/before writing; on
+   little-endian hosts the conversion is compiled out.
+
+   RecordLayout<T> may also define `static void validate(const T&)` which is
+   called for every record read from stream. */
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#  define LIBIM_BIG_ENDIAN 1
+static constexpr bool HostIsBigEndian = true;
+#else
+static constexpr bool HostIsBigEndian = false;
+#endif
+
+template<typename T>
+struct RecordLayout; // Specialize with LIBIM_RECORD_LAYOUT
+
+template<typename Type, std::size_t Offset>
+struct RecordField
+{
+    using type = Type;
+    static constexpr std::size_t offset = Offset;
+    static constexpr std::size_t size   = sizeof(Type);
+};
+
+#define LIBIM_FIELD(Record, member) \
+    RecordField<decltype(Record::member), offsetof(Record, member)>
+
+namespace detail {
+    template<typename... Fields>
+    constexpr bool FieldsContiguous(std::size_t recordSize)
+    {
+        constexpr std::size_t offsets[] = { Fields::offset..., 0 };
+        constexpr std::size_t sizes[]   = { Fields::size..., 0 };
+
+        std::size_t end = 0;
+        for(std::size_t i = 0; i < sizeof...(Fields); i++)
+        {
+            if(offsets[i] != end) return false;
+            end += sizes[i];
+        }
+        return end == recordSize;
+    }
+
+    template<typename T, typename = void>
+    struct HasRecordLayout : std::false_type {};
+
+    template<typename T>
+    struct HasRecordLayout<T, std::void_t<typename RecordLayout<T>::record_type>> : std::true_type {};
+
+    template<typename T, typename = void>
+    struct HasRecordValidate : std::false_type {};
+
+    template<typename T>
+    struct HasRecordValidate<T, std::void_t<decltype(RecordLayout<T>::validate(std::declval<const T&>()))>> : std::true_type {};
+
+    template<typename T>
+    struct IsStdArray : std::false_type {};
+
+    template<typename U, std::size_t N>
+    struct IsStdArray<std::array<U, N>> : std::true_type {};
+}
+
+template<typename T>
+constexpr bool IsRecord = detail::HasRecordLayout<T>::value;
+
+/* Reverses the byte order of a single field value of type U stored at p */
+template<typename U>
+inline void ByteSwapValue(uint8_t* p);
+
+template<typename T, std::size_t Size, typename... Fields>
+struct RecordDescriptor
+{
+    using record_type = T;
+    static constexpr std::size_t size = Size;
+
+    static_assert(std::is_trivially_copyable<T>::value, "Record type must be trivially copyable");
+    static_assert(std::is_standard_layout<T>::value, "Record type must have standard layout");
+    static_assert(sizeof(T) == Size, "Record type size doesn't match its on-disk size");
+    static_assert(detail::FieldsContiguous<Fields...>(Size),
+                  "Record fields must be listed in declaration order, be contiguous and cover the whole record");
+
+    static void byteSwap(uint8_t* p)
+    {
+        (void)p;
+        (ByteSwapValue<typename Fields::type>(p + Fields::offset), ...);
+    }
+};
+
+#define LIBIM_RECORD_LAYOUT(Record, Size, ...) \
+    template<> struct RecordLayout<Record> : RecordDescriptor<Record, Size, __VA_ARGS__> {}
+
+template<typename U>
+inline void ByteSwapValue(uint8_t* p)
+{
+    if constexpr(IsRecord<U>) {
+        RecordLayout<U>::byteSwap(p);
+    }
+    else if constexpr(std::is_array<U>::value)
+    {
+        using E = std::remove_extent_t<U>;
+        for(std::size_t i = 0; i < std::extent<U>::value; i++) {
+            ByteSwapValue<E>(p + i * sizeof(E));
+        }
+    }
+    else if constexpr(detail::IsStdArray<U>::value)
+    {
+        using E = typename U::value_type;
+        for(std::size_t i = 0; i < std::tuple_size<U>::value; i++) {
+            ByteSwapValue<E>(p + i * sizeof(E));
+        }
+    }
+    else
+    {
+        static_assert(std::is_arithmetic<U>::value || std::is_enum<U>::value, "Unsupported record field type");
+        std::reverse(p, p + sizeof(U));
+    }
+}
+
+/* Converts n records from on-disk (little-endian) to host byte order */
+template<typename T>
+inline void RecordsFromDisk(T* records, std::size_t n)
+{
+    if constexpr(IsRecord<T> && HostIsBigEndian)
+    {
+        auto p = reinterpret_cast<uint8_t*>(records);
+        for(std::size_t i = 0; i < n; i++) {
+            RecordLayout<T>::byteSwap(p + i * sizeof(T));
+        }
+    }
+    (void)records; (void)n;
+}
+
+/* Converts n records from host to on-disk (little-endian) byte order */
+template<typename T>
+inline void RecordsToDisk(T* records, std::size_t n)
+{
+    RecordsFromDisk(records, n); // byte swapping is symmetric
+}
+
+/* Calls RecordLayout<T>::validate for n records if defined */
+template<typename T>
+inline void ValidateRecords(const T* records, std::size_t n)
+{
+    if constexpr(IsRecord<T> && detail::HasRecordValidate<T>::value)
+    {
+        for(std::size_t i = 0; i < n; i++) {
+            RecordLayout<T>::validate(records[i]);
+        }
+    }
+    (void)records; (void)n;
+}
+
+#endif // LIBIM_RECORD_H
@@ -5,6 +5,8 @@
 #include <iostream>
 
 #include "assert.h"
+#include "record.h"
+#include "writebatch.h"
 #include <climits>
 #include <cstdint>
 #include <memory>
@@ -39,6 +41,10 @@ std::shared_ptr<T> StreamPointerCast(const std::shared_ptr<U>& r) {
     return std::static_pointer_cast<T>(StreamPointerCast<Stream>(r));
 }
 
+/* Types which are read and written as raw bytes: POD types and described records */
+template<typename T>
+constexpr bool IsRawStreamable = std::is_pod<T>::value || IsRecord<T>;
+
 struct StreamError : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
@@ -128,6 +134,19 @@ public:
         return *this;
     }
 
+    /* Writes all buffers of batch in order */
+    virtual Stream& write(const WriteBatch& batch)
+    {
+        for(const auto& buf : batch.buffers())
+        {
+            if(write(buf.data, buf.size) != buf.size) {
+                throw StreamError("Failed to write data to stream!");
+            }
+        }
+
+        return *this;
+    }
+
     /* Write from stream. read stream from offset to the ennd */
     virtual Stream& write(const Stream& istream, std::size_t offset)
     {
@@ -204,19 +223,19 @@ private:
     template <typename T> T _read(std::size_t lenHint, tag<T>&&) const = delete;
     template <typename T, typename ...Args> T _read(Args&& ..., tag<T>&&) const = delete;
 
-    /* Delete non-POD type version */
-    template <typename T, typename std::enable_if<!std::is_pod<T>::value, int>::type = 0>
+    /* Delete non-POD and non-record type version */
+    template <typename T, typename std::enable_if<!IsRawStreamable<T>, int>::type = 0>
     T _read(tag<T>&&) const = delete;
 
     template <typename T>
-    typename std::enable_if<!std::is_pod<T>::value, Stream>::type&
+    typename std::enable_if<!IsRawStreamable<T>, Stream>::type&
     _write(const T&, tag<T>&&) = delete;
 
-    /* POD type sepcialization */
-    template <typename T, typename std::enable_if<std::is_pod<T>::value, int>::type = 0>
+    /* POD and record type sepcialization */
+    template <typename T, typename std::enable_if<IsRawStreamable<T>, int>::type = 0>
     T _read(tag<T>&&) const;
 
-    template <typename T, typename std::enable_if<std::is_pod<T>::value, int>::type = 0>
+    template <typename T, typename std::enable_if<IsRawStreamable<T>, int>::type = 0>
     Stream& _write(const T&, tag<T>&&);
 
     /* std::unique_ptr specialization */
@@ -240,16 +259,16 @@ private:
     Stream& _write(const std::shared_ptr<T>& ptr, tag<std::shared_ptr<T>>&&);
 
      /* std::vector specialization */
-    template<typename T, typename A, typename std::enable_if_t<std::is_pod<T>::value, int> = 0>
+    template<typename T, typename A, typename std::enable_if_t<IsRawStreamable<T>, int> = 0>
     std::vector<T, A> _read(std::size_t lenHint, tag<std::vector<T, A>>&&) const;
 
-    template<typename T, typename A, typename std::enable_if_t<!std::is_pod<T>::value, int> = 0>
+    template<typename T, typename A, typename std::enable_if_t<!IsRawStreamable<T>, int> = 0>
     std::vector<T, A> _read(std::size_t lenHint, tag<std::vector<T, A>>&&) const;
 
-    template<typename T, typename A, typename std::enable_if_t<std::is_pod<T>::value, int> = 0>
+    template<typename T, typename A, typename std::enable_if_t<IsRawStreamable<T>, int> = 0>
     Stream& _write(const std::vector<T, A>& vec, tag<std::vector<T, A>>&&);
 
-    template<typename T, typename A, typename std::enable_if_t<!std::is_pod<T>::value, int> = 0>
+    template<typename T, typename A, typename std::enable_if_t<!IsRawStreamable<T>, int> = 0>
     Stream& _write(const std::vector<T, A>& vec, tag<std::vector<T, A>>&&);
 
 private:
@@ -286,7 +305,7 @@ private:
 
 
 
-template <typename T, typename std::enable_if<std::is_pod<T>::value, int>::type>
+template <typename T, typename std::enable_if<IsRawStreamable<T>, int>::type>
 T Stream::_read(tag<T>&&) const
 {
     T pod;
@@ -295,12 +314,20 @@ T Stream::_read(tag<T>&&) const
           throw StreamError("Error reading POD from stream!");
     }
 
+    RecordsFromDisk(&pod, 1);
+    ValidateRecords(&pod, 1);
     return pod;
 }
 
-template <typename T, typename std::enable_if<std::is_pod<T>::value, int>::type>
-Stream& Stream::_write(const T& pod, tag<T>&&)
+template <typename T, typename std::enable_if<IsRawStreamable<T>, int>::type>
+Stream& Stream::_write(const T& value, tag<T>&&)
 {
+#ifdef LIBIM_BIG_ENDIAN
+    T pod = value;
+    RecordsToDisk(&pod, 1);
+#else
+    const T& pod = value;
+#endif
     auto nWritten = this->writesome(reinterpret_cast<const byte_t*>(&pod), sizeof(pod));
     if(nWritten != sizeof(pod)) {
         throw StreamError("Error writing POD to stream!");
@@ -585,7 +612,7 @@ Stream& Stream::_write(const std::shared_ptr<T>& ptr, tag<std::shared_ptr<T>>&&)
 }
 
 // std::vector
-template<typename T, typename A, typename std::enable_if_t<std::is_pod<T>::value, int>>
+template<typename T, typename A, typename std::enable_if_t<IsRawStreamable<T>, int>>
 std::vector<T, A> Stream::_read(std::size_t lenHint, tag<std::vector<T, A>>&&) const
 {
     std::vector<T, A> vec(lenHint);
@@ -594,10 +621,12 @@ std::vector<T, A> Stream::_read(std::size_t lenHint, tag<std::vector<T, A>>&&) c
         throw StreamError(std::string("Could not read std::vector of type ") + typeid(T).name() + " from stream");
     }
 
+    RecordsFromDisk(vec.data(), vec.size());
+    ValidateRecords(vec.data(), vec.size());
     return vec;
 }
 
-template<typename T, typename A, typename std::enable_if_t<!std::is_pod<T>::value, int>>
+template<typename T, typename A, typename std::enable_if_t<!IsRawStreamable<T>, int>>
 std::vector<T, A> Stream::_read(std::size_t lenHint, tag<std::vector<T, A>>&&) const
 {
     std::vector<T, A> vec;
@@ -609,9 +638,15 @@ std::vector<T, A> Stream::_read(std::size_t lenHint, tag<std::vector<T, A>>&&) c
     return vec;
 }
 
-template<typename T, typename A, typename std::enable_if_t<std::is_pod<T>::value, int>>
-Stream& Stream::_write(const std::vector<T, A>& vec, tag<std::vector<T, A>>&&)
+template<typename T, typename A, typename std::enable_if_t<IsRawStreamable<T>, int>>
+Stream& Stream::_write(const std::vector<T, A>& values, tag<std::vector<T, A>>&&)
 {
+#ifdef LIBIM_BIG_ENDIAN
+    std::vector<T> vec(values.begin(), values.end());
+    RecordsToDisk(vec.data(), vec.size());
+#else
+    const auto& vec = values;
+#endif
     const std::size_t nWrite = vec.size() * sizeof(T);
     const auto nWritten = this->write(reinterpret_cast<const byte_t*>(vec.data()), nWrite);
     if(nWritten != nWrite) {
@@ -621,7 +656,7 @@ Stream& Stream::_write(const std::vector<T, A>& vec, tag<std::vector<T, A>>&&)
     return *this;
 }
 
-template<typename T, typename A, typename std::enable_if_t<!std::is_pod<T>::value, int>>
+template<typename T, typename A, typename std::enable_if_t<!IsRawStreamable<T>, int>>
 Stream& Stream::_write(const std::vector<T, A>& vec, tag<std::vector<T, A>>&&)
 {
     for(const auto& e : vec) {
@@ -0,0 +1,121 @@
+#ifndef LIBIM_WRITEBATCH_H
+#define LIBIM_WRITEBATCH_H
+#include "../common.h"
+#include "record.h"
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+/* List of buffers written to stream at once, as one contiguous block (gather write).
+   Records are copied into the batch, so they can be added from temporaries. Adjacent
+   records share one buffer. Vectors and byte ranges are only referenced and must
+   outlive the write. */
+class WriteBatch
+{
+public:
+    struct Buffer
+    {
+        const byte_t* data;
+        std::size_t size;
+    };
+
+    /* Adds copy of record */
+    template<typename T, typename std::enable_if_t<std::is_pod<T>::value || IsRecord<T>, int> = 0>
+    WriteBatch& add(const T& record)
+    {
+        T value = record;
+        RecordsToDisk(&value, 1);
+        return copy(reinterpret_cast<const byte_t*>(&value), sizeof(value));
+    }
+
+    /* Adds reference to vector of records */
+    template<typename T, typename A, typename std::enable_if_t<std::is_pod<T>::value || IsRecord<T>, int> = 0>
+    WriteBatch& add(const std::vector<T, A>& records)
+    {
+        /* Records are converted to on-disk byte order in a copy */
+        if constexpr(IsRecord<T> && HostIsBigEndian)
+        {
+            std::vector<T> values(records.begin(), records.end());
+            RecordsToDisk(values.data(), values.size());
+            return copy(reinterpret_cast<const byte_t*>(values.data()), values.size() * sizeof(T));
+        }
+
+        return add(reinterpret_cast<const byte_t*>(records.data()), records.size() * sizeof(T));
+    }
+
+    /* Adds reference to byte range */
+    WriteBatch& add(const byte_t* data, std::size_t size)
+    {
+        if(size > 0)
+        {
+            m_entries.push_back({ data, 0, size });
+            m_size += size;
+        }
+
+        return *this;
+    }
+
+    /* Returns total number of bytes in batch */
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    /* Returns buffers in write order. Buffers are valid until batch is modified. */
+    std::vector<Buffer> buffers() const
+    {
+        std::vector<Buffer> bufs;
+        bufs.reserve(m_entries.size());
+        for(const auto& e : m_entries) {
+            bufs.push_back({ e.data ? e.data : m_storage.data() + e.offset, e.size });
+        }
+
+        return bufs;
+    }
+
+    void clear()
+    {
+        m_entries.clear();
+        m_storage.clear();
+        m_size = 0;
+    }
+
+private:
+    WriteBatch& copy(const byte_t* data, std::size_t size)
+    {
+        /* Extend last buffer if it ends where data is copied to */
+        const std::size_t offset = m_storage.size();
+        if(!m_entries.empty() && !m_entries.back().data &&
+           m_entries.back().offset + m_entries.back().size == offset) {
+            m_entries.back().size += size;
+        }
+        else {
+            m_entries.push_back({ nullptr, offset, size });
+        }
+
+        m_storage.insert(m_storage.end(), data, data + size);
+        m_size += size;
+        return *this;
+    }
+
+    /* Buffer is either referenced data or data copied to m_storage at offset.
+       Copies are stored as offsets because m_storage can be reallocated. */
+    struct Entry
+    {
+        const byte_t* data;
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    std::vector<Entry> m_entries;
+    ByteArray m_storage;
+    std::size_t m_size = 0;
+};
+
+#endif // LIBIM_WRITEBATCH_H
@@ -0,0 +1,126 @@
+#include "writepolicy.h"
+#include "stream.h"
+#include "../stats.h"
+
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#ifndef OS_WINDOWS
+# include <errno.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace {
+    WritePolicy policy;
+
+#ifndef OS_WINDOWS
+    /* One open file per file system which has unsynced files */
+    std::mutex deferredMutex;
+    std::unordered_map<dev_t, int> deferredFs;
+#endif
+}
+
+const WritePolicy& GetWritePolicy()
+{
+    return policy;
+}
+
+void SetWritePolicy(const WritePolicy& p)
+{
+    policy = p;
+}
+
+bool ParseDurability(const std::string& name, Durability& durability)
+{
+    if(name == "none") {
+        durability = Durability::None;
+    }
+    else if(name == "per-file") {
+        durability = Durability::PerFile;
+    }
+    else if(name == "batch") {
+        durability = Durability::Batch;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+#ifndef OS_WINDOWS
+void SyncOnClose(int fd, Durability durability)
+{
+    if(durability == Durability::PerFile)
+    {
+        fsync(fd);
+        StatAdd(Stat::Syscalls);
+        StatAdd(Stat::Syncs);
+    }
+    else if(durability == Durability::Batch)
+    {
+        struct stat fileInfo {};
+        StatAdd(Stat::Syscalls);
+        if(fstat(fd, &fileInfo) == -1) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(deferredMutex);
+        if(!deferredFs.count(fileInfo.st_dev))
+        {
+            StatAdd(Stat::Syscalls);
+            const int fsFd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if(fsFd != -1) {
+                deferredFs.emplace(fileInfo.st_dev, fsFd);
+            }
+        }
+    }
+}
+
+void PreallocateFile(int fd, std::size_t size)
+{
+    if(!GetWritePolicy().preallocate || size == 0) {
+        return;
+    }
+
+    StatAdd(Stat::Syscalls);
+#if defined(__linux__)
+    fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+#else
+    (void)fd;
+#endif
+}
+#endif
+
+void SyncDeferredWrites()
+{
+#ifndef OS_WINDOWS
+    std::lock_guard<std::mutex> lock(deferredMutex);
+    std::string error;
+    for(const auto& [dev, fd] : deferredFs)
+    {
+    #if defined(__linux__)
+        const int res = syncfs(fd);
+    #else
+        const int res = fsync(fd);
+        sync();
+    #endif
+        StatAdd(Stat::Syscalls, 2);
+        StatAdd(Stat::Syncs);
+
+        if(res == -1 && error.empty()) {
+            error = strerror(errno);
+        }
+
+        ::close(fd);
+    }
+
+    deferredFs.clear();
+    if(!error.empty()) {
+        throw StreamError("Failed to sync written files: " + error);
+    }
+#endif
+}
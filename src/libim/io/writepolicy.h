@@ -0,0 +1,44 @@
+#ifndef LIBIM_WRITEPOLICY_H
+#define LIBIM_WRITEPOLICY_H
+#include "../common.h"
+
+#include <cstddef>
+#include <string>
+
+/* When written files are flushed to disk */
+enum class Durability
+{
+    None,    // Never, left to the OS
+    PerFile, // Each file is synced when closed (fsync)
+    Batch    // Files are synced together by SyncDeferredWrites (syncfs)
+};
+
+/* Process wide policy of output files */
+struct WritePolicy
+{
+    Durability durability = Durability::PerFile;
+    bool preallocate = false; // Preallocate disk space of files whose final size is known
+};
+
+/* Policy should be set before any file is opened, it's not synchronized */
+const WritePolicy& GetWritePolicy();
+void SetWritePolicy(const WritePolicy& policy);
+
+/* Parses durability name: none, per-file or batch. Returns false if name is unknown. */
+bool ParseDurability(const std::string& name, Durability& durability);
+
+#ifndef OS_WINDOWS
+/* Flushes file fd according to policy before it is closed.
+   With Batch durability file's file system is remembered to be synced later. */
+void SyncOnClose(int fd, Durability durability);
+
+/* Reserves disk space of size bytes for file fd if enabled by write policy.
+   File size is not changed and failure is ignored as the space is only a hint. */
+void PreallocateFile(int fd, std::size_t size);
+#endif
+
+/* Syncs file systems of files closed with Batch durability.
+   Throws StreamError on error. */
+void SyncDeferredWrites();
+
+#endif // LIBIM_WRITEPOLICY_H
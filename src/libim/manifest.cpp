@@ -0,0 +1,307 @@
+#include "manifest.h"
+#include "cnd.h"
+#include "gob.h"
+#include "progress.h"
+#include "io/filestream.h"
+#include "io/hashingstream.h"
+#include "utils/thread_pool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iomanip>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    constexpr const char* MANIFEST_HEADER = "# libim manifest ";
+    constexpr std::size_t READ_BUFFER_SIZE = 256 * 1024;
+
+    /* Calls hashRange(begin, end) for ranges of [0, n) in parallel, rethrows first exception */
+    template<typename F>
+    void ForEachRange(std::size_t n, std::size_t jobs, F&& hashRange)
+    {
+        if(n == 0) {
+            return;
+        }
+
+        ThreadPool pool(jobs);
+        const std::size_t nRanges = std::min(n, pool.size() * 4); // Several ranges per thread balance uneven entries
+        std::vector<std::future<void>> results;
+        results.reserve(nRanges);
+        for(std::size_t i = 0; i < nRanges; i++) {
+            results.push_back(pool.submit([&hashRange, begin = n * i / nRanges, end = n * (i + 1) / nRanges]{ hashRange(begin, end); }));
+        }
+
+        WaitAll(results);
+    }
+
+    /* Hashes size bytes of istream from current position */
+    uint64_t HashStream(const InputStream& istream, std::size_t size, HashAlgorithm algorithm, std::vector<byte_t>& buffer)
+    {
+        Hasher hasher(algorithm);
+        while(size > 0)
+        {
+            const std::size_t nRead = std::min(size, buffer.size());
+            if(istream.read(buffer.data(), nRead) != nRead) {
+                throw StreamError("Error while reading stream " + istream.name() + "!");
+            }
+
+            hasher.update(buffer.data(), nRead);
+            size -= nRead;
+        }
+
+        return hasher.digest();
+    }
+
+    /* Moves hashed entries to manifest, skipping entries without name */
+    Manifest MakeManifest(HashAlgorithm algorithm, std::vector<ManifestEntry>&& entries)
+    {
+        Manifest manifest;
+        manifest.algorithm = algorithm;
+        for(auto& e : entries)
+        {
+            if(!e.name.empty()) {
+                manifest.entries.push_back(std::move(e));
+            }
+        }
+
+        manifest.sort();
+        return manifest;
+    }
+}
+
+void Manifest::sort()
+{
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b){ return a.name < b.name; });
+}
+
+void Manifest::update(const Manifest& changes, const std::vector<std::string>& removed)
+{
+    std::unordered_set<std::string> replaced(removed.begin(), removed.end());
+    for(const auto& e : changes.entries) {
+        replaced.insert(e.name);
+    }
+
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const auto& e){ return replaced.count(e.name) > 0; }), entries.end());
+    entries.insert(entries.end(), changes.entries.begin(), changes.entries.end());
+}
+
+void WriteManifest(std::ostream& os, const Manifest& manifest)
+{
+    const int hashWidth = manifest.algorithm == HashAlgorithm::Crc32c ? 8 : 16;
+    os << MANIFEST_HEADER << HashAlgorithmName(manifest.algorithm) << '\n';
+    os << std::hex << std::setfill('0');
+    for(const auto& e : manifest.entries) {
+        os << std::setw(hashWidth) << e.hash << "  " << std::dec << e.size << "  " << e.name << '\n' << std::hex;
+    }
+
+    os << std::dec << std::setfill(' ');
+}
+
+Manifest ReadManifest(std::istream& is)
+{
+    Manifest manifest;
+    std::string line;
+    std::size_t nLine = 0;
+    bool hasHeader = false;
+    while(std::getline(is, line))
+    {
+        nLine++;
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if(line.empty()) {
+            continue;
+        }
+
+        if(!hasHeader)
+        {
+            if(line.compare(0, std::strlen(MANIFEST_HEADER), MANIFEST_HEADER) != 0 ||
+               !ParseHashAlgorithm(line.substr(std::strlen(MANIFEST_HEADER)), manifest.algorithm)) {
+                throw StreamError("Invalid manifest header");
+            }
+
+            hasHeader = true;
+            continue;
+        }
+
+        /* <hash>  <size>  <name> */
+        ManifestEntry entry;
+        const char* end = line.data() + line.size();
+        auto res = std::from_chars(line.data(), end, entry.hash, 16);
+        if(res.ec == std::errc() && end - res.ptr > 2 && res.ptr[0] == ' ' && res.ptr[1] == ' ')
+        {
+            res = std::from_chars(res.ptr + 2, end, entry.size);
+            if(res.ec == std::errc() && end - res.ptr > 2 && res.ptr[0] == ' ' && res.ptr[1] == ' ')
+            {
+                entry.name.assign(res.ptr + 2, end);
+                manifest.entries.push_back(std::move(entry));
+                continue;
+            }
+        }
+
+        throw StreamError("Invalid manifest entry at line " + std::to_string(nLine));
+    }
+
+    if(!hasHeader) {
+        throw StreamError("Invalid manifest header");
+    }
+
+    return manifest;
+}
+
+ManifestDiff CompareManifests(const Manifest& expected, const Manifest& actual)
+{
+    std::unordered_map<std::string_view, const ManifestEntry*> actualEntries;
+    actualEntries.reserve(actual.entries.size());
+    for(const auto& e : actual.entries) {
+        actualEntries.emplace(e.name, &e);
+    }
+
+    ManifestDiff diff;
+    for(const auto& e : expected.entries)
+    {
+        auto it = actualEntries.find(e.name);
+        if(it == actualEntries.end()) {
+            diff.missing.push_back(e.name);
+            continue;
+        }
+
+        if(it->second->size != e.size || it->second->hash != e.hash) {
+            diff.changed.push_back(e.name);
+        }
+
+        actualEntries.erase(it);
+    }
+
+    for(const auto& [name, e] : actualEntries) {
+        diff.added.emplace_back(name);
+    }
+
+    std::sort(diff.missing.begin(), diff.missing.end());
+    std::sort(diff.changed.begin(), diff.changed.end());
+    std::sort(diff.added.begin(), diff.added.end());
+    return diff;
+}
+
+std::string ManifestEntryName(const std::string& name)
+{
+    std::string entryName = name;
+    std::replace(entryName.begin(), entryName.end(), '\\', '/');
+    return entryName;
+}
+
+Manifest HashGobFile(const std::string& gobFile, HashAlgorithm algorithm, std::size_t jobs)
+{
+    const auto gobDir = LoadGobFromFile(gobFile);
+    if(!gobDir) {
+        throw StreamError("Failed to load GOB file " + gobFile);
+    }
+
+    const auto& entries = gobDir->entries;
+    uint64_t totalSize = 0;
+    for(const auto& e : entries) {
+        totalSize += e.size;
+    }
+
+    ProgressReporter progress("Hashing", entries.size(), totalSize);
+    std::vector<ManifestEntry> hashed(entries.size());
+    ForEachRange(entries.size(), jobs, [&](std::size_t begin, std::size_t end)
+    {
+        InputFileStream ifs(gobFile);
+        std::vector<byte_t> buffer(READ_BUFFER_SIZE);
+        for(std::size_t i = begin; i < end; i++)
+        {
+            const auto& entry = entries[i];
+            ifs.seek(entry.offset);
+            hashed[i] = { ManifestEntryName(entry.name), entry.size, HashStream(ifs, entry.size, algorithm, buffer) };
+            progress.add(1, entry.size);
+        }
+    });
+
+    progress.finish();
+    return MakeManifest(algorithm, std::move(hashed));
+}
+
+Manifest HashCndFile(const std::string& cndFile, HashAlgorithm algorithm, std::size_t jobs)
+{
+    std::vector<libim::CND::CndMaterialLocation> materials;
+    {
+        InputFileStream ifs(cndFile);
+        materials = libim::CND::LoadCndIndex(ifs).materials;
+    }
+
+    uint64_t totalSize = 0;
+    for(const auto& m : materials) {
+        totalSize += m.size;
+    }
+
+    ProgressReporter progress("Hashing", materials.size(), totalSize);
+    std::vector<ManifestEntry> hashed(materials.size());
+    ForEachRange(materials.size(), jobs, [&](std::size_t begin, std::size_t end)
+    {
+        InputFileStream ifs(cndFile);
+        for(std::size_t i = begin; i < end; i++)
+        {
+            const auto& mat = materials[i];
+            if(mat.header.mipmapCount > 0 && mat.header.texturesPerMipmap > 0)
+            {
+                HashingStream hs(algorithm);
+                libim::CND::CopyMaterialToMat(ifs, mat, hs);
+                hashed[i] = { "mat/" + ManifestEntryName(mat.header.name), hs.size(), hs.digest() };
+            }
+            progress.add(1, mat.size);
+        }
+    });
+
+    progress.finish();
+    return MakeManifest(algorithm, std::move(hashed));
+}
+
+Manifest HashFiles(const std::string& dir, const std::vector<std::string>& names, HashAlgorithm algorithm, std::size_t jobs)
+{
+    ProgressReporter progress("Hashing", names.size(), 0);
+    std::vector<ManifestEntry> hashed(names.size());
+    ForEachRange(names.size(), jobs, [&](std::size_t begin, std::size_t end)
+    {
+        std::vector<byte_t> buffer(READ_BUFFER_SIZE);
+        for(std::size_t i = begin; i < end; i++)
+        {
+            const std::string path = GetNativePath(dir + "/" + names[i]);
+            if(FileExists(path))
+            {
+                InputFileStream ifs(path);
+                const std::size_t size = ifs.size();
+                hashed[i] = { names[i], size, HashStream(ifs, size, algorithm, buffer) };
+                progress.add(1, size);
+            }
+            else {
+                progress.add(1, 0);
+            }
+        }
+    });
+
+    progress.finish();
+    return MakeManifest(algorithm, std::move(hashed));
+}
+
+std::vector<std::string> ListDirFiles(const std::string& dir)
+{
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    const fs::path root(GetNativePath(dir));
+    for(const auto& e : fs::recursive_directory_iterator(root))
+    {
+        if(e.is_regular_file()) {
+            files.push_back(e.path().lexically_relative(root).generic_string());
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
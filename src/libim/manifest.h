@@ -0,0 +1,82 @@
+#ifndef LIBIM_MANIFEST_H
+#define LIBIM_MANIFEST_H
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "utils/hasher.h"
+
+/* Hash and size of archive entry or file */
+struct ManifestEntry
+{
+    std::string name; // Path relative to extraction directory, separated by '/'
+    uint64_t size = 0;
+    uint64_t hash = 0;
+};
+
+/* List of entries hashed with one algorithm.
+   Entries of archives are named as files extracted from them by gobext and cndext,
+   so manifest of archive can be checked against extracted directory and vice versa. */
+struct Manifest
+{
+    HashAlgorithm algorithm = HashAlgorithm::Crc32c;
+    std::vector<ManifestEntry> entries;
+
+    void add(std::string name, uint64_t size, uint64_t hash)
+    {
+        entries.push_back({ std::move(name), size, hash });
+    }
+
+    /* Sorts entries by name */
+    void sort();
+
+    /* Merges entries of changes into manifest, replacing entries with the same name,
+       and drops entries named in removed. Other entries are kept. */
+    void update(const Manifest& changes, const std::vector<std::string>& removed);
+};
+
+/* Writes manifest as text: header line with algorithm, followed by one "<hash>  <size>  <name>" line per entry */
+void WriteManifest(std::ostream& os, const Manifest& manifest);
+
+/* Reads manifest written by WriteManifest. Throws StreamError if manifest is malformed. */
+Manifest ReadManifest(std::istream& is);
+
+/* Entries which differ between expected and actual manifest */
+struct ManifestDiff
+{
+    std::vector<std::string> missing; // Entries of expected manifest not in actual
+    std::vector<std::string> changed; // Entries whose size or hash differ
+    std::vector<std::string> added;   // Entries of actual manifest not in expected
+
+    bool empty() const
+    {
+        return missing.empty() && changed.empty() && added.empty();
+    }
+};
+
+/* Compares manifests hashed with the same algorithm. Names in diff are sorted. */
+ManifestDiff CompareManifests(const Manifest& expected, const Manifest& actual);
+
+/* Returns name of GOB entry or CND material as manifest entry name, separated by '/' */
+std::string ManifestEntryName(const std::string& name);
+
+/* Functions below hash entries in parallel with jobs threads (0 = one per core),
+   every thread reads its own range of entries through its own file handle.
+   They throw StreamError on read error. */
+
+/* Hashes entries of GOB file */
+Manifest HashGobFile(const std::string& gobFile, HashAlgorithm algorithm, std::size_t jobs);
+
+/* Hashes materials of CND file as MAT files extracted from it, named mat/<material name>.
+   MAT file hash covers material's pixel data and its headers. Materials without pixel data are skipped. */
+Manifest HashCndFile(const std::string& cndFile, HashAlgorithm algorithm, std::size_t jobs);
+
+/* Hashes files at relative paths names in dir. Files which don't exist are skipped. */
+Manifest HashFiles(const std::string& dir, const std::vector<std::string>& names, HashAlgorithm algorithm, std::size_t jobs);
+
+/* Returns relative paths of all files in dir and its subdirectories, separated by '/' */
+std::vector<std::string> ListDirFiles(const std::string& dir);
+
+#endif // LIBIM_MANIFEST_H
@@ -0,0 +1,308 @@
+#include "atlas.h"
+#include "bcn.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    struct Point
+    {
+        uint32_t x;
+        uint32_t y;
+    };
+
+    /* Skyline bin packer. The skyline is a list of horizontal segments covering page width,
+       each rect is placed on the segment where its top ends lowest (bottom-left rule). */
+    class SkylinePacker
+    {
+    public:
+        SkylinePacker(uint32_t width, uint32_t height) :
+            m_width(width),
+            m_height(height),
+            m_skyline{ { 0, 0, width } }
+        {}
+
+        std::optional<Point> insert(uint32_t width, uint32_t height)
+        {
+            std::size_t bestIdx = m_skyline.size();
+            uint32_t bestTop   = std::numeric_limits<uint32_t>::max();
+            uint32_t bestWidth = std::numeric_limits<uint32_t>::max();
+            uint32_t bestY = 0;
+            for(std::size_t i = 0; i < m_skyline.size(); i++)
+            {
+                uint32_t y;
+                if(!fits(i, width, height, y)) {
+                    continue;
+                }
+
+                /* Lowest top wins, ties go to narrower segment to keep wide ones free */
+                if(y + height < bestTop || (y + height == bestTop && m_skyline[i].width < bestWidth))
+                {
+                    bestIdx   = i;
+                    bestTop   = y + height;
+                    bestWidth = m_skyline[i].width;
+                    bestY     = y;
+                }
+            }
+
+            if(bestIdx == m_skyline.size()) {
+                return std::nullopt;
+            }
+
+            const Point pos { m_skyline[bestIdx].x, bestY };
+            addSegment(bestIdx, pos.x, bestTop, width);
+            return pos;
+        }
+
+    private:
+        struct Segment
+        {
+            uint32_t x;
+            uint32_t y;
+            uint32_t width;
+        };
+
+        /* Returns false if rect starting at segment i doesn't fit.
+           y is set to the top of the highest segment under the rect. */
+        bool fits(std::size_t i, uint32_t width, uint32_t height, uint32_t& y) const
+        {
+            if(m_skyline[i].x + width > m_width) {
+                return false;
+            }
+
+            y = 0;
+            for(uint32_t left = width; left > 0; i++)
+            {
+                y = std::max(y, m_skyline[i].y);
+                if(y + height > m_height) {
+                    return false;
+                }
+
+                left -= std::min(left, m_skyline[i].width);
+            }
+
+            return true;
+        }
+
+        void addSegment(std::size_t idx, uint32_t x, uint32_t y, uint32_t width)
+        {
+            m_skyline.insert(m_skyline.begin() + idx, { x, y, width });
+
+            /* Cut segments shadowed by the new one */
+            const uint32_t right = x + width;
+            for(std::size_t i = idx + 1; i < m_skyline.size();)
+            {
+                auto& s = m_skyline[i];
+                if(s.x >= right) {
+                    break;
+                }
+
+                const uint32_t shrink = std::min(right - s.x, s.width);
+                s.x     += shrink;
+                s.width -= shrink;
+                if(s.width > 0) {
+                    break;
+                }
+
+                m_skyline.erase(m_skyline.begin() + i);
+            }
+
+            /* Merge neighbours of the same height */
+            for(std::size_t i = 0; i + 1 < m_skyline.size();)
+            {
+                if(m_skyline[i].y == m_skyline[i + 1].y)
+                {
+                    m_skyline[i].width += m_skyline[i + 1].width;
+                    m_skyline.erase(m_skyline.begin() + i + 1);
+                }
+                else {
+                    i++;
+                }
+            }
+        }
+
+        uint32_t m_width;
+        uint32_t m_height;
+        std::vector<Segment> m_skyline;
+    };
+
+    struct Page
+    {
+        SkylinePacker packer;
+        uint32_t usedWidth  = 0;
+        uint32_t usedHeight = 0;
+    };
+
+    inline uint32_t NextPowerOfTwo(uint32_t v)
+    {
+        uint32_t p = 1;
+        while(p < v) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    /* Copies RGBA8 texture to its rect in page, filling padding with edge pixels */
+    void CopyToPage(const Texture& tex, const AtlasEntry& e, uint32_t padding, Bitmap& page, uint32_t pageWidth)
+    {
+        const auto rgba = TextureToRGBA8(tex);
+        const uint32_t rowBytes = e.width * 4;
+        for(uint32_t py = 0; py < e.height + 2 * padding; py++)
+        {
+            const uint32_t sy = std::min(std::max(py, padding) - padding, e.height - 1);
+            const byte_t* src = rgba.data() + std::size_t(sy) * rowBytes;
+            byte_t* dst = page.data() + (std::size_t(e.y - padding + py) * pageWidth + (e.x - padding)) * 4;
+
+            for(uint32_t px = 0; px < padding; px++) {
+                std::memcpy(dst + px * 4, src, 4);
+            }
+
+            std::memcpy(dst + padding * 4, src, rowBytes);
+            for(uint32_t px = 0; px < padding; px++) {
+                std::memcpy(dst + (padding + e.width + px) * 4, src + rowBytes - 4, 4);
+            }
+        }
+    }
+}
+
+TextureAtlas BuildTextureAtlas(const std::vector<Material>& materials, const AtlasOptions& opt, ThreadPool* pool)
+{
+    TextureAtlas atlas;
+    std::vector<const Texture*> textures;
+    for(uint32_t matIdx = 0; matIdx < materials.size(); matIdx++)
+    {
+        const auto& mipmaps = materials[matIdx].mipmaps();
+        for(uint32_t mmIdx = 0; mmIdx < mipmaps.size(); mmIdx++)
+        {
+            const auto& mipmap = mipmaps[mmIdx];
+            const std::size_t nTextures = opt.includeMipmaps ? mipmap.size() : std::min<std::size_t>(mipmap.size(), 1);
+            for(uint32_t texIdx = 0; texIdx < nTextures; texIdx++)
+            {
+                const auto& tex = mipmap[texIdx];
+                if(tex.width() == 0 || tex.height() == 0 || !tex.bitmap()) {
+                    continue;
+                }
+
+                const uint32_t maxSide = std::max(tex.width(), tex.height()) + 2 * opt.padding;
+                if(maxSide > opt.maxSize) {
+                    throw std::invalid_argument("Texture of material " + materials[matIdx].name() + " doesn't fit in atlas");
+                }
+
+                AtlasEntry e;
+                e.materialIdx = matIdx;
+                e.mipmapIdx   = mmIdx;
+                e.textureIdx  = texIdx;
+                e.width       = tex.width();
+                e.height      = tex.height();
+                atlas.entries.push_back(e);
+                textures.push_back(&tex);
+            }
+        }
+    }
+
+    /* Pack from the tallest and widest texture */
+    std::vector<std::size_t> order(atlas.entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        const auto& ea = atlas.entries[a];
+        const auto& eb = atlas.entries[b];
+        return ea.height != eb.height ? ea.height > eb.height : ea.width > eb.width;
+    });
+
+    std::vector<Page> pages;
+    for(auto idx : order)
+    {
+        auto& e = atlas.entries[idx];
+        const uint32_t w = e.width  + 2 * opt.padding;
+        const uint32_t h = e.height + 2 * opt.padding;
+
+        std::optional<Point> pos;
+        for(e.page = 0; e.page < pages.size(); e.page++)
+        {
+            if((pos = pages[e.page].packer.insert(w, h))) {
+                break;
+            }
+        }
+
+        if(!pos)
+        {
+            pages.push_back({ SkylinePacker(opt.maxSize, opt.maxSize) });
+            pos = pages.back().packer.insert(w, h);
+        }
+
+        auto& page = pages[e.page];
+        page.usedWidth  = std::max(page.usedWidth,  pos->x + w);
+        page.usedHeight = std::max(page.usedHeight, pos->y + h);
+        e.x = pos->x + opt.padding;
+        e.y = pos->y + opt.padding;
+    }
+
+    for(const auto& page : pages)
+    {
+        const uint32_t width  = NextPowerOfTwo(page.usedWidth);
+        const uint32_t height = NextPowerOfTwo(page.usedHeight);
+
+        Texture tex;
+        tex.setWidth(width)
+           .setHeight(height)
+           .setColorInfo(RGBA_8888)
+           .setRowSize(GetRowSize(width, RGBA_8888.bpp))
+           .setBitmap(MakeBitmapPtr(GetBitmapSize(width, height, RGBA_8888.bpp)));
+        atlas.pages.push_back(std::move(tex));
+    }
+
+    /* Entries cover disjoint rects of pages, so they can be copied concurrently */
+    std::vector<std::future<void>> tasks;
+    try
+    {
+        for(std::size_t i = 0; i < atlas.entries.size(); i++)
+        {
+            auto& e = atlas.entries[i];
+            const auto& page = atlas.pages[e.page];
+            e.u0 = float(e.x) / page.width();
+            e.v0 = float(e.y) / page.height();
+            e.u1 = float(e.x + e.width)  / page.width();
+            e.v1 = float(e.y + e.height) / page.height();
+
+            auto copy = [&e, &page, tex = textures[i], padding = opt.padding] {
+                CopyToPage(*tex, e, padding, *page.bitmap(), page.width());
+            };
+
+            if(pool) {
+                tasks.push_back(pool->submit(std::move(copy)));
+            }
+            else {
+                copy();
+            }
+        }
+    }
+    catch(...)
+    {
+        /* Queued tasks still reference atlas */
+        for(auto& t : tasks) {
+            t.wait();
+        }
+        throw;
+    }
+
+    WaitAll(tasks);
+    return atlas;
+}
+
+void WriteAtlasUVTable(std::ostream& os, const TextureAtlas& atlas, const std::vector<Material>& materials)
+{
+    os << "material,mipmap,texture,page,x,y,width,height,u0,v0,u1,v1\n";
+    for(const auto& e : atlas.entries)
+    {
+        os << materials.at(e.materialIdx).name() << ',' << e.mipmapIdx << ',' << e.textureIdx << ','
+           << e.page << ',' << e.x << ',' << e.y << ',' << e.width << ',' << e.height << ','
+           << e.u0 << ',' << e.v0 << ',' << e.u1 << ',' << e.v1 << '\n';
+    }
+}
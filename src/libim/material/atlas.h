@@ -0,0 +1,51 @@
+#ifndef LIBIM_ATLAS_H
+#define LIBIM_ATLAS_H
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "material.h"
+#include "texture.h"
+
+class ThreadPool;
+
+struct AtlasOptions
+{
+    uint32_t maxSize = 2048;     // Max width and height of atlas page
+    uint32_t padding = 2;        // Border around each texture, filled with texture's edge pixels
+    bool includeMipmaps = false; // Pack all mip levels of mipmaps, not only base textures
+};
+
+/* Placement of one texture in atlas */
+struct AtlasEntry
+{
+    uint32_t materialIdx = 0;
+    uint32_t mipmapIdx   = 0;
+    uint32_t textureIdx  = 0; // Mip level
+    uint32_t page   = 0;
+    uint32_t x      = 0;      // Pixel rect of texture, without padding
+    uint32_t y      = 0;
+    uint32_t width  = 0;
+    uint32_t height = 0;
+    float u0 = 0, v0 = 0;     // Texture coordinates of rect, origin in top left corner
+    float u1 = 0, v1 = 0;
+};
+
+struct TextureAtlas
+{
+    std::vector<Texture> pages;      // Power of two sized RGBA_8888 textures
+    std::vector<AtlasEntry> entries; // Ordered by material, mipmap and texture index
+};
+
+/* Packs textures of materials into as few atlas pages as possible.
+   Rects are placed with skyline bottom-left packing, from the tallest texture down.
+   Each page is shrunk to the smallest power of two size holding its rects.
+   Textures are converted to RGBA_8888 and copied in parallel if pool is not null.
+   Throws std::invalid_argument if a padded texture is bigger than maxSize. */
+TextureAtlas BuildTextureAtlas(const std::vector<Material>& materials, const AtlasOptions& opt = AtlasOptions(), ThreadPool* pool = nullptr);
+
+/* Writes UV remap table of atlas as CSV, one line per entry:
+   material,mipmap,texture,page,x,y,width,height,u0,v0,u1,v1 */
+void WriteAtlasUVTable(std::ostream& os, const TextureAtlas& atlas, const std::vector<Material>& materials);
+
+#endif // LIBIM_ATLAS_H
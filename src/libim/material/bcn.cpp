@@ -0,0 +1,606 @@
+#include "bcn.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+
+namespace {
+    /* Bit field of pixel channel in color format */
+    struct ChannelField
+    {
+        uint32_t shift = 0;
+        uint32_t mask  = 0; // 0 = channel not present
+        std::array<uint8_t, 256> lut {}; // 8 bit value of channels with up to 8 bits
+
+        ChannelField(int32_t bits, int32_t shl, uint32_t bpp)
+        {
+            if(bits > 0 && bits <= 16 && shl >= 0 && uint32_t(shl + bits) <= bpp)
+            {
+                shift = uint32_t(shl);
+                mask  = (1u << bits) - 1;
+                for(uint32_t v = 0; v <= std::min<uint32_t>(mask, 255); v++) {
+                    lut[v] = scale(v);
+                }
+            }
+        }
+
+        uint8_t decode(uint32_t pixel, uint8_t def) const
+        {
+            if(mask == 0) {
+                return def;
+            }
+
+            const uint32_t v = (pixel >> shift) & mask;
+            return mask <= 255 ? lut[v] : scale(v);
+        }
+
+        /* Scales channel value to 8 bits with rounding */
+        uint8_t scale(uint32_t v) const
+        {
+            return uint8_t((v * 255 + mask / 2) / mask);
+        }
+    };
+
+    struct ColorBlock
+    {
+        uint16_t c0 = 0;
+        uint16_t c1 = 0;
+        uint32_t indices = 0;
+    };
+
+    inline uint16_t PackRGB565(int r, int g, int b)
+    {
+        auto q = [](int v, int max) { return std::clamp((v * max + 127) / 255, 0, max); };
+        return uint16_t((q(r, 31) << 11) | (q(g, 63) << 5) | q(b, 31));
+    }
+
+    inline void UnpackRGB565(uint16_t c, uint8_t* rgba)
+    {
+        const uint32_t r = (c >> 11) & 31;
+        const uint32_t g = (c >> 5)  & 63;
+        const uint32_t b =  c        & 31;
+        rgba[0] = uint8_t((r << 3) | (r >> 2));
+        rgba[1] = uint8_t((g << 2) | (g >> 4));
+        rgba[2] = uint8_t((b << 3) | (b >> 2));
+        rgba[3] = 255;
+    }
+
+    /* Makes 4 color palette of endpoints c0 and c1. With 3 colors the 4th color is transparent black. */
+    inline void MakePalette(uint16_t c0, uint16_t c1, int nColors, uint8_t* palette)
+    {
+        UnpackRGB565(c0, palette);
+        UnpackRGB565(c1, palette + 4);
+        for(int ch = 0; ch < 3; ch++)
+        {
+            const int a = palette[ch], b = palette[4 + ch];
+            if(nColors == 4)
+            {
+                palette[8  + ch] = uint8_t((2 * a + b) / 3);
+                palette[12 + ch] = uint8_t((a + 2 * b) / 3);
+            }
+            else
+            {
+                palette[8  + ch] = uint8_t((a + b) / 2);
+                palette[12 + ch] = 0;
+            }
+        }
+
+        palette[11] = 255;
+        palette[15] = nColors == 4 ? 255 : 0;
+    }
+
+    class BlockEncoder
+    {
+    public:
+        explicit BlockEncoder(const BCEncodeOptions& opt) :
+            m_opt(opt),
+            m_fitIndices(GetFitColorIndicesKernel(opt.kernel))
+        {}
+
+        void encode(const uint8_t* block, byte_t* out)
+        {
+            if(m_opt.format == BCFormat::BC3)
+            {
+                encodeAlpha(block, out);
+                writeColorBlock(encodeColor(block, false), out + 8);
+            }
+            else {
+                writeColorBlock(encodeColor(block, true), out);
+            }
+        }
+
+    private:
+        static void writeColorBlock(const ColorBlock& cb, byte_t* out)
+        {
+            out[0] = byte_t(cb.c0);
+            out[1] = byte_t(cb.c0 >> 8);
+            out[2] = byte_t(cb.c1);
+            out[3] = byte_t(cb.c1 >> 8);
+            for(int i = 0; i < 4; i++) {
+                out[4 + i] = byte_t(cb.indices >> (i * 8));
+            }
+        }
+
+        /* Encodes color of block. With punchThrough pixels with alpha < 128 are encoded as transparent. */
+        ColorBlock encodeColor(const uint8_t* block, bool punchThrough)
+        {
+            uint32_t transparent = 0; // bit i set if pixel i is transparent
+            if(punchThrough)
+            {
+                for(int i = 0; i < 16; i++) {
+                    transparent |= uint32_t(block[i * 4 + 3] < 128) << i;
+                }
+            }
+
+            ColorBlock cb;
+            if(transparent == 0xFFFF)
+            {
+                cb.indices = 0xFFFFFFFF;
+                return cb;
+            }
+
+            /* Transparent pixels take color of an opaque pixel so they don't affect the fit */
+            uint8_t px[64];
+            std::memcpy(px, block, sizeof(px));
+            if(transparent)
+            {
+                const int opaque = [&]{ int i = 0; while(transparent & (1u << i)) i++; return i; }();
+                for(int i = 0; i < 16; i++)
+                {
+                    if(transparent & (1u << i)) {
+                        std::memcpy(px + i * 4, block + opaque * 4, 4);
+                    }
+                }
+            }
+
+            const int nColors = transparent ? 3 : 4;
+            int e0[3], e1[3];
+            if(m_opt.quality == BCQuality::High) {
+                principalAxisEndpoints(px, e0, e1);
+            }
+            else {
+                rangeEndpoints(px, e0, e1);
+            }
+
+            uint32_t error = fit(px, PackRGB565(e0[0], e0[1], e0[2]), PackRGB565(e1[0], e1[1], e1[2]), nColors, cb);
+            if(m_opt.quality == BCQuality::High)
+            {
+                for(int iter = 0; iter < 2 && error > 0; iter++)
+                {
+                    ColorBlock refined;
+                    if(!refineEndpoints(px, cb, nColors, e0, e1)) {
+                        break;
+                    }
+
+                    const uint32_t refinedError = fit(px, PackRGB565(e0[0], e0[1], e0[2]), PackRGB565(e1[0], e1[1], e1[2]), nColors, refined);
+                    if(refinedError >= error) {
+                        break;
+                    }
+
+                    cb    = refined;
+                    error = refinedError;
+                }
+            }
+
+            /* Transparent pixels use 4th palette entry */
+            for(int i = 0; i < 16; i++)
+            {
+                if(transparent & (1u << i)) {
+                    cb.indices |= 3u << (i * 2);
+                }
+            }
+
+            return cb;
+        }
+
+        /* Orders endpoints for palette mode and finds indices. Returns block error. */
+        uint32_t fit(const uint8_t* px, uint16_t c0, uint16_t c1, int nColors, ColorBlock& cb) const
+        {
+            /* 4 color mode requires c0 > c1, 3 color mode c0 <= c1 */
+            if((nColors == 4 && c0 < c1) || (nColors == 3 && c0 > c1)) {
+                std::swap(c0, c1);
+            }
+
+            uint8_t palette[16];
+            MakePalette(c0, c1, nColors, palette);
+
+            cb.c0 = c0;
+            cb.c1 = c1;
+            uint32_t error = m_fitIndices(px, palette, nColors, cb.indices);
+            if(nColors == 4 && c0 == c1) {
+                cb.indices = 0; // Palette is a single color, decoder would use 3 color mode
+            }
+
+            return error;
+        }
+
+        /* Endpoints at the corners of color bounding box, along the diagonal which follows block colors */
+        static void rangeEndpoints(const uint8_t* px, int* e0, int* e1)
+        {
+            int mn[3] = { 255, 255, 255 }, mx[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+            for(int i = 0; i < 16; i++)
+            {
+                for(int ch = 0; ch < 3; ch++)
+                {
+                    mn[ch] = std::min<int>(mn[ch], px[i * 4 + ch]);
+                    mx[ch] = std::max<int>(mx[ch], px[i * 4 + ch]);
+                    mean[ch] += px[i * 4 + ch];
+                }
+            }
+
+            /* Covariance sign of red and blue with green decides the diagonal */
+            int covRG = 0, covBG = 0;
+            for(int i = 0; i < 16; i++)
+            {
+                const int dg = px[i * 4 + 1] * 16 - mean[1];
+                covRG += (px[i * 4 + 0] * 16 - mean[0]) * dg;
+                covBG += (px[i * 4 + 2] * 16 - mean[2]) * dg;
+            }
+
+            if(covRG < 0) std::swap(mn[0], mx[0]);
+            if(covBG < 0) std::swap(mn[2], mx[2]);
+
+            /* Inset box by 1/16 of its range to reduce error of interpolated colors */
+            for(int ch = 0; ch < 3; ch++)
+            {
+                const int inset = (mx[ch] - mn[ch]) / 16;
+                e0[ch] = mx[ch] - inset;
+                e1[ch] = mn[ch] + inset;
+            }
+        }
+
+        /* Endpoints at the extremes of block colors projected on their principal axis */
+        static void principalAxisEndpoints(const uint8_t* px, int* e0, int* e1)
+        {
+            float mean[3] = { 0, 0, 0 };
+            for(int i = 0; i < 16; i++)
+            {
+                for(int ch = 0; ch < 3; ch++) {
+                    mean[ch] += px[i * 4 + ch] / 16.0f;
+                }
+            }
+
+            float cov[6] = {}; // rr rg rb gg gb bb
+            for(int i = 0; i < 16; i++)
+            {
+                const float r = px[i * 4 + 0] - mean[0];
+                const float g = px[i * 4 + 1] - mean[1];
+                const float b = px[i * 4 + 2] - mean[2];
+                cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+                cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+            }
+
+            /* Power iteration */
+            float axis[3] = { 0.9f, 1.0f, 0.7f };
+            for(int iter = 0; iter < 8; iter++)
+            {
+                const float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+                const float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+                const float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+                const float len = std::max({ std::fabs(x), std::fabs(y), std::fabs(z) });
+                if(len < 1e-6f) {
+                    break;
+                }
+
+                axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+            }
+
+            int iMin = 0, iMax = 0;
+            float dMin = 1e30f, dMax = -1e30f;
+            for(int i = 0; i < 16; i++)
+            {
+                const float d = px[i * 4 + 0] * axis[0] + px[i * 4 + 1] * axis[1] + px[i * 4 + 2] * axis[2];
+                if(d < dMin) { dMin = d; iMin = i; }
+                if(d > dMax) { dMax = d; iMax = i; }
+            }
+
+            for(int ch = 0; ch < 3; ch++)
+            {
+                e0[ch] = px[iMax * 4 + ch];
+                e1[ch] = px[iMin * 4 + ch];
+            }
+        }
+
+        /* Least squares endpoints for indices of cb. Returns false if system is singular. */
+        static bool refineEndpoints(const uint8_t* px, const ColorBlock& cb, int nColors, int* e0, int* e1)
+        {
+            /* Weight of c0 per palette index */
+            static constexpr float w4[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+            static constexpr float w3[4] = { 1.0f, 0.0f, 0.5f, 0.0f };
+            const float* w = nColors == 4 ? w4 : w3;
+
+            float aa = 0, bb = 0, ab = 0;
+            float ax[3] = {}, bx[3] = {};
+            for(int i = 0; i < 16; i++)
+            {
+                const float a = w[(cb.indices >> (i * 2)) & 3];
+                const float b = 1.0f - a;
+                aa += a * a; bb += b * b; ab += a * b;
+                for(int ch = 0; ch < 3; ch++)
+                {
+                    ax[ch] += a * px[i * 4 + ch];
+                    bx[ch] += b * px[i * 4 + ch];
+                }
+            }
+
+            const float det = aa * bb - ab * ab;
+            if(std::fabs(det) < 1e-6f) {
+                return false;
+            }
+
+            for(int ch = 0; ch < 3; ch++)
+            {
+                e0[ch] = std::clamp(int(std::lround((ax[ch] * bb - bx[ch] * ab) / det)), 0, 255);
+                e1[ch] = std::clamp(int(std::lround((bx[ch] * aa - ax[ch] * ab) / det)), 0, 255);
+            }
+
+            return true;
+        }
+
+        /* Encodes alpha of block as BC3 alpha block */
+        void encodeAlpha(const uint8_t* block, byte_t* out) const
+        {
+            int mn = 255, mx = 0;
+            int mnInner = 255, mxInner = 0; // Without 0 and 255
+            for(int i = 0; i < 16; i++)
+            {
+                const int a = block[i * 4 + 3];
+                mn = std::min(mn, a);
+                mx = std::max(mx, a);
+                if(a != 0 && a != 255)
+                {
+                    mnInner = std::min(mnInner, a);
+                    mxInner = std::max(mxInner, a);
+                }
+            }
+
+            uint64_t indices = 0;
+            uint8_t a0 = uint8_t(mx), a1 = uint8_t(mn);
+            if(mx != mn)
+            {
+                uint64_t idx8 = 0;
+                const uint32_t err8 = fitAlpha(block, a0, a1, idx8);
+
+                /* 6 alpha mode with exact 0 and 255 can be better if block has both extremes and values in between */
+                uint64_t idx6 = 0;
+                uint32_t err6 = UINT32_MAX;
+                if(m_opt.quality == BCQuality::High && mnInner <= mxInner && mnInner != mxInner) {
+                    err6 = fitAlpha(block, uint8_t(mnInner), uint8_t(mxInner), idx6);
+                }
+
+                if(err6 < err8)
+                {
+                    a0 = uint8_t(mnInner);
+                    a1 = uint8_t(mxInner);
+                    indices = idx6;
+                }
+                else {
+                    indices = idx8;
+                }
+            }
+
+            out[0] = a0;
+            out[1] = a1;
+            for(int i = 0; i < 6; i++) {
+                out[2 + i] = byte_t(indices >> (i * 8));
+            }
+        }
+
+        /* Finds nearest alpha of palette made from a0 and a1 for each pixel. Returns block error. */
+        static uint32_t fitAlpha(const uint8_t* block, uint8_t a0, uint8_t a1, uint64_t& indices)
+        {
+            int palette[8] = { a0, a1 };
+            if(a0 > a1)
+            {
+                for(int i = 1; i < 7; i++) {
+                    palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+                }
+            }
+            else
+            {
+                for(int i = 1; i < 5; i++) {
+                    palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+                }
+                palette[6] = 0;
+                palette[7] = 255;
+            }
+
+            uint32_t error = 0;
+            indices = 0;
+            for(int i = 0; i < 16; i++)
+            {
+                const int a = block[i * 4 + 3];
+                uint32_t best = UINT32_MAX;
+                uint64_t bestIdx = 0;
+                for(int c = 0; c < 8; c++)
+                {
+                    const uint32_t d = uint32_t((a - palette[c]) * (a - palette[c]));
+                    if(d < best)
+                    {
+                        best = d;
+                        bestIdx = uint64_t(c);
+                    }
+                }
+
+                error   += best;
+                indices |= bestIdx << (i * 3);
+            }
+
+            return error;
+        }
+
+    private:
+        const BCEncodeOptions& m_opt;
+        FitColorIndicesFn m_fitIndices;
+    };
+
+    /* Number of block rows encoded by one pool task */
+    uint32_t GetBlockRowsPerTask(uint32_t width, ThreadPool* pool)
+    {
+        /* Aim for tasks of at least ~4096 blocks */
+        const uint32_t blocksPerRow = std::max<uint32_t>(1, (width + 3) / 4);
+        return pool ? std::max<uint32_t>(1, 4096 / blocksPerRow) : UINT32_MAX;
+    }
+
+    /* Queues encoding of image on pool, or encodes it if pool is null */
+    void SubmitEncode(const byte_t* rgba, BCImage& image, const BCEncodeOptions& opt, ThreadPool* pool,
+                      std::vector<std::future<void>>& tasks)
+    {
+        const uint32_t blockRows = (image.height + 3) / 4;
+        if(!pool)
+        {
+            EncodeBCBlockRows(rgba, image.width, image.height, opt, image.data.data(), 0, blockRows);
+            return;
+        }
+
+        const uint32_t step = GetBlockRowsPerTask(image.width, pool);
+        for(uint32_t row = 0; row < blockRows; row += step)
+        {
+            const uint32_t end = std::min(blockRows, row + step);
+            tasks.push_back(pool->submit([rgba, &image, opt, row, end] {
+                EncodeBCBlockRows(rgba, image.width, image.height, opt, image.data.data(), row, end);
+            }));
+        }
+    }
+
+    BCImage MakeImage(uint32_t width, uint32_t height, BCFormat format)
+    {
+        BCImage image;
+        image.width  = width;
+        image.height = height;
+        image.format = format;
+        image.data.resize(GetBCImageSize(format, width, height));
+        return image;
+    }
+}
+
+ByteArray TextureToRGBA8(const Texture& tex)
+{
+    const auto& ci = tex.colorInfo();
+    const uint32_t bytesPerPixel = BBS(ci.bpp);
+    if(bytesPerPixel < 1 || bytesPerPixel > 4 || ci.bpp % 8 != 0) {
+        throw std::invalid_argument("Unsupported texture bit depth: " + std::to_string(ci.bpp));
+    }
+
+    const std::size_t nPixels = std::size_t(tex.width()) * tex.height();
+    if(!tex.bitmap() || tex.bitmap()->size() < nPixels * bytesPerPixel) {
+        throw std::invalid_argument("Texture bitmap is smaller than texture size");
+    }
+
+    const ChannelField red  (ci.redBPP,   ci.RedShl,   ci.bpp);
+    const ChannelField green(ci.greenBPP, ci.GreenShl, ci.bpp);
+    const ChannelField blue (ci.blueBPP,  ci.BlueShl,  ci.bpp);
+    const ChannelField alpha(ci.alphaBPP, ci.AlphaShl, ci.bpp);
+
+    ByteArray rgba(nPixels * 4);
+    const byte_t* src = tex.bitmap()->data();
+    for(std::size_t i = 0; i < nPixels; i++, src += bytesPerPixel)
+    {
+        uint32_t pixel = 0;
+        for(uint32_t b = 0; b < bytesPerPixel; b++) {
+            pixel |= uint32_t(src[b]) << (b * 8);
+        }
+
+        rgba[i * 4 + 0] = red.decode(pixel, 0);
+        rgba[i * 4 + 1] = green.decode(pixel, 0);
+        rgba[i * 4 + 2] = blue.decode(pixel, 0);
+        rgba[i * 4 + 3] = alpha.decode(pixel, 255);
+    }
+
+    return rgba;
+}
+
+void EncodeBCBlockRows(const byte_t* rgba, uint32_t width, uint32_t height, const BCEncodeOptions& opt,
+                       byte_t* out, uint32_t blockRowBegin, uint32_t blockRowEnd)
+{
+    if(width == 0 || height == 0) {
+        return;
+    }
+
+    BlockEncoder encoder(opt);
+    const uint32_t blocksPerRow = (width + 3) / 4;
+    const uint32_t blockSize    = GetBCBlockSize(opt.format);
+    blockRowEnd = std::min(blockRowEnd, (height + 3) / 4);
+
+    uint8_t block[64];
+    for(uint32_t by = blockRowBegin; by < blockRowEnd; by++)
+    {
+        for(uint32_t bx = 0; bx < blocksPerRow; bx++)
+        {
+            /* Gather 4x4 pixels, edge pixels are repeated for partial blocks */
+            for(uint32_t y = 0; y < 4; y++)
+            {
+                const uint32_t sy = std::min(by * 4 + y, height - 1);
+                for(uint32_t x = 0; x < 4; x++)
+                {
+                    const uint32_t sx = std::min(bx * 4 + x, width - 1);
+                    std::memcpy(block + (y * 4 + x) * 4, rgba + (std::size_t(sy) * width + sx) * 4, 4);
+                }
+            }
+
+            encoder.encode(block, out + (std::size_t(by) * blocksPerRow + bx) * blockSize);
+        }
+    }
+}
+
+BCImage EncodeBC(const byte_t* rgba, uint32_t width, uint32_t height, const BCEncodeOptions& opt, ThreadPool* pool)
+{
+    BCImage image = MakeImage(width, height, opt.format);
+    std::vector<std::future<void>> tasks;
+    SubmitEncode(rgba, image, opt, pool, tasks);
+    WaitAll(tasks);
+    return image;
+}
+
+BCImage EncodeTextureBC(const Texture& tex, const BCEncodeOptions& opt, ThreadPool* pool)
+{
+    const auto rgba = TextureToRGBA8(tex);
+    return EncodeBC(rgba.data(), tex.width(), tex.height(), opt, pool);
+}
+
+std::vector<std::vector<BCImage>> EncodeMaterialBC(const Material& mat, const BCEncodeOptions& opt, ThreadPool* pool)
+{
+    struct Level
+    {
+        std::size_t mmIdx;
+        std::size_t texIdx;
+        ByteArray rgba;
+    };
+
+    std::vector<std::vector<BCImage>> images;
+    std::vector<Level> levels;
+    images.reserve(mat.mipmaps().size());
+    for(const auto& mipmap : mat.mipmaps())
+    {
+        auto& mmImages = images.emplace_back();
+        for(const auto& tex : mipmap)
+        {
+            levels.push_back({ images.size() - 1, mmImages.size(), TextureToRGBA8(tex) });
+            mmImages.push_back(MakeImage(tex.width(), tex.height(), opt.format));
+        }
+    }
+
+    /* Images are not reallocated anymore, queue encoding of all levels at once */
+    std::vector<std::future<void>> tasks;
+    try
+    {
+        for(const auto& l : levels) {
+            SubmitEncode(l.rgba.data(), images[l.mmIdx][l.texIdx], opt, pool, tasks);
+        }
+    }
+    catch(...)
+    {
+        /* Queued tasks still reference images */
+        for(auto& t : tasks) {
+            t.wait();
+        }
+        throw;
+    }
+
+    WaitAll(tasks);
+    return images;
+}
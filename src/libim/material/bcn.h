@@ -0,0 +1,72 @@
+#ifndef LIBIM_BCN_H
+#define LIBIM_BCN_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bcn_kernels.h"
+#include "material.h"
+#include "texture.h"
+#include "../common.h"
+
+class ThreadPool;
+
+/* Block compression format. Both formats encode 4x4 pixel blocks. */
+enum class BCFormat
+{
+    BC1, // DXT1, RGB with 1 bit alpha, 8 bytes per block
+    BC3  // DXT5, RGB with interpolated 8 bit alpha, 16 bytes per block
+};
+
+enum class BCQuality
+{
+    Fast, // Endpoints from range of block colors
+    High  // Endpoints along principal axis of block colors, refined by least squares
+};
+
+struct BCEncodeOptions
+{
+    BCFormat  format  = BCFormat::BC1;
+    BCQuality quality = BCQuality::Fast;
+    BCKernel  kernel  = BCKernel::Auto;
+};
+
+/* Block compressed image */
+struct BCImage
+{
+    uint32_t width  = 0;
+    uint32_t height = 0;
+    BCFormat format = BCFormat::BC1;
+    ByteArray data;
+};
+
+inline constexpr uint32_t GetBCBlockSize(BCFormat format)
+{
+    return format == BCFormat::BC1 ? 8 : 16;
+}
+
+inline constexpr std::size_t GetBCImageSize(BCFormat format, uint32_t width, uint32_t height)
+{
+    return std::size_t((width + 3) / 4) * ((height + 3) / 4) * GetBCBlockSize(format);
+}
+
+/* Converts texture pixels of any color format to 8 bit RGBA.
+   Channels with no bits in color format are 0, missing alpha is 255. */
+ByteArray TextureToRGBA8(const Texture& tex);
+
+/* Encodes rows of 4x4 blocks [blockRowBegin, blockRowEnd) of 8 bit RGBA image.
+   out is buffer of whole encoded image, GetBCImageSize bytes. */
+void EncodeBCBlockRows(const byte_t* rgba, uint32_t width, uint32_t height, const BCEncodeOptions& opt,
+                       byte_t* out, uint32_t blockRowBegin, uint32_t blockRowEnd);
+
+/* Encodes 8 bit RGBA image. If pool is not null, block rows are encoded in parallel. */
+BCImage EncodeBC(const byte_t* rgba, uint32_t width, uint32_t height, const BCEncodeOptions& opt, ThreadPool* pool = nullptr);
+
+/* Encodes texture. If pool is not null, block rows are encoded in parallel. */
+BCImage EncodeTextureBC(const Texture& tex, const BCEncodeOptions& opt, ThreadPool* pool = nullptr);
+
+/* Encodes all textures of material. Result is indexed like material's mipmaps: [mipmap][texture].
+   If pool is not null, all textures and their block rows are encoded in parallel. */
+std::vector<std::vector<BCImage>> EncodeMaterialBC(const Material& mat, const BCEncodeOptions& opt, ThreadPool* pool = nullptr);
+
+#endif // LIBIM_BCN_H
@@ -0,0 +1,263 @@
+#include "bcn_kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# define LIBIM_BC_X86_KERNELS
+# include <immintrin.h>
+#endif
+
+static uint32_t FitColorIndicesScalar(const uint8_t* block, const uint8_t* palette, int nColors, uint32_t& indices)
+{
+    uint32_t error = 0;
+    indices = 0;
+    for(int i = 0; i < 16; i++)
+    {
+        const uint8_t* px = block + i * 4;
+        uint32_t best = UINT32_MAX;
+        uint32_t bestIdx = 0;
+        for(int c = 0; c < nColors; c++)
+        {
+            const int dr = int(px[0]) - palette[c * 4 + 0];
+            const int dg = int(px[1]) - palette[c * 4 + 1];
+            const int db = int(px[2]) - palette[c * 4 + 2];
+            const uint32_t d = uint32_t(dr * dr + dg * dg + db * db);
+            if(d < best)
+            {
+                best = d;
+                bestIdx = c;
+            }
+        }
+
+        error   += best;
+        indices |= bestIdx << (i * 2);
+    }
+
+    return error;
+}
+
+#ifdef LIBIM_BC_X86_KERNELS
+
+/* Both kernels split 16 RGBA pixels into R, G and B vectors of 16 bit lanes and compute
+   distance to palette color as (dr, dg) and (db, 0) pairs with madd, which gives 32 bit
+   squared distances of 4 pixels per 128 bits. */
+
+__attribute__((target("sse4.1")))
+static uint32_t FitColorIndicesSSE41(const uint8_t* block, const uint8_t* palette, int nColors, uint32_t& indices)
+{
+    /* Gather channel bytes of 4 pixels to 32 bit lanes: R0R1R2R3 G0G1G2G3 B0B1B2B3 A0A1A2A3 */
+    const __m128i soa = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    const __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)),      soa);
+    const __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16)), soa);
+    const __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 32)), soa);
+    const __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 48)), soa);
+
+    /* Channels of pixels 0-7 and 8-15 as 16 bit lanes */
+    const __m128i t01lo = _mm_unpacklo_epi32(p0, p1); // R0-3 R4-7 G0-3 G4-7
+    const __m128i t01hi = _mm_unpackhi_epi32(p0, p1); // B0-3 B4-7 A0-3 A4-7
+    const __m128i t23lo = _mm_unpacklo_epi32(p2, p3);
+    const __m128i t23hi = _mm_unpackhi_epi32(p2, p3);
+
+    const __m128i r[2] = { _mm_cvtepu8_epi16(t01lo), _mm_cvtepu8_epi16(t23lo) };
+    const __m128i g[2] = { _mm_cvtepu8_epi16(_mm_srli_si128(t01lo, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(t23lo, 8)) };
+    const __m128i b[2] = { _mm_cvtepu8_epi16(t01hi), _mm_cvtepu8_epi16(t23hi) };
+
+    /* Best distance and index of pixels 0-3, 4-7, 8-11, 12-15.
+       Distances start above any possible distance, so the first color is always closer. */
+    const __m128i zero = _mm_setzero_si128();
+    __m128i best[4]    = { _mm_set1_epi32(INT32_MAX), _mm_set1_epi32(INT32_MAX), _mm_set1_epi32(INT32_MAX), _mm_set1_epi32(INT32_MAX) };
+    __m128i bestIdx[4] = { zero, zero, zero, zero };
+    for(int c = 0; c < nColors; c++)
+    {
+        const __m128i pr = _mm_set1_epi16(palette[c * 4 + 0]);
+        const __m128i pg = _mm_set1_epi16(palette[c * 4 + 1]);
+        const __m128i pb = _mm_set1_epi16(palette[c * 4 + 2]);
+        const __m128i idx = _mm_set1_epi32(c);
+
+        for(int h = 0; h < 2; h++)
+        {
+            const __m128i dr = _mm_sub_epi16(r[h], pr);
+            const __m128i dg = _mm_sub_epi16(g[h], pg);
+            const __m128i db = _mm_sub_epi16(b[h], pb);
+
+            const __m128i rg0 = _mm_unpacklo_epi16(dr, dg);
+            const __m128i rg1 = _mm_unpackhi_epi16(dr, dg);
+            const __m128i b0  = _mm_unpacklo_epi16(db, zero);
+            const __m128i b1  = _mm_unpackhi_epi16(db, zero);
+
+            const __m128i d[2] = {
+                _mm_add_epi32(_mm_madd_epi16(rg0, rg0), _mm_madd_epi16(b0, b0)),
+                _mm_add_epi32(_mm_madd_epi16(rg1, rg1), _mm_madd_epi16(b1, b1))
+            };
+
+            for(int q = 0; q < 2; q++)
+            {
+                const int i = h * 2 + q;
+                const __m128i closer = _mm_cmpgt_epi32(best[i], d[q]);
+                best[i]    = _mm_min_epi32(best[i], d[q]);
+                bestIdx[i] = _mm_blendv_epi8(bestIdx[i], idx, closer);
+            }
+        }
+    }
+
+    /* Sum errors and pack indices */
+    __m128i sum = _mm_add_epi32(_mm_add_epi32(best[0], best[1]), _mm_add_epi32(best[2], best[3]));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    /* Shift index of pixel i to bits 2i by multiplying with 4^i and or them together */
+    __m128i packed = zero;
+    for(int i = 0; i < 4; i++)
+    {
+        const __m128i shift = _mm_setr_epi32(1 << (i * 8), 1 << (i * 8 + 2), 1 << (i * 8 + 4), 1 << (i * 8 + 6));
+        packed = _mm_or_si128(packed, _mm_mullo_epi32(bestIdx[i], shift));
+    }
+
+    packed = _mm_or_si128(packed, _mm_shuffle_epi32(packed, _MM_SHUFFLE(1, 0, 3, 2)));
+    packed = _mm_or_si128(packed, _mm_shuffle_epi32(packed, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    indices = uint32_t(_mm_cvtsi128_si32(packed));
+    return uint32_t(_mm_cvtsi128_si32(sum));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i Load2x128(const uint8_t* lo, const uint8_t* hi)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lo))),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi)), 1);
+}
+
+__attribute__((target("avx2")))
+static uint32_t FitColorIndicesAVX2(const uint8_t* block, const uint8_t* palette, int nColors, uint32_t& indices)
+{
+    /* Gather channel bytes of 4 pixels to 32 bit lanes in each 128 bit lane */
+    const __m256i soa = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+                                         0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    /* Pixels 0-3 and 8-11, 4-7 and 12-15 */
+    const __m256i p02 = _mm256_shuffle_epi8(Load2x128(block, block + 32), soa);
+    const __m256i p13 = _mm256_shuffle_epi8(Load2x128(block + 16, block + 48), soa);
+
+    /* Low 128 bits hold pixels 0-7, high 128 bits pixels 8-15 */
+    const __m256i tlo = _mm256_unpacklo_epi32(p02, p13); // R R G G
+    const __m256i thi = _mm256_unpackhi_epi32(p02, p13); // B B A A
+
+    /* 16 bit channels of pixels 0-15 */
+    const __m256i perm = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    const __m256i rg = _mm256_permutevar8x32_epi32(tlo, perm); // R0-15 G0-15 as bytes
+    const __m256i ba = _mm256_permutevar8x32_epi32(thi, perm);
+    const __m256i r = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(rg));
+    const __m256i g = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(rg, 1));
+    const __m256i b = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(ba));
+
+    /* Unpacks are per 128 bit lane: lo holds pixels 0-3 and 8-11, hi holds 4-7 and 12-15 */
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i best[2]    = { _mm256_set1_epi32(INT32_MAX), _mm256_set1_epi32(INT32_MAX) };
+    __m256i bestIdx[2] = { zero, zero };
+    for(int c = 0; c < nColors; c++)
+    {
+        const __m256i dr = _mm256_sub_epi16(r, _mm256_set1_epi16(palette[c * 4 + 0]));
+        const __m256i dg = _mm256_sub_epi16(g, _mm256_set1_epi16(palette[c * 4 + 1]));
+        const __m256i db = _mm256_sub_epi16(b, _mm256_set1_epi16(palette[c * 4 + 2]));
+        const __m256i idx = _mm256_set1_epi32(c);
+
+        const __m256i rg0 = _mm256_unpacklo_epi16(dr, dg);
+        const __m256i rg1 = _mm256_unpackhi_epi16(dr, dg);
+        const __m256i b0  = _mm256_unpacklo_epi16(db, zero);
+        const __m256i b1  = _mm256_unpackhi_epi16(db, zero);
+
+        const __m256i d[2] = {
+            _mm256_add_epi32(_mm256_madd_epi16(rg0, rg0), _mm256_madd_epi16(b0, b0)),
+            _mm256_add_epi32(_mm256_madd_epi16(rg1, rg1), _mm256_madd_epi16(b1, b1))
+        };
+
+        for(int q = 0; q < 2; q++)
+        {
+            const __m256i closer = _mm256_cmpgt_epi32(best[q], d[q]);
+            best[q]    = _mm256_min_epi32(best[q], d[q]);
+            bestIdx[q] = _mm256_blendv_epi8(bestIdx[q], idx, closer);
+        }
+    }
+
+    /* Sum errors */
+    const __m256i s8 = _mm256_add_epi32(best[0], best[1]);
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(s8), _mm256_extracti128_si256(s8, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    /* Shift index of each pixel to its bit position and or them together */
+    const __m256i shiftLo = _mm256_setr_epi32( 0,  2,  4,  6, 16, 18, 20, 22);
+    const __m256i shiftHi = _mm256_setr_epi32( 8, 10, 12, 14, 24, 26, 28, 30);
+    __m256i packed = _mm256_or_si256(_mm256_sllv_epi32(bestIdx[0], shiftLo), _mm256_sllv_epi32(bestIdx[1], shiftHi));
+    __m128i p = _mm_or_si128(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1));
+    p = _mm_or_si128(p, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 3, 2)));
+    p = _mm_or_si128(p, _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    indices = uint32_t(_mm_cvtsi128_si32(p));
+    return uint32_t(_mm_cvtsi128_si32(sum));
+}
+
+#endif // LIBIM_BC_X86_KERNELS
+
+bool IsBCKernelSupported(BCKernel kernel)
+{
+    switch (kernel)
+    {
+    case BCKernel::Auto:
+    case BCKernel::Scalar:
+        return true;
+#ifdef LIBIM_BC_X86_KERNELS
+    case BCKernel::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case BCKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+BCKernel GetBestBCKernel()
+{
+    static const BCKernel best = []
+    {
+        if(IsBCKernelSupported(BCKernel::AVX2)) {
+            return BCKernel::AVX2;
+        }
+        else if(IsBCKernelSupported(BCKernel::SSE41)) {
+            return BCKernel::SSE41;
+        }
+        return BCKernel::Scalar;
+    }();
+
+    return best;
+}
+
+FitColorIndicesFn GetFitColorIndicesKernel(BCKernel kernel)
+{
+    if(kernel == BCKernel::Auto || !IsBCKernelSupported(kernel)) {
+        kernel = GetBestBCKernel();
+    }
+
+    switch (kernel)
+    {
+#ifdef LIBIM_BC_X86_KERNELS
+    case BCKernel::SSE41:
+        return FitColorIndicesSSE41;
+    case BCKernel::AVX2:
+        return FitColorIndicesAVX2;
+#endif
+    default:
+        return FitColorIndicesScalar;
+    }
+}
+
+const char* BCKernelName(BCKernel kernel)
+{
+    switch (kernel)
+    {
+    case BCKernel::Auto:   return "auto";
+    case BCKernel::Scalar: return "scalar";
+    case BCKernel::SSE41:  return "sse4.1";
+    case BCKernel::AVX2:   return "avx2";
+    }
+
+    return "unknown";
+}
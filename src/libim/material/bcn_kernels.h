@@ -0,0 +1,29 @@
+#ifndef LIBIM_BCN_KERNELS_H
+#define LIBIM_BCN_KERNELS_H
+#include <cstdint>
+
+/* Instruction set of block compression kernels */
+enum class BCKernel
+{
+    Auto,   // Best kernel supported by CPU
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+/* Finds nearest of nColors (3 or 4) palette colors for each of 16 block pixels.
+   block and palette are RGBA pixels, alpha is ignored. Ties go to lower palette index.
+   Writes 2 bit palette index of pixel i to bits 2i of indices and returns sum of
+   squared RGB errors. */
+using FitColorIndicesFn = uint32_t(*)(const uint8_t* block, const uint8_t* palette, int nColors, uint32_t& indices);
+
+/* Returns kernel for kernel type. Auto and unsupported kernels resolve to the best supported kernel. */
+FitColorIndicesFn GetFitColorIndicesKernel(BCKernel kernel);
+
+/* Returns kernel type selected for Auto */
+BCKernel GetBestBCKernel();
+
+bool IsBCKernelSupported(BCKernel kernel);
+const char* BCKernelName(BCKernel kernel);
+
+#endif // LIBIM_BCN_KERNELS_H
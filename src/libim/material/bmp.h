@@ -1,5 +1,6 @@
 #ifndef BMP_H
 #define BMP_H
+#include <algorithm>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
@@ -85,56 +86,141 @@ typedef struct {
 } Bmp;
 
 
-//std::shared_ptr<Bmp> LoadBmpFromFile(const std::string& filename)
-//{
-//    Bmp bmp;
-
-//    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
-//    if (!ifs.is_open())
-//    {
-//        std::cerr << "Error opening file: " << strerror(errno) << std::endl;
-//        return 1;
-//    }
-
-//    /* Read header */
-//    if(!ifs.read(reinterpret_cast<char*>(&bmp.header), sizeof(bmp.header)))
-//    {
-//        std::cerr << "Error reading bmp header: " << strerror(errno) << std::endl;
-//        return 1;
-//    }
-
-//    /* Read bmp info header */
-//    if(!ifs.read(reinterpret_cast<char*>(&bmp.info), sizeof(bmp.info)))
-//    {
-//        std::cerr << "Error reading bmp info header: " << strerror(errno) << std::endl;
-//        return 1;
-//    }
-
-//    /* Check bmp type */
-//    if(bmp.header.type != BMP_TYPE)
-//    {
-//        std::cerr << "Error not a bitmap file!\n";
-//        return 2;
-//    }
-
-//    /* Check taht we have v5 info header */
-//    if(bmp.info.size != sizeof(BitmapV5Header))
-//    {
-//        std::cerr << "No v5 bitmap header found!\n";
-//        return 2;
-//    }
-//}
-
-static bool SaveBmpToFile(const std::string& filename, const Bmp& bmp)
+/* Reads bmp with 16, 24 or 32 bit uncompressed or bitfields pixels from file.
+   Info header can be any version, missing fields are zero. Pixel rows are returned
+   top-down without row padding (info.height < 0) and BI_RGB images get their implicit masks.
+   Throws StreamError on error. */
+inline Bmp LoadBmpFromFile(const std::string& filename)
 {
-    try
+    InputFileStream ifs(filename);
+
+    Bmp bmp;
+    bmp.header = ifs.read<BitmapFileHeader>();
+    if(bmp.header.type != BMP_TYPE) {
+        throw StreamError("Not a bmp file");
+    }
+
+    const auto infoSize = ifs.read<uint32_t>();
+    if(infoSize < 40) {
+        throw StreamError("Unsupported bmp info header");
+    }
+
+    /* Bitfield masks of 40 byte header follow it */
+    std::size_t nInfo = std::min<std::size_t>(infoSize, sizeof(BitmapV5Header));
+    ifs.seek(sizeof(BitmapFileHeader));
+    ifs.read(reinterpret_cast<byte_t*>(&bmp.info), 40);
+    if(infoSize == 40 && (bmp.info.compression == BI_BITFIELDS || bmp.info.compression == BI_ALPHABITFIELDS)) {
+        nInfo += bmp.info.compression == BI_BITFIELDS ? 12 : 16;
+    }
+
+    if(nInfo > 40 && ifs.read(reinterpret_cast<byte_t*>(&bmp.info) + 40, nInfo - 40) != nInfo - 40) {
+        throw StreamError("Error reading bmp info header");
+    }
+
+    const uint32_t bpp = bmp.info.bitCount;
+    if(bpp != 16 && bpp != 24 && bpp != 32) {
+        throw StreamError("Unsupported bmp bit depth: " + std::to_string(bpp));
+    }
+
+    if(bmp.info.compression == BI_RGB)
     {
-        OutputFileStream ofs(filename);
-        ofs.write(reinterpret_cast<const byte_t*>(&bmp.header), sizeof(bmp.header));
-        ofs.write(reinterpret_cast<const byte_t*>(&bmp.info),   sizeof(bmp.info));
-        ofs.write(reinterpret_cast<const byte_t*>(bmp.pixelData->data()), bmp.pixelData->size());
+        bmp.info.redMask   = bpp == 16 ? 0x7C00 : 0xFF0000;
+        bmp.info.greenMask = bpp == 16 ? 0x03E0 : 0x00FF00;
+        bmp.info.blueMask  = bpp == 16 ? 0x001F : 0x0000FF;
+        bmp.info.alphaMask = 0;
+    }
+    else if(bmp.info.compression != BI_BITFIELDS && bmp.info.compression != BI_ALPHABITFIELDS) {
+        throw StreamError("Unsupported bmp compression");
+    }
+
+    const int32_t height = bmp.info.height < 0 ? -bmp.info.height : bmp.info.height;
+    if(bmp.info.width <= 0 || height == 0) {
+        throw StreamError("Invalid bmp size");
+    }
+
+    /* Rows are padded to 4 bytes and stored bottom-up unless height is negative */
+    const std::size_t rowSize   = std::size_t(bmp.info.width) * (bpp / 8);
+    const std::size_t rowStride = (rowSize + 3) & ~std::size_t(3);
+    bmp.pixelData = MakeBitmapPtr(rowSize * height);
+    for(int32_t y = 0; y < height; y++)
+    {
+        const int32_t row = bmp.info.height < 0 ? y : height - 1 - y;
+        ifs.seek(bmp.header.offBits + rowStride * y);
+        if(ifs.read(bmp.pixelData->data() + rowSize * row, rowSize) != rowSize) {
+            throw StreamError("Error reading bmp pixel data");
+        }
+    }
 
-        ofs.close();
+    bmp.info.height    = -height;
+    bmp.info.sizeImage = uint32_t(bmp.pixelData->size());
+    return bmp;
+}
+
+/* Converts pixels of bmp loaded by LoadBmpFromFile to 8 bit RGBA.
+   Missing color channels are 0, missing alpha is 255. */
+inline ByteArray BmpToRGBA8(const Bmp& bmp)
+{
+    const uint32_t bytesPerPixel = bmp.info.bitCount / 8;
+    const uint32_t masks[4] = { bmp.info.redMask, bmp.info.greenMask, bmp.info.blueMask, bmp.info.alphaMask };
+
+    uint32_t shift[4] {};
+    uint64_t maxValue[4] {};
+    for(int c = 0; c < 4; c++)
+    {
+        if(masks[c])
+        {
+            while(!(masks[c] & (1u << shift[c]))) {
+                shift[c]++;
+            }
+            maxValue[c] = masks[c] >> shift[c];
+        }
+    }
+
+    const std::size_t nPixels = bmp.pixelData->size() / bytesPerPixel;
+    ByteArray rgba(nPixels * 4);
+    for(std::size_t i = 0; i < nPixels; i++)
+    {
+        const byte_t* p = bmp.pixelData->data() + i * bytesPerPixel;
+        uint32_t pixel = 0;
+        for(uint32_t b = 0; b < bytesPerPixel; b++) {
+            pixel |= uint32_t(p[b]) << (b * 8);
+        }
+
+        for(int c = 0; c < 4; c++)
+        {
+            if(!maxValue[c])
+            {
+                rgba[i * 4 + c] = c == 3 ? 255 : 0;
+                continue;
+            }
+
+            const uint64_t v = (pixel & masks[c]) >> shift[c];
+            rgba[i * 4 + c] = byte_t((v * 255 + maxValue[c] / 2) / maxValue[c]);
+        }
+    }
+
+    return rgba;
+}
+
+/* Writes bmp to file. Throws StreamError on error. */
+inline void WriteBmpToFile(const std::string& filename, const Bmp& bmp)
+{
+    WriteBatch batch;
+    batch.add(reinterpret_cast<const byte_t*>(&bmp.header), sizeof(bmp.header))
+         .add(reinterpret_cast<const byte_t*>(&bmp.info),   sizeof(bmp.info))
+         .add(reinterpret_cast<const byte_t*>(bmp.pixelData->data()), bmp.pixelData->size());
+
+    OutputFileStream ofs(filename);
+    ofs.preallocate(batch.size());
+    ofs.write(batch);
+    ofs.close();
+}
+
+inline bool SaveBmpToFile(const std::string& filename, const Bmp& bmp)
+{
+    try
+    {
+        WriteBmpToFile(filename, bmp);
         return true;
     }
     catch (const std::exception& e)
@@ -1,6 +1,7 @@
 #ifndef LIBIM_COLORFORMAT_H
 #define LIBIM_COLORFORMAT_H
 #include <cstdint>
+#include "../io/record.h"
 
 
 struct ColorFormat
@@ -25,9 +26,27 @@ struct ColorFormat
     int32_t AlphaShr;
 };
 
+LIBIM_RECORD_LAYOUT(ColorFormat, 56,
+    LIBIM_FIELD(ColorFormat, colorMode),
+    LIBIM_FIELD(ColorFormat, bpp),
+    LIBIM_FIELD(ColorFormat, redBPP),
+    LIBIM_FIELD(ColorFormat, greenBPP),
+    LIBIM_FIELD(ColorFormat, blueBPP),
+    LIBIM_FIELD(ColorFormat, RedShl),
+    LIBIM_FIELD(ColorFormat, GreenShl),
+    LIBIM_FIELD(ColorFormat, BlueShl),
+    LIBIM_FIELD(ColorFormat, RedShr),
+    LIBIM_FIELD(ColorFormat, GreenShr),
+    LIBIM_FIELD(ColorFormat, BlueShr),
+    LIBIM_FIELD(ColorFormat, alphaBPP),
+    LIBIM_FIELD(ColorFormat, AlphaShl),
+    LIBIM_FIELD(ColorFormat, AlphaShr)
+);
+
 static constexpr ColorFormat RGB_565   { 1, 16, 5, 6, 5, 11, 5, 0, 3, 2, 3, 0,  0, 0 };
 static constexpr ColorFormat RGBA_4444 { 2, 16, 4, 4, 4, 12, 8, 4, 4, 4, 4, 4,  0, 4 };
 static constexpr ColorFormat ARGB_4444 { 2, 16, 4, 4, 4,  8, 4, 0, 4, 4, 4, 4, 12, 4 };
 static constexpr ColorFormat ARGB_5551 { 2, 16, 5, 5, 5, 10, 5, 0, 3, 3, 3, 1, 16, 7 };
+static constexpr ColorFormat RGBA_8888 { 2, 32, 8, 8, 8,  0, 8, 16, 0, 0, 0, 8, 24, 0 }; // Byte order R, G, B, A
 
 #endif // LIBIM_COLORFORMAT_H
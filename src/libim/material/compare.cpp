@@ -0,0 +1,308 @@
+#include "compare.h"
+#include "bcn.h"
+#include "../utils/thread_pool.h"
+#include "../utils/xxhash.h"
+
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+    constexpr double SSIM_C1 = (0.01 * 255) * (0.01 * 255);
+    constexpr double SSIM_C2 = (0.03 * 255) * (0.03 * 255);
+    constexpr uint32_t SSIM_WINDOW = 8;
+    constexpr uint32_t SSIM_STEP   = 4;
+
+    /* Sums of squared errors and SSIM windows, added up over textures of material */
+    struct MetricSums
+    {
+        uint64_t sqErr    = 0;
+        uint64_t nSamples = 0;
+        double   ssim     = 0.0;
+        uint64_t nWindows = 0;
+
+        ImageMetrics metrics() const
+        {
+            ImageMetrics m;
+            m.mse  = nSamples ? double(sqErr) / nSamples : 0.0;
+            m.psnr = m.mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / m.mse) : std::numeric_limits<double>::infinity();
+            m.ssim = nWindows ? ssim / nWindows : 1.0;
+            return m;
+        }
+    };
+
+    inline uint32_t ChannelCount(uint32_t channelMask)
+    {
+        uint32_t n = 0;
+        for(int c = 0; c < 4; c++) {
+            n += (channelMask >> c) & 1;
+        }
+        return n;
+    }
+
+    /* Returns number of SSIM windows of image, images smaller than window have one */
+    inline uint64_t SSIMWindowCount(uint32_t width, uint32_t height)
+    {
+        if(width < SSIM_WINDOW || height < SSIM_WINDOW) {
+            return 1;
+        }
+        return uint64_t((width - SSIM_WINDOW) / SSIM_STEP + 1) * ((height - SSIM_WINDOW) / SSIM_STEP + 1);
+    }
+
+    /* Returns SSIM of window of n pixels averaged over selected channels */
+    double WindowSSIM(const SSIMBlockSums& s, double n, uint32_t channelMask)
+    {
+        double ssim = 0.0;
+        for(int c = 0; c < 4; c++)
+        {
+            if(!((channelMask >> c) & 1)) {
+                continue;
+            }
+
+            const double muA  = s.a[c] / n;
+            const double muB  = s.b[c] / n;
+            const double varA = s.aa[c] / n - muA * muA;
+            const double varB = s.bb[c] / n - muB * muB;
+            const double cov  = s.ab[c] / n - muA * muB;
+            ssim += ((2.0 * muA * muB + SSIM_C1) * (2.0 * cov + SSIM_C2)) /
+                    ((muA * muA + muB * muB + SSIM_C1) * (varA + varB + SSIM_C2));
+        }
+
+        return ssim / ChannelCount(channelMask);
+    }
+
+    void AddImageMetrics(const byte_t* a, const byte_t* b, uint32_t width, uint32_t height, uint32_t channelMask,
+                         CompareKernel kernel, MetricSums& sums)
+    {
+        const std::size_t nPixels = std::size_t(width) * height;
+        uint64_t sqErr[4] = {};
+        GetSquaredErrorKernel(kernel)(a, b, nPixels, sqErr);
+        for(int c = 0; c < 4; c++)
+        {
+            if((channelMask >> c) & 1) {
+                sums.sqErr += sqErr[c];
+            }
+        }
+        sums.nSamples += nPixels * ChannelCount(channelMask);
+
+        /* Image smaller than window is one window */
+        if(width < SSIM_WINDOW || height < SSIM_WINDOW)
+        {
+            SSIMBlockSums s {};
+            for(std::size_t i = 0; i < nPixels * 4; i++)
+            {
+                const uint32_t va = a[i];
+                const uint32_t vb = b[i];
+                s.a[i & 3]  += va;
+                s.b[i & 3]  += vb;
+                s.aa[i & 3] += va * va;
+                s.bb[i & 3] += vb * vb;
+                s.ab[i & 3] += va * vb;
+            }
+
+            sums.ssim += WindowSSIM(s, double(nPixels), channelMask);
+            sums.nWindows++;
+            return;
+        }
+
+        const auto ssimBlock = GetSSIMBlockKernel(kernel);
+        const std::size_t stride = std::size_t(width) * 4;
+        for(uint32_t y = 0; y + SSIM_WINDOW <= height; y += SSIM_STEP)
+        {
+            for(uint32_t x = 0; x + SSIM_WINDOW <= width; x += SSIM_STEP)
+            {
+                SSIMBlockSums s;
+                const std::size_t offset = y * stride + std::size_t(x) * 4;
+                ssimBlock(a + offset, b + offset, stride, s);
+                sums.ssim += WindowSSIM(s, SSIM_WINDOW * SSIM_WINDOW, channelMask);
+                sums.nWindows++;
+            }
+        }
+    }
+
+    inline bool EqualColorFormats(const ColorFormat& a, const ColorFormat& b)
+    {
+        return std::memcmp(&a, &b, sizeof(ColorFormat)) == 0;
+    }
+
+    /* Returns why materials can't be compared or empty string */
+    std::string IncompatibilityReason(const Material& a, const Material& b)
+    {
+        if(a.width() != b.width() || a.height() != b.height()) {
+            return "size " + std::to_string(a.width()) + "x" + std::to_string(a.height()) +
+                   " -> " + std::to_string(b.width()) + "x" + std::to_string(b.height());
+        }
+
+        if(a.mipmaps().size() != b.mipmaps().size()) {
+            return "mipmaps " + std::to_string(a.mipmaps().size()) + " -> " + std::to_string(b.mipmaps().size());
+        }
+
+        for(std::size_t i = 0; i < a.mipmaps().size(); i++)
+        {
+            const auto& ma = a.mipmaps()[i];
+            const auto& mb = b.mipmaps()[i];
+            if(ma.size() != mb.size()) {
+                return "textures " + std::to_string(ma.size()) + " -> " + std::to_string(mb.size());
+            }
+
+            for(std::size_t t = 0; t < ma.size(); t++)
+            {
+                if(ma[t].width() != mb[t].width() || ma[t].height() != mb[t].height() || !ma[t].bitmap() || !mb[t].bitmap()) {
+                    return "texture " + std::to_string(t) + " of mipmap " + std::to_string(i) + " differs in size";
+                }
+            }
+        }
+
+        return std::string();
+    }
+
+    MaterialDiff CompareMaterial(const Material& a, const Material& b, CompareKernel kernel)
+    {
+        MaterialDiff diff;
+        diff.name   = a.name();
+        diff.reason = IncompatibilityReason(a, b);
+        if(!diff.reason.empty())
+        {
+            diff.status = MaterialDiffStatus::Incompatible;
+            return diff;
+        }
+
+        const bool sameFormat = EqualColorFormats(a.colorFormat(), b.colorFormat());
+        const uint32_t channelMask = (a.colorFormat().alphaBPP > 0 || b.colorFormat().alphaBPP > 0) ? 0xF : 0x7;
+
+        MetricSums sums;
+        for(std::size_t i = 0; i < a.mipmaps().size(); i++)
+        {
+            for(std::size_t t = 0; t < a.mipmaps()[i].size(); t++)
+            {
+                const auto& ta = a.mipmaps()[i][t];
+                const auto& tb = b.mipmaps()[i][t];
+                const auto& pa = *ta.bitmap();
+                const auto& pb = *tb.bitmap();
+
+                if(sameFormat && pa.size() == pb.size() && XXH64(pa.data(), pa.size()) == XXH64(pb.data(), pb.size()))
+                {
+                    sums.nSamples += uint64_t(ta.width()) * ta.height() * ChannelCount(channelMask);
+                    const uint64_t nWindows = SSIMWindowCount(ta.width(), ta.height());
+                    sums.ssim     += double(nWindows);
+                    sums.nWindows += nWindows;
+                    continue;
+                }
+
+                diff.nChangedTextures++;
+                const auto rgbaA = TextureToRGBA8(ta);
+                const auto rgbaB = TextureToRGBA8(tb);
+                AddImageMetrics(rgbaA.data(), rgbaB.data(), ta.width(), ta.height(), channelMask, kernel, sums);
+            }
+        }
+
+        diff.status  = diff.nChangedTextures ? MaterialDiffStatus::Changed : MaterialDiffStatus::Identical;
+        diff.metrics = sums.metrics();
+        return diff;
+    }
+}
+
+ImageMetrics CompareRGBA8(const byte_t* a, const byte_t* b, uint32_t width, uint32_t height, uint32_t channelMask, CompareKernel kernel)
+{
+    if((channelMask & 0xF) == 0) {
+        throw std::invalid_argument("No channel to compare");
+    }
+
+    MetricSums sums;
+    AddImageMetrics(a, b, width, height, channelMask & 0xF, kernel, sums);
+    return sums.metrics();
+}
+
+uint64_t HashMaterialPixels(const Material& mat)
+{
+    XXHash64 hash;
+    for(const auto& mipmap : mat.mipmaps())
+    {
+        for(const auto& tex : mipmap)
+        {
+            if(tex.bitmap()) {
+                hash.update(tex.bitmap()->data(), tex.bitmap()->size());
+            }
+        }
+    }
+    return hash.digest();
+}
+
+std::vector<MaterialDiff> CompareMaterials(const std::vector<Material>& oldMaterials, const std::vector<Material>& newMaterials,
+                                           CompareKernel kernel, ThreadPool* pool)
+{
+    std::unordered_map<std::string, std::size_t> newByName;
+    for(std::size_t i = 0; i < newMaterials.size(); i++) {
+        newByName.emplace(newMaterials[i].name(), i);
+    }
+
+    std::vector<MaterialDiff> diffs(oldMaterials.size());
+    std::vector<bool> matched(newMaterials.size(), false);
+    std::vector<std::future<void>> tasks;
+    try
+    {
+        for(std::size_t i = 0; i < oldMaterials.size(); i++)
+        {
+            auto it = newByName.find(oldMaterials[i].name());
+            if(it == newByName.end())
+            {
+                diffs[i].name   = oldMaterials[i].name();
+                diffs[i].status = MaterialDiffStatus::Removed;
+                continue;
+            }
+
+            matched[it->second] = true;
+            auto compare = [&diff = diffs[i], &a = oldMaterials[i], &b = newMaterials[it->second], kernel] {
+                diff = CompareMaterial(a, b, kernel);
+            };
+
+            if(pool) {
+                tasks.push_back(pool->submit(std::move(compare)));
+            }
+            else {
+                compare();
+            }
+        }
+    }
+    catch(...)
+    {
+        /* Queued tasks still reference diffs */
+        for(auto& t : tasks) {
+            t.wait();
+        }
+        throw;
+    }
+
+    WaitAll(tasks);
+
+    for(std::size_t i = 0; i < newMaterials.size(); i++)
+    {
+        if(!matched[i])
+        {
+            MaterialDiff diff;
+            diff.name   = newMaterials[i].name();
+            diff.status = MaterialDiffStatus::Added;
+            diffs.push_back(std::move(diff));
+        }
+    }
+
+    return diffs;
+}
+
+const char* MaterialDiffStatusName(MaterialDiffStatus status)
+{
+    switch (status)
+    {
+    case MaterialDiffStatus::Identical:    return "identical";
+    case MaterialDiffStatus::Changed:      return "changed";
+    case MaterialDiffStatus::Added:        return "added";
+    case MaterialDiffStatus::Removed:      return "removed";
+    case MaterialDiffStatus::Incompatible: return "incompatible";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,57 @@
+#ifndef LIBIM_COMPARE_H
+#define LIBIM_COMPARE_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compare_kernels.h"
+#include "material.h"
+#include "../common.h"
+
+class ThreadPool;
+
+enum class MaterialDiffStatus
+{
+    Identical,   // Pixel data is byte identical
+    Changed,     // Pixel data differs
+    Added,       // Material is only in new materials
+    Removed,     // Material is only in old materials
+    Incompatible // Size or number of mipmaps or textures differs
+};
+
+/* Difference of two images. Identical images have mse 0, psnr infinity and ssim 1. */
+struct ImageMetrics
+{
+    double mse  = 0.0;
+    double psnr = 0.0; // dB
+    double ssim = 1.0; // Mean of 8x8 windows at 4 pixel steps
+};
+
+struct MaterialDiff
+{
+    std::string name;
+    MaterialDiffStatus status = MaterialDiffStatus::Identical;
+    ImageMetrics metrics;    // Over all textures of Identical and Changed materials
+    std::size_t nChangedTextures = 0;
+    std::string reason;      // Why material is Incompatible
+};
+
+/* Compares two 8 bit RGBA images of equal size.
+   Bit c of channelMask selects channel c (R, G, B, A) included in metrics. */
+ImageMetrics CompareRGBA8(const byte_t* a, const byte_t* b, uint32_t width, uint32_t height,
+                          uint32_t channelMask = 0xF, CompareKernel kernel = CompareKernel::Auto);
+
+/* Returns XXH64 hash of pixel data of all material's textures */
+uint64_t HashMaterialPixels(const Material& mat);
+
+/* Matches materials by name and compares them. Textures with byte identical pixel data
+   (equal XXH64 hash and color format) are skipped, the rest are decoded to RGBA8 and compared.
+   Alpha is compared when any of the color formats has alpha.
+   Result has diffs of old materials in their order followed by Added materials.
+   If pool is not null, materials are compared in parallel. */
+std::vector<MaterialDiff> CompareMaterials(const std::vector<Material>& oldMaterials, const std::vector<Material>& newMaterials,
+                                           CompareKernel kernel = CompareKernel::Auto, ThreadPool* pool = nullptr);
+
+const char* MaterialDiffStatusName(MaterialDiffStatus status);
+
+#endif // LIBIM_COMPARE_H
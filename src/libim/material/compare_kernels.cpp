@@ -0,0 +1,285 @@
+#include "compare_kernels.h"
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# define LIBIM_COMPARE_X86_KERNELS
+# include <immintrin.h>
+#endif
+
+static void SquaredErrorScalar(const uint8_t* a, const uint8_t* b, std::size_t nPixels, uint64_t sqErr[4])
+{
+    for(std::size_t i = 0; i < nPixels * 4; i++)
+    {
+        const int32_t d = int32_t(a[i]) - int32_t(b[i]);
+        sqErr[i & 3] += uint32_t(d * d);
+    }
+}
+
+static void SSIMBlockScalar(const uint8_t* a, const uint8_t* b, std::size_t stride, SSIMBlockSums& sums)
+{
+    sums = SSIMBlockSums{};
+    for(int y = 0; y < 8; y++, a += stride, b += stride)
+    {
+        for(int i = 0; i < 32; i++)
+        {
+            const uint32_t va = a[i];
+            const uint32_t vb = b[i];
+            sums.a[i & 3]  += va;
+            sums.b[i & 3]  += vb;
+            sums.aa[i & 3] += va * va;
+            sums.bb[i & 3] += vb * vb;
+            sums.ab[i & 3] += va * vb;
+        }
+    }
+}
+
+#ifdef LIBIM_COMPARE_X86_KERNELS
+
+/* Pixels are widened to 16 bit lanes whose index mod 4 is the channel. Squares and
+   products of 8 bit values fit in 16 bits, so they're computed with mullo and widened
+   to 32 bit lanes by unpack, which keeps lane index mod 4. */
+
+/* Squared errors of 32 bit lane accumulator are flushed to 64 bit sums every
+   MAX_32BIT_PIXELS pixels, before 65025 * MAX_32BIT_PIXELS / lanes could overflow */
+static constexpr std::size_t MAX_32BIT_PIXELS = 16384;
+
+__attribute__((target("sse4.1")))
+static inline __m128i SquareLo32SSE41(__m128i d)
+{
+    return _mm_unpacklo_epi16(_mm_mullo_epi16(d, d), _mm_setzero_si128());
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i SquareHi32SSE41(__m128i d)
+{
+    return _mm_unpackhi_epi16(_mm_mullo_epi16(d, d), _mm_setzero_si128());
+}
+
+__attribute__((target("sse4.1")))
+static void SquaredErrorSSE41(const uint8_t* a, const uint8_t* b, std::size_t nPixels, uint64_t sqErr[4])
+{
+    std::size_t i = 0;
+    while(i + 4 <= nPixels)
+    {
+        const std::size_t end = std::min(nPixels & ~std::size_t(3), i + MAX_32BIT_PIXELS);
+        __m128i acc = _mm_setzero_si128();
+        for(; i < end; i += 4)
+        {
+            const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i * 4));
+            const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i * 4));
+            const __m128i dLo = _mm_sub_epi16(_mm_cvtepu8_epi16(va), _mm_cvtepu8_epi16(vb));
+            const __m128i dHi = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(va, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(vb, 8)));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(SquareLo32SSE41(dLo), SquareHi32SSE41(dLo)));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(SquareLo32SSE41(dHi), SquareHi32SSE41(dHi)));
+        }
+
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+        for(int c = 0; c < 4; c++) {
+            sqErr[c] += lanes[c];
+        }
+    }
+
+    SquaredErrorScalar(a + i * 4, b + i * 4, nPixels - i, sqErr);
+}
+
+__attribute__((target("sse4.1")))
+static void SSIMBlockSSE41(const uint8_t* a, const uint8_t* b, std::size_t stride, SSIMBlockSums& sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sa  = zero, sb  = zero; // 16 bit sums of 32 values
+    __m128i saa = zero, sbb = zero, sab = zero;
+
+    for(int y = 0; y < 8; y++, a += stride, b += stride)
+    {
+        for(int half = 0; half < 2; half++)
+        {
+            const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + half * 16));
+            const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + half * 16));
+            const __m128i a16[2] = { _mm_cvtepu8_epi16(va), _mm_cvtepu8_epi16(_mm_srli_si128(va, 8)) };
+            const __m128i b16[2] = { _mm_cvtepu8_epi16(vb), _mm_cvtepu8_epi16(_mm_srli_si128(vb, 8)) };
+            for(int j = 0; j < 2; j++)
+            {
+                sa = _mm_add_epi16(sa, a16[j]);
+                sb = _mm_add_epi16(sb, b16[j]);
+
+                const __m128i aa = _mm_mullo_epi16(a16[j], a16[j]);
+                const __m128i bb = _mm_mullo_epi16(b16[j], b16[j]);
+                const __m128i ab = _mm_mullo_epi16(a16[j], b16[j]);
+                saa = _mm_add_epi32(saa, _mm_add_epi32(_mm_unpacklo_epi16(aa, zero), _mm_unpackhi_epi16(aa, zero)));
+                sbb = _mm_add_epi32(sbb, _mm_add_epi32(_mm_unpacklo_epi16(bb, zero), _mm_unpackhi_epi16(bb, zero)));
+                sab = _mm_add_epi32(sab, _mm_add_epi32(_mm_unpacklo_epi16(ab, zero), _mm_unpackhi_epi16(ab, zero)));
+            }
+        }
+    }
+
+    sa = _mm_add_epi32(_mm_unpacklo_epi16(sa, zero), _mm_unpackhi_epi16(sa, zero));
+    sb = _mm_add_epi32(_mm_unpacklo_epi16(sb, zero), _mm_unpackhi_epi16(sb, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.a),  sa);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.b),  sb);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.aa), saa);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.bb), sbb);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.ab), sab);
+}
+
+__attribute__((target("avx2")))
+static inline __m128i Fold256To128(__m256i v)
+{
+    return _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+__attribute__((target("avx2")))
+static void SquaredErrorAVX2(const uint8_t* a, const uint8_t* b, std::size_t nPixels, uint64_t sqErr[4])
+{
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    while(i + 8 <= nPixels)
+    {
+        const std::size_t end = std::min(nPixels & ~std::size_t(7), i + MAX_32BIT_PIXELS);
+        __m256i acc = zero;
+        for(; i < end; i += 8)
+        {
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i * 4));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i * 4));
+            const __m256i dLo = _mm256_sub_epi16(_mm256_unpacklo_epi8(va, zero), _mm256_unpacklo_epi8(vb, zero));
+            const __m256i dHi = _mm256_sub_epi16(_mm256_unpackhi_epi8(va, zero), _mm256_unpackhi_epi8(vb, zero));
+            const __m256i sqLo = _mm256_mullo_epi16(dLo, dLo);
+            const __m256i sqHi = _mm256_mullo_epi16(dHi, dHi);
+            acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_unpacklo_epi16(sqLo, zero), _mm256_unpackhi_epi16(sqLo, zero)));
+            acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_unpacklo_epi16(sqHi, zero), _mm256_unpackhi_epi16(sqHi, zero)));
+        }
+
+        alignas(16) uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), Fold256To128(acc));
+        for(int c = 0; c < 4; c++) {
+            sqErr[c] += lanes[c];
+        }
+    }
+
+    /* Tail runs non-VEX SSE code, clear upper halves to avoid the AVX-SSE transition penalty */
+    _mm256_zeroupper();
+    SquaredErrorSSE41(a + i * 4, b + i * 4, nPixels - i, sqErr);
+}
+
+__attribute__((target("avx2")))
+static void SSIMBlockAVX2(const uint8_t* a, const uint8_t* b, std::size_t stride, SSIMBlockSums& sums)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sa  = zero, sb  = zero; // 16 bit sums of 16 values
+    __m256i saa = zero, sbb = zero, sab = zero;
+
+    for(int y = 0; y < 8; y++, a += stride, b += stride)
+    {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+        const __m256i a16[2] = { _mm256_unpacklo_epi8(va, zero), _mm256_unpackhi_epi8(va, zero) };
+        const __m256i b16[2] = { _mm256_unpacklo_epi8(vb, zero), _mm256_unpackhi_epi8(vb, zero) };
+        for(int j = 0; j < 2; j++)
+        {
+            sa = _mm256_add_epi16(sa, a16[j]);
+            sb = _mm256_add_epi16(sb, b16[j]);
+
+            const __m256i aa = _mm256_mullo_epi16(a16[j], a16[j]);
+            const __m256i bb = _mm256_mullo_epi16(b16[j], b16[j]);
+            const __m256i ab = _mm256_mullo_epi16(a16[j], b16[j]);
+            saa = _mm256_add_epi32(saa, _mm256_add_epi32(_mm256_unpacklo_epi16(aa, zero), _mm256_unpackhi_epi16(aa, zero)));
+            sbb = _mm256_add_epi32(sbb, _mm256_add_epi32(_mm256_unpacklo_epi16(bb, zero), _mm256_unpackhi_epi16(bb, zero)));
+            sab = _mm256_add_epi32(sab, _mm256_add_epi32(_mm256_unpacklo_epi16(ab, zero), _mm256_unpackhi_epi16(ab, zero)));
+        }
+    }
+
+    sa = _mm256_add_epi32(_mm256_unpacklo_epi16(sa, zero), _mm256_unpackhi_epi16(sa, zero));
+    sb = _mm256_add_epi32(_mm256_unpacklo_epi16(sb, zero), _mm256_unpackhi_epi16(sb, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.a),  Fold256To128(sa));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.b),  Fold256To128(sb));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.aa), Fold256To128(saa));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.bb), Fold256To128(sbb));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums.ab), Fold256To128(sab));
+}
+
+#endif // LIBIM_COMPARE_X86_KERNELS
+
+bool IsCompareKernelSupported(CompareKernel kernel)
+{
+    switch (kernel)
+    {
+    case CompareKernel::Auto:
+    case CompareKernel::Scalar:
+        return true;
+#ifdef LIBIM_COMPARE_X86_KERNELS
+    case CompareKernel::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case CompareKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+CompareKernel GetBestCompareKernel()
+{
+    static const CompareKernel best = []
+    {
+        if(IsCompareKernelSupported(CompareKernel::AVX2)) {
+            return CompareKernel::AVX2;
+        }
+        else if(IsCompareKernelSupported(CompareKernel::SSE41)) {
+            return CompareKernel::SSE41;
+        }
+        return CompareKernel::Scalar;
+    }();
+
+    return best;
+}
+
+static CompareKernel ResolveKernel(CompareKernel kernel)
+{
+    if(kernel == CompareKernel::Auto || !IsCompareKernelSupported(kernel)) {
+        return GetBestCompareKernel();
+    }
+    return kernel;
+}
+
+SquaredErrorFn GetSquaredErrorKernel(CompareKernel kernel)
+{
+    switch (ResolveKernel(kernel))
+    {
+#ifdef LIBIM_COMPARE_X86_KERNELS
+    case CompareKernel::SSE41:
+        return SquaredErrorSSE41;
+    case CompareKernel::AVX2:
+        return SquaredErrorAVX2;
+#endif
+    default:
+        return SquaredErrorScalar;
+    }
+}
+
+SSIMBlockFn GetSSIMBlockKernel(CompareKernel kernel)
+{
+    switch (ResolveKernel(kernel))
+    {
+#ifdef LIBIM_COMPARE_X86_KERNELS
+    case CompareKernel::SSE41:
+        return SSIMBlockSSE41;
+    case CompareKernel::AVX2:
+        return SSIMBlockAVX2;
+#endif
+    default:
+        return SSIMBlockScalar;
+    }
+}
+
+const char* CompareKernelName(CompareKernel kernel)
+{
+    switch (kernel)
+    {
+    case CompareKernel::Auto:   return "auto";
+    case CompareKernel::Scalar: return "scalar";
+    case CompareKernel::SSE41:  return "sse4.1";
+    case CompareKernel::AVX2:   return "avx2";
+    }
+
+    return "unknown";
+}
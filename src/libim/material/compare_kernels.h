@@ -0,0 +1,41 @@
+#ifndef LIBIM_COMPARE_KERNELS_H
+#define LIBIM_COMPARE_KERNELS_H
+#include <cstddef>
+#include <cstdint>
+
+/* Instruction set of image compare kernels */
+enum class CompareKernel
+{
+    Auto,   // Best kernel supported by CPU
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+/* Per channel sums of 8x8 block of two RGBA images */
+struct SSIMBlockSums
+{
+    uint32_t a[4];
+    uint32_t b[4];
+    uint32_t aa[4];
+    uint32_t bb[4];
+    uint32_t ab[4];
+};
+
+/* Adds per channel sums of squared differences of nPixels 8 bit RGBA pixels a and b to sqErr */
+using SquaredErrorFn = void(*)(const uint8_t* a, const uint8_t* b, std::size_t nPixels, uint64_t sqErr[4]);
+
+/* Computes sums of 8x8 RGBA block starting at a and b. stride is row size in bytes. */
+using SSIMBlockFn = void(*)(const uint8_t* a, const uint8_t* b, std::size_t stride, SSIMBlockSums& sums);
+
+/* Return kernels for kernel type. Auto and unsupported kernels resolve to the best supported kernel. */
+SquaredErrorFn GetSquaredErrorKernel(CompareKernel kernel);
+SSIMBlockFn GetSSIMBlockKernel(CompareKernel kernel);
+
+/* Returns kernel type selected for Auto */
+CompareKernel GetBestCompareKernel();
+
+bool IsCompareKernelSupported(CompareKernel kernel);
+const char* CompareKernelName(CompareKernel kernel);
+
+#endif // LIBIM_COMPARE_KERNELS_H
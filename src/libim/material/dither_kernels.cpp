@@ -0,0 +1,180 @@
+#include "dither_kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# define LIBIM_DITHER_X86_KERNELS
+# include <immintrin.h>
+#endif
+
+/* x / 255 for x in [0, 65534] */
+static inline uint32_t Div255(uint32_t x)
+{
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+static void QuantizeRowScalar(const uint8_t* rgba, uint32_t width, const uint16_t* thresholds, const DitherFormat& format, uint8_t* out)
+{
+    for(uint32_t x = 0; x < width; x++)
+    {
+        const uint32_t t = thresholds[x & 7];
+        uint32_t pixel = 0;
+        for(int c = 0; c < 4; c++)
+        {
+            if(format.bits[c] == 0) {
+                continue;
+            }
+
+            const uint32_t levels = (1u << format.bits[c]) - 1;
+            pixel |= Div255(rgba[x * 4 + c] * levels + t) << format.shl[c];
+        }
+
+        out[x * 2]     = uint8_t(pixel);
+        out[x * 2 + 1] = uint8_t(pixel >> 8);
+    }
+}
+
+#ifdef LIBIM_DITHER_X86_KERNELS
+
+/* Both kernels unpack each channel of 8 or 16 pixels to 16 bit lanes, quantize it with
+   mullo/add and Div255 by shifts, and OR it to its position in the 16 bit pixels. */
+
+__attribute__((target("sse4.1")))
+static void QuantizeRowSSE41(const uint8_t* rgba, uint32_t width, const uint16_t* thresholds, const DitherFormat& format, uint8_t* out)
+{
+    const __m128i t     = _mm_loadu_si128(reinterpret_cast<const __m128i*>(thresholds));
+    const __m128i one   = _mm_set1_epi16(1);
+    const __m128i bytes = _mm_set1_epi32(0xFF);
+
+    uint32_t x = 0;
+    for(; x + 8 <= width; x += 8)
+    {
+        const __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + x * 4));
+        const __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + x * 4 + 16));
+
+        __m128i pixels = _mm_setzero_si128();
+        for(int c = 0; c < 4; c++)
+        {
+            if(format.bits[c] == 0) {
+                continue;
+            }
+
+            const __m128i v = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(p0, c * 8), bytes),
+                                               _mm_and_si128(_mm_srli_epi32(p1, c * 8), bytes));
+            const __m128i levels = _mm_set1_epi16(short((1 << format.bits[c]) - 1));
+            const __m128i n = _mm_add_epi16(_mm_mullo_epi16(v, levels), t);
+            const __m128i q = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(n, one), _mm_srli_epi16(n, 8)), 8);
+            pixels = _mm_or_si128(pixels, _mm_sll_epi16(q, _mm_cvtsi32_si128(int(format.shl[c]))));
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 2), pixels);
+    }
+
+    QuantizeRowScalar(rgba + x * 4, width - x, thresholds, format, out + x * 2);
+}
+
+__attribute__((target("avx2")))
+static void QuantizeRowAVX2(const uint8_t* rgba, uint32_t width, const uint16_t* thresholds, const DitherFormat& format, uint8_t* out)
+{
+    /* packus works per 128 bit lane, so channel lanes hold pixels 0-3, 8-11 | 4-7, 12-15
+       until they're put in order by permute. Thresholds follow the same order. */
+    const __m128i tRow  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(thresholds));
+    const __m256i t     = _mm256_permute4x64_epi64(_mm256_castsi128_si256(tRow), _MM_SHUFFLE(1, 1, 0, 0));
+    const __m256i one   = _mm256_set1_epi16(1);
+    const __m256i bytes = _mm256_set1_epi32(0xFF);
+
+    uint32_t x = 0;
+    for(; x + 16 <= width; x += 16)
+    {
+        const __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + x * 4));
+        const __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + x * 4 + 32));
+
+        __m256i pixels = _mm256_setzero_si256();
+        for(int c = 0; c < 4; c++)
+        {
+            if(format.bits[c] == 0) {
+                continue;
+            }
+
+            const __m256i v = _mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, c * 8), bytes),
+                                                  _mm256_and_si256(_mm256_srli_epi32(p1, c * 8), bytes));
+            const __m256i levels = _mm256_set1_epi16(short((1 << format.bits[c]) - 1));
+            const __m256i n = _mm256_add_epi16(_mm256_mullo_epi16(v, levels), t);
+            const __m256i q = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(n, one), _mm256_srli_epi16(n, 8)), 8);
+            pixels = _mm256_or_si256(pixels, _mm256_sll_epi16(q, _mm_cvtsi32_si128(int(format.shl[c]))));
+        }
+
+        pixels = _mm256_permute4x64_epi64(pixels, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * 2), pixels);
+    }
+
+    /* Tail runs non-VEX SSE code, clear upper halves to avoid the AVX-SSE transition penalty */
+    _mm256_zeroupper();
+    QuantizeRowSSE41(rgba + x * 4, width - x, thresholds, format, out + x * 2);
+}
+
+#endif // LIBIM_DITHER_X86_KERNELS
+
+bool IsDitherKernelSupported(DitherKernel kernel)
+{
+    switch (kernel)
+    {
+    case DitherKernel::Auto:
+    case DitherKernel::Scalar:
+        return true;
+#ifdef LIBIM_DITHER_X86_KERNELS
+    case DitherKernel::SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case DitherKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+DitherKernel GetBestDitherKernel()
+{
+    static const DitherKernel best = []
+    {
+        if(IsDitherKernelSupported(DitherKernel::AVX2)) {
+            return DitherKernel::AVX2;
+        }
+        else if(IsDitherKernelSupported(DitherKernel::SSE41)) {
+            return DitherKernel::SSE41;
+        }
+        return DitherKernel::Scalar;
+    }();
+
+    return best;
+}
+
+QuantizeRowFn GetQuantizeRowKernel(DitherKernel kernel)
+{
+    if(kernel == DitherKernel::Auto || !IsDitherKernelSupported(kernel)) {
+        kernel = GetBestDitherKernel();
+    }
+
+    switch (kernel)
+    {
+#ifdef LIBIM_DITHER_X86_KERNELS
+    case DitherKernel::SSE41:
+        return QuantizeRowSSE41;
+    case DitherKernel::AVX2:
+        return QuantizeRowAVX2;
+#endif
+    default:
+        return QuantizeRowScalar;
+    }
+}
+
+const char* DitherKernelName(DitherKernel kernel)
+{
+    switch (kernel)
+    {
+    case DitherKernel::Auto:   return "auto";
+    case DitherKernel::Scalar: return "scalar";
+    case DitherKernel::SSE41:  return "sse4.1";
+    case DitherKernel::AVX2:   return "avx2";
+    }
+
+    return "unknown";
+}
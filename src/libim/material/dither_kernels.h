@@ -0,0 +1,35 @@
+#ifndef LIBIM_DITHER_KERNELS_H
+#define LIBIM_DITHER_KERNELS_H
+#include <cstdint>
+
+/* Instruction set of dither kernels */
+enum class DitherKernel
+{
+    Auto,   // Best kernel supported by CPU
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+/* Layout of 16 bit pixel. Channels are R, G, B and A, channel with 0 bits is not present. */
+struct DitherFormat
+{
+    uint32_t bits[4];
+    uint32_t shl[4];
+};
+
+/* Quantizes row of width 8 bit RGBA pixels to 16 bit little endian pixels of format.
+   Channel value v with b bits is quantized to (v * (2^b - 1) + t) / 255, where threshold t
+   is thresholds[x % 8] in range [0, 254]. */
+using QuantizeRowFn = void(*)(const uint8_t* rgba, uint32_t width, const uint16_t* thresholds, const DitherFormat& format, uint8_t* out);
+
+/* Returns kernel for kernel type. Auto and unsupported kernels resolve to the best supported kernel. */
+QuantizeRowFn GetQuantizeRowKernel(DitherKernel kernel);
+
+/* Returns kernel type selected for Auto */
+DitherKernel GetBestDitherKernel();
+
+bool IsDitherKernelSupported(DitherKernel kernel);
+const char* DitherKernelName(DitherKernel kernel);
+
+#endif // LIBIM_DITHER_KERNELS_H
@@ -10,6 +10,8 @@
 
 #include "bmp.h"
 #include "../io/filestream.h"
+#include "../io/record.h"
+#include "../utils/hasher.h"
 #include "material.h"
 #include "colorformat.h"
 
@@ -76,83 +78,63 @@ struct MatColorHeader
 };
 
 
-/* Stream class template function specialization */
-template<> inline MatHeader Stream::read<MatHeader>() const
+/* On-disk record layouts */
+template<> struct RecordLayout<MatHeader> : RecordDescriptor<MatHeader, 76,
+    LIBIM_FIELD(MatHeader, magic),
+    LIBIM_FIELD(MatHeader, version),
+    LIBIM_FIELD(MatHeader, type),
+    LIBIM_FIELD(MatHeader, recordCount),
+    LIBIM_FIELD(MatHeader, mipmapCount),
+    LIBIM_FIELD(MatHeader, colorInfo)>
 {
-    MatHeader matHeader;
-    auto nRead = this->readsome(reinterpret_cast<byte_t*>(&matHeader), sizeof(MatHeader));
-    if(nRead != sizeof(MatHeader)) {
-        throw StreamError("Error reading MatHeader from stream!");
-    }
-
-    /* Verify file signature */
-    if(matHeader.magic != MAT_FILE_SIG) {
-        throw StreamError("Unknown MAT file");
-    }
-
-    /* Verify file version */
-    if(matHeader.version != MAT_VERSION) {
-        throw StreamError(std::string("Wrong MAT file version: ") + std::to_string(matHeader.version));
-    }
-
-    return matHeader;
-}
-
-template<> inline Stream& Stream::write(const MatHeader& matHeader)
-{
-    auto nWritten = this->write(reinterpret_cast<const byte_t*>(&matHeader), sizeof(MatHeader));
-    if(nWritten != sizeof(MatHeader)) {
-        throw StreamError("Error writing MatHeader to stream");
-    }
-
-    return *this;
-}
-
-template<> inline MatRecordHeader Stream::read<MatRecordHeader>() const
-{
-    MatRecordHeader matRecord;
-    auto nRead = this->readsome(reinterpret_cast<byte_t*>(&matRecord), sizeof(MatRecordHeader));
-    if(nRead != sizeof(MatRecordHeader)) {
-        throw StreamError("Error reading MatRecordHeader from stream");
-    }
-
-    return matRecord;
-}
-
-template<> inline Stream& Stream::write(const MatRecordHeader& matRecord)
-{
-    auto nWritten = this->write(reinterpret_cast<const byte_t*>(&matRecord), sizeof(MatRecordHeader));
-    if(nWritten != sizeof(MatRecordHeader)) {
-        throw StreamError("Error writing MatRecordHeader to stream");
-    }
-
-    return *this;
-}
-
-template<> inline MatMipmapHeader Stream::read<MatMipmapHeader>() const
-{
-    MatMipmapHeader mipmapHeader;
-    auto nRead = this->readsome(reinterpret_cast<byte_t*>(&mipmapHeader), sizeof(MatMipmapHeader));
-    if(nRead != sizeof(MatMipmapHeader)) {
-        throw StreamError("Error reading MatMipmapHeader from stream");
-    }
-
-    return mipmapHeader;
-}
+    static void validate(const MatHeader& matHeader)
+    {
+        /* Verify file signature */
+        if(matHeader.magic != MAT_FILE_SIG) {
+            throw StreamError("Unknown MAT file");
+        }
 
-template<> inline Stream& Stream::write(const MatMipmapHeader& mipmapHeader)
-{
-    auto nWritten = this->write(reinterpret_cast<const byte_t*>(&mipmapHeader), sizeof(MatMipmapHeader));
-    if(nWritten != sizeof(MatMipmapHeader)) {
-        throw StreamError("Error writing MatMipmapHeader to stream");
+        /* Verify file version */
+        if(matHeader.version != MAT_VERSION) {
+            throw StreamError(std::string("Wrong MAT file version: ") + std::to_string(matHeader.version));
+        }
     }
+};
 
-    return *this;
-}
-
-
-
-uint32_t MatTextureBitmapSize(const MatTexture& tex, uint32_t bpp)
+LIBIM_RECORD_LAYOUT(MatRecordHeader, 40,
+    LIBIM_FIELD(MatRecordHeader, recordType),
+    LIBIM_FIELD(MatRecordHeader, transparentColor),
+    LIBIM_FIELD(MatRecordHeader, Unknown1),
+    LIBIM_FIELD(MatRecordHeader, Unknown2),
+    LIBIM_FIELD(MatRecordHeader, Unknown3),
+    LIBIM_FIELD(MatRecordHeader, Unknown4),
+    LIBIM_FIELD(MatRecordHeader, Unknown5),
+    LIBIM_FIELD(MatRecordHeader, Unknown6),
+    LIBIM_FIELD(MatRecordHeader, Unknown7),
+    LIBIM_FIELD(MatRecordHeader, Unknown8)
+);
+
+LIBIM_RECORD_LAYOUT(MatMipmapHeader, 24,
+    LIBIM_FIELD(MatMipmapHeader, width),
+    LIBIM_FIELD(MatMipmapHeader, height),
+    LIBIM_FIELD(MatMipmapHeader, TransparentBool),
+    LIBIM_FIELD(MatMipmapHeader, Unknown1),
+    LIBIM_FIELD(MatMipmapHeader, Unknown2),
+    LIBIM_FIELD(MatMipmapHeader, textureCount)
+);
+
+LIBIM_RECORD_LAYOUT(MatColorHeader, 24,
+    LIBIM_FIELD(MatColorHeader, RecordType),
+    LIBIM_FIELD(MatColorHeader, ColorNum),
+    LIBIM_FIELD(MatColorHeader, Unknown1),
+    LIBIM_FIELD(MatColorHeader, Unknown2),
+    LIBIM_FIELD(MatColorHeader, Unknown3),
+    LIBIM_FIELD(MatColorHeader, Unknown4)
+);
+
+
+
+inline uint32_t MatTextureBitmapSize(const MatTexture& tex, uint32_t bpp)
 {
     return GetBitmapSize(tex.header.height, tex.header.width, bpp);
 }
@@ -173,58 +155,52 @@ uint32_t MatTextureBitmapSize(const MatTexture& tex, uint32_t bpp)
 
 
 
-std::shared_ptr<Material> LoadMaterialFromFile(const std::string& path)
+/* Reads MAT file from current position of istream. Throws StreamError on error. */
+inline Material ReadMaterial(const InputStream& istream, const std::string& name)
 {
-    try
-    {
-        InputFileStream ifstream(path);
+    /* Read header */
+    auto header = istream.read<MatHeader>();
+    if(header.type != MAT_MIPMAP_TYPE) {
+        throw StreamError("MAT file does not contain mipmaps");
+    }
 
-        /* Read header */
-        auto header = ifstream.read<MatHeader>();
+    if(header.recordCount != header.mipmapCount) {
+        throw StreamError("Old MAT file");
+    }
 
-        if(header.type != MAT_MIPMAP_TYPE)
-        {
-            std::cerr << "Error MAT file does not contain mipmaps!\n";
-            return nullptr;
-        }
+    if(header.recordCount <= 0) {
+        throw StreamError("MAT file record count == 0");
+    }
 
-        if(header.recordCount != header.mipmapCount)
-        {
-            std::cerr << "Error old MAT file!\n";
-            return nullptr;
-        }
+    /* Read Material records */
+    auto records = istream.read<std::vector<MatRecordHeader>>(header.recordCount);
 
-        if(header.recordCount == 0)
-        {
-            std::cerr << "Error: MAT file record count == 0!\n";
-            return nullptr;
+    /* Read mipmaps */
+    std::pmr::vector<Mipmap> mipmaps(header.mipmapCount);
+    for(auto& mipmap : mipmaps)
+    {
+        auto mmHeader = istream.read<MatMipmapHeader>();
+        mipmap = istream.read<Mipmap,uint32_t, uint32_t, uint32_t, const ColorFormat&>(mmHeader.textureCount, mmHeader.width, mmHeader.height, header.colorInfo);
+        if(mipmap.empty()) {
+            throw StreamError("MAT file mipmap has no textures");
         }
+    }
 
-        /* Read Material records */
-        auto records = ifstream.read<std::vector<MatRecordHeader>>(header.recordCount);
-
-        /* Read mipmaps */
-        std::vector<Mipmap> mipmaps(header.mipmapCount);
-        for(auto& mipmap : mipmaps)
-        {
-            try
-            {
-                auto mmHeader = ifstream.read<MatMipmapHeader>();
-                mipmap = ifstream.read<Mipmap,uint32_t, uint32_t, uint32_t, const ColorFormat&>(mmHeader.textureCount, mmHeader.width, mmHeader.height, header.colorInfo);
-            }
-            catch (const std::exception& e)
-            {
-                std::cerr << "Error reading mipmap header and bitmap data from MAT file stream: " << e.what() << "!\n";
-                return nullptr;
-            }
-        }
+    Material mat(name);
+    mat.setSize(mipmaps.at(0).at(0).width(), mipmaps.at(0).at(0).height());
+    mat.setColorFormat(header.colorInfo);
+    mat.setMipmaps(std::move(mipmaps));
+    StatAdd(Stat::Materials);
 
-        auto mat = std::make_shared<Material>(ifstream.name());//GetFileNameFromPath(filepath) + ".mat");
-        mat->setSize(mipmaps.at(0).at(0).width(), mipmaps.at(0).at(0).height());
-        mat->setColorFormat(header.colorInfo);
-        mat->setMipmaps(std::move(mipmaps));
+    return mat;
+}
 
-        return mat;
+inline std::shared_ptr<Material> LoadMaterialFromFile(const std::string& path)
+{
+    try
+    {
+        InputFileStream ifstream(path);
+        return std::make_shared<Material>(ReadMaterial(ifstream, ifstream.name()));
     }
     catch (const std::exception& e)
     {
@@ -233,7 +209,30 @@ std::shared_ptr<Material> LoadMaterialFromFile(const std::string& path)
     }
 }
 
-static bool SaveMaterialToFile(std::string file, const Material& mat)
+/* Adds MAT file header and record headers of material with mipmapCount mipmaps to batch */
+inline void WriteMatFileHeader(WriteBatch& batch, const ColorFormat& colorInfo, uint32_t mipmapCount)
+{
+    MatHeader header{};
+    header.magic       = MAT_FILE_SIG;
+    header.version     = MAT_VERSION;
+    header.type        = MAT_MIPMAP_TYPE;
+    header.recordCount = mipmapCount;
+    header.mipmapCount = mipmapCount;
+    header.colorInfo   = colorInfo;
+
+    batch.add(header);
+
+    /* Add record headers */
+    MatRecordHeader record {};
+    record.recordType = 8;
+
+    for(uint32_t i = 0; i < mipmapCount; i++) {
+        batch.add(record);
+    }
+}
+
+/* Writes material to MAT file. If hasher is given, written file is also hashed with it. */
+inline bool SaveMaterialToFile(std::string file, const Material& mat, Hasher* hasher = nullptr)
 {
     if(mat.mipmaps().empty() || mat.mipmaps().at(0).empty()) {
         return false;
@@ -243,39 +242,33 @@ static bool SaveMaterialToFile(std::string file, const Material& mat)
     {
         OutputFileStream ofstream(std::move(file));
 
-        /* Write MAT header to file */
-        MatHeader header{};
-        header.magic       = MAT_FILE_SIG;
-        header.version     = MAT_VERSION;
-        header.type        = MAT_MIPMAP_TYPE;
-        header.recordCount = mat.mipmaps().size();
-        header.mipmapCount = mat.mipmaps().size();
-        header.colorInfo   = mat.colorFormat();
+        /* Gather whole file and write it at once */
+        WriteBatch batch;
+        WriteMatFileHeader(batch, mat.colorFormat(), mat.mipmaps().size());
 
-        ofstream.write(header);
-
-        /* Write record headers to file */
-        MatRecordHeader record {};
-        record.recordType = 8;
-
-        for(uint32_t i = 0; i < header.recordCount; i++) {
-            ofstream.write(record);
-        }
-
-        /* Write mipmaps to file */
         MatMipmapHeader mmHeader {};
         for(const auto& mipmap : mat.mipmaps())
         {
-            /* Write mipmap header to fiel */
+            /* Add mipmap header */
             mmHeader.width  = mipmap.at(0).width();
             mmHeader.height = mipmap.at(0).height();
             mmHeader.textureCount = mipmap.size();
 
-            ofstream.write(mmHeader);
+            batch.add(mmHeader);
 
-            /* Write mipmap's textures to file */
+            /* Add mipmap's textures */
             for(const auto& tex : mipmap) {
-                ofstream.write(tex.bitmap());
+                batch.add(*tex.bitmap());
+            }
+        }
+
+        ofstream.preallocate(batch.size());
+        ofstream.write(batch);
+
+        if(hasher)
+        {
+            for(const auto& buf : batch.buffers()) {
+                hasher->update(buf.data, buf.size);
             }
         }
 
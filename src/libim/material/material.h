@@ -1,22 +1,30 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 #include <cstdint>
+#include <memory_resource>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "texture.h"
 #include "common.h"
+#include "../stats.h"
 #include "../io/stream.h"
 
 
-struct Mipmap : public std::vector<Texture>{};
+struct Mipmap : public std::pmr::vector<Texture>
+{
+    using std::pmr::vector<Texture>::vector;
+};
 
 class Material
 {
 public:
     Material() = default;
-    Material(const std::string& name) : m_name(name){}
+    Material(const std::string& name, std::pmr::memory_resource* mr = std::pmr::get_default_resource()) :
+        m_name(name),
+        m_mipmaps(mr)
+    {}
     Material(const Material&) = default;
     Material(Material&&) noexcept = default;
     Material& operator = (const Material&) = default;
@@ -73,13 +81,13 @@ public:
         return m_colorFormat;
     }
 
-    Material& setMipmaps(const std::vector<Mipmap>& mipmaps)
+    Material& setMipmaps(const std::pmr::vector<Mipmap>& mipmaps)
     {
         m_mipmaps = mipmaps;
         return *this;
     }
 
-    Material& setMipmaps(std::vector<Mipmap> && mipmaps) noexcept
+    Material& setMipmaps(std::pmr::vector<Mipmap> && mipmaps)
     {
         m_mipmaps = std::move(mipmaps);
         return *this;
@@ -97,7 +105,7 @@ public:
         return *this;
     }
 
-    const std::vector<Mipmap>& mipmaps() const
+    const std::pmr::vector<Mipmap>& mipmaps() const
     {
         return m_mipmaps;
     }
@@ -107,14 +115,15 @@ private:
     uint32_t m_width;
     uint32_t m_height;
     ColorFormat m_colorFormat;
-    std::vector<Mipmap> m_mipmaps;
+    std::pmr::vector<Mipmap> m_mipmaps;
 };
 
 
-inline Bitmap::const_iterator CopyMipmapFromBuffer(Mipmap& mipmap, const Bitmap& buffer, uint32_t textureCount, uint32_t width, uint32_t height, const ColorFormat& colorInfo)
+/* Copies mipmap's textures from buffer starting at itBitmapBegin.
+   Returns iterator past the last copied byte. */
+inline Bitmap::const_iterator CopyMipmapFromBuffer(Mipmap& mipmap, Bitmap::const_iterator itBitmapBegin, uint32_t textureCount, uint32_t width, uint32_t height, const ColorFormat& colorInfo, std::pmr::memory_resource* mr = std::pmr::get_default_resource())
 {
-    auto itBitmapBegin = buffer.begin();
-    auto itBitmapEnd   = buffer.end();
+    auto itBitmapEnd = itBitmapBegin;
     for(uint32_t mmIdx = 0; mmIdx < textureCount; mmIdx++) // Mipmap textures
     {
         /* Calculate texture size according to the mipmap index */
@@ -129,7 +138,7 @@ inline Bitmap::const_iterator CopyMipmapFromBuffer(Mipmap& mipmap, const Bitmap&
 
         /* Init texture bitmap buffer */
         uint32_t bitmapSize = GetBitmapSize(texWidth, texHeight, tex.colorInfo().bpp);
-        auto bitmap = MakeBitmapPtr(bitmapSize);
+        auto bitmap = MakeBitmapPtr(bitmapSize, mr);
 
         /* Copy texture's bitmap from buffer */
         itBitmapEnd = std::next(itBitmapBegin, bitmapSize);
@@ -138,42 +147,12 @@ inline Bitmap::const_iterator CopyMipmapFromBuffer(Mipmap& mipmap, const Bitmap&
         tex.setBitmap(std::move(bitmap));
         mipmap.emplace_back(std::move(tex));
         itBitmapBegin = itBitmapEnd;
+        StatAdd(Stat::TexturesDecoded);
     }
 
     return itBitmapEnd;
 }
 
-inline Mipmap MoveMipmapFromBuffer(Bitmap& buffer, uint32_t textureCount, uint32_t width, uint32_t height, const ColorFormat& colorInfo)
-{
-    Mipmap mipmap;
-    for(uint32_t mmIdx = 0; mmIdx < textureCount; mmIdx++) // Mipmap's textures
-    {
-        /* Calculate texture's size according to the mipmap index */
-        uint32_t texWidth  = width >> mmIdx;
-        uint32_t texHeight = height >> mmIdx;
-
-        Texture tex;
-        tex.setWidth(texWidth)
-           .setHeight(texHeight)
-           .setColorInfo(colorInfo)
-           .setRowSize(GetRowSize(texHeight, tex.colorInfo().bpp));
-
-        /* Init texture bitmap buffer */
-        uint32_t bitmapSize = GetBitmapSize(texWidth, texHeight, tex.colorInfo().bpp);
-        auto bitmap = std::make_shared<Bitmap>(bitmapSize);
-
-        /* Copy texture's bitmap from buffer */
-        auto itBitmapEnd = std::next(buffer.begin(), bitmapSize);
-        std::copy(buffer.begin(), itBitmapEnd, bitmap->begin());
-
-        buffer.erase(buffer.begin(), itBitmapEnd);
-        tex.setBitmap(std::move(bitmap));
-        mipmap.emplace_back(std::move(tex));
-    }
-
-    return mipmap;
-}
-
 template<> inline Mipmap Stream::read<Mipmap, uint32_t, uint32_t, uint32_t, const ColorFormat&>(uint32_t textureCount, uint32_t width, uint32_t height, const ColorFormat& colorInfo) const
 {
     Mipmap mipmap;
@@ -186,6 +165,7 @@ template<> inline Mipmap Stream::read<Mipmap, uint32_t, uint32_t, uint32_t, cons
         /* Read Texture */
         auto tex = this->read<Texture, uint32_t, uint32_t, const ColorFormat&>(texWidth, texHeight, colorInfo);
         mipmap.emplace_back(std::move(tex));
+        StatAdd(Stat::TexturesDecoded);
     }
 
     return mipmap;
@@ -0,0 +1,363 @@
+#include "quantize.h"
+#include "../utils/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+    /* Images with fewer pixels are error diffused by a single task */
+    constexpr std::size_t MIN_WAVEFRONT_PIXELS = 65536;
+
+    /* Row y of error diffusion checks progress of row y - 1 every this many pixels */
+    constexpr uint32_t WAVEFRONT_CHUNK = 64;
+
+    constexpr uint8_t BAYER8[8][8] = {
+        {  0, 32,  8, 40,  2, 34, 10, 42 },
+        { 48, 16, 56, 24, 50, 18, 58, 26 },
+        { 12, 44,  4, 36, 14, 46,  6, 38 },
+        { 60, 28, 52, 20, 62, 30, 54, 22 },
+        {  3, 35, 11, 43,  1, 33,  9, 41 },
+        { 51, 19, 59, 27, 49, 17, 57, 25 },
+        { 15, 47,  7, 39, 13, 45,  5, 37 },
+        { 63, 31, 55, 23, 61, 29, 53, 21 }
+    };
+
+    /* Quantization thresholds of Bayer matrix, (2m + 1) / 128 scaled to [0, 255) */
+    struct ThresholdTable
+    {
+        alignas(16) uint16_t rows[8][8];
+        alignas(16) uint16_t round[8]; // Round to nearest
+
+        ThresholdTable()
+        {
+            for(int y = 0; y < 8; y++)
+            {
+                for(int x = 0; x < 8; x++) {
+                    rows[y][x] = uint16_t((2 * BAYER8[y][x] + 1) * 255 / 128);
+                }
+                round[y] = 127;
+            }
+        }
+    };
+
+    const ThresholdTable THRESHOLDS;
+
+    DitherFormat GetDitherFormat(const ColorFormat& format)
+    {
+        if(format.bpp != 16) {
+            throw std::invalid_argument("Can't quantize to " + std::to_string(format.bpp) + " bit color format");
+        }
+
+        /* Channels which don't fit in pixel are not present, as in TextureToRGBA8 */
+        DitherFormat df {};
+        const int32_t bits[4] = { format.redBPP, format.greenBPP, format.blueBPP, format.alphaBPP };
+        const int32_t shl[4]  = { format.RedShl, format.GreenShl, format.BlueShl, format.AlphaShl };
+        for(int c = 0; c < 4; c++)
+        {
+            if(bits[c] > 0 && bits[c] <= 8 && shl[c] >= 0 && shl[c] + bits[c] <= 16)
+            {
+                df.bits[c] = uint32_t(bits[c]);
+                df.shl[c]  = uint32_t(shl[c]);
+            }
+        }
+
+        return df;
+    }
+
+    /* Quantization of one image, shared by its pool tasks */
+    struct QuantizeJob
+    {
+        const byte_t* rgba;
+        uint32_t width;
+        uint32_t height;
+        DitherFormat format;
+        QuantizeOptions opt;
+        BitmapPtr bitmap; // Output, owned by job as tasks can outlive texture on error
+        byte_t* out;
+
+        /* Error diffusion state: error passed to row y in 1/16 units, 4 channels per pixel
+           with one pixel of margin on both sides, and number of pixels done in row y */
+        std::vector<std::vector<int16_t>> errors;
+        std::unique_ptr<std::atomic<uint32_t>[]> progress;
+    };
+
+    void QuantizeRows(const QuantizeJob& job, uint32_t rowBegin, uint32_t rowEnd)
+    {
+        const auto quantizeRow = GetQuantizeRowKernel(job.opt.kernel);
+        for(uint32_t y = rowBegin; y < rowEnd; y++)
+        {
+            const uint16_t* thresholds = job.opt.method == DitherMethod::Ordered ? THRESHOLDS.rows[y & 7] : THRESHOLDS.round;
+            quantizeRow(job.rgba + std::size_t(y) * job.width * 4, job.width, thresholds, job.format,
+                        job.out + std::size_t(y) * job.width * 2);
+        }
+    }
+
+    /* Floyd-Steinberg: error goes 7/16 right, 3/16 down left, 5/16 down and 1/16 down right.
+       Rows are scanned left to right, so row y can run behind row y - 1 in a wavefront. */
+    void DiffuseRow(QuantizeJob& job, uint32_t y)
+    {
+        const uint32_t width = job.width;
+        const int16_t* in = job.errors[y].data();
+        int16_t* next = y + 1 < job.height ? job.errors[y + 1].data() : nullptr;
+        const byte_t* src = job.rgba + std::size_t(y) * width * 4;
+        byte_t* dst = job.out + std::size_t(y) * width * 2;
+
+        int carry[4] = {};
+        for(uint32_t x = 0; x < width; x++)
+        {
+            if(y > 0 && x % WAVEFRONT_CHUNK == 0)
+            {
+                const uint32_t needed = std::min(width, x + WAVEFRONT_CHUNK + 1);
+                while(job.progress[y - 1].load(std::memory_order_acquire) < needed) {
+                    std::this_thread::yield();
+                }
+            }
+
+            uint32_t pixel = 0;
+            for(int c = 0; c < 4; c++)
+            {
+                const uint32_t bits = job.format.bits[c];
+                if(bits == 0) {
+                    continue;
+                }
+
+                const int levels = (1 << bits) - 1;
+                const int err = carry[c] + in[(x + 1) * 4 + c];
+                const int v = std::clamp(int(src[x * 4 + c]) + ((err + 8) >> 4), 0, 255);
+                const int q = (v * levels + 127) / 255;
+                const int e = v - (q * 255 + levels / 2) / levels;
+
+                carry[c] = e * 7;
+                if(next)
+                {
+                    next[x * 4 + c]       += int16_t(e * 3);
+                    next[(x + 1) * 4 + c] += int16_t(e * 5);
+                    next[(x + 2) * 4 + c] += int16_t(e);
+                }
+
+                pixel |= uint32_t(q) << job.format.shl[c];
+            }
+
+            dst[x * 2]     = byte_t(pixel);
+            dst[x * 2 + 1] = byte_t(pixel >> 8);
+            job.progress[y].store(x + 1, std::memory_order_release);
+        }
+
+        /* Row y - 1 is done too, nothing writes this row's errors anymore */
+        std::vector<int16_t>().swap(job.errors[y]);
+    }
+
+    /* Number of rows quantized by one pool task */
+    uint32_t GetRowsPerTask(uint32_t width, ThreadPool* pool)
+    {
+        /* Aim for tasks of at least ~65536 pixels */
+        return pool ? std::max<uint32_t>(1, 65536 / std::max<uint32_t>(1, width)) : UINT32_MAX;
+    }
+
+    /* Queues quantization of image on pool, or quantizes it if pool is null */
+    void SubmitQuantize(std::shared_ptr<QuantizeJob> job, ThreadPool* pool, std::vector<std::future<void>>& tasks)
+    {
+        if(job->opt.method != DitherMethod::Diffusion)
+        {
+            if(!pool)
+            {
+                QuantizeRows(*job, 0, job->height);
+                return;
+            }
+
+            const uint32_t step = GetRowsPerTask(job->width, pool);
+            for(uint32_t row = 0; row < job->height; row += step)
+            {
+                const uint32_t end = std::min(job->height, row + step);
+                tasks.push_back(pool->submit([job, row, end] { QuantizeRows(*job, row, end); }));
+            }
+            return;
+        }
+
+        job->errors.assign(job->height, std::vector<int16_t>((std::size_t(job->width) + 2) * 4, 0));
+        job->progress.reset(new std::atomic<uint32_t>[job->height]);
+        for(uint32_t y = 0; y < job->height; y++) {
+            job->progress[y].store(0, std::memory_order_relaxed);
+        }
+
+        auto diffuseRows = [job](uint32_t rowBegin, uint32_t rowEnd)
+        {
+            for(uint32_t y = rowBegin; y < rowEnd; y++) {
+                DiffuseRow(*job, y);
+            }
+        };
+
+        if(!pool) {
+            diffuseRows(0, job->height);
+        }
+        else if(std::size_t(job->width) * job->height < MIN_WAVEFRONT_PIXELS) {
+            tasks.push_back(pool->submit([=] { diffuseRows(0, job->height); }));
+        }
+        else
+        {
+            /* Tasks are started in submission order, so row y - 1 a task waits on
+               is either running or done */
+            for(uint32_t y = 0; y < job->height; y++) {
+                tasks.push_back(pool->submit([=] { diffuseRows(y, y + 1); }));
+            }
+        }
+    }
+
+    Texture MakeTexture(uint32_t width, uint32_t height, const ColorFormat& format, std::pmr::memory_resource* mr)
+    {
+        Texture tex;
+        tex.setWidth(width)
+           .setHeight(height)
+           .setColorInfo(format)
+           .setRowSize(GetRowSize(width, format.bpp))
+           .setBitmap(MakeBitmapPtr(GetBitmapSize(width, height, format.bpp), mr));
+        return tex;
+    }
+
+    std::shared_ptr<QuantizeJob> MakeJob(const byte_t* rgba, const Texture& tex, const DitherFormat& format, const QuantizeOptions& opt)
+    {
+        auto job = std::make_shared<QuantizeJob>();
+        job->rgba   = rgba;
+        job->width  = tex.width();
+        job->height = tex.height();
+        job->format = format;
+        job->opt    = opt;
+        job->bitmap = tex.bitmap();
+        job->out    = job->bitmap->data();
+        return job;
+    }
+}
+
+bool ParseDitherMethod(const std::string& name, DitherMethod& method)
+{
+    if(name == "none") {
+        method = DitherMethod::None;
+    }
+    else if(name == "ordered") {
+        method = DitherMethod::Ordered;
+    }
+    else if(name == "diffusion") {
+        method = DitherMethod::Diffusion;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+RGBAImage DownsampleRGBA8(const RGBAImage& image)
+{
+    RGBAImage half;
+    half.width  = std::max<uint32_t>(1, image.width  / 2);
+    half.height = std::max<uint32_t>(1, image.height / 2);
+    half.data.resize(std::size_t(half.width) * half.height * 4);
+
+    for(uint32_t y = 0; y < half.height; y++)
+    {
+        const uint32_t y0 = std::min(y * 2, image.height - 1);
+        const uint32_t y1 = std::min(y * 2 + 1, image.height - 1);
+        for(uint32_t x = 0; x < half.width; x++)
+        {
+            const uint32_t x0 = std::min(x * 2, image.width - 1);
+            const uint32_t x1 = std::min(x * 2 + 1, image.width - 1);
+            for(int c = 0; c < 4; c++)
+            {
+                auto px = [&](uint32_t sx, uint32_t sy) { return uint32_t(image.data[(std::size_t(sy) * image.width + sx) * 4 + c]); };
+                half.data[(std::size_t(y) * half.width + x) * 4 + c] = byte_t((px(x0, y0) + px(x1, y0) + px(x0, y1) + px(x1, y1) + 2) / 4);
+            }
+        }
+    }
+
+    return half;
+}
+
+Texture QuantizeRGBA8(const byte_t* rgba, uint32_t width, uint32_t height, const ColorFormat& format,
+                      const QuantizeOptions& opt, ThreadPool* pool, std::pmr::memory_resource* mr)
+{
+    const auto df = GetDitherFormat(format);
+    auto tex = MakeTexture(width, height, format, mr);
+
+    std::vector<std::future<void>> tasks;
+    try {
+        SubmitQuantize(MakeJob(rgba, tex, df, opt), pool, tasks);
+    }
+    catch(...)
+    {
+        /* Queued tasks still reference texture */
+        for(auto& t : tasks) {
+            t.wait();
+        }
+        throw;
+    }
+
+    WaitAll(tasks);
+    return tex;
+}
+
+Material QuantizeMaterial(const std::string& name, const std::vector<RGBAImage>& images, const ColorFormat& format,
+                          uint32_t textureCount, const QuantizeOptions& opt, ThreadPool* pool)
+{
+    if(images.empty() || textureCount == 0) {
+        throw std::invalid_argument("Material must have at least one image and texture");
+    }
+
+    const uint32_t width  = images.at(0).width;
+    const uint32_t height = images.at(0).height;
+    if((width >> (textureCount - 1)) == 0 || (height >> (textureCount - 1)) == 0) {
+        throw std::invalid_argument("Image is too small for " + std::to_string(textureCount) + " mipmap textures");
+    }
+
+    const auto df = GetDitherFormat(format);
+
+    Material mat(name);
+    mat.setSize(width, height)
+       .setColorFormat(format);
+
+    /* Downsampled levels must outlive quantization tasks */
+    std::deque<RGBAImage> levels;
+    std::vector<std::future<void>> tasks;
+    try
+    {
+        std::pmr::vector<Mipmap> mipmaps;
+        for(const auto& image : images)
+        {
+            if(image.width != width || image.height != height || image.data.size() < std::size_t(width) * height * 4) {
+                throw std::invalid_argument("Material images must be of equal size");
+            }
+
+            Mipmap mipmap;
+            const RGBAImage* level = &image;
+            for(uint32_t texIdx = 0; texIdx < textureCount; texIdx++)
+            {
+                if(texIdx > 0) {
+                    level = &levels.emplace_back(DownsampleRGBA8(*level));
+                }
+
+                auto tex = MakeTexture(width >> texIdx, height >> texIdx, format, std::pmr::get_default_resource());
+                SubmitQuantize(MakeJob(level->data.data(), tex, df, opt), pool, tasks);
+                mipmap.push_back(std::move(tex));
+            }
+
+            mipmaps.push_back(std::move(mipmap));
+        }
+
+        mat.setMipmaps(std::move(mipmaps));
+    }
+    catch(...)
+    {
+        /* Queued tasks still reference images and textures */
+        for(auto& t : tasks) {
+            t.wait();
+        }
+        throw;
+    }
+
+    WaitAll(tasks);
+    return mat;
+}
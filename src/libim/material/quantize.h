@@ -0,0 +1,59 @@
+#ifndef LIBIM_QUANTIZE_H
+#define LIBIM_QUANTIZE_H
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "colorformat.h"
+#include "dither_kernels.h"
+#include "material.h"
+#include "texture.h"
+#include "../common.h"
+
+class ThreadPool;
+
+enum class DitherMethod
+{
+    None,     // Round to nearest
+    Ordered,  // 8x8 Bayer matrix
+    Diffusion // Floyd-Steinberg error diffusion
+};
+
+struct QuantizeOptions
+{
+    DitherMethod method = DitherMethod::Ordered;
+    DitherKernel kernel = DitherKernel::Auto; // Kernel of None and Ordered methods
+};
+
+/* 8 bit RGBA image */
+struct RGBAImage
+{
+    uint32_t width  = 0;
+    uint32_t height = 0;
+    ByteArray data;
+};
+
+/* Parses dither method name: none, ordered or diffusion. Returns false if name is unknown. */
+bool ParseDitherMethod(const std::string& name, DitherMethod& method);
+
+/* Returns image of half size, each pixel is average of 2x2 pixels */
+RGBAImage DownsampleRGBA8(const RGBAImage& image);
+
+/* Quantizes 8 bit RGBA image to 16 bit color format.
+   If pool is not null, rows are quantized in parallel. Error diffusion rows run as a
+   wavefront: row y proceeds while row y - 1 is at least 2 pixels ahead.
+   pool must not be the pool this function is called from.
+   Throws std::invalid_argument if format is not 16 bit. */
+Texture QuantizeRGBA8(const byte_t* rgba, uint32_t width, uint32_t height, const ColorFormat& format,
+                      const QuantizeOptions& opt, ThreadPool* pool = nullptr,
+                      std::pmr::memory_resource* mr = std::pmr::get_default_resource());
+
+/* Makes material with color format from images. Each image is one mipmap whose textureCount
+   textures are the image and its successive downsampled halves.
+   If pool is not null, all textures are quantized in parallel.
+   Throws std::invalid_argument if images are not of equal size or format is not 16 bit. */
+Material QuantizeMaterial(const std::string& name, const std::vector<RGBAImage>& images, const ColorFormat& format,
+                          uint32_t textureCount, const QuantizeOptions& opt, ThreadPool* pool = nullptr);
+
+#endif // LIBIM_QUANTIZE_H
@@ -0,0 +1,562 @@
+#include "texfile.h"
+#include "../io/filestream.h"
+#include "../io/writebatch.h"
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    /* DDS constants */
+    constexpr uint32_t DDS_MAGIC              = 0x20534444; // "DDS "
+    constexpr uint32_t DDS_HEADER_SIZE        = 124;
+    constexpr uint32_t DDS_PIXELFORMAT_SIZE   = 32;
+    constexpr uint32_t DDSD_CAPS              = 0x1;
+    constexpr uint32_t DDSD_HEIGHT            = 0x2;
+    constexpr uint32_t DDSD_WIDTH             = 0x4;
+    constexpr uint32_t DDSD_PITCH             = 0x8;
+    constexpr uint32_t DDSD_PIXELFORMAT       = 0x1000;
+    constexpr uint32_t DDSD_MIPMAPCOUNT       = 0x20000;
+    constexpr uint32_t DDSD_LINEARSIZE        = 0x80000;
+    constexpr uint32_t DDPF_ALPHAPIXELS       = 0x1;
+    constexpr uint32_t DDPF_FOURCC            = 0x4;
+    constexpr uint32_t DDPF_RGB               = 0x40;
+    constexpr uint32_t DDSCAPS_COMPLEX        = 0x8;
+    constexpr uint32_t DDSCAPS_TEXTURE        = 0x1000;
+    constexpr uint32_t DDSCAPS_MIPMAP         = 0x400000;
+    constexpr uint32_t DDS_FOURCC_DXT1        = 0x31545844; // "DXT1"
+    constexpr uint32_t DDS_FOURCC_DXT5        = 0x35545844; // "DXT5"
+    constexpr uint32_t DDS_FOURCC_DX10        = 0x30315844; // "DX10"
+    constexpr uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+    /* KTX2 constants */
+    constexpr std::array<byte_t, 12> KTX2_IDENTIFIER = {{ 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' }};
+    constexpr uint32_t KTX2_HEADER_SIZE       = 80;  // Identifier, header and index
+    constexpr uint32_t KTX2_LEVEL_INDEX_SIZE  = 24;  // Per level
+    constexpr uint32_t KHR_DF_VERSION         = 2;
+    constexpr uint32_t KHR_DF_MODEL_RGBSDA    = 1;
+    constexpr uint32_t KHR_DF_MODEL_BC1A      = 128;
+    constexpr uint32_t KHR_DF_MODEL_BC3       = 130;
+    constexpr uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+    constexpr uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+    constexpr uint32_t KHR_DF_CHANNEL_RED     = 0;
+    constexpr uint32_t KHR_DF_CHANNEL_GREEN   = 1;
+    constexpr uint32_t KHR_DF_CHANNEL_BLUE    = 2;
+    constexpr uint32_t KHR_DF_CHANNEL_ALPHA   = 15;
+    constexpr uint32_t KHR_DF_CHANNEL_BC1A_ALPHAPRESENT = 1;
+    constexpr uint32_t KHR_DF_CHANNEL_BC3_COLOR = 0;
+    constexpr uint32_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+    constexpr char     KTX2_WRITER_KEY[]      = "KTXwriter";
+    constexpr char     KTX2_WRITER[]          = "libim";
+
+    struct ChannelMasks
+    {
+        uint32_t r = 0;
+        uint32_t g = 0;
+        uint32_t b = 0;
+        uint32_t a = 0;
+
+        bool operator == (const ChannelMasks& rhs) const {
+            return r == rhs.r && g == rhs.g && b == rhs.b && a == rhs.a;
+        }
+    };
+
+    enum class PixelKind
+    {
+        Packed, // Uncompressed pixels with channel masks
+        BC1,
+        BC3
+    };
+
+    /* Pixel format of texture file images. 0 format code = format not available in container. */
+    struct PixelFormat
+    {
+        PixelKind kind;
+        uint32_t bpp;       // Bits per pixel of packed format
+        ChannelMasks masks;
+        uint32_t dxgi;      // DXGI_FORMAT
+        uint32_t vk;        // VkFormat
+    };
+
+    /* 16 bit formats material pixel data can be written as is */
+    constexpr std::array<PixelFormat, 4> NATIVE_FORMATS = {{
+        { PixelKind::Packed, 16, { 0xF800, 0x07E0, 0x001F, 0x0000 }, 85,  4          }, // B5G6R5_UNORM, R5G6B5_UNORM_PACK16
+        { PixelKind::Packed, 16, { 0x7C00, 0x03E0, 0x001F, 0x8000 }, 86,  8          }, // B5G5R5A1_UNORM, A1R5G5B5_UNORM_PACK16
+        { PixelKind::Packed, 16, { 0x0F00, 0x00F0, 0x000F, 0xF000 }, 115, 1000340000 }, // B4G4R4A4_UNORM, A4R4G4B4_UNORM_PACK16
+        { PixelKind::Packed, 16, { 0xF000, 0x0F00, 0x00F0, 0x000F }, 0,   2          }  // -, R4G4B4A4_UNORM_PACK16
+    }};
+
+    constexpr PixelFormat RGBA8_FORMAT = { PixelKind::Packed, 32, { 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 }, 28, 37 }; // R8G8B8A8_UNORM
+    constexpr PixelFormat BC1_FORMAT   = { PixelKind::BC1, 0, {}, 71, 133 }; // BC1_UNORM, BC1_RGBA_UNORM_BLOCK
+    constexpr PixelFormat BC3_FORMAT   = { PixelKind::BC3, 0, {}, 77, 137 }; // BC3_UNORM, BC3_UNORM_BLOCK
+
+    /* Images of texture file, indexed by [layer][level] */
+    struct TexFileImages
+    {
+        PixelFormat format;
+        uint32_t width  = 0;
+        uint32_t height = 0;
+        uint32_t layers = 0;
+        uint32_t levels = 0;
+        std::vector<std::vector<WriteBatch::Buffer>> images;
+        std::deque<ByteArray> storage; // Converted pixel data referenced by images
+    };
+
+    inline void Put32(ByteArray& out, uint32_t v)
+    {
+        for(int i = 0; i < 4; i++) {
+            out.push_back(byte_t(v >> (i * 8)));
+        }
+    }
+
+    inline void Put64(ByteArray& out, uint64_t v)
+    {
+        Put32(out, uint32_t(v));
+        Put32(out, uint32_t(v >> 32));
+    }
+
+    inline std::size_t AlignUp(std::size_t v, std::size_t alignment)
+    {
+        return (v + alignment - 1) / alignment * alignment;
+    }
+
+    /* Returns false if a color channel is missing or a channel doesn't fit in 16 bits */
+    bool GetChannelMasks16(const ColorFormat& ci, ChannelMasks& masks)
+    {
+        auto mask = [](int32_t bits, int32_t shl, uint32_t& m)
+        {
+            if(bits == 0)
+            {
+                m = 0;
+                return true;
+            }
+
+            if(bits < 0 || shl < 0 || bits + shl > 16) {
+                return false;
+            }
+
+            m = RGBMask(bits, shl);
+            return true;
+        };
+
+        return ci.bpp == 16 &&
+               mask(ci.redBPP,   ci.RedShl,   masks.r) && masks.r &&
+               mask(ci.greenBPP, ci.GreenShl, masks.g) && masks.g &&
+               mask(ci.blueBPP,  ci.BlueShl,  masks.b) && masks.b &&
+               mask(ci.alphaBPP, ci.AlphaShl, masks.a) &&
+               (masks.r & masks.g) == 0 && ((masks.r | masks.g) & masks.b) == 0 && ((masks.r | masks.g | masks.b) & masks.a) == 0;
+    }
+
+    /* Returns native format of color format in container or nullptr if there is none */
+    const PixelFormat* FindNativeFormat(const ColorFormat& ci, TexFileFormat container, uint32_t layers, PixelFormat& masked)
+    {
+        ChannelMasks masks;
+        if(!GetChannelMasks16(ci, masks)) {
+            return nullptr;
+        }
+
+        for(const auto& f : NATIVE_FORMATS)
+        {
+            if(f.masks == masks && (container == TexFileFormat::DDS ? f.dxgi : f.vk) != 0) {
+                return &f;
+            }
+        }
+
+        /* Legacy DDS header describes any channel masks, but it can't store arrays */
+        if(container == TexFileFormat::DDS && layers == 1)
+        {
+            masked = { PixelKind::Packed, 16, masks, 0, 0 };
+            return &masked;
+        }
+
+        return nullptr;
+    }
+
+    /* Validates mip chains of material and collects images to be written */
+    TexFileImages GetTexFileImages(const Material& mat, const TexFileOptions& opt, ThreadPool* pool)
+    {
+        const auto& mipmaps = mat.mipmaps();
+        if(mipmaps.empty() || mipmaps.at(0).empty()) {
+            throw std::invalid_argument("Material has no textures");
+        }
+
+        TexFileImages tf;
+        const auto& base = mipmaps.at(0).at(0);
+        tf.width  = base.width();
+        tf.height = base.height();
+        tf.layers = uint32_t(mipmaps.size());
+        tf.levels = uint32_t(mipmaps.at(0).size());
+
+        for(const auto& mipmap : mipmaps)
+        {
+            if(mipmap.size() != tf.levels) {
+                throw std::invalid_argument("Material mipmaps have different number of textures");
+            }
+
+            for(uint32_t level = 0; level < tf.levels; level++)
+            {
+                const auto& tex = mipmap.at(level);
+                if(tex.width() == 0 || tex.height() == 0 ||
+                   tex.width() != (tf.width >> level) || tex.height() != (tf.height >> level)) {
+                    throw std::invalid_argument("Invalid size of mipmap texture");
+                }
+
+                if(!tex.bitmap() || tex.bitmap()->size() < GetBitmapSize(tex.width(), tex.height(), tex.colorInfo().bpp)) {
+                    throw std::invalid_argument("Texture has no pixel data");
+                }
+            }
+        }
+
+        PixelFormat masked {};
+        const PixelFormat* native = nullptr;
+        switch(opt.encoding)
+        {
+        case TexFileEncoding::Native:
+            native = FindNativeFormat(base.colorInfo(), opt.format, tf.layers, masked);
+            tf.format = native ? *native : RGBA8_FORMAT;
+            break;
+        case TexFileEncoding::RGBA8:
+            tf.format = RGBA8_FORMAT;
+            break;
+        case TexFileEncoding::BC1:
+            tf.format = BC1_FORMAT;
+            break;
+        case TexFileEncoding::BC3:
+            tf.format = BC3_FORMAT;
+            break;
+        }
+
+        tf.images.resize(tf.layers);
+        if(tf.format.kind != PixelKind::Packed)
+        {
+            BCEncodeOptions bcOpt;
+            bcOpt.format  = tf.format.kind == PixelKind::BC1 ? BCFormat::BC1 : BCFormat::BC3;
+            bcOpt.quality = opt.bcQuality;
+
+            auto encoded = EncodeMaterialBC(mat, bcOpt, pool);
+            for(uint32_t layer = 0; layer < tf.layers; layer++)
+            {
+                for(auto& img : encoded.at(layer))
+                {
+                    const auto& data = tf.storage.emplace_back(std::move(img.data));
+                    tf.images[layer].push_back({ data.data(), data.size() });
+                }
+            }
+
+            return tf;
+        }
+
+        for(uint32_t layer = 0; layer < tf.layers; layer++)
+        {
+            for(const auto& tex : mipmaps.at(layer))
+            {
+                if(native)
+                {
+                    const auto& bitmap = *tex.bitmap();
+                    tf.images[layer].push_back({ bitmap.data(), GetBitmapSize(tex.width(), tex.height(), 16) });
+                }
+                else
+                {
+                    const auto& data = tf.storage.emplace_back(TextureToRGBA8(tex));
+                    tf.images[layer].push_back({ data.data(), data.size() });
+                }
+            }
+        }
+
+        return tf;
+    }
+
+    void WriteDds(const TexFileImages& tf, ByteArray& header, WriteBatch& batch)
+    {
+        const auto& f = tf.format;
+        const bool compressed = f.kind != PixelKind::Packed;
+        const bool dx10 = tf.layers > 1;
+        if(dx10 && f.dxgi == 0) {
+            throw std::invalid_argument("Pixel format can't be written to DDS texture array");
+        }
+
+        Put32(header, DDS_MAGIC);
+        Put32(header, DDS_HEADER_SIZE);
+        Put32(header, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT |
+                      (tf.levels > 1 ? DDSD_MIPMAPCOUNT : 0) |
+                      (compressed ? DDSD_LINEARSIZE : DDSD_PITCH));
+        Put32(header, tf.height);
+        Put32(header, tf.width);
+        Put32(header, compressed ? uint32_t(tf.images[0][0].size) : tf.width * f.bpp / 8);
+        Put32(header, 0); // depth
+        Put32(header, tf.levels);
+        for(int i = 0; i < 11; i++) {
+            Put32(header, 0); // reserved1
+        }
+
+        /* Pixel format */
+        Put32(header, DDS_PIXELFORMAT_SIZE);
+        if(dx10 || compressed)
+        {
+            Put32(header, DDPF_FOURCC);
+            Put32(header, dx10 ? DDS_FOURCC_DX10 : f.kind == PixelKind::BC1 ? DDS_FOURCC_DXT1 : DDS_FOURCC_DXT5);
+            for(int i = 0; i < 5; i++) {
+                Put32(header, 0);
+            }
+        }
+        else
+        {
+            Put32(header, DDPF_RGB | (f.masks.a ? DDPF_ALPHAPIXELS : 0));
+            Put32(header, 0);
+            Put32(header, f.bpp);
+            Put32(header, f.masks.r);
+            Put32(header, f.masks.g);
+            Put32(header, f.masks.b);
+            Put32(header, f.masks.a);
+        }
+
+        Put32(header, DDSCAPS_TEXTURE | (tf.levels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+        for(int i = 0; i < 4; i++) {
+            Put32(header, 0); // caps2, caps3, caps4, reserved2
+        }
+
+        if(dx10)
+        {
+            Put32(header, f.dxgi);
+            Put32(header, D3D10_RESOURCE_DIMENSION_TEXTURE2D);
+            Put32(header, 0); // miscFlag
+            Put32(header, tf.layers);
+            Put32(header, 0); // miscFlags2
+        }
+
+        /* Each layer with its full mip chain */
+        batch.add(header.data(), header.size());
+        for(const auto& layer : tf.images)
+        {
+            for(const auto& img : layer) {
+                batch.add(img.data, img.size);
+            }
+        }
+    }
+
+    /* Appends data format descriptor of pixel format */
+    void PutKtx2Dfd(ByteArray& out, const PixelFormat& f)
+    {
+        struct Sample
+        {
+            uint32_t channel;
+            uint32_t bitOffset;
+            uint32_t bitLength;
+            uint32_t upper;
+        };
+
+        std::vector<Sample> samples;
+        uint32_t model      = KHR_DF_MODEL_RGBSDA;
+        uint32_t blockDim   = 0;
+        uint32_t planeBytes = f.bpp / 8;
+        switch(f.kind)
+        {
+        case PixelKind::Packed:
+        {
+            const std::array<std::pair<uint32_t, uint32_t>, 4> channels = {{
+                { KHR_DF_CHANNEL_RED,   f.masks.r },
+                { KHR_DF_CHANNEL_GREEN, f.masks.g },
+                { KHR_DF_CHANNEL_BLUE,  f.masks.b },
+                { KHR_DF_CHANNEL_ALPHA, f.masks.a }
+            }};
+
+            for(const auto& [channel, mask] : channels)
+            {
+                if(mask == 0) {
+                    continue;
+                }
+
+                uint32_t offset = 0;
+                while(!(mask & (1u << offset))) {
+                    offset++;
+                }
+
+                const uint32_t length = uint32_t(__builtin_popcount(mask));
+                samples.push_back({ channel, offset, length, uint32_t((uint64_t(1) << length) - 1) });
+            }
+
+            /* Samples of packed format are ordered from the least significant bit */
+            std::sort(samples.begin(), samples.end(), [](const auto& a, const auto& b){ return a.bitOffset < b.bitOffset; });
+        } break;
+        case PixelKind::BC1:
+            model      = KHR_DF_MODEL_BC1A;
+            blockDim   = 0x0303;
+            planeBytes = 8;
+            samples.push_back({ KHR_DF_CHANNEL_BC1A_ALPHAPRESENT, 0, 64, 0xFFFFFFFF });
+            break;
+        case PixelKind::BC3:
+            model      = KHR_DF_MODEL_BC3;
+            blockDim   = 0x0303;
+            planeBytes = 16;
+            samples.push_back({ KHR_DF_CHANNEL_BC3_ALPHA, 0,  64, 0xFFFFFFFF });
+            samples.push_back({ KHR_DF_CHANNEL_BC3_COLOR, 64, 64, 0xFFFFFFFF });
+            break;
+        }
+
+        const uint32_t blockSize = 24 + 16 * uint32_t(samples.size());
+        Put32(out, 4 + blockSize); // dfdTotalSize
+        Put32(out, 0);             // vendorId = Khronos, descriptorType = basic
+        Put32(out, KHR_DF_VERSION | (blockSize << 16));
+        Put32(out, model | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+        Put32(out, blockDim);
+        Put32(out, planeBytes);
+        Put32(out, 0);
+        for(const auto& s : samples)
+        {
+            Put32(out, s.bitOffset | ((s.bitLength - 1) << 16) | (s.channel << 24));
+            Put32(out, 0); // sample position
+            Put32(out, 0); // lower
+            Put32(out, s.upper);
+        }
+    }
+
+    void WriteKtx2(const TexFileImages& tf, ByteArray& header, WriteBatch& batch)
+    {
+        const auto& f = tf.format;
+
+        ByteArray dfd;
+        PutKtx2Dfd(dfd, f);
+
+        ByteArray kvd;
+        Put32(kvd, sizeof(KTX2_WRITER_KEY) + sizeof(KTX2_WRITER));
+        kvd.insert(kvd.end(), KTX2_WRITER_KEY, KTX2_WRITER_KEY + sizeof(KTX2_WRITER_KEY));
+        kvd.insert(kvd.end(), KTX2_WRITER, KTX2_WRITER + sizeof(KTX2_WRITER));
+        kvd.resize(AlignUp(kvd.size(), 4), 0);
+
+        /* Levels are stored from the smallest one, each aligned to lcm(texel block size, 4) */
+        const std::size_t alignment = f.kind == PixelKind::BC3 ? 16 : f.kind == PixelKind::BC1 ? 8 : 4;
+        const std::size_t dfdOffset = KTX2_HEADER_SIZE + KTX2_LEVEL_INDEX_SIZE * tf.levels;
+        const std::size_t kvdOffset = dfdOffset + dfd.size();
+
+        std::vector<std::pair<std::size_t, std::size_t>> levels(tf.levels); // offset, size
+        std::size_t offset = kvdOffset + kvd.size();
+        for(uint32_t level = tf.levels; level-- > 0;)
+        {
+            offset = AlignUp(offset, alignment);
+            levels[level].first = offset;
+            for(const auto& layer : tf.images) {
+                levels[level].second += layer[level].size;
+            }
+
+            offset += levels[level].second;
+        }
+
+        header.insert(header.end(), KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end());
+        Put32(header, f.vk);
+        Put32(header, f.kind == PixelKind::Packed && f.bpp == 16 ? 2 : 1); // typeSize
+        Put32(header, tf.width);
+        Put32(header, tf.height);
+        Put32(header, 0); // pixelDepth
+        Put32(header, tf.layers > 1 ? tf.layers : 0);
+        Put32(header, 1); // faceCount
+        Put32(header, tf.levels);
+        Put32(header, 0); // supercompressionScheme
+        Put32(header, uint32_t(dfdOffset));
+        Put32(header, uint32_t(dfd.size()));
+        Put32(header, uint32_t(kvdOffset));
+        Put32(header, uint32_t(kvd.size()));
+        Put64(header, 0); // sgdByteOffset
+        Put64(header, 0); // sgdByteLength
+        for(const auto& [levelOffset, levelSize] : levels)
+        {
+            Put64(header, levelOffset);
+            Put64(header, levelSize);
+            Put64(header, levelSize); // uncompressedByteLength
+        }
+
+        header.insert(header.end(), dfd.begin(), dfd.end());
+        header.insert(header.end(), kvd.begin(), kvd.end());
+
+        /* Level padding */
+        static constexpr std::array<byte_t, 16> zeros {};
+        batch.add(header.data(), header.size());
+        std::size_t pos = header.size();
+        for(uint32_t level = tf.levels; level-- > 0;)
+        {
+            batch.add(zeros.data(), levels[level].first - pos);
+            for(const auto& layer : tf.images) {
+                batch.add(layer[level].data, layer[level].size);
+            }
+
+            pos = levels[level].first + levels[level].second;
+        }
+    }
+
+    /* Gathers texture file into batch. Batch references header and tf. */
+    void GatherTexFile(const TexFileImages& tf, TexFileFormat format, ByteArray& header, WriteBatch& batch)
+    {
+        if(format == TexFileFormat::DDS) {
+            WriteDds(tf, header, batch);
+        }
+        else {
+            WriteKtx2(tf, header, batch);
+        }
+    }
+}
+
+const char* TexFileExtension(TexFileFormat format)
+{
+    return format == TexFileFormat::DDS ? ".dds" : ".ktx2";
+}
+
+bool ParseTexFileFormat(const std::string& name, TexFileFormat& format)
+{
+    if(name == "dds") {
+        format = TexFileFormat::DDS;
+    }
+    else if(name == "ktx2") {
+        format = TexFileFormat::KTX2;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+bool ParseTexFileEncoding(const std::string& name, TexFileEncoding& encoding)
+{
+    if(name == "native") {
+        encoding = TexFileEncoding::Native;
+    }
+    else if(name == "rgba8") {
+        encoding = TexFileEncoding::RGBA8;
+    }
+    else if(name == "bc1") {
+        encoding = TexFileEncoding::BC1;
+    }
+    else if(name == "bc3") {
+        encoding = TexFileEncoding::BC3;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+void WriteMaterialToTexFile(Stream& ostream, const Material& mat, const TexFileOptions& opt, ThreadPool* pool)
+{
+    const auto tf = GetTexFileImages(mat, opt, pool);
+
+    ByteArray header;
+    WriteBatch batch;
+    GatherTexFile(tf, opt.format, header, batch);
+    ostream.write(batch);
+}
+
+void WriteMaterialToTexFile(const std::string& filePath, const Material& mat, const TexFileOptions& opt, ThreadPool* pool)
+{
+    const auto tf = GetTexFileImages(mat, opt, pool);
+
+    ByteArray header;
+    WriteBatch batch;
+    GatherTexFile(tf, opt.format, header, batch);
+
+    OutputFileStream ofs(filePath);
+    ofs.preallocate(batch.size());
+    ofs.write(batch);
+    ofs.close();
+}
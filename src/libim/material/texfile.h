@@ -0,0 +1,53 @@
+#ifndef LIBIM_TEXFILE_H
+#define LIBIM_TEXFILE_H
+#include <string>
+
+#include "bcn.h"
+#include "material.h"
+#include "../io/stream.h"
+
+class ThreadPool;
+
+/* Texture container file format */
+enum class TexFileFormat
+{
+    DDS, // DirectDraw Surface
+    KTX2 // Khronos Texture 2.0
+};
+
+/* Pixel encoding of texture file */
+enum class TexFileEncoding
+{
+    Native, // Material pixel data as is if container has matching 16 bit format, otherwise RGBA8
+    RGBA8,
+    BC1,
+    BC3
+};
+
+struct TexFileOptions
+{
+    TexFileFormat   format    = TexFileFormat::DDS;
+    TexFileEncoding encoding  = TexFileEncoding::Native;
+    BCQuality       bcQuality = BCQuality::High;
+};
+
+/* Returns file extension of format, e.g. ".dds" */
+const char* TexFileExtension(TexFileFormat format);
+
+/* Parses format name: dds or ktx2. Returns false if name is unknown. */
+bool ParseTexFileFormat(const std::string& name, TexFileFormat& format);
+
+/* Parses encoding name: native, rgba8, bc1 or bc3. Returns false if name is unknown. */
+bool ParseTexFileEncoding(const std::string& name, TexFileEncoding& encoding);
+
+/* Writes all mipmaps of material to one texture file. Each mipmap (cel) is an array layer
+   and its textures are the layer's mip levels.
+   Native 16 bit formats are written from textures' bitmaps without conversion:
+     DDS:  RGB565, ARGB1555 and ARGB4444, any 16 bit layout if material has a single mipmap
+     KTX2: RGB565, ARGB1555, ARGB4444 and RGBA4444
+   BC textures are encoded in parallel if pool is not null.
+   Throws std::invalid_argument if mipmaps don't have equal mip chains, StreamError on write error. */
+void WriteMaterialToTexFile(Stream& ostream, const Material& mat, const TexFileOptions& opt, ThreadPool* pool = nullptr);
+void WriteMaterialToTexFile(const std::string& filePath, const Material& mat, const TexFileOptions& opt, ThreadPool* pool = nullptr);
+
+#endif // LIBIM_TEXFILE_H
@@ -0,0 +1,69 @@
+#include "arena.h"
+#include "../common.h"
+
+#include <cstdint>
+#include <new>
+
+#if defined(__linux__)
+# include <sys/mman.h>
+# define LIBIM_HAS_THP 1
+#endif
+
+HugePageResource::HugePageResource(std::size_t minSize, std::pmr::memory_resource* upstream) :
+    m_minSize(minSize),
+    m_upstream(upstream)
+{}
+
+void* HugePageResource::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+#ifdef LIBIM_HAS_THP
+    if(bytes >= m_minSize && alignment <= HugePageSize)
+    {
+        /* Map extra huge page so the returned block can be aligned to huge page boundary */
+        const std::size_t size = (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+        void* p = mmap(nullptr, size + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        auto begin   = reinterpret_cast<uintptr_t>(p);
+        auto aligned = (begin + HugePageSize - 1) & ~(uintptr_t(HugePageSize) - 1);
+        if(aligned != begin) {
+            munmap(p, aligned - begin);
+        }
+
+        const auto tail = (begin + size + HugePageSize) - (aligned + size);
+        if(tail) {
+            munmap(reinterpret_cast<void*>(aligned + size), tail);
+        }
+
+        madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+        return reinterpret_cast<void*>(aligned);
+    }
+#endif
+    return m_upstream->allocate(bytes, alignment);
+}
+
+void HugePageResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment)
+{
+#ifdef LIBIM_HAS_THP
+    if(bytes >= m_minSize && alignment <= HugePageSize)
+    {
+        const std::size_t size = (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+        munmap(p, size);
+        return;
+    }
+#endif
+    m_upstream->deallocate(p, bytes, alignment);
+}
+
+bool HugePageResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+MaterialArena::MaterialArena(std::size_t initialSize, bool hugePages) :
+    m_hugePages(HugePageResource::HugePageSize),
+    m_arena(std::max<std::size_t>(initialSize, 1),
+            hugePages ? static_cast<std::pmr::memory_resource*>(&m_hugePages) : std::pmr::new_delete_resource())
+{}
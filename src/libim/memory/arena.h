@@ -0,0 +1,55 @@
+#ifndef LIBIM_ARENA_H
+#define LIBIM_ARENA_H
+#include <cstddef>
+#include <memory_resource>
+
+/* Memory resource which maps large allocations directly from the OS and
+   marks them for transparent huge pages (Linux only).
+   Allocations smaller than minSize are forwarded to upstream resource. */
+class HugePageResource : public std::pmr::memory_resource
+{
+public:
+    static constexpr std::size_t HugePageSize = 2 * 1024 * 1024;
+
+    explicit HugePageResource(std::size_t minSize = HugePageSize,
+                              std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+    std::size_t m_minSize;
+    std::pmr::memory_resource* m_upstream;
+};
+
+/* Monotonic arena for loading a whole set of materials.
+   Every Material, Mipmap, Texture and bitmap allocated from the arena is
+   freed at once when the arena is released or destroyed, so the arena
+   must outlive all objects allocated from it. */
+class MaterialArena
+{
+public:
+    /* initialSize - size of the first memory block, e.g. size of the CND file being loaded.
+       hugePages   - back big blocks with transparent huge pages */
+    explicit MaterialArena(std::size_t initialSize = 1024 * 1024, bool hugePages = false);
+    MaterialArena(const MaterialArena&) = delete;
+    MaterialArena& operator = (const MaterialArena&) = delete;
+
+    std::pmr::memory_resource* resource()
+    {
+        return &m_arena;
+    }
+
+    void release()
+    {
+        m_arena.release();
+    }
+
+private:
+    HugePageResource m_hugePages;
+    std::pmr::monotonic_buffer_resource m_arena;
+};
+
+#endif // LIBIM_ARENA_H
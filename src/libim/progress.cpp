@@ -0,0 +1,185 @@
+#include "progress.h"
+#include "common.h"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#ifdef OS_WINDOWS
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
+
+namespace {
+    std::atomic<ProgressMode> progressMode { ProgressMode::Auto };
+
+    /* Weight of the last interval's rate in smoothed rate */
+    constexpr double RATE_SMOOTHING = 0.3;
+
+    bool IsStderrTerminal()
+    {
+#ifdef OS_WINDOWS
+        return _isatty(_fileno(stderr)) != 0;
+#else
+        return isatty(STDERR_FILENO) != 0;
+#endif
+    }
+
+    void PrintDuration(std::ostream& os, double seconds)
+    {
+        const uint64_t s = uint64_t(seconds + 0.5);
+        if(s >= 3600) {
+            os << s / 3600 << ':' << std::setw(2) << std::setfill('0') << (s / 60) % 60;
+        }
+        else {
+            os << s / 60;
+        }
+        os << ':' << std::setw(2) << std::setfill('0') << s % 60 << std::setfill(' ');
+    }
+}
+
+void SetProgressMode(ProgressMode mode)
+{
+    progressMode.store(mode, std::memory_order_relaxed);
+}
+
+bool ProgressEnabled()
+{
+    switch(progressMode.load(std::memory_order_relaxed))
+    {
+        case ProgressMode::On:  return true;
+        case ProgressMode::Off: return false;
+        default:
+            return IsStderrTerminal();
+    }
+}
+
+ProgressReporter::ProgressReporter(std::string label, uint64_t totalItems, uint64_t totalBytes, std::chrono::milliseconds refreshInterval) :
+    m_label(std::move(label)),
+    m_totalItems(totalItems),
+    m_totalBytes(totalBytes),
+    m_interval(refreshInterval)
+{
+    if(!ProgressEnabled()) {
+        return;
+    }
+
+    m_active   = true;
+    m_terminal = IsStderrTerminal();
+    m_start    = std::chrono::steady_clock::now();
+    m_lastTime = m_start;
+    m_thread   = std::thread([this]{ run(); });
+}
+
+ProgressReporter::~ProgressReporter()
+{
+    finish();
+}
+
+void ProgressReporter::finish()
+{
+    if(!m_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+    print(/*final=*/true);
+}
+
+void ProgressReporter::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_cv.wait_for(lock, m_interval, [this]{ return m_stop; })) {
+        print(/*final=*/false);
+    }
+}
+
+void ProgressReporter::print(bool final)
+{
+    const auto now   = std::chrono::steady_clock::now();
+    const auto items = m_items.load(std::memory_order_relaxed);
+    const auto bytes = m_bytes.load(std::memory_order_relaxed);
+
+    double itemRate = 0.0;
+    double byteRate = 0.0;
+    if(final)
+    {
+        /* Average over whole operation */
+        const double elapsed = std::chrono::duration<double>(now - m_start).count();
+        if(elapsed > 0.0)
+        {
+            itemRate = items / elapsed;
+            byteRate = bytes / elapsed;
+        }
+    }
+    else
+    {
+        const double elapsed = std::chrono::duration<double>(now - m_lastTime).count();
+        if(elapsed > 0.0)
+        {
+            const bool first = m_lastTime == m_start;
+            m_itemRate = first ? (items - m_lastItems) / elapsed : m_itemRate + RATE_SMOOTHING * ((items - m_lastItems) / elapsed - m_itemRate);
+            m_byteRate = first ? (bytes - m_lastBytes) / elapsed : m_byteRate + RATE_SMOOTHING * ((bytes - m_lastBytes) / elapsed - m_byteRate);
+        }
+
+        m_lastTime  = now;
+        m_lastItems = items;
+        m_lastBytes = bytes;
+        itemRate = m_itemRate;
+        byteRate = m_byteRate;
+    }
+
+    /* Line is formatted first and written at once */
+    std::ostringstream os;
+    os << (m_terminal ? "\r" : "") << m_label << ": " << items;
+    if(m_totalItems > 0) {
+        os << '/' << m_totalItems;
+    }
+
+    os << " files  " << std::fixed << std::setprecision(1);
+    if(m_totalBytes > 0 || bytes > 0)
+    {
+        /* Bytes are not shown for operations which count only items */
+        os << bytes / (1024.0 * 1024.0);
+        if(m_totalBytes > 0) {
+            os << '/' << m_totalBytes / (1024.0 * 1024.0);
+        }
+        os << " MB  " << byteRate / (1024.0 * 1024.0) << " MB/s  ";
+    }
+
+    os << std::setprecision(0) << itemRate << " files/s";
+    if(final)
+    {
+        os << "  in ";
+        PrintDuration(os, std::chrono::duration<double>(now - m_start).count());
+    }
+    else
+    {
+        /* ETA from bytes if total is known, items otherwise */
+        double eta = -1.0;
+        if(m_totalBytes > 0 && byteRate > 0.0) {
+            eta = (m_totalBytes > bytes ? m_totalBytes - bytes : 0) / byteRate;
+        }
+        else if(m_totalItems > 0 && itemRate > 0.0) {
+            eta = (m_totalItems > items ? m_totalItems - items : 0) / itemRate;
+        }
+
+        if(eta >= 0.0)
+        {
+            os << "  ETA ";
+            PrintDuration(os, eta);
+        }
+    }
+
+    os << (m_terminal ? "\033[K" : "") << (final || !m_terminal ? "\n" : "");
+
+    const std::string line = os.str();
+    std::fwrite(line.data(), 1, line.size(), stderr);
+    std::fflush(stderr);
+}
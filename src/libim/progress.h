@@ -0,0 +1,88 @@
+#ifndef LIBIM_PROGRESS_H
+#define LIBIM_PROGRESS_H
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class ProgressMode
+{
+    Auto, // Report progress if stderr is terminal
+    On,
+    Off
+};
+
+/* Sets whether ProgressReporter reports progress. Default is Auto. */
+void SetProgressMode(ProgressMode mode);
+
+/* Returns true if ProgressReporter reports progress */
+bool ProgressEnabled();
+
+/* Reports progress of an operation to stderr while in scope: processed items and bytes,
+   current items/s and MB/s, and ETA. Items and bytes are added to relaxed atomic counters,
+   so add can be called from any thread at little cost. A background thread prints the
+   progress line every refresh interval, in place if stderr is terminal or as a new line otherwise.
+   Does nothing if progress reporting is disabled. */
+class ProgressReporter
+{
+public:
+    static constexpr std::chrono::milliseconds DEFAULT_REFRESH_INTERVAL {250};
+
+    /* totalItems and totalBytes can be 0 if unknown, no ETA is shown then */
+    ProgressReporter(std::string label, uint64_t totalItems, uint64_t totalBytes,
+                     std::chrono::milliseconds refreshInterval = DEFAULT_REFRESH_INTERVAL);
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator = (const ProgressReporter&) = delete;
+
+    /* Returns true if progress is reported */
+    bool active() const
+    {
+        return m_active;
+    }
+
+    void add(uint64_t items, uint64_t bytes)
+    {
+        if(m_active)
+        {
+            m_items.fetch_add(items, std::memory_order_relaxed);
+            m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    /* Stops reporting and prints final line with totals and average rates */
+    void finish();
+
+private:
+    void run();
+    void print(bool final);
+
+    std::string m_label;
+    uint64_t m_totalItems;
+    uint64_t m_totalBytes;
+    std::chrono::milliseconds m_interval;
+    bool m_active   = false;
+    bool m_terminal = false;
+
+    std::atomic<uint64_t> m_items {0};
+    std::atomic<uint64_t> m_bytes {0};
+
+    /* Reporter thread state */
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_lastTime;
+    uint64_t m_lastItems = 0;
+    uint64_t m_lastBytes = 0;
+    double m_itemRate = 0.0; // Smoothed items/s
+    double m_byteRate = 0.0; // Smoothed bytes/s
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    std::thread m_thread;
+};
+
+#endif // LIBIM_PROGRESS_H
@@ -0,0 +1,225 @@
+#include "client.h"
+
+#include <cstring>
+
+#ifndef OS_WINDOWS
+# include <errno.h>
+# include <sys/socket.h>
+# include <sys/uio.h>
+# include <sys/un.h>
+# include <unistd.h>
+#endif
+
+#ifndef OS_WINDOWS
+namespace {
+#ifdef MSG_NOSIGNAL
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    constexpr int SEND_FLAGS = 0;
+#endif
+}
+
+ResourceClient::ResourceClient(const std::string& socketPath)
+{
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if(socketPath.size() >= sizeof(addr.sun_path)) {
+        throw ResourceServerError("Socket path is too long: " + socketPath);
+    }
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(m_fd == -1) {
+        throw ResourceServerError(std::string("Failed to create socket: ") + strerror(errno));
+    }
+
+    if(connect(m_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == -1)
+    {
+        const std::string error = strerror(errno);
+        ::close(m_fd);
+        throw ResourceServerError("Failed to connect to " + socketPath + ": " + error);
+    }
+}
+
+ResourceClient::~ResourceClient()
+{
+    ::close(m_fd);
+}
+
+void ResourceClient::recv(void* data, std::size_t size)
+{
+    auto* p = static_cast<byte_t*>(data);
+    while(size > 0)
+    {
+        const ssize_t n = ::recv(m_fd, p, size, 0);
+        if(n == -1 && errno == EINTR) {
+            continue;
+        }
+        else if(n <= 0) {
+            throw ResourceServerError(n == 0 ? std::string("Connection closed by server") : std::string("Failed to receive response: ") + strerror(errno));
+        }
+
+        p += n;
+        size -= std::size_t(n);
+    }
+}
+
+ResourceResponseHeader ResourceClient::request(ResourceOp op, const std::string& archive, const std::string& entry, ResourceStatus allowed)
+{
+    ResourceRequestHeader req;
+    req.op          = op;
+    req.archiveSize = uint32_t(archive.size());
+    req.entrySize   = uint32_t(entry.size());
+
+    WriteBatch batch;
+    batch.add(req)
+         .add(reinterpret_cast<const byte_t*>(archive.data()), archive.size())
+         .add(reinterpret_cast<const byte_t*>(entry.data()), entry.size());
+
+    std::vector<iovec> iov;
+    for(const auto& buf : batch.buffers()) {
+        iov.push_back({ const_cast<byte_t*>(buf.data), buf.size });
+    }
+
+    /* Request is small, it's sent whole unless interrupted */
+    std::size_t idx = 0;
+    while(idx < iov.size())
+    {
+        msghdr msg {};
+        msg.msg_iov    = &iov[idx];
+        msg.msg_iovlen = iov.size() - idx;
+
+        ssize_t n = sendmsg(m_fd, &msg, SEND_FLAGS);
+        if(n == -1)
+        {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw ResourceServerError(std::string("Failed to send request: ") + strerror(errno));
+        }
+
+        while(idx < iov.size() && std::size_t(n) >= iov[idx].iov_len) {
+            n -= ssize_t(iov[idx++].iov_len);
+        }
+
+        if(idx < iov.size())
+        {
+            iov[idx].iov_base = static_cast<byte_t*>(iov[idx].iov_base) + n;
+            iov[idx].iov_len -= std::size_t(n);
+        }
+    }
+
+    ResourceResponseHeader res;
+    recv(&res, sizeof(res));
+    RecordsFromDisk(&res, 1);
+    if(res.magic != RESOURCE_RESPONSE_MAGIC) {
+        throw ResourceServerError("Bad response from server");
+    }
+
+    if(res.status != ResourceStatus::Ok && res.status != allowed)
+    {
+        std::string error(std::size_t(res.size), '\0');
+        recv(error.data(), error.size());
+        throw ResourceServerError(error);
+    }
+
+    return res;
+}
+#else
+ResourceClient::ResourceClient(const std::string&)
+{
+    throw ResourceServerError("Resource server is not supported on this platform");
+}
+
+ResourceClient::~ResourceClient() {}
+
+void ResourceClient::recv(void*, std::size_t) {}
+
+ResourceResponseHeader ResourceClient::request(ResourceOp, const std::string&, const std::string&, ResourceStatus)
+{
+    return {};
+}
+#endif
+
+std::vector<ResourceEntry> ResourceClient::recvEntries(uint64_t size)
+{
+    ByteArray body(size);
+    recv(body.data(), body.size());
+
+    std::vector<ResourceEntry> entries;
+    for(std::size_t off = 0; off < body.size();)
+    {
+        if(body.size() - off < sizeof(ResourceEntryHeader)) {
+            throw ResourceServerError("Bad response from server");
+        }
+
+        ResourceEntryHeader header;
+        std::memcpy(&header, body.data() + off, sizeof(header));
+        RecordsFromDisk(&header, 1);
+        off += sizeof(header);
+
+        if(body.size() - off < header.nameSize) {
+            throw ResourceServerError("Bad response from server");
+        }
+
+        entries.push_back({ std::string(reinterpret_cast<const char*>(body.data() + off), header.nameSize), header.size });
+        off += header.nameSize;
+    }
+
+    return entries;
+}
+
+std::vector<ResourceEntry> ResourceClient::archives()
+{
+    const auto res = request(ResourceOp::Archives, "", "");
+    return recvEntries(res.size);
+}
+
+std::vector<ResourceEntry> ResourceClient::list(const std::string& archive)
+{
+    const auto res = request(ResourceOp::List, archive, "");
+    return recvEntries(res.size);
+}
+
+std::optional<ResourceEntry> ResourceClient::stat(const std::string& archive, const std::string& entry)
+{
+    const auto res = request(ResourceOp::Stat, archive, entry, ResourceStatus::NotFound);
+    if(res.status == ResourceStatus::NotFound)
+    {
+        ByteArray error(res.size);
+        recv(error.data(), error.size());
+        return std::nullopt;
+    }
+
+    auto entries = recvEntries(res.size);
+    if(entries.size() != 1) {
+        throw ResourceServerError("Bad response from server");
+    }
+    return std::move(entries.front());
+}
+
+ByteArray ResourceClient::read(const std::string& archive, const std::string& entry)
+{
+    const auto res = request(ResourceOp::Read, archive, entry);
+    ByteArray data(res.size);
+    recv(data.data(), data.size());
+    return data;
+}
+
+uint64_t ResourceClient::read(const std::string& archive, const std::string& entry, Stream& ostream)
+{
+    const auto res = request(ResourceOp::Read, archive, entry);
+
+    ByteArray buffer(std::min<uint64_t>(res.size, 256 * 1024));
+    for(uint64_t nLeft = res.size; nLeft > 0;)
+    {
+        const std::size_t nChunk = std::size_t(std::min<uint64_t>(nLeft, buffer.size()));
+        recv(buffer.data(), nChunk);
+        if(ostream.write(buffer.data(), nChunk) != nChunk) {
+            throw StreamError("Failed to write entry data to stream");
+        }
+        nLeft -= nChunk;
+    }
+
+    return res.size;
+}
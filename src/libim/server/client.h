@@ -0,0 +1,56 @@
+#ifndef LIBIM_SERVER_CLIENT_H
+#define LIBIM_SERVER_CLIENT_H
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "protocol.h"
+#include "server.h"
+#include "../io/stream.h"
+
+/* Archive or entry served by resource server */
+struct ResourceEntry
+{
+    std::string name;
+    uint64_t size = 0;
+};
+
+/* Connection to resource server. Requests are sent one at a time and block until answered.
+   Methods throw ResourceServerError on connection error or if server returns an error. */
+class ResourceClient
+{
+public:
+    /* Connects to server listening on socketPath */
+    explicit ResourceClient(const std::string& socketPath);
+    ~ResourceClient();
+
+    ResourceClient(const ResourceClient&) = delete;
+    ResourceClient& operator = (const ResourceClient&) = delete;
+
+    /* Returns served archives */
+    std::vector<ResourceEntry> archives();
+
+    /* Returns entries of archive */
+    std::vector<ResourceEntry> list(const std::string& archive);
+
+    /* Returns entry of archive or nothing if archive has no such entry */
+    std::optional<ResourceEntry> stat(const std::string& archive, const std::string& entry);
+
+    /* Reads entry of archive */
+    ByteArray read(const std::string& archive, const std::string& entry);
+
+    /* Reads entry of archive to ostream. Returns number of bytes written. */
+    uint64_t read(const std::string& archive, const std::string& entry, Stream& ostream);
+
+private:
+    /* Sends request and returns response header. Throws if response status is an error other than allowed. */
+    ResourceResponseHeader request(ResourceOp op, const std::string& archive, const std::string& entry,
+                                   ResourceStatus allowed = ResourceStatus::Ok);
+    void recv(void* data, std::size_t size);
+    std::vector<ResourceEntry> recvEntries(uint64_t size);
+
+    int m_fd = -1;
+};
+
+#endif // LIBIM_SERVER_CLIENT_H
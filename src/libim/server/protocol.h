@@ -0,0 +1,78 @@
+#ifndef LIBIM_SERVER_PROTOCOL_H
+#define LIBIM_SERVER_PROTOCOL_H
+#include <array>
+#include <cstdint>
+
+#include "../io/record.h"
+
+/* Binary protocol of resource server.
+   Client sends request header followed by archive name and entry name, without terminators.
+   Server replies with response header followed by size bytes of body:
+     Archives, List: ResourceEntryHeader and name of each archive or entry
+     Stat:           ResourceEntryHeader and name of entry
+     Read:           Entry file data. GOB entries are sent as stored, CND materials as MAT files.
+   On error body is error message. Connection stays open for next request. */
+
+static constexpr std::array<char, 4> RESOURCE_REQUEST_MAGIC  = {{ 'I', 'M', 'R', 'Q' }};
+static constexpr std::array<char, 4> RESOURCE_RESPONSE_MAGIC = {{ 'I', 'M', 'R', 'S' }};
+static constexpr uint32_t RESOURCE_NAME_MAX_SIZE = 4096;
+
+enum class ResourceOp : uint32_t
+{
+    Archives = 1, // List served archives
+    List     = 2, // List entries of archive
+    Stat     = 3, // Entry info
+    Read     = 4  // Entry data
+};
+
+enum class ResourceStatus : uint32_t
+{
+    Ok             = 0,
+    NotFound       = 1, // No such entry in archive
+    UnknownArchive = 2,
+    BadRequest     = 3
+};
+
+struct ResourceRequestHeader
+{
+    std::array<char, 4> magic = RESOURCE_REQUEST_MAGIC;
+    ResourceOp op = ResourceOp::Archives;
+    uint32_t archiveSize = 0; // Size of archive name
+    uint32_t entrySize   = 0; // Size of entry name
+};
+
+struct ResourceResponseHeader
+{
+    std::array<char, 4> magic = RESOURCE_RESPONSE_MAGIC;
+    ResourceStatus status = ResourceStatus::Ok;
+    uint64_t size = 0; // Size of body
+};
+
+/* Archive or entry info, followed by nameSize bytes of name */
+struct ResourceEntryHeader
+{
+    uint64_t size     = 0; // Size of archive file or entry file
+    uint32_t nameSize = 0;
+    uint32_t reserved = 0;
+};
+
+LIBIM_RECORD_LAYOUT(ResourceRequestHeader, 16,
+    LIBIM_FIELD(ResourceRequestHeader, magic),
+    LIBIM_FIELD(ResourceRequestHeader, op),
+    LIBIM_FIELD(ResourceRequestHeader, archiveSize),
+    LIBIM_FIELD(ResourceRequestHeader, entrySize)
+);
+
+LIBIM_RECORD_LAYOUT(ResourceResponseHeader, 16,
+    LIBIM_FIELD(ResourceResponseHeader, magic),
+    LIBIM_FIELD(ResourceResponseHeader, status),
+    LIBIM_FIELD(ResourceResponseHeader, size)
+);
+
+LIBIM_RECORD_LAYOUT(ResourceEntryHeader, 16,
+    LIBIM_FIELD(ResourceEntryHeader, size),
+    LIBIM_FIELD(ResourceEntryHeader, nameSize),
+    LIBIM_FIELD(ResourceEntryHeader, reserved)
+);
+
+#endif // LIBIM_SERVER_PROTOCOL_H
@@ -0,0 +1,656 @@
+#include "server.h"
+#include "../cnd.h"
+#include "../gob.h"
+#include "../stats.h"
+#include "../io/filestream.h"
+#include "../io/filekey.h"
+#include "../material/mat.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+
+#ifndef OS_WINDOWS
+# include <errno.h>
+# include <fcntl.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <sys/stat.h>
+# include <sys/uio.h>
+# include <sys/un.h>
+# include <unistd.h>
+#endif
+#ifdef __linux__
+# include <sys/sendfile.h>
+#endif
+
+/* Indexed archive served to clients. Immutable, replaced when archive file changes. */
+class ServedArchive
+{
+public:
+    struct Entry
+    {
+        std::string name;
+        uint64_t offset = 0; // Offset of entry data in archive
+        uint64_t size   = 0; // Size of served file
+        std::optional<libim::CND::CndMatHeader> material; // Set if entry is CND material, served as MAT file
+    };
+
+    ServedArchive(const std::string& path, const std::string& name);
+    ~ServedArchive();
+
+    ServedArchive(const ServedArchive&) = delete;
+    ServedArchive& operator = (const ServedArchive&) = delete;
+
+    const std::string& path() const
+    {
+        return m_path;
+    }
+
+    const std::string& name() const
+    {
+        return m_name;
+    }
+
+    int fd() const
+    {
+        return m_fd;
+    }
+
+    uint64_t fileSize() const
+    {
+        return m_key.size;
+    }
+
+    /* Returns key of archive file if file no longer has the content which was indexed
+       and wasn't already tried to be reindexed, or nothing otherwise.
+       Called with server's archives mutex held. */
+    std::optional<FileKey> changedKey() const;
+
+    /* Records key of archive file which failed to be reindexed, so it's not retried until file changes again.
+       Called with server's archives mutex held. */
+    void setFailedKey(const FileKey& key) const;
+
+    const std::vector<Entry>& entries() const
+    {
+        return m_entries;
+    }
+
+    const Entry* find(const std::string& name) const
+    {
+        const auto it = m_index.find(name);
+        return it != m_index.end() ? &m_entries[it->second] : nullptr;
+    }
+
+private:
+    InputFileStream openStream() const;
+    void loadGob();
+    void loadCnd();
+
+    std::string m_path;
+    std::string m_name;
+    int m_fd = -1;
+    FileKey m_key;
+    mutable std::optional<FileKey> m_failedKey; // Guarded by server's archives mutex
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string, std::size_t> m_index;
+};
+
+#ifndef OS_WINDOWS
+namespace {
+#ifdef MSG_NOSIGNAL
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    constexpr int SEND_FLAGS = 0;
+#endif
+
+    std::string ErrnoStr()
+    {
+        return strerror(errno);
+    }
+
+    void SetCloseOnExec(int fd)
+    {
+        fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+    }
+
+    bool SameKey(const FileKey& a, const FileKey& b)
+    {
+        return a.size == b.size && a.mtime == b.mtime && a.inode == b.inode && a.device == b.device;
+    }
+
+    /* Returns false if peer closed connection before all data was received */
+    bool RecvAll(int fd, void* data, std::size_t size)
+    {
+        auto* p = static_cast<byte_t*>(data);
+        while(size > 0)
+        {
+            const ssize_t n = recv(fd, p, size, 0);
+            if(n == -1 && errno == EINTR) {
+                continue;
+            }
+            else if(n <= 0) {
+                return false;
+            }
+
+            p += n;
+            size -= std::size_t(n);
+        }
+        return true;
+    }
+
+    /* Sends all buffers of batch. more hints that more data follows. Throws ResourceServerError on error. */
+    void SendBatch(int fd, const WriteBatch& batch, bool more = false)
+    {
+        std::vector<iovec> iov;
+        iov.reserve(batch.buffers().size());
+        for(const auto& buf : batch.buffers()) {
+            iov.push_back({ const_cast<byte_t*>(buf.data), buf.size });
+        }
+
+        int flags = SEND_FLAGS;
+    #ifdef MSG_MORE
+        if(more) {
+            flags |= MSG_MORE;
+        }
+    #else
+        (void)more;
+    #endif
+
+        std::size_t idx = 0;
+        while(idx < iov.size())
+        {
+            msghdr msg {};
+            msg.msg_iov    = &iov[idx];
+            msg.msg_iovlen = std::min<std::size_t>(iov.size() - idx, IOV_MAX);
+
+            ssize_t n = sendmsg(fd, &msg, flags);
+            StatAdd(Stat::Syscalls);
+            if(n == -1)
+            {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw ResourceServerError("Failed to send response: " + ErrnoStr());
+            }
+
+            StatAdd(Stat::BytesWritten, uint64_t(n));
+            while(idx < iov.size() && std::size_t(n) >= iov[idx].iov_len) {
+                n -= ssize_t(iov[idx++].iov_len);
+            }
+
+            if(idx < iov.size())
+            {
+                iov[idx].iov_base = static_cast<byte_t*>(iov[idx].iov_base) + n;
+                iov[idx].iov_len -= std::size_t(n);
+            }
+        }
+    }
+
+    /* Sends size bytes of file fd at offset to socket, by kernel where supported.
+       Throws ResourceServerError on error. */
+    void SendFileRange(int sock, int fd, uint64_t offset, uint64_t size)
+    {
+    #ifdef __linux__
+        off_t off = off_t(offset);
+        while(size > 0)
+        {
+            const ssize_t n = sendfile(sock, fd, &off, size);
+            StatAdd(Stat::Syscalls);
+            if(n == -1 && errno == EINTR) {
+                continue;
+            }
+            else if(n <= 0) {
+                throw ResourceServerError("Failed to send entry data: " + (n == 0 ? std::string("archive file truncated") : ErrnoStr()));
+            }
+
+            StatAdd(Stat::BytesWritten, uint64_t(n));
+            size -= uint64_t(n);
+        }
+    #else
+        ByteArray buffer(64 * 1024);
+        while(size > 0)
+        {
+            const ssize_t n = pread(fd, buffer.data(), std::min<uint64_t>(size, buffer.size()), off_t(offset));
+            StatAdd(Stat::Syscalls);
+            if(n == -1 && errno == EINTR) {
+                continue;
+            }
+            else if(n <= 0) {
+                throw ResourceServerError("Failed to read entry data: " + (n == 0 ? std::string("archive file truncated") : ErrnoStr()));
+            }
+
+            WriteBatch batch;
+            batch.add(buffer.data(), std::size_t(n));
+            SendBatch(sock, batch);
+            offset += uint64_t(n);
+            size   -= uint64_t(n);
+        }
+    #endif
+    }
+
+    void SendResponse(int fd, ResourceStatus status, const WriteBatch& body)
+    {
+        ResourceResponseHeader header;
+        header.status = status;
+        header.size   = body.size();
+
+        WriteBatch batch;
+        batch.add(header);
+        for(const auto& buf : body.buffers()) {
+            batch.add(buf.data, buf.size);
+        }
+        SendBatch(fd, batch);
+    }
+
+    void SendError(int fd, ResourceStatus status, const std::string& message)
+    {
+        WriteBatch body;
+        body.add(reinterpret_cast<const byte_t*>(message.data()), message.size());
+        SendResponse(fd, status, body);
+    }
+
+    void AddEntryInfo(WriteBatch& batch, const std::string& name, uint64_t size)
+    {
+        ResourceEntryHeader header;
+        header.size     = size;
+        header.nameSize = uint32_t(name.size());
+        batch.add(header)
+             .add(reinterpret_cast<const byte_t*>(name.data()), name.size());
+    }
+
+    /* Sends entry file, MAT file is assembled from material's headers and pixel data in archive */
+    void SendEntry(int fd, const ServedArchive& archive, const ServedArchive::Entry& entry)
+    {
+        ResourceResponseHeader header;
+        header.size = entry.size;
+
+        WriteBatch batch;
+        batch.add(header);
+        if(!entry.material)
+        {
+            SendBatch(fd, batch, /*more=*/true);
+            SendFileRange(fd, archive.fd(), entry.offset, entry.size);
+            return;
+        }
+
+        const auto& matHeader = *entry.material;
+        WriteMatFileHeader(batch, matHeader.colorInfo, matHeader.mipmapCount);
+
+        MatMipmapHeader mmHeader {};
+        mmHeader.width        = matHeader.width;
+        mmHeader.height       = matHeader.height;
+        mmHeader.textureCount = matHeader.texturesPerMipmap;
+
+        const uint32_t nMipmapSize = GetMipmapPixelDataSize(matHeader.texturesPerMipmap, matHeader.width, matHeader.height, matHeader.colorInfo.bpp);
+        for(int32_t i = 0; i < matHeader.mipmapCount; i++)
+        {
+            batch.add(mmHeader);
+            SendBatch(fd, batch, /*more=*/true);
+            batch.clear();
+
+            SendFileRange(fd, archive.fd(), entry.offset + uint64_t(i) * nMipmapSize, nMipmapSize);
+        }
+    }
+}
+
+ServedArchive::ServedArchive(const std::string& path, const std::string& name) :
+    m_path(path),
+    m_name(name)
+{
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(m_fd == -1) {
+        throw ResourceServerError("Failed to open archive " + path + ": " + ErrnoStr());
+    }
+
+    try
+    {
+        /* Key is taken from opened file before it's indexed, so index and key are of the same file
+           and archive changed while it's indexed is reindexed on next request */
+        const auto key = GetFileKey(m_fd);
+        if(!key) {
+            throw ResourceServerError("Failed to stat archive " + path + ": " + ErrnoStr());
+        }
+        m_key = *key;
+
+        std::string ext = GetFileExtension(path);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if(ext == "cnd") {
+            loadCnd();
+        }
+        else {
+            loadGob();
+        }
+    }
+    catch(...)
+    {
+        ::close(m_fd);
+        throw;
+    }
+
+    m_index.reserve(m_entries.size());
+    for(std::size_t i = 0; i < m_entries.size(); i++) {
+        m_index.emplace(m_entries[i].name, i);
+    }
+}
+
+ServedArchive::~ServedArchive()
+{
+    ::close(m_fd);
+}
+
+std::optional<FileKey> ServedArchive::changedKey() const
+{
+    const auto key = GetFileKey(m_path);
+    if(!key || SameKey(*key, m_key) || (m_failedKey && SameKey(*key, *m_failedKey))) {
+        return std::nullopt;
+    }
+    return key;
+}
+
+void ServedArchive::setFailedKey(const FileKey& key) const
+{
+    m_failedKey = key;
+}
+
+InputFileStream ServedArchive::openStream() const
+{
+    /* Stream gets its own descriptor of the opened file, file isn't reopened by path */
+    const int fd = ::fcntl(m_fd, F_DUPFD_CLOEXEC, 0);
+    if(fd == -1) {
+        throw ResourceServerError("Failed to duplicate file descriptor of archive " + m_path + ": " + ErrnoStr());
+    }
+    return InputFileStream(fd, m_path);
+}
+
+void ServedArchive::loadGob()
+{
+    std::vector<GobFileEntry> gobEntries;
+    {
+        auto ifstream = openStream();
+        if(!LoadGobDirectory(ifstream, gobEntries)) {
+            throw ResourceServerError("Failed to load GOB file " + m_path);
+        }
+    }
+
+    m_entries.reserve(gobEntries.size());
+    for(const auto& e : gobEntries)
+    {
+        Entry entry;
+        entry.name   = e.name;
+        entry.offset = e.offset;
+        entry.size   = e.size;
+        m_entries.push_back(std::move(entry));
+    }
+}
+
+void ServedArchive::loadCnd()
+{
+    auto ifstream = openStream();
+    const auto index = libim::CND::LoadCndIndex(ifstream);
+
+    /* Materials which can't be written as MAT files are not served */
+    m_entries.reserve(index.materials.size());
+    for(const auto& mat : index.materials)
+    {
+        const auto& header = mat.header;
+        if(!libim::CND::IsMatCopyable(header)) {
+            continue;
+        }
+
+        Entry entry;
+        entry.name     = header.name;
+        entry.offset   = mat.offset;
+        entry.size     = libim::CND::GetMatFileSize(header);
+        entry.material = header;
+        m_entries.push_back(std::move(entry));
+    }
+}
+
+ResourceServer::ResourceServer(std::string socketPath, const std::vector<std::string>& archives) :
+    m_socketPath(std::move(socketPath))
+{
+    for(const auto& path : archives)
+    {
+        const std::string name = GetFileName(path);
+        for(const auto& a : m_archives)
+        {
+            if(a->name() == name) {
+                throw ResourceServerError("Archive name " + name + " is not unique");
+            }
+        }
+        m_archives.push_back(std::make_shared<const ServedArchive>(path, name));
+    }
+
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if(m_socketPath.size() >= sizeof(addr.sun_path)) {
+        throw ResourceServerError("Socket path is too long: " + m_socketPath);
+    }
+    std::memcpy(addr.sun_path, m_socketPath.c_str(), m_socketPath.size() + 1);
+
+    /* Remove socket file left by server which didn't exit cleanly */
+    struct stat st;
+    if(lstat(m_socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        ::unlink(m_socketPath.c_str());
+    }
+
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(m_listenFd == -1) {
+        throw ResourceServerError("Failed to create socket: " + ErrnoStr());
+    }
+    SetCloseOnExec(m_listenFd);
+
+    if(bind(m_listenFd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == -1 ||
+       listen(m_listenFd, SOMAXCONN) == -1 ||
+       pipe(m_wakeFds) == -1)
+    {
+        const std::string error = ErrnoStr();
+        ::close(m_listenFd);
+        throw ResourceServerError("Failed to listen on " + m_socketPath + ": " + error);
+    }
+}
+
+ResourceServer::~ResourceServer()
+{
+    stop();
+    reapConnections(/*all=*/true);
+    ::close(m_listenFd);
+    ::close(m_wakeFds[0]);
+    ::close(m_wakeFds[1]);
+    ::unlink(m_socketPath.c_str());
+}
+
+void ResourceServer::run()
+{
+    while(!m_stop)
+    {
+        pollfd fds[2] = {
+            { m_listenFd,   POLLIN, 0 },
+            { m_wakeFds[0], POLLIN, 0 }
+        };
+
+        if(poll(fds, 2, -1) == -1)
+        {
+            if(errno == EINTR) {
+                continue;
+            }
+            throw ResourceServerError("Failed to wait for connections: " + ErrnoStr());
+        }
+
+        if(m_stop || !(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        const int fd = accept(m_listenFd, nullptr, nullptr);
+        if(fd == -1) {
+            continue;
+        }
+        SetCloseOnExec(fd);
+
+        reapConnections(/*all=*/false);
+        auto& conn = m_connections.emplace_back();
+        conn.fd = fd;
+        conn.thread = std::thread([this, &conn] {
+            serve(conn);
+            conn.done = true;
+        });
+    }
+
+    reapConnections(/*all=*/true);
+}
+
+void ResourceServer::stop()
+{
+    if(!m_stop.exchange(true))
+    {
+        const byte_t b = 0;
+        (void)::write(m_wakeFds[1], &b, 1);
+    }
+}
+
+void ResourceServer::reapConnections(bool all)
+{
+    for(auto it = m_connections.begin(); it != m_connections.end();)
+    {
+        if(all && !it->done) {
+            ::shutdown(it->fd, SHUT_RDWR);
+        }
+
+        if(all || it->done)
+        {
+            it->thread.join();
+            ::close(it->fd);
+            it = m_connections.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+std::shared_ptr<const ServedArchive> ResourceServer::archive(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_archivesMutex);
+    for(auto& a : m_archives)
+    {
+        if(a->name() != name) {
+            continue;
+        }
+
+        /* Reindex changed archive, keep serving old index if new file can't be loaded */
+        if(const auto key = a->changedKey())
+        {
+            try {
+                a = std::make_shared<const ServedArchive>(a->path(), a->name());
+            }
+            catch(const std::exception&) {
+                a->setFailedKey(*key);
+            }
+        }
+        return a;
+    }
+
+    return nullptr;
+}
+
+void ResourceServer::serve(Connection& conn)
+{
+    const int fd = conn.fd;
+    std::string archiveName;
+    std::string entryName;
+    try
+    {
+        for(;;)
+        {
+            ResourceRequestHeader req;
+            if(!RecvAll(fd, &req, sizeof(req))) {
+                return;
+            }
+            RecordsFromDisk(&req, 1);
+
+            if(req.magic != RESOURCE_REQUEST_MAGIC || req.archiveSize > RESOURCE_NAME_MAX_SIZE || req.entrySize > RESOURCE_NAME_MAX_SIZE)
+            {
+                SendError(fd, ResourceStatus::BadRequest, "Bad request");
+                return;
+            }
+
+            archiveName.resize(req.archiveSize);
+            entryName.resize(req.entrySize);
+            if(!RecvAll(fd, archiveName.data(), archiveName.size()) || !RecvAll(fd, entryName.data(), entryName.size())) {
+                return;
+            }
+
+            WriteBatch body;
+            if(req.op == ResourceOp::Archives)
+            {
+                std::vector<std::shared_ptr<const ServedArchive>> archives;
+                {
+                    std::lock_guard<std::mutex> lock(m_archivesMutex);
+                    archives = m_archives;
+                }
+
+                for(const auto& a : archives) {
+                    AddEntryInfo(body, a->name(), a->fileSize());
+                }
+                SendResponse(fd, ResourceStatus::Ok, body);
+                continue;
+            }
+
+            const auto archive = this->archive(archiveName);
+            if(!archive)
+            {
+                SendError(fd, ResourceStatus::UnknownArchive, "Archive " + archiveName + " not found");
+                continue;
+            }
+
+            if(req.op == ResourceOp::List)
+            {
+                for(const auto& e : archive->entries()) {
+                    AddEntryInfo(body, e.name, e.size);
+                }
+                SendResponse(fd, ResourceStatus::Ok, body);
+                continue;
+            }
+            else if(req.op != ResourceOp::Stat && req.op != ResourceOp::Read)
+            {
+                SendError(fd, ResourceStatus::BadRequest, "Unknown request " + std::to_string(uint32_t(req.op)));
+                continue;
+            }
+
+            const auto* entry = archive->find(entryName);
+            if(!entry)
+            {
+                SendError(fd, ResourceStatus::NotFound, "Entry " + entryName + " not found in " + archiveName);
+                continue;
+            }
+
+            if(req.op == ResourceOp::Stat)
+            {
+                AddEntryInfo(body, entry->name, entry->size);
+                SendResponse(fd, ResourceStatus::Ok, body);
+            }
+            else {
+                SendEntry(fd, *archive, *entry);
+            }
+        }
+    }
+    catch(const std::exception&) {
+        /* Connection can't be recovered after partial response, client sees it closed */
+    }
+}
+#else
+ServedArchive::~ServedArchive() {}
+
+ResourceServer::ResourceServer(std::string socketPath, const std::vector<std::string>&) :
+    m_socketPath(std::move(socketPath))
+{
+    throw ResourceServerError("Resource server is not supported on this platform");
+}
+
+ResourceServer::~ResourceServer() {}
+void ResourceServer::run() {}
+void ResourceServer::stop() {}
+#endif
@@ -0,0 +1,70 @@
+#ifndef LIBIM_SERVER_SERVER_H
+#define LIBIM_SERVER_SERVER_H
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protocol.h"
+#include "../io/stream.h"
+
+struct ResourceServerError : public StreamError {
+    using StreamError::StreamError;
+};
+
+class ServedArchive;
+
+/* Serves entries of GOB and CND archives to local clients over Unix domain socket.
+   Archives are opened and indexed once and reindexed when the archive file changes.
+   Entry data is sent by kernel from archive file to socket (sendfile), CND materials
+   as MAT files. Every connection is served by its own thread.
+   Client disconnecting during reply raises SIGPIPE, which the process should ignore. */
+class ResourceServer
+{
+public:
+    /* Opens and indexes archives and listens on socketPath, replacing stale socket file.
+       Archives are named by their file name. Throws ResourceServerError on error. */
+    ResourceServer(std::string socketPath, const std::vector<std::string>& archives);
+    ~ResourceServer();
+
+    ResourceServer(const ResourceServer&) = delete;
+    ResourceServer& operator = (const ResourceServer&) = delete;
+
+    const std::string& socketPath() const
+    {
+        return m_socketPath;
+    }
+
+    /* Accepts and serves connections until stop() is called. Throws ResourceServerError on error. */
+    void run();
+
+    /* Stops run() and closes all connections. Can be called from any thread. */
+    void stop();
+
+private:
+    struct Connection
+    {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<bool> done{ false };
+    };
+
+    void serve(Connection& conn);
+    void reapConnections(bool all);
+    std::shared_ptr<const ServedArchive> archive(const std::string& name);
+
+    std::string m_socketPath;
+    int m_listenFd = -1;
+    int m_wakeFds[2] = { -1, -1 };
+    std::atomic<bool> m_stop{ false };
+
+    std::mutex m_archivesMutex;
+    std::vector<std::shared_ptr<const ServedArchive>> m_archives;
+
+    std::list<Connection> m_connections;
+};
+
+#endif // LIBIM_SERVER_SERVER_H
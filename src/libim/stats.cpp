@@ -0,0 +1,195 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+
+using namespace detail;
+
+static const auto ProcessStart = std::chrono::steady_clock::now();
+
+struct detail::ThreadStats
+{
+    ThreadStats();
+    ~ThreadStats();
+
+    std::array<std::atomic<uint64_t>, STAT_COUNT> counters {};
+    std::mutex phaseMutex;
+    std::vector<std::pair<const char*, double>> phases;
+};
+
+namespace {
+    struct GlobalStats
+    {
+        std::mutex mutex;
+        std::vector<ThreadStats*> threads;
+        std::array<uint64_t, STAT_COUNT> retired {};
+        std::vector<std::pair<std::string, double>> retiredPhases;
+    };
+
+    /* Never destroyed so thread stats can be merged during static destruction */
+    GlobalStats& Global()
+    {
+        static GlobalStats* gs = new GlobalStats;
+        return *gs;
+    }
+
+    void MergePhase(std::vector<std::pair<std::string, double>>& phases, const char* name, double seconds)
+    {
+        auto it = std::find_if(phases.begin(), phases.end(), [&](const auto& p){ return p.first == name; });
+        if(it == phases.end()) {
+            phases.emplace_back(name, seconds);
+        }
+        else {
+            it->second += seconds;
+        }
+    }
+}
+
+ThreadStats::ThreadStats()
+{
+    auto& gs = Global();
+    std::lock_guard<std::mutex> lock(gs.mutex);
+    gs.threads.push_back(this);
+}
+
+ThreadStats::~ThreadStats()
+{
+    auto& gs = Global();
+    std::lock_guard<std::mutex> lock(gs.mutex);
+    for(std::size_t i = 0; i < STAT_COUNT; i++) {
+        gs.retired[i] += counters[i].load(std::memory_order_relaxed);
+    }
+
+    for(const auto& p : phases) {
+        MergePhase(gs.retiredPhases, p.first, p.second);
+    }
+
+    gs.threads.erase(std::remove(gs.threads.begin(), gs.threads.end(), this), gs.threads.end());
+}
+
+ThreadStats& detail::CurrentThreadStats()
+{
+    thread_local ThreadStats ts;
+    return ts;
+}
+
+std::atomic<uint64_t>* detail::ThreadCounters(ThreadStats& ts)
+{
+    return ts.counters.data();
+}
+
+void detail::AddPhaseTime(const char* phase, double seconds)
+{
+    auto& ts = CurrentThreadStats();
+    std::lock_guard<std::mutex> lock(ts.phaseMutex);
+    auto it = std::find_if(ts.phases.begin(), ts.phases.end(), [&](const auto& p){
+        return p.first == phase || std::strcmp(p.first, phase) == 0;
+    });
+
+    if(it == ts.phases.end()) {
+        ts.phases.emplace_back(phase, seconds);
+    }
+    else {
+        it->second += seconds;
+    }
+}
+
+const char* StatName(Stat s)
+{
+    switch (s)
+    {
+    case Stat::Syscalls:        return "syscalls";
+    case Stat::FileOpens:       return "file_opens";
+    case Stat::ReadCalls:       return "read_calls";
+    case Stat::WriteCalls:      return "write_calls";
+    case Stat::Seeks:           return "seeks";
+    case Stat::Syncs:           return "syncs";
+    case Stat::BytesRead:       return "bytes_read";
+    case Stat::BytesWritten:    return "bytes_written";
+    case Stat::GobEntries:      return "gob_entries";
+    case Stat::Materials:       return "materials";
+    case Stat::TexturesDecoded: return "textures_decoded";
+    default:
+        return "unknown";
+    }
+}
+
+StatsSnapshot GetStats()
+{
+    StatsSnapshot snapshot;
+
+    auto& gs = Global();
+    std::lock_guard<std::mutex> lock(gs.mutex);
+    snapshot.counters = gs.retired;
+    snapshot.phases   = gs.retiredPhases;
+
+    for(auto ts : gs.threads)
+    {
+        for(std::size_t i = 0; i < STAT_COUNT; i++) {
+            snapshot.counters[i] += ts->counters[i].load(std::memory_order_relaxed);
+        }
+
+        std::lock_guard<std::mutex> phaseLock(ts->phaseMutex);
+        for(const auto& p : ts->phases) {
+            MergePhase(snapshot.phases, p.first, p.second);
+        }
+    }
+
+    std::chrono::duration<double> wallTime = std::chrono::steady_clock::now() - ProcessStart;
+    snapshot.wallTime = wallTime.count();
+    return snapshot;
+}
+
+void PrintStats(std::ostream& os, const StatsSnapshot& stats)
+{
+    os << "---------------- Statistics ----------------\n";
+    for(std::size_t i = 0; i < STAT_COUNT; i++)
+    {
+        os << "  " << std::left << std::setfill(' ') << std::setw(24) << StatName(static_cast<Stat>(i))
+           << std::right << std::setw(16) << stats.counters[i] << "\n";
+    }
+
+    os << "  Phase wall time:\n";
+    for(const auto& p : stats.phases)
+    {
+        os << "    " << std::left << std::setw(22) << p.first
+           << std::right << std::setw(14) << std::fixed << std::setprecision(3) << p.second * 1000.0 << " ms\n";
+    }
+
+    os << "  " << std::left << std::setw(24) << "total_wall_time"
+       << std::right << std::setw(14) << std::fixed << std::setprecision(3) << stats.wallTime * 1000.0 << " ms\n";
+    os << std::defaultfloat << std::setprecision(6);
+}
+
+void PrintPhaseTimes(std::ostream& os, const StatsSnapshot& stats)
+{
+    os << "Phase times:\n";
+    for(const auto& p : stats.phases)
+    {
+        os << "  " << std::left << std::setfill(' ') << std::setw(24) << p.first
+           << std::right << std::setw(12) << std::fixed << std::setprecision(3) << p.second * 1000.0 << " ms"
+           << std::setw(7) << std::setprecision(1) << (stats.wallTime > 0.0 ? p.second / stats.wallTime * 100.0 : 0.0) << " %\n";
+    }
+
+    os << "  " << std::left << std::setw(24) << "total_wall_time"
+       << std::right << std::setw(12) << std::fixed << std::setprecision(3) << stats.wallTime * 1000.0 << " ms\n";
+    os << std::defaultfloat << std::setprecision(6);
+}
+
+void PrintStatsJson(std::ostream& os, const StatsSnapshot& stats)
+{
+    os << "{\"counters\": {";
+    for(std::size_t i = 0; i < STAT_COUNT; i++) {
+        os << (i ? ", " : "") << "\"" << StatName(static_cast<Stat>(i)) << "\": " << stats.counters[i];
+    }
+
+    os << "}, \"phases_s\": {" << std::setprecision(9);
+    for(std::size_t i = 0; i < stats.phases.size(); i++) {
+        os << (i ? ", " : "") << "\"" << stats.phases[i].first << "\": " << stats.phases[i].second;
+    }
+
+    os << "}, \"wall_time_s\": " << stats.wallTime << "}\n";
+    os << std::defaultfloat << std::setprecision(6);
+}
@@ -0,0 +1,94 @@
+#ifndef LIBIM_STATS_H
+#define LIBIM_STATS_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Low overhead I/O and parse counters.
+   Counters are accumulated per thread and merged into the global totals
+   when the thread exits or when a snapshot is taken. */
+enum class Stat : std::size_t
+{
+    Syscalls,        // Total number of file system calls issued
+    FileOpens,
+    ReadCalls,
+    WriteCalls,
+    Seeks,
+    Syncs,
+    BytesRead,
+    BytesWritten,
+    GobEntries,      // Number of GOB directory entries parsed
+    Materials,       // Number of materials loaded
+    TexturesDecoded, // Number of textures decoded from stream or buffer
+    Count
+};
+
+static constexpr std::size_t STAT_COUNT = static_cast<std::size_t>(Stat::Count);
+
+struct StatsSnapshot
+{
+    std::array<uint64_t, STAT_COUNT> counters {};
+    std::vector<std::pair<std::string, double>> phases; // Accumulated wall time in seconds per phase
+    double wallTime = 0.0;                               // Seconds since process start
+
+    uint64_t operator[](Stat s) const
+    {
+        return counters[static_cast<std::size_t>(s)];
+    }
+};
+
+namespace detail {
+    struct ThreadStats;
+    ThreadStats& CurrentThreadStats();
+    std::atomic<uint64_t>* ThreadCounters(ThreadStats& ts);
+    void AddPhaseTime(const char* phase, double seconds);
+}
+
+/* Adds n to counter of the calling thread */
+inline void StatAdd(Stat s, uint64_t n = 1)
+{
+    thread_local std::atomic<uint64_t>* counters = detail::ThreadCounters(detail::CurrentThreadStats());
+    auto& c = counters[static_cast<std::size_t>(s)];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); // single writer
+}
+
+/* Measures wall time from construction to destruction and adds it to phase */
+class StatPhaseTimer
+{
+public:
+    explicit StatPhaseTimer(const char* phase) :
+        m_phase(phase),
+        m_start(std::chrono::steady_clock::now())
+    {}
+
+    StatPhaseTimer(const StatPhaseTimer&) = delete;
+    StatPhaseTimer& operator = (const StatPhaseTimer&) = delete;
+
+    ~StatPhaseTimer()
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+        detail::AddPhaseTime(m_phase, elapsed.count());
+    }
+
+private:
+    const char* m_phase;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+const char* StatName(Stat s);
+
+/* Returns sum of counters of all exited and running threads */
+StatsSnapshot GetStats();
+
+void PrintStats(std::ostream& os, const StatsSnapshot& stats);
+void PrintStatsJson(std::ostream& os, const StatsSnapshot& stats);
+
+/* Prints wall time of each phase and its share of total wall time */
+void PrintPhaseTimes(std::ostream& os, const StatsSnapshot& stats);
+
+#endif // LIBIM_STATS_H
@@ -0,0 +1,82 @@
+#ifndef LIBIM_BOUNDED_QUEUE_H
+#define LIBIM_BOUNDED_QUEUE_H
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+/* Blocking FIFO queue of limited capacity for passing work between pipeline stages.
+   push() blocks while the queue is full, so a fast producer is throttled to the
+   pace of its consumer and the number of items in flight stays bounded.
+   After close() push() fails and pop() returns the remaining items, then nothing. */
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t capacity) :
+        m_capacity(std::max<std::size_t>(capacity, 1))
+    {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator = (const BoundedQueue&) = delete;
+
+    /* Returns false if queue was closed and item was not queued */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [&]{ return m_closed || m_items.size() < m_capacity; });
+        if(m_closed) {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /* Returns nothing if queue is closed and empty */
+    std::optional<T> pop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [&]{ return m_closed || !m_items.empty(); });
+        if(m_items.empty()) {
+            return std::nullopt;
+        }
+
+        std::optional<T> item(std::move(m_items.front()));
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return item;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+    std::size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    const std::size_t m_capacity;
+    bool m_closed = false;
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+};
+
+#endif // LIBIM_BOUNDED_QUEUE_H
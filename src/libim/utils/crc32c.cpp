@@ -0,0 +1,121 @@
+#include "crc32c.h"
+#include <array>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+# define LIBIM_CRC32C_X86_KERNEL
+# include <immintrin.h>
+#endif
+
+namespace {
+    constexpr uint32_t POLY = 0x82F63B78; // Reversed Castagnoli polynomial
+
+    using CrcTables = std::array<std::array<uint32_t, 256>, 8>;
+
+    /* Table k maps byte b to CRC of b followed by k zero bytes */
+    CrcTables MakeTables()
+    {
+        CrcTables t {};
+        for(uint32_t b = 0; b < 256; b++)
+        {
+            uint32_t crc = b;
+            for(int i = 0; i < 8; i++) {
+                crc = (crc >> 1) ^ (POLY & (0 - (crc & 1)));
+            }
+            t[0][b] = crc;
+        }
+
+        for(uint32_t b = 0; b < 256; b++)
+        {
+            for(std::size_t k = 1; k < t.size(); k++) {
+                t[k][b] = (t[k - 1][b] >> 8) ^ t[0][t[k - 1][b] & 0xFF];
+            }
+        }
+
+        return t;
+    }
+
+    const CrcTables& Tables()
+    {
+        static const CrcTables tables = MakeTables();
+        return tables;
+    }
+
+    uint32_t UpdateScalar(uint32_t crc, const uint8_t* p, std::size_t size)
+    {
+        const auto& t = Tables();
+        for(; size >= 8; p += 8, size -= 8)
+        {
+            const uint32_t lo = crc ^ (uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24);
+            crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+                  t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+        }
+
+        for(; size > 0; p++, size--) {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+        }
+
+        return crc;
+    }
+
+#ifdef LIBIM_CRC32C_X86_KERNEL
+    __attribute__((target("sse4.2")))
+    uint32_t UpdateSSE42(uint32_t crc, const uint8_t* p, std::size_t size)
+    {
+# ifdef __x86_64__
+        uint64_t crc64 = crc;
+        for(; size >= 8; p += 8, size -= 8)
+        {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            crc64 = _mm_crc32_u64(crc64, v);
+        }
+        crc = uint32_t(crc64);
+# endif
+        for(; size >= 4; p += 4, size -= 4)
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            crc = _mm_crc32_u32(crc, v);
+        }
+
+        for(; size > 0; p++, size--) {
+            crc = _mm_crc32_u8(crc, *p);
+        }
+
+        return crc;
+    }
+#endif
+
+    using UpdateFunc = uint32_t(*)(uint32_t, const uint8_t*, std::size_t);
+    UpdateFunc BestUpdate()
+    {
+        static const UpdateFunc update = []
+        {
+#ifdef LIBIM_CRC32C_X86_KERNEL
+            if(__builtin_cpu_supports("sse4.2")) {
+                return &UpdateSSE42;
+            }
+#endif
+            return &UpdateScalar;
+        }();
+        return update;
+    }
+}
+
+void Crc32c::update(const void* data, std::size_t size)
+{
+    m_crc = BestUpdate()(m_crc, static_cast<const uint8_t*>(data), size);
+}
+
+uint32_t CRC32C(const void* data, std::size_t size)
+{
+    Crc32c crc;
+    crc.update(data, size);
+    return crc.digest();
+}
+
+bool IsCrc32cAccelerated()
+{
+    return BestUpdate() != &UpdateScalar;
+}
@@ -0,0 +1,29 @@
+#ifndef LIBIM_CRC32C_H
+#define LIBIM_CRC32C_H
+#include <cstddef>
+#include <cstdint>
+
+/* Streaming CRC-32C (Castagnoli).
+   Uses SSE4.2 crc32 instruction if CPU supports it, otherwise slicing-by-8 tables.
+   Digest of data fed by any sequence of update() calls equals CRC32C of the whole data. */
+class Crc32c
+{
+public:
+    void update(const void* data, std::size_t size);
+
+    uint32_t digest() const
+    {
+        return ~m_crc;
+    }
+
+private:
+    uint32_t m_crc = 0xFFFFFFFF;
+};
+
+/* Returns CRC-32C of data */
+uint32_t CRC32C(const void* data, std::size_t size);
+
+/* Returns true if CRC-32C is computed with SSE4.2 instruction */
+bool IsCrc32cAccelerated();
+
+#endif // LIBIM_CRC32C_H
@@ -0,0 +1,20 @@
+#include "hasher.h"
+
+const char* HashAlgorithmName(HashAlgorithm algorithm)
+{
+    return algorithm == HashAlgorithm::Crc32c ? "crc32c" : "xxh64";
+}
+
+bool ParseHashAlgorithm(const std::string& name, HashAlgorithm& algorithm)
+{
+    if(name == "crc32c") {
+        algorithm = HashAlgorithm::Crc32c;
+    }
+    else if(name == "xxh64") {
+        algorithm = HashAlgorithm::XXH64;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
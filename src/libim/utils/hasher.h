@@ -0,0 +1,64 @@
+#ifndef LIBIM_HASHER_H
+#define LIBIM_HASHER_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "crc32c.h"
+#include "xxhash.h"
+
+enum class HashAlgorithm
+{
+    Crc32c,
+    XXH64
+};
+
+/* Returns name of hash algorithm: crc32c or xxh64 */
+const char* HashAlgorithmName(HashAlgorithm algorithm);
+
+/* Parses hash algorithm name. Returns false if name is unknown. */
+bool ParseHashAlgorithm(const std::string& name, HashAlgorithm& algorithm);
+
+/* Streaming hash of selected algorithm */
+class Hasher
+{
+public:
+    explicit Hasher(HashAlgorithm algorithm) :
+        m_algorithm(algorithm)
+    {}
+
+    HashAlgorithm algorithm() const
+    {
+        return m_algorithm;
+    }
+
+    void update(const void* data, std::size_t size)
+    {
+        m_size += size;
+        if(m_algorithm == HashAlgorithm::Crc32c) {
+            m_crc.update(data, size);
+        }
+        else {
+            m_xxh.update(data, size);
+        }
+    }
+
+    uint64_t digest() const
+    {
+        return m_algorithm == HashAlgorithm::Crc32c ? m_crc.digest() : m_xxh.digest();
+    }
+
+    /* Returns number of bytes hashed */
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    HashAlgorithm m_algorithm;
+    Crc32c m_crc;
+    XXHash64 m_xxh;
+    uint64_t m_size = 0;
+};
+
+#endif // LIBIM_HASHER_H
@@ -0,0 +1,52 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(std::size_t nThreads, std::size_t queueSize) :
+    m_tasks(queueSize ? queueSize : 4 * (nThreads ? nThreads : HardwareThreads()))
+{
+    if(nThreads == 0) {
+        nThreads = HardwareThreads();
+    }
+
+    m_workers.reserve(nThreads);
+    for(std::size_t i = 0; i < nThreads; i++) {
+        m_workers.emplace_back([this]{ run(); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    m_tasks.close();
+    for(auto& w : m_workers) {
+        w.join();
+    }
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [&]{ return m_pending == 0; });
+}
+
+std::size_t ThreadPool::HardwareThreads()
+{
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::run()
+{
+    while(auto task = m_tasks.pop())
+    {
+        (*task)();
+        taskDone();
+    }
+}
+
+void ThreadPool::taskDone()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(--m_pending == 0) {
+        m_idle.notify_all();
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef LIBIM_THREAD_POOL_H
+#define LIBIM_THREAD_POOL_H
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "bounded_queue.h"
+
+/* Fixed size pool of worker threads.
+   Tasks are queued in a bounded queue, so submit() blocks while the queue is full
+   and a producer can't get arbitrarily far ahead of the workers. */
+class ThreadPool
+{
+public:
+    /* nThreads  - number of workers, 0 = number of hardware threads
+       queueSize - max number of queued tasks, 0 = 4 tasks per worker */
+    explicit ThreadPool(std::size_t nThreads = 0, std::size_t queueSize = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator = (const ThreadPool&) = delete;
+
+    /* Waits for all queued tasks to finish */
+    ~ThreadPool();
+
+    std::size_t size() const
+    {
+        return m_workers.size();
+    }
+
+    /* Queues task f for execution. Exceptions thrown by f are stored in the returned future. */
+    template<typename F>
+    std::future<std::invoke_result_t<F>> submit(F&& f)
+    {
+        using R = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        auto future = task->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending++;
+        }
+
+        if(!m_tasks.push([task]{ (*task)(); })) {
+            taskDone();
+            throw std::runtime_error("ThreadPool: submit after shutdown");
+        }
+
+        return future;
+    }
+
+    /* Blocks until all submitted tasks have finished */
+    void wait();
+
+    /* Returns number of hardware threads, at least 1 */
+    static std::size_t HardwareThreads();
+
+private:
+    void run();
+    void taskDone();
+
+private:
+    BoundedQueue<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::size_t m_pending = 0;
+};
+
+/* Waits for all tasks and rethrows first exception.
+   Every task is waited for even if one fails, so tasks never outlive data they refer to. */
+template<typename T>
+void WaitAll(std::vector<std::future<T>>& tasks)
+{
+    std::exception_ptr error;
+    for(auto& t : tasks)
+    {
+        try {
+            t.get();
+        }
+        catch(...)
+        {
+            if(!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+#endif // LIBIM_THREAD_POOL_H
@@ -0,0 +1,147 @@
+#include "xxhash.h"
+#include <cstring>
+
+namespace {
+    constexpr uint64_t P1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t P3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t P5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t Rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    /* Little endian loads */
+    inline uint64_t Read64(const uint8_t* p)
+    {
+        uint64_t v = 0;
+        for(int i = 7; i >= 0; i--) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    inline uint32_t Read32(const uint8_t* p)
+    {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+
+    inline uint64_t Round(uint64_t acc, uint64_t input)
+    {
+        acc += input * P2;
+        acc  = Rotl(acc, 31);
+        return acc * P1;
+    }
+
+    inline uint64_t MergeRound(uint64_t acc, uint64_t v)
+    {
+        acc ^= Round(0, v);
+        return acc * P1 + P4;
+    }
+
+    /* Consumes 32 byte stripes of data, returns pointer past the last consumed stripe */
+    inline const uint8_t* ProcessStripes(uint64_t v[4], const uint8_t* p, const uint8_t* end)
+    {
+        for(; p + 32 <= end; p += 32)
+        {
+            v[0] = Round(v[0], Read64(p));
+            v[1] = Round(v[1], Read64(p + 8));
+            v[2] = Round(v[2], Read64(p + 16));
+            v[3] = Round(v[3], Read64(p + 24));
+        }
+        return p;
+    }
+
+    uint64_t Finalize(uint64_t h, const uint8_t* p, std::size_t size)
+    {
+        for(; size >= 8; p += 8, size -= 8)
+        {
+            h ^= Round(0, Read64(p));
+            h  = Rotl(h, 27) * P1 + P4;
+        }
+
+        if(size >= 4)
+        {
+            h ^= uint64_t(Read32(p)) * P1;
+            h  = Rotl(h, 23) * P2 + P3;
+            p += 4;
+            size -= 4;
+        }
+
+        for(; size > 0; p++, size--)
+        {
+            h ^= *p * P5;
+            h  = Rotl(h, 11) * P1;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+}
+
+XXHash64::XXHash64(uint64_t seed) :
+    m_v{ seed + P1 + P2, seed + P2, seed, seed - P1 },
+    m_seed(seed)
+{}
+
+void XXHash64::update(const void* data, std::size_t size)
+{
+    const uint8_t* p   = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    m_totalSize += size;
+
+    if(m_bufferSize + size < 32)
+    {
+        if(size > 0) {
+            std::memcpy(m_buffer + m_bufferSize, p, size);
+        }
+        m_bufferSize += size;
+        return;
+    }
+
+    if(m_bufferSize > 0)
+    {
+        const std::size_t fill = 32 - m_bufferSize;
+        std::memcpy(m_buffer + m_bufferSize, p, fill);
+        ProcessStripes(m_v, m_buffer, m_buffer + 32);
+        p += fill;
+        m_bufferSize = 0;
+    }
+
+    p = ProcessStripes(m_v, p, end);
+    m_bufferSize = std::size_t(end - p);
+    if(m_bufferSize > 0) {
+        std::memcpy(m_buffer, p, m_bufferSize);
+    }
+}
+
+uint64_t XXHash64::digest() const
+{
+    uint64_t h;
+    if(m_totalSize >= 32)
+    {
+        h = Rotl(m_v[0], 1) + Rotl(m_v[1], 7) + Rotl(m_v[2], 12) + Rotl(m_v[3], 18);
+        for(uint64_t v : m_v) {
+            h = MergeRound(h, v);
+        }
+    }
+    else {
+        h = m_seed + P5;
+    }
+
+    h += m_totalSize;
+    return Finalize(h, m_buffer, m_bufferSize);
+}
+
+uint64_t XXH64(const void* data, std::size_t size, uint64_t seed)
+{
+    XXHash64 hash(seed);
+    hash.update(data, size);
+    return hash.digest();
+}
@@ -0,0 +1,27 @@
+#ifndef LIBIM_XXHASH_H
+#define LIBIM_XXHASH_H
+#include <cstddef>
+#include <cstdint>
+
+/* Streaming XXH64 hash.
+   Digest of data fed by any sequence of update() calls equals XXH64 of the whole data. */
+class XXHash64
+{
+public:
+    explicit XXHash64(uint64_t seed = 0);
+
+    void update(const void* data, std::size_t size);
+    uint64_t digest() const;
+
+private:
+    uint64_t m_v[4];
+    uint64_t m_seed;
+    uint64_t m_totalSize = 0;
+    uint8_t  m_buffer[32];
+    std::size_t m_bufferSize = 0;
+};
+
+/* Returns XXH64 hash of data */
+uint64_t XXH64(const void* data, std::size_t size, uint64_t seed = 0);
+
+#endif // LIBIM_XXHASH_H